@@ -0,0 +1,665 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm_omp.h>
+#include "nvm_cli.h"
+
+/*
+ * Workload parameters, overridable via ENV("NVM_BENCH_*")
+ */
+static struct {
+	int qd;		///< Number of outstanding commands, one per thread
+	size_t nops;	///< Number of commands for random workloads
+	int ratio;	///< Percentage of reads for mixed workloads
+	int nlines;	///< Number of lines / block indexes to span
+	int prep;	///< Whether to erase+write lines before reading them
+	unsigned seed;	///< Seed for the per-thread PRNGs
+	int ntrials;	///< Number of trials per span for the scale workload
+	const char *csv;	///< Directory to write scale results to as CSV
+} conf;
+
+typedef struct {
+	size_t nops;		///< Number of commands issued
+	size_t nbytes;		///< Number of bytes transferred
+	size_t nerr;		///< Number of failed commands
+	size_t elapsed;		///< Wall-clock in nsec
+	NVM_CLI_LAT lat;	///< Per-command latency
+} BENCH_RES;
+
+static void conf_fill(void)
+{
+	conf.qd = getenv("NVM_BENCH_QD") ? atoi(getenv("NVM_BENCH_QD")) : 1;
+	conf.nops = getenv("NVM_BENCH_NOPS") ?
+		    atol(getenv("NVM_BENCH_NOPS")) : 1000;
+	conf.ratio = getenv("NVM_BENCH_RATIO") ?
+		     atoi(getenv("NVM_BENCH_RATIO")) : 70;
+	conf.nlines = getenv("NVM_BENCH_NLINES") ?
+		      atoi(getenv("NVM_BENCH_NLINES")) : 1;
+	conf.prep = getenv("NVM_BENCH_NOPREP") ? 0 : 1;
+	conf.seed = getenv("NVM_BENCH_SEED") ?
+		    atoi(getenv("NVM_BENCH_SEED")) : 1337;
+	conf.ntrials = getenv("NVM_BENCH_NTRIALS") ?
+		       atoi(getenv("NVM_BENCH_NTRIALS")) : 3;
+	conf.csv = getenv("NVM_BENCH_CSV");
+
+	conf.qd = conf.qd < 1 ? 1 : conf.qd;
+	conf.nlines = conf.nlines < 1 ? 1 : conf.nlines;
+	conf.ntrials = conf.ntrials < 1 ? 1 : conf.ntrials;
+	conf.ratio = conf.ratio < 0 ? 0 : (conf.ratio > 100 ? 100 : conf.ratio);
+}
+
+static int res_alloc(BENCH_RES *res, size_t nops)
+{
+	memset(res, 0, sizeof(*res));
+
+	res->lat.samples = malloc(sizeof(*res->lat.samples) * (nops ? nops : 1));
+	if (!res->lat.samples) {
+		perror("malloc");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void res_pr_json(BENCH_RES *res)
+{
+	const double secs = res->elapsed / 1000000000.0;
+
+	nvm_cli_lat_sum(&res->lat);
+
+	printf("\"nops\": %lu, \"nerr\": %lu, \"nbytes\": %lu, ",
+	       res->nops, res->nerr, res->nbytes);
+	printf("\"elapsed\": %.6lf, \"iops\": %.2lf, \"mbs\": %.2lf, ",
+	       secs, secs ? res->nops / secs : 0.0,
+	       secs ? (res->nbytes / (double)(1 << 20)) / secs : 0.0);
+	printf("\"lat_usec\": ");
+	nvm_cli_lat_pr_json(&res->lat);
+}
+
+static void res_free(BENCH_RES *res)
+{
+	free(res->lat.samples);
+}
+
+static void bench_pr_json(const char *workload, NVM_CLI_CMD_ARGS *args,
+			  BENCH_RES *res)
+{
+	printf("{\"workload\": \"%s\", \"qd\": %d, \"pmode\": %d, ",
+	       workload, conf.qd, nvm_cli_pmode(args->dev));
+	res_pr_json(res);
+	printf("}\n");
+}
+
+/*
+ * Random sector address within the line at block `blk` on the LUNs in
+ * [bgn, end], restricted to pages below `npages`
+ */
+static struct nvm_addr rand_sector(const struct nvm_geo *geo,
+				   struct nvm_addr bgn, struct nvm_addr end,
+				   int blk, int npages, unsigned *seed)
+{
+	struct nvm_addr addr;
+
+	addr.ppa = 0;
+	addr.g.ch = bgn.g.ch + rand_r(seed) % (end.g.ch - bgn.g.ch + 1);
+	addr.g.lun = bgn.g.lun + rand_r(seed) % (end.g.lun - bgn.g.lun + 1);
+	addr.g.blk = blk;
+	addr.g.pl = rand_r(seed) % geo->nplanes;
+	addr.g.pg = rand_r(seed) % npages;
+	addr.g.sec = rand_r(seed) % geo->nsectors;
+
+	return addr;
+}
+
+/*
+ * Erase and fill the lines used by read workloads, unless NVM_BENCH_NOPREP
+ */
+static int lines_prep(NVM_CLI_CMD_ARGS *args, struct nvm_addr bgn,
+		      struct nvm_addr end, int blk_bgn, int nlines)
+{
+	ssize_t res = 0;
+	char *buf = NULL;
+
+	for (int blk = blk_bgn; conf.prep && blk < blk_bgn + nlines; ++blk) {
+		struct nvm_vblk *vblk;
+		size_t nbytes;
+
+		vblk = nvm_vblk_alloc_line(args->dev, bgn.g.ch, end.g.ch,
+					   bgn.g.lun, end.g.lun, blk);
+		if (!vblk) {
+			perror("nvm_vblk_alloc_line");
+			free(buf);
+			return -1;
+		}
+		nbytes = nvm_vblk_get_nbytes(vblk);
+
+		if (!buf) {
+			buf = nvm_buf_alloc(args->geo, nbytes);
+			if (!buf) {
+				perror("nvm_buf_alloc");
+				nvm_vblk_free(vblk);
+				return -1;
+			}
+			nvm_buf_fill(buf, nbytes);
+		}
+
+		res = nvm_vblk_erase(vblk);
+		if (res >= 0)
+			res = nvm_vblk_write(vblk, buf, nbytes);
+
+		nvm_vblk_free(vblk);
+
+		if (res < 0) {
+			perror("lines_prep");
+			free(buf);
+			return -1;
+		}
+	}
+
+	free(buf);
+
+	return 0;
+}
+
+/*
+ * Sequential line write: erase each line, then write it one stripe at a time,
+ * where a stripe is a virtual page on each block of the line
+ */
+int line_write(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	const struct nvm_addr bgn = args->addrs[0], end = args->addrs[1];
+	const size_t nblks = (end.g.ch - bgn.g.ch + 1) *
+			     (end.g.lun - bgn.g.lun + 1);
+	const size_t stripe_nbytes = nblks * args->geo->vpg_nbytes;
+	const size_t nstripes = conf.nlines * args->geo->npages;
+	BENCH_RES res;
+	size_t t_bgn;
+	char *buf;
+
+	if (res_alloc(&res, nstripes))
+		return 1;
+
+	buf = nvm_buf_alloc(args->geo, stripe_nbytes);
+	if (!buf) {
+		perror("nvm_buf_alloc");
+		res_free(&res);
+		return 1;
+	}
+	nvm_buf_fill(buf, stripe_nbytes);
+
+	t_bgn = nvm_cli_ns();
+	for (int blk = bgn.g.blk; blk < bgn.g.blk + conf.nlines; ++blk) {
+		struct nvm_vblk *vblk;
+
+		vblk = nvm_vblk_alloc_line(args->dev, bgn.g.ch, end.g.ch,
+					   bgn.g.lun, end.g.lun, blk);
+		if (!vblk) {
+			perror("nvm_vblk_alloc_line");
+			break;
+		}
+
+		if (nvm_vblk_erase(vblk) < 0) {
+			++res.nerr;
+			nvm_vblk_free(vblk);
+			continue;
+		}
+
+		for (size_t i = 0; i < args->geo->npages; ++i) {
+			const size_t t_cmd = nvm_cli_ns();
+
+			if (nvm_vblk_write(vblk, buf, stripe_nbytes) < 0)
+				++res.nerr;
+			else
+				res.nbytes += stripe_nbytes;
+
+			res.lat.samples[res.lat.nsamples++] = nvm_cli_ns() - t_cmd;
+			++res.nops;
+		}
+
+		nvm_vblk_free(vblk);
+	}
+	res.elapsed = nvm_cli_ns() - t_bgn;
+
+	bench_pr_json("line_write", args, &res);
+
+	free(buf);
+	res_free(&res);
+
+	return res.nerr != 0;
+}
+
+/*
+ * Random single-sector reads on the LUNs in [bgn, end] at queue-depth qd
+ */
+static int rand_read_span(NVM_CLI_CMD_ARGS *args, struct nvm_addr bgn,
+			  struct nvm_addr end, BENCH_RES *res)
+{
+	const int PMODE = NVM_FLAG_PMODE_SNGL;
+	size_t nerr = 0;
+	size_t t_bgn;
+
+	t_bgn = nvm_cli_ns();
+	#pragma omp parallel num_threads(conf.qd) reduction(+:nerr)
+	{
+		unsigned seed = conf.seed + omp_get_thread_num();
+		char *buf = nvm_buf_alloc(args->geo, args->geo->sector_nbytes);
+
+		#pragma omp for schedule(dynamic, 1)
+		for (size_t i = 0; i < conf.nops; ++i) {
+			const int blk = bgn.g.blk + rand_r(&seed) % conf.nlines;
+			struct nvm_addr addr;
+			struct nvm_ret ret;
+			size_t t_cmd;
+
+			addr = rand_sector(args->geo, bgn, end, blk,
+					   args->geo->npages, &seed);
+
+			t_cmd = nvm_cli_ns();
+			if (!buf || nvm_addr_read(args->dev, &addr, 1, buf, NULL,
+						  PMODE, &ret))
+				++nerr;
+			res->lat.samples[i] = nvm_cli_ns() - t_cmd;
+		}
+
+		free(buf);
+	}
+	res->elapsed = nvm_cli_ns() - t_bgn;
+
+	res->nops = conf.nops;
+	res->nerr = nerr;
+	res->nbytes = (conf.nops - nerr) * args->geo->sector_nbytes;
+	res->lat.nsamples = conf.nops;
+
+	return 0;
+}
+
+int rand_read(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	const struct nvm_addr bgn = args->addrs[0], end = args->addrs[1];
+	BENCH_RES res;
+
+	if (lines_prep(args, bgn, end, bgn.g.blk, conf.nlines))
+		return 1;
+
+	if (res_alloc(&res, conf.nops))
+		return 1;
+
+	rand_read_span(args, bgn, end, &res);
+
+	bench_pr_json("rand_read", args, &res);
+	res_free(&res);
+
+	return res.nerr != 0;
+}
+
+/*
+ * Mixed random reads and sequential writes
+ *
+ * Reads target the prepared line(s) at `blk`, writes append virtual pages to
+ * the line following them. Each thread owns a disjoint subset of the blocks in
+ * the write line, such that pages within a block are programmed in order.
+ */
+int mix(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	const struct nvm_addr bgn = args->addrs[0], end = args->addrs[1];
+	const int PMODE = nvm_cli_pmode(args->dev);
+	const int SPAGE_NADDRS = args->geo->nplanes * args->geo->nsectors;
+	const int wblk = bgn.g.blk + conf.nlines;
+	struct nvm_vblk *wline;
+	size_t nerr = 0, nbytes = 0;
+	BENCH_RES res;
+	size_t t_bgn;
+
+	if (lines_prep(args, bgn, end, bgn.g.blk, conf.nlines))
+		return 1;
+
+	wline = nvm_vblk_alloc_line(args->dev, bgn.g.ch, end.g.ch, bgn.g.lun,
+				    end.g.lun, wblk);
+	if (!wline) {
+		perror("nvm_vblk_alloc_line");
+		return 1;
+	}
+	if (nvm_vblk_erase(wline) < 0) {
+		perror("nvm_vblk_erase");
+		nvm_vblk_free(wline);
+		return 1;
+	}
+
+	if (res_alloc(&res, conf.nops)) {
+		nvm_vblk_free(wline);
+		return 1;
+	}
+
+	t_bgn = nvm_cli_ns();
+	#pragma omp parallel num_threads(conf.qd) reduction(+:nerr,nbytes)
+	{
+		const int tid = omp_get_thread_num();
+		const int nblks = nvm_vblk_get_naddrs(wline);
+		struct nvm_addr *blks = nvm_vblk_get_addrs(wline);
+		unsigned seed = conf.seed + tid;
+		size_t wpos = 0;	// Pages written, by this thread
+		size_t wmax = 0;	// Pages this thread may write
+		char *buf;
+
+		for (int idx = tid; idx < nblks; idx += conf.qd)
+			wmax += args->geo->npages;
+
+		buf = nvm_buf_alloc(args->geo, args->geo->vpg_nbytes);
+		if (buf)
+			nvm_buf_fill(buf, args->geo->vpg_nbytes);
+
+		#pragma omp for schedule(dynamic, 1)
+		for (size_t i = 0; i < conf.nops; ++i) {
+			const int do_read = (rand_r(&seed) % 100) < conf.ratio;
+			struct nvm_addr addrs[SPAGE_NADDRS];
+			struct nvm_ret ret;
+			size_t t_cmd;
+			ssize_t err;
+
+			t_cmd = nvm_cli_ns();
+			if (!buf) {
+				err = -1;
+			} else if (do_read || wpos >= wmax) {
+				const int blk = bgn.g.blk + rand_r(&seed) %
+								conf.nlines;
+
+				addrs[0] = rand_sector(args->geo, bgn, end, blk,
+						       args->geo->npages, &seed);
+				err = nvm_addr_read(args->dev, addrs, 1, buf,
+						    NULL, NVM_FLAG_PMODE_SNGL,
+						    &ret);
+				if (!err)
+					nbytes += args->geo->sector_nbytes;
+			} else {
+				const size_t nown = wmax / args->geo->npages;
+				const int idx = tid + (wpos % nown) * conf.qd;
+				const int pg = wpos / nown;
+
+				for (int j = 0; j < SPAGE_NADDRS; ++j) {
+					addrs[j].ppa = blks[idx].ppa;
+					addrs[j].g.pg = pg;
+					addrs[j].g.pl = j / args->geo->nsectors;
+					addrs[j].g.sec = j % args->geo->nsectors;
+				}
+				err = nvm_addr_write(args->dev, addrs,
+						     SPAGE_NADDRS, buf, NULL,
+						     PMODE, &ret);
+				if (!err)
+					nbytes += args->geo->vpg_nbytes;
+				++wpos;
+			}
+			if (err)
+				++nerr;
+
+			res.lat.samples[i] = nvm_cli_ns() - t_cmd;
+		}
+
+		free(buf);
+	}
+	res.elapsed = nvm_cli_ns() - t_bgn;
+
+	res.nops = conf.nops;
+	res.nerr = nerr;
+	res.nbytes = nbytes;
+	res.lat.nsamples = conf.nops;
+
+	printf("{\"workload\": \"mix\", \"ratio\": %d, ", conf.ratio);
+	printf("\"qd\": %d, \"pmode\": %d, ", conf.qd, PMODE);
+	res_pr_json(&res);
+	printf("}\n");
+
+	res_free(&res);
+	nvm_vblk_free(wline);
+
+	return res.nerr != 0;
+}
+
+/*
+ * Erase storm: erase every block of the lines, all planes per command, with qd
+ * erases outstanding
+ */
+int erase_storm(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	const struct nvm_addr bgn = args->addrs[0], end = args->addrs[1];
+	const int PMODE = nvm_cli_pmode(args->dev);
+	const int nchs = end.g.ch - bgn.g.ch + 1;
+	const int nluns = end.g.lun - bgn.g.lun + 1;
+	const size_t nerases = (size_t)nchs * nluns * conf.nlines;
+	size_t nerr = 0;
+	BENCH_RES res;
+	size_t t_bgn;
+
+	if (res_alloc(&res, nerases))
+		return 1;
+
+	t_bgn = nvm_cli_ns();
+	#pragma omp parallel for num_threads(conf.qd) schedule(dynamic, 1) reduction(+:nerr)
+	for (size_t i = 0; i < nerases; ++i) {
+		const int nplanes = args->geo->nplanes;
+		struct nvm_addr addrs[nplanes];
+		struct nvm_ret ret;
+		size_t t_cmd;
+
+		for (int pl = 0; pl < nplanes; ++pl) {	// Spread over LUNs
+			addrs[pl].ppa = 0;
+			addrs[pl].g.ch = bgn.g.ch + i % nchs;
+			addrs[pl].g.lun = bgn.g.lun + (i / nchs) % nluns;
+			addrs[pl].g.blk = bgn.g.blk + i / (nchs * nluns);
+			addrs[pl].g.pl = pl;
+		}
+
+		t_cmd = nvm_cli_ns();
+		if (nvm_addr_erase(args->dev, addrs, nplanes, PMODE, &ret))
+			++nerr;
+		res.lat.samples[i] = nvm_cli_ns() - t_cmd;
+	}
+	res.elapsed = nvm_cli_ns() - t_bgn;
+
+	res.nops = nerases;
+	res.nerr = nerr;
+	res.nbytes = (nerases - nerr) * args->geo->vblk_nbytes;
+	res.lat.nsamples = nerases;
+
+	bench_pr_json("erase_storm", args, &res);
+	res_free(&res);
+
+	return res.nerr != 0;
+}
+
+/*
+ * Per-LUN isolation: random reads against one LUN at a time, making slow or
+ * misbehaving dies stand out when comparing their latency distributions
+ */
+int lun_iso(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	const struct nvm_addr bgn = args->addrs[0], end = args->addrs[1];
+	size_t nerr = 0;
+	int first = 1;
+
+	if (lines_prep(args, bgn, end, bgn.g.blk, conf.nlines))
+		return 1;
+
+	printf("{\"workload\": \"lun_iso\", \"qd\": %d, \"luns\": [\n", conf.qd);
+	for (int ch = bgn.g.ch; ch <= end.g.ch; ++ch) {
+		for (int lun = bgn.g.lun; lun <= end.g.lun; ++lun) {
+			struct nvm_addr lun_addr = bgn;
+			BENCH_RES res;
+
+			lun_addr.g.ch = ch;
+			lun_addr.g.lun = lun;
+
+			if (res_alloc(&res, conf.nops))
+				return 1;
+
+			rand_read_span(args, lun_addr, lun_addr, &res);
+			nerr += res.nerr;
+
+			printf("%s  {\"ch\": %d, \"lun\": %d, ",
+			       first ? "" : ",\n", ch, lun);
+			res_pr_json(&res);
+			printf("}");
+			first = 0;
+
+			res_free(&res);
+		}
+	}
+	printf("\n]}\n");
+
+	return nerr != 0;
+}
+
+static int size_cmp(const void *a, const void *b)
+{
+	const size_t x = *(const size_t *)a, y = *(const size_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * LUN scaling: erase, write and read a vblk spanning 1..N of the LUNs in
+ * [bgn, end], channels first, on one open device with a buffer allocated and
+ * filled up front. Each span runs ntrials times and its median wall-clock is
+ * kept. With NVM_BENCH_CSV=<dir>, writes <dir>/{erase,write,read}.csv with
+ * rows of "span,secs,nbytes" as read by python/viz.py.
+ */
+int scale(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	static const char *ops[] = {"erase", "write", "read"};
+	const struct nvm_addr bgn = args->addrs[0], end = args->addrs[1];
+	const int nchs = end.g.ch - bgn.g.ch + 1;
+	const int nspans = nchs * (end.g.lun - bgn.g.lun + 1);
+	const size_t vblk_nbytes = args->geo->nplanes * args->geo->npages *
+				   args->geo->nsectors *
+				   args->geo->sector_nbytes;
+	struct nvm_addr addrs[nspans];
+	size_t wc[3][conf.ntrials];
+	FILE *fps[3] = {NULL};
+	size_t nerr = 0;
+	char *buf;
+
+	for (int i = 0; i < nspans; ++i) {
+		addrs[i].ppa = 0;
+		addrs[i].g.ch = bgn.g.ch + i % nchs;
+		addrs[i].g.lun = bgn.g.lun + i / nchs;
+		addrs[i].g.blk = bgn.g.blk;
+	}
+
+	buf = nvm_buf_alloc(args->geo, nspans * vblk_nbytes);
+	if (!buf) {
+		perror("nvm_buf_alloc");
+		return 1;
+	}
+	nvm_buf_fill(buf, nspans * vblk_nbytes);
+
+	for (int op = 0; conf.csv && op < 3; ++op) {
+		char path[4096];
+
+		snprintf(path, sizeof(path), "%s/%s.csv", conf.csv, ops[op]);
+		fps[op] = fopen(path, "w");
+		if (!fps[op]) {
+			perror("fopen");
+			nerr = 1;
+			goto out;
+		}
+	}
+
+	printf("{\"workload\": \"scale\", \"ntrials\": %d, \"pmode\": %d, ",
+	       conf.ntrials, nvm_cli_pmode(args->dev));
+	printf("\"spans\": [\n");
+	for (int span = 1; span <= nspans; ++span) {
+		const size_t nbytes = span * vblk_nbytes;
+		struct nvm_vblk *vblk;
+
+		vblk = nvm_vblk_alloc(args->dev, addrs, span);
+		if (!vblk) {
+			perror("nvm_vblk_alloc");
+			nerr = 1;
+			break;
+		}
+
+		for (int t = 0; t < conf.ntrials; ++t) {
+			size_t t_bgn;
+
+			t_bgn = nvm_cli_ns();
+			if (nvm_vblk_erase(vblk) < 0)
+				++nerr;
+			wc[0][t] = nvm_cli_ns() - t_bgn;
+
+			t_bgn = nvm_cli_ns();
+			if (nvm_vblk_pwrite(vblk, buf, nbytes, 0) < 0)
+				++nerr;
+			wc[1][t] = nvm_cli_ns() - t_bgn;
+
+			t_bgn = nvm_cli_ns();
+			if (nvm_vblk_pread(vblk, buf, nbytes, 0) < 0)
+				++nerr;
+			wc[2][t] = nvm_cli_ns() - t_bgn;
+		}
+		nvm_vblk_free(vblk);
+
+		printf("%s  {\"span\": %d, \"nbytes\": %lu",
+		       span > 1 ? ",\n" : "", span, nbytes);
+		for (int op = 0; op < 3; ++op) {
+			double secs;
+
+			qsort(wc[op], conf.ntrials, sizeof(size_t), size_cmp);
+			secs = wc[op][conf.ntrials / 2] / 1000000000.0;
+
+			printf(", \"%s\": %.6lf", ops[op], secs);
+			if (fps[op])
+				fprintf(fps[op], "%d,%.6lf,%lu\n", span, secs,
+					nbytes);
+		}
+		printf("}");
+	}
+	printf("\n], \"nerr\": %lu}\n", nerr);
+
+out:
+	for (int op = 0; op < 3; ++op)
+		if (fps[op])
+			fclose(fps[op]);
+	free(buf);
+
+	return nerr != 0;
+}
+
+//
+// Remaining code is CLI boiler-plate
+//
+static NVM_CLI_CMD cmds[] = {
+	{"line_write", line_write, NVM_CLI_ARG_LINE, 0x0},
+	{"rand_read", rand_read, NVM_CLI_ARG_LINE, 0x0},
+	{"mix", mix, NVM_CLI_ARG_LINE, 0x0},
+	{"erase_storm", erase_storm, NVM_CLI_ARG_LINE, 0x0},
+	{"lun_iso", lun_iso, NVM_CLI_ARG_LINE, 0x0},
+	{"scale", scale, NVM_CLI_ARG_LINE, 0x0},
+};
+
+static int ncmds = sizeof(cmds) / sizeof(cmds[0]);
+
+int main(int argc, char **argv)
+{
+	NVM_CLI_CMD *cmd;
+	int ret = 0;
+
+	conf_fill();
+
+	cmd = nvm_cli_setup(argc, argv, cmds, ncmds);
+	if (cmd) {
+		ret = cmd->func(&cmd->args, cmd->flags);
+	} else {
+		nvm_cli_usage(argv[0], "NVM benchmark (nvm_bench)", cmds,
+			      ncmds);
+		printf("\nWorkloads are tuned via ENV(NVM_BENCH_QD, ");
+		printf("NVM_BENCH_NOPS, NVM_BENCH_RATIO, NVM_BENCH_NLINES, ");
+		printf("NVM_BENCH_NOPREP, NVM_BENCH_SEED, NVM_BENCH_NTRIALS, ");
+		printf("NVM_BENCH_CSV)\n");
+		ret = 1;
+	}
+	nvm_cli_teardown(cmd);
+
+	return ret != 0;
+}
@@ -13,11 +13,51 @@ int info(NVM_CLI_CMD_ARGS *args, int flags)
 	return 0;
 }
 
+int erase_range(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	struct nvm_erase_stat stat = {};
+	struct nvm_addr failed[16];
+	struct nvm_addr bgn = {}, end = {};
+	ssize_t res;
+
+	if (args->nlbas != 6) {
+		printf("usage: erase_range dev ch_bgn ch_end lun_bgn lun_end blk_bgn blk_end\n");
+		errno = EINVAL;
+		return -1;
+	}
+	bgn.g.ch = args->lbas[0];
+	end.g.ch = args->lbas[1];
+	bgn.g.lun = args->lbas[2];
+	end.g.lun = args->lbas[3];
+	bgn.g.blk = args->lbas[4];
+	end.g.blk = args->lbas[5];
+
+	stat.failed = failed;
+	stat.failed_max = sizeof(failed) / sizeof(failed[0]);
+
+	printf("** nvm_dev_erase_range(...):\n");
+	nvm_timer_start();
+	res = nvm_dev_erase_range(args->dev, bgn, end,
+				  nvm_dev_get_pmode(args->dev), &stat);
+	if (res < 0)
+		perror("nvm_dev_erase_range");
+	nvm_timer_stop();
+
+	printf("nblks(%lu), nerased(%lu), nskipped(%lu), nfailed(%lu)\n",
+	       stat.nblks, stat.nerased, stat.nskipped, stat.nfailed);
+	for (uint64_t i = 0; i < stat.nfailed && i < stat.failed_max; ++i)
+		nvm_addr_pr(failed[i]);
+	nvm_timer_pr("nvm_dev_erase_range");
+
+	return res < 0;
+}
+
 //
 // Remaining code is CLI boiler-plate
 //
 static NVM_CLI_CMD cmds[] = {
 	{"info", info, NVM_CLI_ARG_NONE, 0x0},
+	{"erase_range", erase_range, NVM_CLI_ARG_INTLIST, 0x0},
 };
 
 static int ncmds = sizeof(cmds) / sizeof(cmds[0]);
@@ -1,5 +1,7 @@
+#define _GNU_SOURCE
 #include "nvm_cli.h"
 #include <sys/time.h>
+#include <time.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -36,6 +38,63 @@ void nvm_timer_pr(const char* tool)
     printf("Ran %s, elapsed wall-clock: %lf\n", tool, nvm_timer_elapsed());
 }
 
+size_t nvm_cli_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int lat_cmp(const void *a, const void *b)
+{
+	const size_t la = *(const size_t *)a, lb = *(const size_t *)b;
+
+	return (la > lb) - (la < lb);
+}
+
+static inline size_t lat_pct(NVM_CLI_LAT *lat, double pct)
+{
+	size_t idx = (size_t)(pct * lat->nsamples / 100.0);
+
+	return lat->samples[idx < lat->nsamples ? idx : lat->nsamples - 1];
+}
+
+void nvm_cli_lat_sum(NVM_CLI_LAT *lat)
+{
+	double sum = 0;
+
+	if (!lat->nsamples) {
+		lat->min = lat->max = lat->p50 = lat->p90 = lat->p99 = 0;
+		lat->p999 = 0;
+		lat->avg = 0;
+		return;
+	}
+
+	qsort(lat->samples, lat->nsamples, sizeof(*lat->samples), lat_cmp);
+
+	for (size_t i = 0; i < lat->nsamples; ++i)
+		sum += lat->samples[i];
+
+	lat->min = lat->samples[0];
+	lat->max = lat->samples[lat->nsamples - 1];
+	lat->avg = sum / lat->nsamples;
+	lat->p50 = lat_pct(lat, 50.0);
+	lat->p90 = lat_pct(lat, 90.0);
+	lat->p99 = lat_pct(lat, 99.0);
+	lat->p999 = lat_pct(lat, 99.9);
+}
+
+void nvm_cli_lat_pr_json(NVM_CLI_LAT *lat)
+{
+	printf("{\"min\": %.3lf, \"avg\": %.3lf, \"p50\": %.3lf, ",
+	       lat->min / 1000.0, lat->avg / 1000.0, lat->p50 / 1000.0);
+	printf("\"p90\": %.3lf, \"p99\": %.3lf, \"p999\": %.3lf, ",
+	       lat->p90 / 1000.0, lat->p99 / 1000.0, lat->p999 / 1000.0);
+	printf("\"max\": %.3lf}", lat->max / 1000.0);
+}
+
 int nvm_cli_pmode(struct nvm_dev *dev)
 {
 	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
@@ -165,6 +224,17 @@ NVM_CLI_CMD *nvm_cli_setup(int argc, char **argv, NVM_CLI_CMD cmds[], int ncmds)
 	memset(dev_path, 0, sizeof(dev_path));
 	strcpy(dev_path, argv[2]);
 
+	if (getenv("NVM_CLI_TRACE")) {			// Enable tracing
+		size_t nrecs = 1 << 16;
+
+		if (getenv("NVM_CLI_TRACE_NRECS"))
+			nrecs = atol(getenv("NVM_CLI_TRACE_NRECS"));
+		if (nvm_trace_enable(nrecs)) {
+			perror("nvm_trace_enable");
+			return NULL;
+		}
+	}
+
 	cmd->args.dev = nvm_dev_open(dev_path);		// Open device
 	if (!cmd->args.dev) {
 		perror("nvm_dev_open");
@@ -327,5 +397,11 @@ void nvm_cli_teardown(NVM_CLI_CMD *cmd)
 	if (cmd->args.dev) {
 		nvm_dev_close(cmd->args.dev);
 	}
+
+	if (getenv("NVM_CLI_TRACE")) {
+		nvm_trace_disable();
+		if (nvm_trace_dump(getenv("NVM_CLI_TRACE")))
+			perror("nvm_trace_dump");
+	}
 }
 
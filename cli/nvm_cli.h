@@ -42,6 +42,36 @@ NVM_CLI_CMD *nvm_cli_setup(int argc, char **argv, NVM_CLI_CMD cmds[], int ncmds)
 
 void nvm_cli_teardown(NVM_CLI_CMD *cmd);
 
+/**
+ * Latency samples, in nsec, along with a summary produced by nvm_cli_lat_sum
+ */
+typedef struct {
+	size_t *samples;	///< Latency samples in nsec
+	size_t nsamples;	///< Number of samples
+	size_t min;		///< Minimum latency in nsec
+	size_t max;		///< Maximum latency in nsec
+	double avg;		///< Average latency in nsec
+	size_t p50;		///< 50th percentile latency in nsec
+	size_t p90;		///< 90th percentile latency in nsec
+	size_t p99;		///< 99th percentile latency in nsec
+	size_t p999;		///< 99.9th percentile latency in nsec
+} NVM_CLI_LAT;
+
+/**
+ * @returns Monotonic wall-clock in nsec for latency sampling
+ */
+size_t nvm_cli_ns(void);
+
+/**
+ * Sort the samples of the given latency and compute its summary
+ */
+void nvm_cli_lat_sum(NVM_CLI_LAT *lat);
+
+/**
+ * Prints the summary of the given latency as a JSON object in usec
+ */
+void nvm_cli_lat_pr_json(NVM_CLI_LAT *lat);
+
 size_t nvm_timer_start(void);
 size_t nvm_timer_stop(void);
 double nvm_timer_elapsed(void);
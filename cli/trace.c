@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include "nvm_cli.h"
+
+/*
+ * Decoder for trace-files produced by nvm_trace_dump, e.g. by running any of
+ * the nvm_* CLI tools with ENV("NVM_CLI_TRACE") set to the trace-file path.
+ *
+ * Since decoding requires no device, this tool does not use nvm_cli_setup.
+ */
+
+static const char *opcode_str(uint16_t opcode)
+{
+	switch (opcode) {
+	case 0x90:
+		return "erase";
+	case 0x91:
+		return "write";
+	case 0x92:
+		return "read";
+	default:
+		return "unknown";
+	}
+}
+
+int csv(struct nvm_trace_rec *recs, size_t nrecs)
+{
+	printf("ts,dur,tid,opcode,op,naddrs,ppa,err,result,status\n");
+	for (size_t i = 0; i < nrecs; ++i) {
+		struct nvm_trace_rec *rec = &recs[i];
+
+		printf("%lu,%lu,%u,0x%02x,%s,%u,0x%016lx,%d,0x%x,%lu\n",
+		       rec->ts, rec->dur, rec->tid, rec->opcode,
+		       opcode_str(rec->opcode), rec->naddrs, rec->ppa, rec->err,
+		       rec->result, rec->status);
+	}
+
+	return 0;
+}
+
+/*
+ * Two column CSV, without header, of "cmd#,duration-in-sec" as consumed by
+ * python/viz.py, use with `--yaxis wall-clock` to plot command latency
+ */
+int viz(struct nvm_trace_rec *recs, size_t nrecs)
+{
+	for (size_t i = 0; i < nrecs; ++i)
+		printf("%lu,%.9lf\n", i + 1, recs[i].dur / 1000000000.0);
+
+	return 0;
+}
+
+int json(struct nvm_trace_rec *recs, size_t nrecs)
+{
+	printf("[\n");
+	for (size_t i = 0; i < nrecs; ++i) {
+		struct nvm_trace_rec *rec = &recs[i];
+
+		printf("  {\"ts\": %lu, \"dur\": %lu, \"tid\": %u, ",
+		       rec->ts, rec->dur, rec->tid);
+		printf("\"opcode\": %u, \"op\": \"%s\", \"naddrs\": %u, ",
+		       rec->opcode, opcode_str(rec->opcode), rec->naddrs);
+		printf("\"ppa\": \"0x%016lx\", \"err\": %d, \"result\": %u, ",
+		       rec->ppa, rec->err, rec->result);
+		printf("\"status\": %lu}%s\n", rec->status,
+		       (i + 1 < nrecs) ? "," : "");
+	}
+	printf("]\n");
+
+	return 0;
+}
+
+int pr(struct nvm_trace_rec *recs, size_t nrecs)
+{
+	printf("trace { nrecs(%lu) }\n", nrecs);
+	for (size_t i = 0; i < nrecs; ++i)
+		nvm_trace_rec_pr(&recs[i]);
+
+	return 0;
+}
+
+//
+// Remaining code is CLI boiler-plate
+//
+typedef int (*TRACE_FUNC)(struct nvm_trace_rec *, size_t);
+
+static struct {
+	char name[NVM_CLI_CMD_LEN];
+	TRACE_FUNC func;
+} cmds[] = {
+	{"csv", csv},
+	{"viz", viz},
+	{"json", json},
+	{"pr", pr},
+};
+
+static int ncmds = sizeof(cmds) / sizeof(cmds[0]);
+
+int main(int argc, char **argv)
+{
+	struct nvm_trace_rec *recs;
+	size_t nrecs = 0;
+	int ret;
+
+	for (int i = 0; argc == 3 && i < ncmds; ++i) {
+		if (strcmp(argv[1], cmds[i].name))
+			continue;
+
+		recs = nvm_trace_load(argv[2], &nrecs);
+		if (!recs) {
+			perror("nvm_trace_load");
+			return 1;
+		}
+
+		ret = cmds[i].func(recs, nrecs);
+		free(recs);
+
+		return ret != 0;
+	}
+
+	printf("NVM trace decoder (nvm_trace_*) -- ");
+	nvm_ver_pr();
+	printf("\n\nUsage:\n");
+	for (int i = 0; i < ncmds; ++i)
+		printf(" %s %10s trace_path\n", argv[0], cmds[i].name);
+
+	return 1;
+}
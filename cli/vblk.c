@@ -1,8 +1,15 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <liblightnvm.h>
+#include <nvm_omp.h>
 #include "nvm_cli.h"
 
 int erase(NVM_CLI_CMD_ARGS *args, int flags)
@@ -34,7 +41,7 @@ int erase(NVM_CLI_CMD_ARGS *args, int flags)
 	return res < 0;
 }
 
-int read(NVM_CLI_CMD_ARGS *args, int flags)
+int cmd_read(NVM_CLI_CMD_ARGS *args, int flags)
 {
 	ssize_t res = 0;
 
@@ -84,7 +91,7 @@ int read(NVM_CLI_CMD_ARGS *args, int flags)
 	return res < 0;
 }
 
-int write(NVM_CLI_CMD_ARGS *args, int flags)
+int cmd_write(NVM_CLI_CMD_ARGS *args, int flags)
 {
 	ssize_t res = 0;
 
@@ -323,6 +330,273 @@ int line_pad(NVM_CLI_CMD_ARGS *args, int flags)
 	return res < 0;
 }
 
+/*
+ * Pipeline moving a line between the device and a file through a ring of
+ * vpage-aligned buffers, the device side runs in the calling thread and the
+ * file side in a thread of its own such that the two overlap
+ */
+typedef struct {
+	struct nvm_vblk *vblk;
+	int fd;
+	int to_file;		///< Direction, device to file or file to device
+	size_t nbytes;		///< Bytes to move
+	size_t chunk_nbytes;	///< Bytes per ring slot
+	size_t align;		///< Alignment of device transfers
+	size_t nchunks;
+	int depth;		///< Number of ring slots
+	char **bufs;
+	size_t *lens;		///< Bytes held by each slot
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t nfilled;		///< Slots handed from the producer
+	size_t ndrained;	///< Slots handed back from the consumer
+	int err;		///< errno of the first failing side
+} PIPE;
+
+static int pipe_file_io(PIPE *pipe, char *buf, size_t count, size_t offset)
+{
+	size_t nbytes = 0;
+
+	while (nbytes < count) {
+		ssize_t res;
+
+		if (pipe->to_file)
+			res = pwrite(pipe->fd, buf + nbytes, count - nbytes,
+				     offset + nbytes);
+		else
+			res = pread(pipe->fd, buf + nbytes, count - nbytes,
+				    offset + nbytes);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+		if (!res)		// EOF
+			break;
+
+		nbytes += res;
+	}
+	if (!pipe->to_file)	// Zero-pad the tail to device alignment
+		memset(buf + nbytes, 0, pipe->chunk_nbytes - nbytes);
+
+	return nbytes == count || !pipe->to_file ? 0 : EIO;
+}
+
+static int pipe_dev_io(PIPE *pipe, char *buf, size_t count, size_t offset)
+{
+	ssize_t res;
+
+	if (pipe->to_file)
+		res = nvm_vblk_pread(pipe->vblk, buf, count, offset);
+	else
+		res = nvm_vblk_pwrite(pipe->vblk, buf, count, offset);
+
+	return res < 0 ? errno : 0;
+}
+
+static void pipe_fail(PIPE *pipe, int err)
+{
+	pthread_mutex_lock(&pipe->lock);
+	if (!pipe->err)
+		pipe->err = err;
+	pthread_cond_broadcast(&pipe->cond);
+	pthread_mutex_unlock(&pipe->lock);
+}
+
+/*
+ * Fill slots in order, waiting for the consumer to hand back a slot when the
+ * ring is full
+ */
+static void pipe_produce(PIPE *pipe, int dev_side)
+{
+	for (size_t i = 0; i < pipe->nchunks; ++i) {
+		const size_t offset = i * pipe->chunk_nbytes;
+		const size_t left = pipe->nbytes - offset;
+		const size_t len = left < pipe->chunk_nbytes ?
+				   left : pipe->chunk_nbytes;
+		char *buf = pipe->bufs[i % pipe->depth];
+		int err;
+
+		pthread_mutex_lock(&pipe->lock);
+		while (!pipe->err && pipe->nfilled - pipe->ndrained ==
+		       (size_t)pipe->depth)
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		err = pipe->err;
+		pthread_mutex_unlock(&pipe->lock);
+		if (err)
+			return;
+
+		if (dev_side) {
+			err = pipe_dev_io(pipe, buf, len, offset);
+			pipe->lens[i % pipe->depth] = len;
+		} else {	// Round up, O_DIRECT reads the tail short
+			const size_t alen = (len + pipe->align - 1) /
+					    pipe->align * pipe->align;
+
+			err = pipe_file_io(pipe, buf, alen, offset);
+			pipe->lens[i % pipe->depth] = alen;
+		}
+		if (err) {
+			pipe_fail(pipe, err);
+			return;
+		}
+
+		pthread_mutex_lock(&pipe->lock);
+		++pipe->nfilled;
+		pthread_cond_broadcast(&pipe->cond);
+		pthread_mutex_unlock(&pipe->lock);
+	}
+}
+
+/*
+ * Drain slots in order, handing each back to the producer once transferred
+ */
+static void pipe_consume(PIPE *pipe, int dev_side)
+{
+	for (size_t i = 0; i < pipe->nchunks; ++i) {
+		const size_t offset = i * pipe->chunk_nbytes;
+		char *buf = pipe->bufs[i % pipe->depth];
+		int err;
+
+		pthread_mutex_lock(&pipe->lock);
+		while (!pipe->err && pipe->nfilled == i)
+			pthread_cond_wait(&pipe->cond, &pipe->lock);
+		err = pipe->err;
+		pthread_mutex_unlock(&pipe->lock);
+		if (err)
+			return;
+
+		if (dev_side)
+			err = pipe_dev_io(pipe, buf, pipe->lens[i % pipe->depth],
+					  offset);
+		else
+			err = pipe_file_io(pipe, buf, pipe->lens[i % pipe->depth],
+					   offset);
+		if (err) {
+			pipe_fail(pipe, err);
+			return;
+		}
+
+		pthread_mutex_lock(&pipe->lock);
+		++pipe->ndrained;
+		pthread_cond_broadcast(&pipe->cond);
+		pthread_mutex_unlock(&pipe->lock);
+	}
+}
+
+static void *pipe_file_stage(void *arg)
+{
+	PIPE *pipe = arg;
+
+	if (pipe->to_file)
+		pipe_consume(pipe, 0);
+	else
+		pipe_produce(pipe, 0);
+
+	return NULL;
+}
+
+/*
+ * Move `nbytes` between `vblk` and `fd`, tuned via ENV(NVM_CLI_PIPE_DEPTH,
+ * NVM_CLI_PIPE_NVPGS) for ring slots and vpages per block in a slot
+ */
+static int pipe_run(struct nvm_dev *dev, struct nvm_vblk *vblk, int fd,
+		    int to_file, size_t nbytes)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const int nblks = nvm_vblk_get_naddrs(vblk);
+	PIPE pipe = { 0 };
+	pthread_t file_thread;
+	int nvpgs, err = 0;
+
+	pipe.depth = getenv("NVM_CLI_PIPE_DEPTH") ?
+		     atoi(getenv("NVM_CLI_PIPE_DEPTH")) : 4;
+	nvpgs = getenv("NVM_CLI_PIPE_NVPGS") ?
+		atoi(getenv("NVM_CLI_PIPE_NVPGS")) :
+		NVM_NADDR_MAX / (geo->nplanes * geo->nsectors);
+	pipe.depth = pipe.depth < 2 ? 2 : pipe.depth;
+	nvpgs = nvpgs < 1 ? 1 : nvpgs;
+
+	pipe.vblk = vblk;
+	pipe.fd = fd;
+	pipe.to_file = to_file;
+	pipe.nbytes = nbytes;
+	pipe.align = geo->vpg_nbytes;
+	pipe.chunk_nbytes = nblks * nvpgs * geo->vpg_nbytes;
+	pipe.nchunks = (nbytes + pipe.chunk_nbytes - 1) / pipe.chunk_nbytes;
+	pthread_mutex_init(&pipe.lock, NULL);
+	pthread_cond_init(&pipe.cond, NULL);
+
+	pipe.bufs = calloc(pipe.depth, sizeof(*pipe.bufs));
+	pipe.lens = calloc(pipe.depth, sizeof(*pipe.lens));
+	if (!pipe.bufs || !pipe.lens) {
+		err = ENOMEM;
+		goto out;
+	}
+	for (int i = 0; i < pipe.depth; ++i) {
+		pipe.bufs[i] = nvm_dev_buf_alloc(dev, pipe.chunk_nbytes);
+		if (!pipe.bufs[i]) {
+			err = errno;
+			goto out;
+		}
+	}
+
+	printf("** pipe: nchunks(%zu), chunk_nbytes(%zu), depth(%d)\n",
+	       pipe.nchunks, pipe.chunk_nbytes, pipe.depth);
+
+	err = pthread_create(&file_thread, NULL, pipe_file_stage, &pipe);
+	if (err)
+		goto out;
+
+	if (to_file)
+		pipe_produce(&pipe, 1);
+	else
+		pipe_consume(&pipe, 1);
+
+	pthread_join(file_thread, NULL);
+	err = pipe.err;
+
+out:
+	for (int i = 0; pipe.bufs && i < pipe.depth; ++i)
+		free(pipe.bufs[i]);
+	free(pipe.bufs);
+	free(pipe.lens);
+	pthread_cond_destroy(&pipe.cond);
+	pthread_mutex_destroy(&pipe.lock);
+
+	if (err) {
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Open ENV(NVM_CLI_FILE) or the default file of the line, O_DIRECT where the
+ * file-system supports it
+ */
+static int pipe_file_open(struct nvm_addr bgn, struct nvm_addr end, int flags)
+{
+	char file_name[1024];
+	const char *path = getenv("NVM_CLI_FILE");
+	int fd;
+
+	if (!path) {
+		sprintf(file_name, "vblk_line_%016lx_%016lx.bin", bgn.ppa,
+			end.ppa);
+		path = file_name;
+	}
+
+	printf("** file: '%s'\n", path);
+
+	fd = open(path, flags | O_DIRECT, 0644);
+	if (fd < 0 && errno == EINVAL)
+		fd = open(path, flags, 0644);
+
+	return fd;
+}
+
 int line_to_file(NVM_CLI_CMD_ARGS *args, int flags)
 {
 	ssize_t res = 0;
@@ -330,8 +604,7 @@ int line_to_file(NVM_CLI_CMD_ARGS *args, int flags)
 	struct nvm_addr bgn, end;
 	struct nvm_vblk *vblk;
 	size_t nbytes;
-	const struct nvm_geo *geo;
-	char *buf;
+	int fd;
 
 	bgn = args->addrs[0];
 	end = args->addrs[1];
@@ -343,38 +616,80 @@ int line_to_file(NVM_CLI_CMD_ARGS *args, int flags)
 		return errno;
 	}
 	nbytes = nvm_vblk_get_nbytes(vblk);
-	geo = nvm_dev_get_geo(args->dev);
-
-	printf("** nvm_vblk_read(...):\n");
-	nvm_vblk_pr(vblk);
 
-	nvm_timer_start();
-	buf = nvm_buf_alloc(geo, nbytes);
-	if (!buf) {
-		perror("nvm_buf_alloc");
+	fd = pipe_file_open(bgn, end, O_WRONLY | O_CREAT | O_TRUNC);
+	if (fd < 0) {
+		perror("open");
+		nvm_vblk_free(vblk);
 		return errno;
 	}
-	nvm_timer_stop();
-	nvm_timer_pr("nvm_buf_alloc");
+
+	printf("** nvm_vblk_pread(...) -> file:\n");
+	nvm_vblk_pr(vblk);
 
 	nvm_timer_start();
-	res = nvm_vblk_read(vblk, buf, nbytes);
+	res = pipe_run(args->dev, vblk, fd, 1, nbytes);
 	if (res < 0)
-		perror("nvm_vblk_read");
+		perror("line_to_file");
 	nvm_timer_stop();
-	nvm_timer_pr("nvm_vblk_read");
+	nvm_timer_pr("line_to_file");
 
-	{
-		FILE *file_handle;
-		char file_name[1024];
+	close(fd);
+	nvm_vblk_free(vblk);
+
+	return res < 0;
+}
+
+int file_to_line(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	ssize_t res = 0;
 
-		sprintf(file_name, "vblk_line_%016lx_%016lx.bin", bgn.ppa, end.ppa);
-		file_handle = fopen(file_name, "wb");
-		fwrite(buf, 1, nbytes, file_handle);
-		fclose(file_handle);
+	struct nvm_addr bgn, end;
+	struct nvm_vblk *vblk;
+	struct stat st;
+	int fd;
+
+	bgn = args->addrs[0];
+	end = args->addrs[1];
+
+	vblk = nvm_vblk_alloc_line(args->dev, bgn.g.ch, end.g.ch, bgn.g.lun,
+				   end.g.lun, end.g.blk);
+	if (!vblk) {
+		perror("nvm_vblk_alloc");
+		return errno;
 	}
 
-	free(buf);
+	fd = pipe_file_open(bgn, end, O_RDONLY);
+	if (fd < 0) {
+		perror("open");
+		nvm_vblk_free(vblk);
+		return errno;
+	}
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		close(fd);
+		nvm_vblk_free(vblk);
+		return errno;
+	}
+	if (!st.st_size || (size_t)st.st_size > nvm_vblk_get_nbytes(vblk)) {
+		printf("FAILED: file size(%zu) is zero or exceeds line\n",
+		       (size_t)st.st_size);
+		close(fd);
+		nvm_vblk_free(vblk);
+		return EINVAL;
+	}
+
+	printf("** file -> nvm_vblk_pwrite(...):\n");
+	nvm_vblk_pr(vblk);
+
+	nvm_timer_start();
+	res = pipe_run(args->dev, vblk, fd, 0, st.st_size);
+	if (res < 0)
+		perror("file_to_line");
+	nvm_timer_stop();
+	nvm_timer_pr("file_to_line");
+
+	close(fd);
 	nvm_vblk_free(vblk);
 
 	return res < 0;
@@ -524,13 +839,372 @@ int set_pad(NVM_CLI_CMD_ARGS *args, int flags)
 	return res < 0;
 }
 
+/*
+ * Load parameters, overridable via ENV("NVM_CLI_LOAD_*")
+ */
+static struct {
+	int nvblks;	///< Number of vblks / lines under load at once
+	int qd;		///< Number of outstanding commands, one per thread
+	int ratio;	///< Percentage of reads
+	double secs;	///< Duration, 0 for no limit
+	size_t nbytes;	///< Bytes to transfer, 0 for no limit
+	double ival;	///< Seconds between live throughput reports
+	size_t nsamples;	///< Latency samples kept per thread and op
+} load;
+
+/*
+ * A vblk under load: written sequentially one stripe at a time, then erased
+ * and written again, and read at random from the written part
+ */
+typedef struct {
+	struct nvm_vblk *vblk;
+	pthread_mutex_t lock;	///< Serializes writes and erases
+	size_t wpos;		///< Bytes written since the erase
+	size_t nerases;		///< Odd while erasing, for reads racing erases
+	size_t nbytes;
+} LOAD_VBLK;
+
+/*
+ * Latency samples of a thread, a uniform reservoir once full
+ */
+typedef struct {
+	size_t *samples;
+	size_t nsamples;
+	size_t nseen;
+} LOAD_LAT;
+
+static void load_conf_fill(void)
+{
+	load.nvblks = getenv("NVM_CLI_LOAD_NVBLKS") ?
+		      atoi(getenv("NVM_CLI_LOAD_NVBLKS")) : 1;
+	load.qd = getenv("NVM_CLI_LOAD_QD") ?
+		  atoi(getenv("NVM_CLI_LOAD_QD")) : 1;
+	load.ratio = getenv("NVM_CLI_LOAD_RATIO") ?
+		     atoi(getenv("NVM_CLI_LOAD_RATIO")) : 70;
+	load.secs = getenv("NVM_CLI_LOAD_SECS") ?
+		    atof(getenv("NVM_CLI_LOAD_SECS")) : 0;
+	load.nbytes = getenv("NVM_CLI_LOAD_NBYTES") ?
+		      atol(getenv("NVM_CLI_LOAD_NBYTES")) : 0;
+	load.ival = getenv("NVM_CLI_LOAD_IVAL") ?
+		    atof(getenv("NVM_CLI_LOAD_IVAL")) : 1.0;
+	load.nsamples = 1 << 16;
+
+	load.nvblks = load.nvblks < 1 ? 1 : load.nvblks;
+	load.qd = load.qd < 1 ? 1 : load.qd;
+	load.ratio = load.ratio < 0 ? 0 : (load.ratio > 100 ? 100 : load.ratio);
+	load.ival = load.ival <= 0 ? 1.0 : load.ival;
+	if (!load.secs && !load.nbytes)
+		load.secs = 10;
+}
+
+static void load_lat_add(LOAD_LAT *lat, size_t sample, unsigned *seed)
+{
+	size_t idx;
+
+	++lat->nseen;
+	if (lat->nsamples < load.nsamples) {
+		lat->samples[lat->nsamples++] = sample;
+		return;
+	}
+
+	idx = ((size_t)rand_r(seed) * RAND_MAX + rand_r(seed)) % lat->nseen;
+	if (idx < load.nsamples)
+		lat->samples[idx] = sample;
+}
+
+static void load_lat_pr(const char *name, LOAD_LAT lats[], int nlats)
+{
+	NVM_CLI_LAT lat;
+
+	memset(&lat, 0, sizeof(lat));
+	lat.samples = malloc(sizeof(*lat.samples) * load.nsamples * nlats);
+	if (!lat.samples) {
+		perror("malloc");
+		return;
+	}
+	for (int i = 0; i < nlats; ++i) {
+		memcpy(lat.samples + lat.nsamples, lats[i].samples,
+		       sizeof(*lat.samples) * lats[i].nsamples);
+		lat.nsamples += lats[i].nsamples;
+	}
+	nvm_cli_lat_sum(&lat);
+
+	printf("\"%s_lat_usec\": ", name);
+	nvm_cli_lat_pr_json(&lat);
+
+	free(lat.samples);
+}
+
+/*
+ * Run `load.qd` threads issuing stripe-sized reads and writes against the
+ * given vblks, until `load.secs` have passed or `load.nbytes` are transferred,
+ * printing throughput every `load.ival` seconds followed by a JSON summary
+ */
+static int load_run(NVM_CLI_CMD_ARGS *args, LOAD_VBLK vblks[], int nvblks,
+		    size_t stripe_nbytes)
+{
+	const size_t t_end = load.secs ? load.secs * 1000000000.0 : 0;
+	const size_t t_ival = load.ival * 1000000000.0;
+	LOAD_LAT rlats[load.qd], wlats[load.qd];
+	size_t nreads = 0, nwrites = 0, nerases = 0, nerr = 0;
+	size_t rbytes = 0, wbytes = 0;
+	int stop = 0;
+	size_t t_bgn;
+
+	memset(rlats, 0, sizeof(rlats));
+	memset(wlats, 0, sizeof(wlats));
+	for (int i = 0; i < load.qd; ++i) {
+		rlats[i].samples = malloc(sizeof(size_t) * load.nsamples);
+		wlats[i].samples = malloc(sizeof(size_t) * load.nsamples);
+		if (!rlats[i].samples || !wlats[i].samples) {
+			perror("malloc");
+			stop = 1;
+		}
+	}
+
+	t_bgn = nvm_cli_ns();
+	#pragma omp parallel num_threads(load.qd + 1)
+	{
+		const int tid = omp_get_thread_num();
+		unsigned seed = 1337 + tid;
+		char *buf = NULL;
+		struct nvm_vblk *rvblks[nvblks];	// Handles of the reader
+
+		memset(rvblks, 0, sizeof(rvblks));
+		if (tid) {
+			buf = nvm_dev_buf_alloc(args->dev, stripe_nbytes);
+			if (buf)
+				nvm_buf_fill(buf, stripe_nbytes);
+			else
+				__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+		}
+
+		// Reads go via handles of their own, as the outcome kept by a
+		// vblk, see nvm_vblk_get_ret, is not shared safely
+		for (int i = 0; tid && i < nvblks; ++i) {
+			rvblks[i] = nvm_vblk_alloc(args->dev,
+					nvm_vblk_get_addrs(vblks[i].vblk),
+					nvm_vblk_get_naddrs(vblks[i].vblk));
+			if (!rvblks[i]) {
+				perror("nvm_vblk_alloc");
+				__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+				break;
+			}
+		}
+
+		while (tid && !__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+			const int idx = rand_r(&seed) % nvblks;
+			LOAD_VBLK *lv = &vblks[idx];
+			const size_t gen = __atomic_load_n(&lv->nerases,
+							   __ATOMIC_SEQ_CST);
+			const size_t wpos = __atomic_load_n(&lv->wpos,
+							    __ATOMIC_ACQUIRE);
+			const int do_read = wpos && !(gen & 1) &&
+					    (rand_r(&seed) % 100) < load.ratio;
+			size_t t_cmd = nvm_cli_ns();
+			ssize_t res;
+
+			if (do_read) {
+				const size_t off = (rand_r(&seed) %
+						    (wpos / stripe_nbytes)) *
+						   stripe_nbytes;
+
+				res = nvm_vblk_pread(rvblks[idx], buf,
+						     stripe_nbytes, off);
+				t_cmd = nvm_cli_ns() - t_cmd;
+				if (res < 0 && gen != __atomic_load_n(
+						&lv->nerases, __ATOMIC_SEQ_CST))
+					continue;	// Raced an erase
+				load_lat_add(&rlats[tid - 1], t_cmd, &seed);
+				if (res < 0) {
+					__atomic_fetch_add(&nerr, 1,
+							   __ATOMIC_RELAXED);
+					continue;
+				}
+				__atomic_fetch_add(&nreads, 1,
+						   __ATOMIC_RELAXED);
+				__atomic_fetch_add(&rbytes, stripe_nbytes,
+						   __ATOMIC_RELAXED);
+				continue;
+			}
+
+			pthread_mutex_lock(&lv->lock);
+			if (lv->wpos == lv->nbytes) {	// Full, start over
+				__atomic_fetch_add(&lv->nerases, 1,
+						   __ATOMIC_SEQ_CST);
+				if (nvm_vblk_erase(lv->vblk) < 0)
+					__atomic_fetch_add(&nerr, 1,
+							   __ATOMIC_RELAXED);
+				__atomic_fetch_add(&nerases, 1,
+						   __ATOMIC_RELAXED);
+				__atomic_store_n(&lv->wpos, 0,
+						 __ATOMIC_RELEASE);
+				__atomic_fetch_add(&lv->nerases, 1,
+						   __ATOMIC_SEQ_CST);
+			}
+
+			t_cmd = nvm_cli_ns();
+			res = nvm_vblk_pwrite(lv->vblk, buf, stripe_nbytes,
+					      lv->wpos);
+			load_lat_add(&wlats[tid - 1], nvm_cli_ns() - t_cmd,
+				     &seed);
+			if (res < 0) {		// Skip the stripe
+				__atomic_fetch_add(&nerr, 1, __ATOMIC_RELAXED);
+			} else {
+				__atomic_fetch_add(&nwrites, 1,
+						   __ATOMIC_RELAXED);
+				__atomic_fetch_add(&wbytes, stripe_nbytes,
+						   __ATOMIC_RELAXED);
+			}
+			__atomic_store_n(&lv->wpos, lv->wpos + stripe_nbytes,
+					 __ATOMIC_RELEASE);
+			pthread_mutex_unlock(&lv->lock);
+		}
+
+		// Thread 0 reports live throughput and decides when to stop
+		for (size_t t_last = t_bgn, last = 0; !tid;) {
+			const struct timespec nap = {0, 10000000};
+			size_t now, cur;
+
+			nanosleep(&nap, NULL);
+
+			now = nvm_cli_ns();
+			cur = __atomic_load_n(&rbytes, __ATOMIC_RELAXED) +
+			      __atomic_load_n(&wbytes, __ATOMIC_RELAXED);
+
+			if (now - t_last >= t_ival) {
+				printf("# t(%.1lf), mbs(%.2lf), nerr(%lu)\n",
+				       (now - t_bgn) / 1000000000.0,
+				       ((cur - last) / (double)(1 << 20)) /
+				       ((now - t_last) / 1000000000.0),
+				       __atomic_load_n(&nerr,
+						       __ATOMIC_RELAXED));
+				fflush(stdout);
+				t_last = now;
+				last = cur;
+			}
+
+			if ((t_end && now - t_bgn >= t_end) ||
+			    (load.nbytes && cur >= load.nbytes))
+				__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+			if (__atomic_load_n(&stop, __ATOMIC_RELAXED))
+				break;
+		}
+
+		for (int i = 0; i < nvblks; ++i)
+			nvm_vblk_free(rvblks[i]);
+		free(buf);
+	}
+	t_bgn = nvm_cli_ns() - t_bgn;
+
+	printf("{\"workload\": \"load\", \"nvblks\": %d, \"qd\": %d, ",
+	       nvblks, load.qd);
+	printf("\"ratio\": %d, \"elapsed\": %.6lf, ", load.ratio,
+	       t_bgn / 1000000000.0);
+	printf("\"nreads\": %lu, \"nwrites\": %lu, \"nerases\": %lu, ",
+	       nreads, nwrites, nerases);
+	printf("\"nerr\": %lu, \"mbs\": %.2lf,\n ", nerr,
+	       ((rbytes + wbytes) / (double)(1 << 20)) /
+	       (t_bgn / 1000000000.0));
+	load_lat_pr("read", rlats, load.qd);
+	printf(",\n ");
+	load_lat_pr("write", wlats, load.qd);
+	printf("}\n");
+
+	for (int i = 0; i < load.qd; ++i) {
+		free(rlats[i].samples);
+		free(wlats[i].samples);
+	}
+
+	return nerr != 0;
+}
+
+static int load_vblks_run(NVM_CLI_CMD_ARGS *args, LOAD_VBLK vblks[],
+			  int nvblks)
+{
+	size_t stripe_nbytes = 0;
+	int err = 0;
+
+	for (int i = 0; i < nvblks; ++i) {
+		if (!vblks[i].vblk) {
+			perror("nvm_vblk_alloc");
+			err = 1;
+			break;
+		}
+		pthread_mutex_init(&vblks[i].lock, NULL);
+		vblks[i].nbytes = nvm_vblk_get_nbytes(vblks[i].vblk);
+		vblks[i].wpos = 0;
+
+		stripe_nbytes = nvm_vblk_get_naddrs(vblks[i].vblk) *
+				args->geo->vpg_nbytes;
+
+		if (nvm_vblk_erase(vblks[i].vblk) < 0) {
+			perror("nvm_vblk_erase");
+			err = 1;
+			break;
+		}
+	}
+
+	if (!err)
+		err = load_run(args, vblks, nvblks, stripe_nbytes);
+
+	for (int i = 0; i < nvblks; ++i)
+		nvm_vblk_free(vblks[i].vblk);
+
+	return err;
+}
+
+/*
+ * Load each of the given block addresses as a vblk of its own
+ */
+int set_load(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	LOAD_VBLK vblks[args->naddrs];
+
+	load_conf_fill();
+
+	memset(vblks, 0, sizeof(vblks));
+	for (int i = 0; i < args->naddrs; ++i)
+		vblks[i].vblk = nvm_vblk_alloc(args->dev, &args->addrs[i], 1);
+
+	return load_vblks_run(args, vblks, args->naddrs);
+}
+
+/*
+ * Load NVM_CLI_LOAD_NVBLKS lines, at blocks blk, blk + 1, ...
+ */
+int line_load(NVM_CLI_CMD_ARGS *args, int flags)
+{
+	const struct nvm_addr bgn = args->addrs[0], end = args->addrs[1];
+	LOAD_VBLK *vblks;
+	int err;
+
+	load_conf_fill();
+
+	vblks = calloc(load.nvblks, sizeof(*vblks));
+	if (!vblks) {
+		perror("calloc");
+		return 1;
+	}
+	for (int i = 0; i < load.nvblks; ++i)
+		vblks[i].vblk = nvm_vblk_alloc_line(args->dev, bgn.g.ch,
+						    end.g.ch, bgn.g.lun,
+						    end.g.lun, bgn.g.blk + i);
+
+	err = load_vblks_run(args, vblks, load.nvblks);
+
+	free(vblks);
+
+	return err;
+}
+
 //
 // Remaining code is CLI boiler-plate
 //
 static NVM_CLI_CMD cmds[] = {
 	{"erase", erase, NVM_CLI_ARG_ADDRLIST, 0x0},
-	{"read", read, NVM_CLI_ARG_ADDRLIST, 0x0},
-	{"write", write, NVM_CLI_ARG_ADDRLIST, 0x0},
+	{"read", cmd_read, NVM_CLI_ARG_ADDRLIST, 0x0},
+	{"write", cmd_write, NVM_CLI_ARG_ADDRLIST, 0x0},
 	{"pad", pad, NVM_CLI_ARG_ADDRLIST, 0x0},
 
 	{"set_erase", set_erase, NVM_CLI_ARG_ADDRLIST, 0x0},
@@ -543,6 +1217,10 @@ static NVM_CLI_CMD cmds[] = {
 	{"line_write", line_write, NVM_CLI_ARG_LINE, 0x0},
 	{"line_pad", line_pad, NVM_CLI_ARG_LINE, 0x0},
 	{"line_to_file", line_to_file, NVM_CLI_ARG_LINE, 0x0},
+	{"file_to_line", file_to_line, NVM_CLI_ARG_LINE, 0x0},
+
+	{"set_load", set_load, NVM_CLI_ARG_ADDRLIST, 0x0},
+	{"line_load", line_load, NVM_CLI_ARG_LINE, 0x0},
 };
 
 static int ncmds = sizeof(cmds) / sizeof(cmds[0]);
@@ -558,6 +1236,11 @@ int main(int argc, char **argv)
 	} else {
 		nvm_cli_usage(argv[0], "NVM Virtual Block (nvm_vblk_*)", cmds,
 			      ncmds);
+		printf("\nLoad is tuned via ENV(NVM_CLI_LOAD_NVBLKS, ");
+		printf("NVM_CLI_LOAD_QD, NVM_CLI_LOAD_RATIO, NVM_CLI_LOAD_SECS, ");
+		printf("NVM_CLI_LOAD_NBYTES, NVM_CLI_LOAD_IVAL)\n");
+		printf("File transfers via ENV(NVM_CLI_FILE, ");
+		printf("NVM_CLI_PIPE_DEPTH, NVM_CLI_PIPE_NVPGS)\n");
 		ret = 1;
 	}
 	nvm_cli_teardown(cmd);
@@ -84,7 +84,21 @@ struct nvm_vblk;
 enum meta_mode {
 	NVM_META_MODE_NONE = 0x0,
 	NVM_META_MODE_ALPHA = 0x1,
-	NVM_META_MODE_CONST = 0x2
+	NVM_META_MODE_CONST = 0x2,
+	NVM_META_MODE_CRC = 0x3,	///< CRC32C of each sector in its OOB
+	NVM_META_MODE_CRC_SEQ = 0x4	///< As above, plus a write sequence number
+};
+
+/**
+ * Leading bytes of the OOB area of a sector in NVM_META_MODE_CRC and
+ * NVM_META_MODE_CRC_SEQ, the checksum covers the sector data followed by
+ * `seq`, host byte-order
+ *
+ * @see nvm_dev_set_meta_mode
+ */
+struct nvm_meta_crc {
+	uint32_t crc;	///< CRC32C of the sector data and seq
+	uint32_t seq;	///< Sequence number of the write command, 0 in CRC mode
 };
 
 enum nvm_bounds {
@@ -138,6 +152,21 @@ struct nvm_addr {
 	};
 };
 
+/**
+ * Outcome of the last nvm_vblk_pread / nvm_vblk_pwrite on a virtual block
+ *
+ * When the command fails, `nbytes` counts the bytes transferred and `failed`
+ * lists the sectors which did not transfer, after any retries configured via
+ * nvm_dev_set_retry. Sectors are listed in no particular order.
+ *
+ * @see nvm_vblk_get_ret
+ */
+struct nvm_vblk_ret {
+	size_t nbytes;			///< Number of bytes transferred
+	int nfailed;			///< Number of failed sectors
+	struct nvm_addr *failed;	///< Addresses of the failed sectors
+};
+
 /**
  * Representation of device and virtual block geometry
  *
@@ -185,6 +214,181 @@ struct nvm_bbt {
 	uint64_t nblks;	///< Length of the bad block array
 };
 
+/**
+ * Progress and outcome of nvm_dev_erase_range, counting blocks by channel,
+ * LUN, and block index, i.e. all planes of a block as one. The counters are
+ * updated as erases complete and may be read by another thread to follow the
+ * progress.
+ *
+ * @see nvm_dev_erase_range
+ */
+struct nvm_erase_stat {
+	uint64_t nblks;		///< Number of blocks in the range
+	uint64_t nerased;	///< Number of blocks erased
+	uint64_t nskipped;	///< Number of blocks skipped as bad in the bbt
+	uint64_t nfailed;	///< Number of blocks which failed to erase
+	struct nvm_addr *failed;///< Addresses of failed blocks, may be NULL
+	uint64_t failed_max;	///< Length of `failed`, failures beyond are dropped
+};
+
+/**
+ * Layouts of striped LBA I/O, ordering the dimensions of the geometry from
+ * fastest to slowest varying beyond a virtual page. NVM_LBA_LAYOUT_SEQ does
+ * not stripe, a LUN is filled before moving on to the next.
+ *
+ * @see nvm_dev_set_lba_layout and nvm_lba_striped_pread
+ */
+enum nvm_lba_layout {
+	NVM_LBA_LAYOUT_CHANNEL = 0x0,	///< channels, luns, pages, blocks
+	NVM_LBA_LAYOUT_LUN = 0x1,	///< luns, channels, pages, blocks
+	NVM_LBA_LAYOUT_SEQ = 0x2	///< pages, blocks, luns, channels, sequential
+};
+
+/**
+ * Units enumerated by nvm_addr_iter
+ */
+enum nvm_addr_iter_unit {
+	NVM_ADDR_ITER_SECTOR = 0x0,	///< Every sector of every plane
+	NVM_ADDR_ITER_PAGE = 0x1,	///< Every page of every plane, sector 0
+	NVM_ADDR_ITER_BLOCK = 0x2	///< Every block of every plane, page 0
+};
+
+/**
+ * Orders of enumeration by nvm_addr_iter, listing the dimensions from slowest
+ * to fastest varying, planes and sectors are always the innermost
+ */
+enum nvm_addr_iter_order {
+	NVM_ADDR_ITER_ORDER_GEO = 0x0,		///< channels, luns, blocks, pages
+	NVM_ADDR_ITER_ORDER_STRIPE = 0x1	///< blocks, pages, luns, channels
+};
+
+/**
+ * Opaque iterator over the addresses of a region of a device
+ *
+ * @see nvm_addr_iter_alloc, nvm_addr_iter_next, and nvm_addr_iter_free
+ *
+ * @struct nvm_addr_iter
+ */
+struct nvm_addr_iter;
+
+/**
+ * Opaque builder of multi-plane vectored commands from an unordered set of
+ * addresses
+ *
+ * @see nvm_cmd_builder_alloc, nvm_cmd_builder_add, and nvm_cmd_builder_write
+ *
+ * @struct nvm_cmd_builder
+ */
+struct nvm_cmd_builder;
+
+/**
+ * Opaque append-only writer over a range of lines
+ *
+ * @see nvm_stream_open, nvm_stream_append, and nvm_stream_close
+ *
+ * @struct nvm_stream
+ */
+struct nvm_stream;
+
+/**
+ * Opaque handle for asynchronous LBA I/O
+ *
+ * @see nvm_lba_ctx_create, nvm_lba_submit, and nvm_lba_reap
+ */
+struct nvm_lba_ctx;
+
+#define NVM_LBA_CTX_SQPOLL 0x1	///< Let a kernel thread poll for submissions
+
+/**
+ * Operations of asynchronous LBA commands
+ */
+enum nvm_lba_op {
+	NVM_LBA_OP_READ = 0x0,
+	NVM_LBA_OP_WRITE = 0x1
+};
+
+/**
+ * Completion of an asynchronous LBA command
+ */
+struct nvm_lba_cpl {
+	void *opaque;	///< Opaque pointer given to nvm_lba_submit
+	ssize_t res;	///< Number of bytes transferred or negative errno
+};
+
+/**
+ * Commands hit by an error injected on an emulated device
+ *
+ * @see nvm_emu_inject
+ */
+enum nvm_emu_err {
+	NVM_EMU_ERR_ERASE = 0x1,	///< Fail erase of the block
+	NVM_EMU_ERR_WRITE = 0x2,	///< Fail write of the sector
+	NVM_EMU_ERR_READ = 0x4		///< Fail read of the sector
+};
+
+/**
+ * Counters of the per-LUN scheduler
+ *
+ * @see nvm_sched_enable and nvm_sched_get_stat
+ */
+struct nvm_sched_stat {
+	uint64_t ncmds;		///< Number of commands admitted
+	uint64_t nwaits;	///< Number of LUN slots which had to be waited for
+	uint64_t npromotions;	///< Number of aged programs/erases passing reads
+	int max_inflight;	///< Highest number of commands in flight on a LUN
+};
+
+/**
+ * Commands which can be enqueued on a submission ring
+ *
+ * @see nvm_ring_submit
+ */
+enum nvm_ring_op {
+	NVM_RING_OP_ERASE = 0x0,	///< As nvm_addr_erase, `data` is ignored
+	NVM_RING_OP_WRITE = 0x1,	///< As nvm_addr_write
+	NVM_RING_OP_READ = 0x2		///< As nvm_addr_read
+};
+
+/**
+ * Descriptor of a command enqueued on a submission ring
+ *
+ * The descriptor, its addresses and buffers are owned by the library from
+ * nvm_ring_submit until the command completes, as observed via nvm_ring_poll,
+ * nvm_ring_wait or the eventfd `efd`.
+ *
+ * @see nvm_ring_submit
+ */
+struct nvm_ring_cmd {
+	int op;			///< One of enum nvm_ring_op
+	struct nvm_addr *addrs;	///< Addresses of the command
+	int naddrs;		///< Number of addresses
+	void *data;		///< Data buffer, as for nvm_addr_write/read
+	void *meta;		///< Meta buffer, as for nvm_addr_write/read
+	uint16_t flags;		///< Plane-mode flags
+	int efd;		///< eventfd signaled on completion, -1 for none
+	void *opaque;		///< Left untouched by the library
+	struct nvm_ret ret;	///< Completion result and status
+	ssize_t res;		///< 0 on success, negative errno on error
+	uint32_t done;		///< Completion word, internal to the library
+};
+
+/**
+ * Representation of a traced command
+ *
+ * @see nvm_trace_enable, nvm_trace_dump, and nvm_trace_load
+ */
+struct nvm_trace_rec {
+	uint64_t ts;		///< Submission time in nsec (CLOCK_MONOTONIC)
+	uint64_t dur;		///< Duration of the command in nsec
+	uint64_t ppa;		///< First address of the command, generic-format
+	uint64_t status;	///< NVMe command status / completion bits
+	uint32_t result;	///< NVMe command error codes
+	uint32_t tid;		///< Id of the submitting thread
+	uint16_t opcode;	///< Command opcode
+	uint16_t naddrs;	///< Number of addresses in the command
+	int32_t err;		///< Return value of the submission
+};
+
 /**
  * @returns the "major" version of the library
  */
@@ -232,6 +436,126 @@ ssize_t nvm_lba_pread(struct nvm_dev *dev, void *buf, size_t count,
 ssize_t nvm_lba_pwrite(struct nvm_dev *dev, const void *buf, size_t count,
 		       off_t offset);
 
+/**
+ * Read `count` bytes at the given logical `offset` in the striped layout of
+ * the device into `buf`
+ *
+ * The request is split into virtual pages, these are grouped per LUN and each
+ * LUN is read with vectored commands, the LUNs concurrently.
+ *
+ * @param dev Handle to the device
+ * @param buf Buffer to read into
+ * @param count Number of bytes to read, a multiple of the virtual page size
+ * @param offset Logical offset, a multiple of the virtual page size
+ * @returns On success, `count` is returned. On error, -1 is returned and
+ * `errno` set to indicate the error.
+ */
+ssize_t nvm_lba_striped_pread(struct nvm_dev *dev, void *buf, size_t count,
+			      off_t offset);
+
+/**
+ * Write `count` bytes from `buf` at the given logical `offset` in the striped
+ * layout of the device
+ *
+ * As with nvm_addr_write, the caller is responsible for erasing blocks and
+ * writing the pages of a block in order. Writing the logical space in order
+ * does so for all layouts.
+ *
+ * @param dev Handle to the device
+ * @param buf Buffer to write from
+ * @param count Number of bytes to write, a multiple of the virtual page size
+ * @param offset Logical offset, a multiple of the virtual page size
+ * @returns On success, `count` is returned. On error, -1 is returned and
+ * `errno` set to indicate the error.
+ */
+ssize_t nvm_lba_striped_pwrite(struct nvm_dev *dev, const void *buf,
+			       size_t count, off_t offset);
+
+/**
+ * Convert a logical offset in the striped layout of the device to an address
+ *
+ * @param dev Handle to the device
+ * @param offset Logical offset
+ * @returns Address of the sector at the given offset
+ */
+struct nvm_addr nvm_lba_striped_off2gen(struct nvm_dev *dev, size_t offset);
+
+/**
+ * Create a context for asynchronous LBA I/O with at most `depth` commands in
+ * flight
+ *
+ * The context is built on io_uring with the device fd registered as a fixed
+ * file. On backends which do not do LBA I/O on a file descriptor, e.g. the
+ * emulator, commands are executed synchronously, via the backend, by
+ * nvm_lba_reap. A context is not thread-safe, use a context per thread.
+ *
+ * @param dev Handle to the device
+ * @param depth Maximum number of commands in flight
+ * @param flags Zero or NVM_LBA_CTX_SQPOLL
+ * @returns On success, a context. On error, NULL is returned and `errno` set
+ * to indicate the error, ENOSYS when io_uring is not available.
+ */
+struct nvm_lba_ctx *nvm_lba_ctx_create(struct nvm_dev *dev, int depth,
+				       int flags);
+
+/**
+ * Destroy the given context, commands in flight are abandoned
+ *
+ * @param ctx The context to destroy
+ */
+void nvm_lba_ctx_destroy(struct nvm_lba_ctx *ctx);
+
+/**
+ * Register buffers with the context, commands with data within a registered
+ * buffer avoid mapping the pages on every submission
+ *
+ * @param ctx The context to register buffers with
+ * @param bufs Array of `nbufs` buffers
+ * @param nbytes Array of `nbufs` buffer sizes
+ * @param nbufs Number of buffers
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_lba_ctx_reg_bufs(struct nvm_lba_ctx *ctx, void *bufs[],
+			 size_t nbytes[], int nbufs);
+
+/**
+ * @returns Number of commands submitted and not yet reaped
+ */
+int nvm_lba_ctx_get_ninflight(struct nvm_lba_ctx *ctx);
+
+/**
+ * Queue a read or write of `count` bytes at `offset`, the command is passed to
+ * the kernel by the next call to nvm_lba_reap
+ *
+ * Alignment rules are those of nvm_lba_pread / nvm_lba_pwrite.
+ *
+ * @param ctx The context to submit to
+ * @param op NVM_LBA_OP_READ or NVM_LBA_OP_WRITE
+ * @param buf Buffer to transfer from / to
+ * @param count Number of bytes to transfer
+ * @param offset Offset in bytes on the device
+ * @param opaque Pointer returned in the completion of the command
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, EBUSY when `depth` commands are in flight.
+ */
+int nvm_lba_submit(struct nvm_lba_ctx *ctx, int op, void *buf, size_t count,
+		   off_t offset, void *opaque);
+
+/**
+ * Pass queued commands to the kernel and reap up to `ncpls` completions,
+ * waiting for at least `min` of them
+ *
+ * @param ctx The context to reap from
+ * @param cpls Array to store completions in
+ * @param ncpls Length of `cpls`
+ * @param min Minimum number of completions to wait for
+ * @returns On success, the number of completions stored in `cpls`. On error,
+ * -1 is returned and `errno` set to indicate the error.
+ */
+int nvm_lba_reap(struct nvm_lba_ctx *ctx, struct nvm_lba_cpl *cpls,
+		 int ncpls, int min);
+
 /**
  * Prints a humanly readable representation the given `struct nvm_ret`
  *
@@ -342,6 +666,327 @@ void nvm_bbt_pr(const struct nvm_bbt *bbt);
  */
 void nvm_bbt_state_pr(int state);
 
+/**
+ * Enable tracing of commands submitted via the nvm_addr_* interface
+ *
+ * @note
+ * Tracing is process-wide, each submitting thread records into its own
+ * lock-free ring of `nrecs` records, rounded up to a power of two. When a ring
+ * is full, the oldest records are overwritten. The capacity of a ring is fixed
+ * by the first command a thread submits with tracing enabled. When a thread
+ * exits, its ring is kept for nvm_trace_dump until a thread started later takes
+ * it over, thus rings are bounded by the number of concurrently tracing threads.
+ *
+ * @param nrecs Number of records to keep per thread
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_trace_enable(size_t nrecs);
+
+/**
+ * Disable tracing, records already captured are kept for nvm_trace_dump
+ */
+void nvm_trace_disable(void);
+
+/**
+ * Write the records of all threads, ordered by submission time, to the binary
+ * trace-file at `path`
+ *
+ * @note
+ * Records overwritten while dumping are left out, and so is the oldest record
+ * of a full ring since its slot is the next one the owning thread fills.
+ *
+ * @param path Path of the trace-file to write
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_trace_dump(const char *path);
+
+/**
+ * Read the records from a trace-file written by nvm_trace_dump
+ *
+ * @param path Path of the trace-file to read
+ * @param nrecs Pointer to store the number of records read
+ * @returns On success, an array of `nrecs` records which the caller must free.
+ * On error, NULL is returned and `errno` set to indicate the error.
+ */
+struct nvm_trace_rec *nvm_trace_load(const char *path, size_t *nrecs);
+
+/**
+ * Prints a humanly readable representation of the given trace record
+ *
+ * @param rec The trace record to print
+ */
+void nvm_trace_rec_pr(const struct nvm_trace_rec *rec);
+
+/**
+ * Inject an error on an emulated device
+ *
+ * Erase errors hit the block of the given address, read and write errors hit
+ * the sector. A failed write does not program the sector.
+ *
+ * @param dev Handle to an emulated device
+ * @param addr Address to fail commands on
+ * @param ops Bitwise OR of the enum nvm_emu_err commands to fail
+ * @param count Number of commands to fail, negative to fail all
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_emu_inject(struct nvm_dev *dev, struct nvm_addr addr, int ops,
+		   int count);
+
+/**
+ * Clear all errors injected on an emulated device
+ *
+ * @param dev Handle to an emulated device
+ */
+void nvm_emu_inject_clear(struct nvm_dev *dev);
+
+/**
+ * Allocate a builder of commands for the given device
+ *
+ * Addresses are added in any order, nvm_cmd_builder_erase/write/read then
+ * sort them, fill in the plane and sector siblings required by the plane-mode
+ * of the device (see nvm_dev_get_pmode) for erase and read, and issue the
+ * fewest commands within the `*_naddrs_max` of the device.
+ *
+ * @param dev Handle to the device
+ * @returns On success, a builder without addresses is returned. On error,
+ * NULL is returned and `errno` set to indicate the error.
+ */
+struct nvm_cmd_builder *nvm_cmd_builder_alloc(struct nvm_dev *dev);
+
+/**
+ * Free the given builder
+ */
+void nvm_cmd_builder_free(struct nvm_cmd_builder *builder);
+
+/**
+ * Remove all addresses from the given builder
+ */
+void nvm_cmd_builder_reset(struct nvm_cmd_builder *builder);
+
+/**
+ * Returns the number of addresses added to the given builder
+ */
+int nvm_cmd_builder_get_naddrs(struct nvm_cmd_builder *builder);
+
+/**
+ * Add an address to the given builder
+ *
+ * For erase, addresses are of blocks on a plane, pages and sectors are
+ * ignored. For write and read, addresses are of sectors and `buf` points to a
+ * sector of data to write from or read into.
+ *
+ * @param builder The builder to add to
+ * @param addr Address in generic-format
+ * @param buf Buffer of geo.sector_nbytes, NULL for erase
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_cmd_builder_add(struct nvm_cmd_builder *builder, struct nvm_addr addr,
+			void *buf);
+
+/**
+ * Erase the blocks added to the given builder, in plane-mode the sibling
+ * planes of each block are erased as well
+ *
+ * @param builder The builder of the commands
+ * @param ret Pointer to structure in which to store the result of a failed
+ * command
+ * @returns On success, the number of commands issued. On error, -1 and `errno`
+ * set to indicate the error.
+ */
+ssize_t nvm_cmd_builder_erase(struct nvm_cmd_builder *builder,
+			      struct nvm_ret *ret);
+
+/**
+ * Write the sectors added to the given builder, in ascending address order
+ *
+ * The sectors must cover whole pages, and in plane-mode the pages of all
+ * planes, since a page cannot be programmed again until the block is erased.
+ * Otherwise no command is issued and `errno` is set to EINVAL.
+ *
+ * @param builder The builder of the commands
+ * @param ret Pointer to structure in which to store the result of a failed
+ * command
+ * @returns On success, the number of commands issued. On error, -1 and `errno`
+ * set to indicate the error.
+ */
+ssize_t nvm_cmd_builder_write(struct nvm_cmd_builder *builder,
+			      struct nvm_ret *ret);
+
+/**
+ * Read the sectors added to the given builder into their buffers
+ *
+ * In plane-mode, sectors of a page which are not added are read as well and
+ * discarded.
+ *
+ * @param builder The builder of the commands
+ * @param ret Pointer to structure in which to store the result of a failed
+ * command
+ * @returns On success, the number of commands issued. On error, -1 and `errno`
+ * set to indicate the error.
+ */
+ssize_t nvm_cmd_builder_read(struct nvm_cmd_builder *builder,
+			     struct nvm_ret *ret);
+
+/**
+ * Open an append-only writer over the lines spanning the given channels and
+ * LUNs, one line per block in [blk_bgn, blk_end]
+ *
+ * Lines are written in ascending block order. A background thread erases up to
+ * `nahead` lines ahead of the line being written, such that appends do not
+ * wait for erases at line boundaries. Lines which fail to erase, e.g. due to
+ * a bad block, are skipped.
+ *
+ * @param dev Handle to the device
+ * @param ch_bgn First channel of the lines
+ * @param ch_end Last channel of the lines
+ * @param lun_bgn First LUN of the lines
+ * @param lun_end Last LUN of the lines
+ * @param blk_bgn Block of the first line
+ * @param blk_end Block of the last line
+ * @param nahead Number of lines to erase ahead, at least one
+ * @returns On success, an opaque pointer to the stream is returned. On error,
+ * NULL and `errno` set to indicate the error.
+ */
+struct nvm_stream *nvm_stream_open(struct nvm_dev *dev, int ch_bgn,
+				   int ch_end, int lun_bgn, int lun_end,
+				   int blk_bgn, int blk_end, int nahead);
+
+/**
+ * Append `count` bytes from `buf` to the stream, rolling over to the next line
+ * when the current line is full
+ *
+ * @param stream The stream to append to
+ * @param buf Buffer to write from
+ * @param count Number of bytes to write, a multiple of geo.vpg_nbytes
+ * @param addr When not NULL, set to the address of the first virtual page
+ * written
+ * @returns On success, `count` is returned. On error, -1 is returned and
+ * `errno` set to indicate the error, ENOSPC when the lines are exhausted in
+ * which case the part of `buf` which did fit remains written.
+ */
+ssize_t nvm_stream_append(struct nvm_stream *stream, const void *buf,
+			  size_t count, struct nvm_addr *addr);
+
+/**
+ * Close the stream, padding the line being written and stopping the
+ * background erase
+ *
+ * @param stream The stream to close
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_stream_close(struct nvm_stream *stream);
+
+/**
+ * Enable per-LUN scheduling of the commands issued via nvm_addr_* and thereby
+ * nvm_vblk_* and nvm_lba_striped_* on the given device
+ *
+ * At most `depth` commands are in flight on a LUN, further commands wait and
+ * are admitted with reads ahead of programs and erases. A program or erase
+ * which has waited for `aging_us` microseconds is admitted before any read,
+ * bounding the starvation of writers. A command addressing multiple LUNs waits
+ * for a slot on each of them, in ascending order.
+ *
+ * @param dev Handle to the device
+ * @param depth Maximum number of commands in flight per LUN
+ * @param aging_us Wait in microseconds after which programs and erases are
+ * promoted
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_sched_enable(struct nvm_dev *dev, int depth, int aging_us);
+
+/**
+ * Disable per-LUN scheduling on the given device
+ *
+ * Commands issued from here on are not scheduled, the call returns once the
+ * commands holding or waiting for a slot have completed.
+ *
+ * @param dev Handle to the device
+ */
+void nvm_sched_disable(struct nvm_dev *dev);
+
+/**
+ * Obtain the counters of the scheduler of the given device
+ *
+ * @param dev Handle to the device
+ * @param stat Counters are written here
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_sched_get_stat(struct nvm_dev *dev, struct nvm_sched_stat *stat);
+
+/**
+ * Prints a human readable representation of the given scheduler counters
+ */
+void nvm_sched_stat_pr(const struct nvm_sched_stat *stat);
+
+/**
+ * Enable a submission ring on the given device, drained by `nsubmitters`
+ * library threads issuing the commands via nvm_addr_*
+ *
+ * Any number of application threads may enqueue commands on the ring without
+ * locking, decoupling the number of application threads from the number of
+ * commands in flight on the device, which is at most `nsubmitters`.
+ *
+ * @param dev Handle to the device
+ * @param nentries Capacity of the ring, rounded up to a power of two
+ * @param nsubmitters Number of submitter threads
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_ring_enable(struct nvm_dev *dev, int nentries, int nsubmitters);
+
+/**
+ * Complete the commands on the submission ring of the given device, then
+ * stop its submitters and free it
+ *
+ * @note Must not be called while threads are submitting to the ring
+ *
+ * @param dev Handle to the device
+ */
+void nvm_ring_disable(struct nvm_dev *dev);
+
+/**
+ * Enqueue a command on the submission ring of the given device, without
+ * blocking
+ *
+ * @param dev Handle to the device
+ * @param cmd The command to enqueue, see struct nvm_ring_cmd
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error, EAGAIN when the ring is full.
+ */
+int nvm_ring_submit(struct nvm_dev *dev, struct nvm_ring_cmd *cmd);
+
+/**
+ * Returns 1 when the given submitted command has completed, 0 otherwise
+ */
+int nvm_ring_poll(struct nvm_ring_cmd *cmd);
+
+/**
+ * Wait for the given submitted command to complete
+ *
+ * @param cmd The command to wait for
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to the error of the command.
+ */
+int nvm_ring_wait(struct nvm_ring_cmd *cmd);
+
+/**
+ * Compute the CRC32C (Castagnoli) of the given buffer, using the SSE4.2 or
+ * ARMv8 CRC instructions when available
+ *
+ * @param crc CRC of the preceding data, 0 for the first buffer
+ * @param buf The buffer to checksum
+ * @param len Length of the buffer in bytes
+ * @returns The CRC32C of the data so far
+ */
+uint32_t nvm_crc32c(uint32_t crc, const void *buf, size_t len);
+
 /**
  * Prints human readable representation of the given geometry
  */
@@ -350,6 +995,23 @@ void nvm_geo_pr(const struct nvm_geo *geo);
 /**
  * Creates a handle to given device path
  *
+ * Paths prefixed with "/emu/", e.g. "/emu/nvme0n1", open an emulated device.
+ * The emulator enforces erase-before-write and in-order programming of the
+ * sectors in a block, stores out-of-bound metadata and bad-block-tables, and
+ * fails reads of unwritten sectors. It is configured via the environment:
+ *
+ * NVM_EMU_GEO="nchannels,nluns,nplanes,nblocks,npages,nsectors,sector_nbytes,
+ * meta_nbytes", defaults to "2,4,2,64,32,4,4096,16"
+ *
+ * NVM_EMU_FMT="0x380830082808001010102008", address format as in sysfs,
+ * defaults to the fields of the geometry packed from sectors to channels
+ *
+ * NVM_EMU_DIR="/tmp", persist state in a sparse file named after the device
+ * in the given directory, by default state lives in memory until closed
+ *
+ * The I/O backend is selected by the device path, NVM_DEV_BE="ioctl" or
+ * NVM_DEV_BE="emu" overrides the selection.
+ *
  * @param dev_path Path of the device to open e.g. "/dev/nvme0n1"
  *
  * @returns A handle to the device
@@ -370,6 +1032,30 @@ void nvm_dev_close(struct nvm_dev *dev);
  */
 void nvm_dev_pr(struct nvm_dev *dev);
 
+/**
+ * Returns the name of the I/O backend of the given device e.g. "ioctl"
+ *
+ * @param dev The device to obtain the backend name for
+ */
+const char *nvm_dev_get_be_name(struct nvm_dev *dev);
+
+/**
+ * Returns the layout of striped LBA I/O on the given device
+ *
+ * @param dev The device to obtain the layout for
+ */
+int nvm_dev_get_lba_layout(struct nvm_dev *dev);
+
+/**
+ * Sets the layout of striped LBA I/O on the given device
+ *
+ * @param dev The device to set the layout for
+ * @param layout One of enum nvm_lba_layout
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_dev_set_lba_layout(struct nvm_dev *dev, int layout);
+
 /**
  * Returns the default plane_mode of the given device
  *
@@ -379,8 +1065,63 @@ void nvm_dev_pr(struct nvm_dev *dev);
 int nvm_dev_get_pmode(struct nvm_dev *dev);
 
 int nvm_dev_get_meta_mode(struct nvm_dev *dev);
+
+/**
+ * Sets the meta_mode of the given device
+ *
+ * In NVM_META_MODE_CRC and NVM_META_MODE_CRC_SEQ the leading bytes of the OOB
+ * area of each sector hold a struct nvm_meta_crc. It is computed by
+ * nvm_addr_write and verified by nvm_addr_read, and thereby by all writes and
+ * reads built upon them. Metadata given by the caller fills the remainder of
+ * the OOB area. A read of a sector failing verification fails with `errno`
+ * set to EBADMSG, and the bits of the failed sectors set in `ret->status`.
+ *
+ * @param dev The device to set the meta_mode for
+ * @param meta_mode One of enum meta_mode
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
 int nvm_dev_set_meta_mode(struct nvm_dev *dev, int meta_mode);
 
+/**
+ * Set the retry policy of vectored commands on the given device
+ *
+ * When an erase or read command fails, only the addresses flagged in the
+ * completion status are re-issued, up to `nretries` times, waiting
+ * `backoff_us` microseconds before the first attempt and doubling the wait
+ * for every following attempt. Writes are never retried, as a failed program
+ * cannot be repeated in place. The status of the returned nvm_ret flags the
+ * addresses which still failed. Retries are disabled by default.
+ *
+ * @param dev The device to set the retry policy for
+ * @param nretries Maximum number of re-issues, 0 to disable retries
+ * @param backoff_us Microseconds to wait before the first re-issue
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_dev_set_retry(struct nvm_dev *dev, int nretries, int backoff_us);
+
+/**
+ * Returns the NUMA node the device is attached to, as read from sysfs on
+ * nvm_dev_open or set via nvm_dev_set_numa_node
+ *
+ * @param dev The device to obtain the NUMA node of
+ * @returns The NUMA node of the device, -1 when unknown
+ */
+int nvm_dev_get_numa_node(struct nvm_dev *dev);
+
+/**
+ * Set the NUMA node on which buffers from nvm_dev_buf_alloc are placed and to
+ * whose CPUs the worker threads of the library bind themselves when doing I/O
+ * on the device
+ *
+ * @param dev The device to set the NUMA node of
+ * @param node The NUMA node to use, -1 to disable NUMA placement
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_dev_set_numa_node(struct nvm_dev *dev, int node);
+
 /**
  * Returns the maximum number of addresses to use when sending erases to device.
  * That is, when invoking nvm_addr_erase.
@@ -488,6 +1229,45 @@ const struct nvm_geo *nvm_dev_get_geo(struct nvm_dev *dev);
  */
 void *nvm_buf_alloc(const struct nvm_geo *geo, size_t nbytes);
 
+/**
+ * Allocate a buffer aligned to match the geometry of the given device, placed
+ * in memory of the NUMA node the device is attached to
+ *
+ * @note
+ * Placement is best-effort, when the node is unknown or the memory policy
+ * cannot be applied the buffer is allocated as with nvm_buf_alloc. Free the
+ * buffer using free().
+ *
+ * @param dev The device to get alignment and placement information from
+ * @param nbytes The size of the allocated buffer in bytes
+ *
+ * @returns A pointer to the allocated memory. On error: NULL is returned and
+ * `errno` set appropriatly
+ */
+void *nvm_dev_buf_alloc(struct nvm_dev *dev, size_t nbytes);
+
+/**
+ * Erase the blocks of the LUNs spanned by `bgn` and `end`, each of the
+ * channel, LUN, and block fields ranging from its value in `bgn` to its value
+ * in `end`, both inclusive, and the fields below block ignored
+ *
+ * Blocks with any plane marked in the bad-block-table are skipped. Each LUN is
+ * erased by its own thread issuing vectored erases of all planes of as many
+ * blocks as the erase_naddrs_max of the device allows, such that every LUN of
+ * the range is kept busy.
+ *
+ * @param dev Handle to the device on which to erase
+ * @param bgn First block of the range
+ * @param end Last block of the range
+ * @param flags Access mode, e.g. nvm_dev_get_pmode
+ * @param stat Filled with the progress and outcome of the erase, may be NULL
+ * @returns On success, the number of blocks erased. On error: returns -1, sets
+ * `errno` accordingly, and fills `stat` with the blocks which failed
+ */
+ssize_t nvm_dev_erase_range(struct nvm_dev *dev, struct nvm_addr bgn,
+			    struct nvm_addr end, uint16_t flags,
+			    struct nvm_erase_stat *stat);
+
 /**
  * Fills `buf` with chars A-Z
  *
@@ -574,6 +1354,215 @@ ssize_t nvm_addr_read(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 		      void *buf, void *meta, uint16_t flags,
 		      struct nvm_ret *ret);
 
+/**
+ * Erase nvm at addresses already encoded in the device format, e.g. by
+ * nvm_addr_gen2dev or nvm_addr_iter_next, skipping the conversion done by
+ * nvm_addr_erase
+ *
+ * @note
+ * The addresses are only checked for bits outside of the fields of the device
+ * address format, not for each field being within the geometry.
+ *
+ * @param dev Handle to the device on which to erase
+ * @param ppas Array of device-format block addresses
+ * @param naddrs Length of array of addresses
+ * @param flags Access mode
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result.
+ * @returns 0 on success. On error: returns -1, sets `errno` accordingly, and
+ *          fills `ret` with lower-level result and status codes
+ */
+ssize_t nvm_addr_erase_dev(struct nvm_dev *dev, const uint64_t ppas[],
+			   int naddrs, uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Write content of buf to nvm at device-format address(es), see
+ * nvm_addr_erase_dev and nvm_addr_write
+ *
+ * @param dev Handle to the device on which to write
+ * @param ppas Array of device-format sector addresses
+ * @param naddrs Length of array of addresses
+ * @param buf The buffer which content to write, of size
+ *            `naddrs * geo.sector_nbytes`
+ * @param meta Buffer containing metadata, of size `naddrs * geo.meta_nbytes`,
+ *             or NULL
+ * @param flags Access mode
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result.
+ * @returns 0 on success. On error: returns -1, sets `errno` accordingly, and
+ *          fills `ret` with lower-level result and status codes
+ */
+ssize_t nvm_addr_write_dev(struct nvm_dev *dev, const uint64_t ppas[],
+			   int naddrs, const void *buf, const void *meta,
+			   uint16_t flags, struct nvm_ret *ret);
+
+/**
+ * Read content of nvm at device-format addresses into buf, see
+ * nvm_addr_erase_dev and nvm_addr_read
+ *
+ * @param dev Handle to the device on which to read
+ * @param ppas Array of device-format sector addresses
+ * @param naddrs Length of array of addresses
+ * @param buf Buffer to store result of read into, of size
+ *            `naddrs * geo.sector_nbytes`
+ * @param meta Buffer to store content of metadata, of size
+ *             `naddrs * geo.meta_nbytes`, or NULL
+ * @param flags Access mode
+ * @param ret Pointer to structure in which to store lower-level status and
+ *            result.
+ * @returns 0 on success. On error: returns -1, sets `errno` accordingly, and
+ *          fills `ret` with lower-level result and status codes
+ */
+ssize_t nvm_addr_read_dev(struct nvm_dev *dev, const uint64_t ppas[],
+			  int naddrs, void *buf, void *meta, uint16_t flags,
+			  struct nvm_ret *ret);
+
+/**
+ * Erase blocks at any number of addresses
+ *
+ * The addresses are split into commands of whole plane-mode units, as given
+ * by `flags`, within the erase_naddrs_max of the device. Commands starting on
+ * different LUNs are issued concurrently, those starting on the same LUN in
+ * order.
+ *
+ * @param dev Handle to the device on which to erase
+ * @param addrs List of memory address, any length
+ * @param naddrs Length of array of memory addresses
+ * @param flags Access mode
+ * @param rets Filled with the result of each command, may be NULL
+ * @param nrets Length of `rets`, results of commands beyond it are dropped
+ * @returns On success, the number of commands issued. On error: returns -1,
+ * sets `errno` accordingly, and fills `rets` with lower-level result and
+ * status codes of each command
+ */
+ssize_t nvm_addr_erase_many(struct nvm_dev *dev, struct nvm_addr addrs[],
+			    int naddrs, uint16_t flags, struct nvm_ret rets[],
+			    int nrets);
+
+/**
+ * Write content of buf to any number of addresses, see nvm_addr_erase_many for
+ * how the addresses are split into commands
+ *
+ * @note
+ * Commands are issued concurrently only when each of them addresses a single
+ * LUN, the order of programs to a block is thereby preserved.
+ *
+ * @param dev Handle to the device on which to write
+ * @param addrs List of memory address, any length
+ * @param naddrs Length of array of memory addresses
+ * @param buf Buffer to write, of size `naddrs * geo.sector_nbytes`
+ * @param meta Buffer of metadata, of size `naddrs * geo.meta_nbytes`, or NULL
+ * @param flags Access mode
+ * @param rets Filled with the result of each command, may be NULL
+ * @param nrets Length of `rets`, results of commands beyond it are dropped
+ * @returns On success, the number of commands issued. On error: returns -1,
+ * sets `errno` accordingly, and fills `rets` with lower-level result and
+ * status codes of each command
+ */
+ssize_t nvm_addr_write_many(struct nvm_dev *dev, struct nvm_addr addrs[],
+			    int naddrs, const void *buf, const void *meta,
+			    uint16_t flags, struct nvm_ret rets[], int nrets);
+
+/**
+ * Read content of any number of addresses into buf, see nvm_addr_erase_many
+ * for how the addresses are split into commands
+ *
+ * @param dev Handle to the device on which to read
+ * @param addrs List of memory address, any length
+ * @param naddrs Length of array of memory addresses
+ * @param buf Buffer to read into, of size `naddrs * geo.sector_nbytes`
+ * @param meta Buffer for metadata, of size `naddrs * geo.meta_nbytes`, or NULL
+ * @param flags Access mode
+ * @param rets Filled with the result of each command, may be NULL
+ * @param nrets Length of `rets`, results of commands beyond it are dropped
+ * @returns On success, the number of commands issued. On error: returns -1,
+ * sets `errno` accordingly, and fills `rets` with lower-level result and
+ * status codes of each command
+ */
+ssize_t nvm_addr_read_many(struct nvm_dev *dev, struct nvm_addr addrs[],
+			   int naddrs, void *buf, void *meta, uint16_t flags,
+			   struct nvm_ret rets[], int nrets);
+
+/**
+ * Copy any number of sectors from `src` to `dst` along with their metadata,
+ * `dst[i]` receiving the content of `src[i]`
+ *
+ * @note
+ * The copy is split into commands as nvm_addr_write_many does, and the read of
+ * a chunk overlaps the program of the one before it. Chunks are programmed in
+ * order, the blocks of `dst` must be erased.
+ *
+ * @param dev Handle to the device on which to copy
+ * @param src List of sector addresses to copy from, any length
+ * @param dst List of sector addresses to copy to, of the same length
+ * @param naddrs Length of `src` and `dst`
+ * @param flags Access mode
+ * @param ret Filled with the result of the first failing command, may be NULL
+ * @returns 0 on success. On error: returns -1, sets `errno` as the first failing
+ * command did, and fills `ret` with lower-level result and status codes
+ */
+ssize_t nvm_addr_copy(struct nvm_dev *dev, struct nvm_addr src[],
+		      struct nvm_addr dst[], int naddrs, uint16_t flags,
+		      struct nvm_ret *ret);
+
+/**
+ * Allocate an iterator over the addresses of the region spanned by `bgn` and
+ * `end`, each field ranging from its value in `bgn` to its value in `end`,
+ * both inclusive
+ *
+ * E.g. a LUN is spanned by the first and last sector of its last block, a line
+ * by varying channels and LUNs over a single block, and the device by the
+ * first and last sector of the geometry.
+ *
+ * With NVM_ADDR_ITER_ORDER_STRIPE consecutive pages are on distinct channels
+ * and then LUNs, such that the chunks returned by nvm_addr_iter_next keep
+ * every LUN of the region busy. With NVM_ADDR_ITER_ORDER_GEO the region is
+ * enumerated one LUN at a time.
+ *
+ * @param dev Handle to the device
+ * @param bgn First address of the region
+ * @param end Last address of the region
+ * @param unit One of enum nvm_addr_iter_unit, fields below it are ignored
+ * @param order One of enum nvm_addr_iter_order
+ * @returns On success, an iterator positioned at `bgn` is returned. On error,
+ * NULL is returned and `errno` set to indicate the error.
+ */
+struct nvm_addr_iter *nvm_addr_iter_alloc(struct nvm_dev *dev,
+					  struct nvm_addr bgn,
+					  struct nvm_addr end, int unit,
+					  int order);
+
+/**
+ * Free the given iterator
+ */
+void nvm_addr_iter_free(struct nvm_addr_iter *iter);
+
+/**
+ * Position the given iterator at the first address of its region
+ */
+void nvm_addr_iter_reset(struct nvm_addr_iter *iter);
+
+/**
+ * Returns the number of addresses in the region of the given iterator
+ */
+size_t nvm_addr_iter_get_naddrs(struct nvm_addr_iter *iter);
+
+/**
+ * Fill the next chunk of addresses of the given iterator
+ *
+ * Chunks hold whole multiples of the planes and sectors of a page when
+ * `naddrs_max` allows, such that each chunk is a valid plane-mode command.
+ *
+ * @param iter The iterator to advance
+ * @param addrs Filled with addresses in generic format, may be NULL
+ * @param ppas Filled with addresses in device format, may be NULL
+ * @param naddrs_max Length of `addrs` and `ppas`, e.g. NVM_NADDR_MAX
+ * @returns On success, the number of addresses filled, 0 once the region is
+ * exhausted. On error, -1 is returned and `errno` set to indicate the error.
+ */
+int nvm_addr_iter_next(struct nvm_addr_iter *iter, struct nvm_addr addrs[],
+		       uint64_t ppas[], int naddrs_max);
+
 /**
  * Checks whether the given address exceeds bounds of the given geometry
  *
@@ -748,6 +1737,24 @@ ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
  */
 ssize_t nvm_vblk_pad(struct nvm_vblk *vblk);
 
+/**
+ * Copy the content of virtual block `src` into the erased virtual block `dst`
+ *
+ * @note
+ * Blocks are copied pairwise, `src` and `dst` must consist of the same number
+ * of blocks on the same device. Only the part of `src` written via
+ * nvm_vblk_write, up to its write position, is copied. A bounded number of
+ * workers copy disjoint sets of blocks via nvm_addr_copy, each in page order
+ * across the LUNs of its blocks.
+ *
+ * @param src The virtual block to copy from
+ * @param dst The virtual block to copy to
+ * @returns On success, the number of bytes copied is returned and the write
+ * position of `dst` is set to that of `src`. On error, -1 is returned and
+ * `errno` set to indicate the error.
+ */
+ssize_t nvm_vblk_copy(struct nvm_vblk *src, struct nvm_vblk *dst);
+
 /**
  * Read from a virtual block
  */
@@ -766,6 +1773,57 @@ ssize_t nvm_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count,
  */
 struct nvm_dev *nvm_vblk_get_dev(struct nvm_vblk *vblk);
 
+/**
+ * Protect the virtual block with XOR parity across its blocks
+ *
+ * With `nparity` set to 1 the last block of the virtual block holds the XOR of
+ * the virtual pages at the same page of the other blocks, a stripe. Writes
+ * compute the parity inline and must be aligned to whole stripes. Reads of a
+ * stripe with a block failing to read are rebuilt from the other blocks of the
+ * stripe. The capacity, see nvm_vblk_get_nbytes, shrinks by one block.
+ *
+ * @note The write and read positions are reset
+ *
+ * @param vblk The virtual block, of at least two blocks, e.g. a line
+ * @param nparity Number of parity blocks, 0 or 1
+ * @returns On success, 0 is returned. On error, -1 is returned and `errno` set
+ * to indicate the error.
+ */
+int nvm_vblk_set_parity(struct nvm_vblk *vblk, int nparity);
+
+/**
+ * Returns the number of parity blocks of the given virtual block
+ */
+int nvm_vblk_get_parity(struct nvm_vblk *vblk);
+
+/**
+ * Read as nvm_vblk_pread from a virtual block with parity, without issuing
+ * commands to block `idx` and rebuilding its data from the other blocks
+ * instead, e.g. to read around a LUN which is busy erasing or programming
+ *
+ * @param vblk The virtual block to read from
+ * @param buf Buffer to read into
+ * @param count Number of bytes to read, aligned to stripes
+ * @param offset Offset to read from, aligned to stripes
+ * @param idx Index of the data block to read around, not the parity block
+ * @returns On success, `count` is returned. On error, -1 is returned and
+ * `errno` set to indicate the error.
+ */
+ssize_t nvm_vblk_pread_around(struct nvm_vblk *vblk, void *buf, size_t count,
+			      size_t offset, int idx);
+
+/**
+ * Retrieve the outcome of the last nvm_vblk_pread / nvm_vblk_pwrite, including
+ * the number of bytes transferred and the addresses of the sectors which
+ * failed, e.g. to remap or rebuild them without re-issuing the whole range
+ *
+ * The returned struct is owned by the virtual block and valid until the next
+ * I/O on it or until it is freed.
+ *
+ * @param vblk The virtual block to retrieve the outcome from
+ */
+const struct nvm_vblk_ret *nvm_vblk_get_ret(struct nvm_vblk *vblk);
+
 /**
  * Retrieve the set of addresses defining the virtual block
  *
@@ -116,6 +116,9 @@
 
 #define NVM_UNIVERSAL_SECT_SH 9
 
+#define NVM_NUMA_NCPUS_MAX 1024
+#define NVM_NUMA_NODES_MAX 1024
+
 /**
  * NVMe command opcodes as defined by LigthNVM specification 1.2
  */
@@ -127,6 +130,36 @@ enum spec12_opcodes {
 	S12_OPC_READ = 0x92
 };
 
+/**
+ * NVMe command completion results as defined by LightNVM specification 1.2
+ */
+enum spec12_rsp {
+	S12_RSP_SUCCESS = 0x0,
+	S12_RSP_ERR_INVALID = 0x2,	///< NVMe generic: Invalid field
+	S12_RSP_ERR_FAILCRC = 0x4004,
+	S12_RSP_ERR_FAILWRITE = 0x40ff,
+	S12_RSP_ERR_FAILECC = 0x4281,
+	S12_RSP_ERR_EMPTYPAGE = 0x42ff,
+	S12_RSP_WARN_HIGHECC = 0x4700
+};
+
+/**
+ * Bad-block-table as returned by the kernel, hack'n'slashed in here...
+ */
+struct krnl_bbt {
+	uint8_t		tblid[4];
+	uint16_t	verid;
+	uint16_t	revid;
+	uint32_t	rvsd1;
+	uint32_t	tblks;
+	uint32_t	tfact;
+	uint32_t	tgrown;
+	uint32_t	tdresv;
+	uint32_t	thresv;
+	uint32_t	rsvd2[8];
+	uint8_t		blk[0];
+};
+
 /**
  * Representation of widths in LBA <-> Physical sector mapping
  *
@@ -134,7 +167,8 @@ enum spec12_opcodes {
  *
  * channels[]luns[]blocks[]pages[]planes[]sectors[] = sector_nbytes
  *
- * Contains the stride in bytes for each dimension of the geometry.
+ * Contains the stride in bytes for each dimension of the geometry, the order
+ * above is NVM_LBA_LAYOUT_SEQ, see nvm_lba_map_init for the others.
  */
 typedef struct nvm_lba_map {
 	size_t channel_nbytes;	///< Number of bytes in a channel
@@ -145,6 +179,62 @@ typedef struct nvm_lba_map {
 	size_t sector_nbytes;	///< Number of bytes in a sector
 } NVM_LBA_MAP;
 
+/**
+ * Divisor with precomputed constants for dividends below 2^32: a shift and
+ * mask when it is a power of two, otherwise the reciprocal ceil(2^64 / d)
+ * with which quotient and remainder are exact via multiplication, see
+ * "Faster Remainder by Direct Computation", Lemire et al.
+ */
+struct nvm_div {
+	uint32_t d;		///< The divisor
+	uint32_t shift;		///< log2(d) when d is a power of two
+	uint64_t mask;		///< d - 1 when d is a power of two, else 0
+	uint64_t mult;		///< ceil(2^64 / d) when d is not a power of two
+};
+
+static inline void nvm_div_init(struct nvm_div *div, uint32_t d)
+{
+	div->d = d ? d : 1;
+	div->shift = 0;
+	div->mask = 0;
+	div->mult = 0;
+
+	if (!(div->d & (div->d - 1))) {
+		while ((1U << div->shift) < div->d)
+			++div->shift;
+		div->mask = div->d - 1;
+		return;
+	}
+
+	div->mult = UINT64_MAX / div->d + 1;
+}
+
+static inline uint32_t nvm_div(const struct nvm_div *div, uint32_t n)
+{
+	if (!div->mult)
+		return n >> div->shift;
+
+	return ((unsigned __int128)div->mult * n) >> 64;
+}
+
+static inline uint32_t nvm_mod(const struct nvm_div *div, uint32_t n)
+{
+	if (!div->mult)
+		return n & div->mask;
+
+	return ((unsigned __int128)(div->mult * n) * div->d) >> 64;
+}
+
+/**
+ * Divisors of the geometry, derived along with it at nvm_dev_open
+ */
+struct nvm_geo_div {
+	struct nvm_div nplanes;
+	struct nvm_div npages;
+	struct nvm_div nsectors;
+	struct nvm_div spage_naddrs;	///< Sectors in a virtual page
+};
+
 /**
  * Encoding descriptor for address formats
  */
@@ -202,12 +292,64 @@ struct nvm_addr_fmt_mask {
 	};
 };
 
+struct nvm_user_vio;
+struct nvm_passthru_vio;
+
+/**
+ * I/O backend operations, selected by nvm_dev_open
+ *
+ * The vio and admin functions take the same arguments and have the same
+ * semantics as NVME_NVM_IOCTL_SUBMIT_VIO and NVME_NVM_IOCTL_ADMIN_VIO,
+ * pread/pwrite as their libc counterparts on the block device.
+ */
+struct nvm_be {
+	const char *name;	///< Name used by NVM_DEV_BE
+	const char *pfx;	///< Device path prefix, NULL matches any path
+
+	/**
+	 * Open the device and fill geometry and address format
+	 */
+	int (*open)(struct nvm_dev *dev);
+	void (*close)(struct nvm_dev *dev);
+
+	int (*vio)(struct nvm_dev *dev, struct nvm_user_vio *ctl);
+	int (*admin)(struct nvm_dev *dev, struct nvm_passthru_vio *ctl);
+
+	ssize_t (*pwrite)(struct nvm_dev *dev, const void *buf, size_t count,
+			  off_t offset);
+	ssize_t (*pread)(struct nvm_dev *dev, void *buf, size_t count,
+			 off_t offset);
+
+	/**
+	 * Non-zero when pread/pwrite are plain I/O on `dev->fd`, such that
+	 * asynchronous LBA I/O can submit them via io_uring instead
+	 */
+	int fd_io;
+
+	/**
+	 * Device-side copy of naddrs sectors from src to dst, addresses in
+	 * device format. NULL when the device lacks a vector-copy, the copy is
+	 * then done by reading into and writing from host buffers.
+	 */
+	int (*copy)(struct nvm_dev *dev, const uint64_t src[],
+		    const uint64_t dst[], int naddrs, uint16_t flags,
+		    struct nvm_ret *ret);
+};
+
+extern const struct nvm_be nvm_be_ioctl;	///< LightNVM kernel ioctls
+extern const struct nvm_be nvm_be_emu;		///< Emulator, see nvm_emu.c
+
 struct nvm_dev {
 	char name[NVM_DEV_NAME_LEN];	///< Device name e.g. "nvme0n1"
 	char path[NVM_DEV_PATH_LEN];	///< Device path e.g. "/dev/nvme0n1"
 	struct nvm_addr_fmt fmt;	///< Device address format
 	struct nvm_addr_fmt_mask mask;	///< Device address format mask
+	uint64_t (*gen2dev)(const struct nvm_dev *dev, struct nvm_addr addr);
+	struct nvm_addr (*dev2gen)(const struct nvm_dev *dev, uint64_t addr);
+	uint64_t codec_mask;		///< Field bits for the identity codec
+	uint64_t ppa_mask;		///< Bits of all fields of fmt
 	struct nvm_geo geo;		///< Device geometry
+	struct nvm_geo_div gdiv;	///< Divisors of the geometry
 	uint64_t ssw;			///< Bit-width for LBA fmt conversion
 	int pmode;			///< Default plane-mode I/O
 	int fd;				///< Device fd / IOCTL handle
@@ -218,20 +360,171 @@ struct nvm_dev {
 	size_t nbbts;			///< Number of entries in cache
 	struct nvm_bbt **bbts;		///< Cache of bad-block-tables
 	enum meta_mode meta_mode;	///< Flag to indicate the how meta is w
+	uint32_t meta_seq;		///< Last sequence number written
+	int retry_nretries;		///< Re-issues of failed addresses
+	int retry_backoff_us;		///< Delay before the first re-issue
+	int lba_layout;			///< Layout of striped LBA I/O
+	struct nvm_lba_map lba_map;	///< Strides of striped LBA I/O
+	const struct nvm_be *be;	///< I/O backend
+	struct nvm_emu *emu;		///< Emulator state, NULL on real devices
+	struct nvm_sched *sched;	///< Per-LUN admission, NULL when disabled
+	int sched_nusers;		///< Commands using sched, see nvm_sched_disable
+	struct nvm_ring *ring;		///< Submission ring, NULL when disabled
+	int numa_node;			///< Node of the device, -1 if unknown
+	uint64_t numa_cpus[NVM_NUMA_NCPUS_MAX / 64];	///< CPUs of numa_node
 };
 
 struct nvm_vblk {
 	struct nvm_dev *dev;
 	struct nvm_addr blks[128];
 	int nblks;
+	struct nvm_div nblks_div;	///< Divisor of nblks
 	size_t nbytes;
 	size_t pos_write;
 	size_t pos_read;
 	int nthreads;
+	int nparity;		///< Trailing blocks holding parity, 0 or 1
+	struct nvm_vblk_ret ret;	///< Outcome of the last pread/pwrite
+	int nfailed_max;	///< Allocated length of ret.failed
+};
+
+/**
+ * Address added to a command builder, with the key it is ordered by
+ */
+struct nvm_cmd_ent {
+	struct nvm_addr addr;
+	void *buf;
+	uint64_t key;
+};
+
+/**
+ * Fields of struct nvm_addr as enumerated by struct nvm_addr_iter
+ */
+enum nvm_addr_field {
+	NVM_ADDR_FIELD_CH = 0,
+	NVM_ADDR_FIELD_LUN,
+	NVM_ADDR_FIELD_BLK,
+	NVM_ADDR_FIELD_PG,
+	NVM_ADDR_FIELD_PL,
+	NVM_ADDR_FIELD_SEC,
+	NVM_ADDR_NFIELDS
+};
+
+struct nvm_addr_iter {
+	struct nvm_dev *dev;
+	int fields[NVM_ADDR_NFIELDS];	///< From slowest to fastest varying
+	uint32_t bgn[NVM_ADDR_NFIELDS];	///< Indexed by enum nvm_addr_field
+	uint32_t end[NVM_ADDR_NFIELDS];
+	uint32_t cur[NVM_ADDR_NFIELDS];
+	int unit_naddrs;		///< Planes times sectors of a page
+	size_t naddrs;
+	int done;
 };
 
+struct nvm_cmd_builder {
+	struct nvm_dev *dev;
+	struct nvm_cmd_ent *ents;
+	int nents;
+	int nents_max;
+};
+
+/**
+ * Non-zero when commands should be recorded via nvm_trace_push
+ */
+extern int nvm_trace_enabled;
+
+/**
+ * @returns Current time in nsec for command trace records
+ */
+uint64_t nvm_trace_ts(void);
+
+/**
+ * Record a completed command in the trace ring of the calling thread
+ */
+void nvm_trace_push(uint16_t opcode, struct nvm_addr addrs[], int naddrs,
+		    uint64_t ts, int err, uint32_t result, uint64_t status);
+
+/**
+ * Wait for a slot on each LUN addressed by the command, in ascending order
+ *
+ * @param luns Filled with the acquired LUNs, room for naddrs entries
+ * @param nluns Set to the number of LUNs acquired
+ * @returns The scheduler to be passed on to nvm_sched_release along with
+ * `luns` and `nluns`, NULL when scheduling is disabled
+ */
+struct nvm_sched *nvm_sched_acquire(struct nvm_dev *dev, uint16_t opcode,
+				    struct nvm_addr addrs[], int naddrs,
+				    size_t luns[], int *nluns);
+
+/**
+ * Release the slots acquired by nvm_sched_acquire
+ */
+void nvm_sched_release(struct nvm_dev *dev, struct nvm_sched *sched,
+		       size_t luns[], int nluns);
+
+/**
+ * Bind the calling thread to the CPUs of the NUMA node of the device, a no-op
+ * when the node is unknown or the thread is already bound to it. For threads
+ * owned by the library, OpenMP workers use nvm_numa_bind_worker.
+ */
+void nvm_numa_bind(struct nvm_dev *dev);
+
+/**
+ * Affinity of an OpenMP worker saved by nvm_numa_bind_worker
+ */
+struct nvm_numa_aff {
+	uint64_t cpus[NVM_NUMA_NCPUS_MAX / 64];	///< Affinity before binding
+	int bound;				///< Whether the worker was bound
+};
+
+/**
+ * Bind the calling worker of a parallel region to the CPUs of the NUMA node of
+ * the device, saving its affinity in `aff`. The master thread is left as is.
+ * The pool threads are shared with the application, so each worker restores
+ * its affinity with nvm_numa_unbind_worker before leaving the region.
+ */
+void nvm_numa_bind_worker(struct nvm_dev *dev, struct nvm_numa_aff *aff);
+
+/**
+ * Restore the affinity saved by nvm_numa_bind_worker
+ */
+void nvm_numa_unbind_worker(struct nvm_numa_aff *aff);
+
+/**
+ * Checksum stored in struct nvm_meta_crc for a sector of data
+ */
+uint32_t nvm_meta_crc(const void *data, size_t nbytes, uint32_t seq);
+
 void nvm_lba_map_pr(struct nvm_lba_map* map);
 
+/**
+ * Setup the strides of the given map for the given layout
+ *
+ * Sectors and planes are always the innermost dimensions, such that a virtual
+ * page is the unit of striping, the layout orders the remaining dimensions.
+ *
+ * @returns 0 on success, -1 on error and errno set to indicate the error
+ */
+int nvm_lba_map_init(struct nvm_lba_map *map, const struct nvm_geo *geo,
+		     int layout);
+
+/**
+ * Parse an address format from its sysfs representation e.g.
+ * "0x380830082808001010102008", a trailing newline is accepted
+ *
+ * @returns 0 on success, -1 on error and errno set to indicate the error
+ */
+int nvm_addr_fmt_parse(const char *str, struct nvm_addr_fmt *fmt,
+		       struct nvm_addr_fmt_mask *mask);
+
+/**
+ * Select the gen2dev/dev2gen codec of the device for its address format: a
+ * hard-coded one for known formats, masking for formats matching the layout of
+ * struct nvm_addr, and otherwise the generic one reading dev->fmt and
+ * dev->mask. Must be called whenever dev->fmt changes.
+ */
+void nvm_addr_codec_setup(struct nvm_dev *dev);
+
 /**
  * Prints a humanly readable representation of the give address format
  *
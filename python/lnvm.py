@@ -4,6 +4,25 @@
 """
 from __future__ import print_function
 import ctypes
+import ctypes.util
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+NVM_NADDR_MAX = 64
+
+NVM_FLAG_PMODE_SNGL = 0x0
+NVM_FLAG_PMODE_DUAL = 0x1
+NVM_FLAG_PMODE_QUAD = 0x2
+NVM_FLAG_SCRBL = 0x200
+
+NVM_BBT_FREE = 0x0
+NVM_BBT_BAD = 0x1
+NVM_BBT_GBAD = 0x2
+NVM_BBT_DMRK = 0x4
+NVM_BBT_HMRK = 0x8
 
 class AddrGDesc(ctypes.Structure):
     """Wrapper for anonymous member NVM_ADDR.g """
@@ -44,6 +63,33 @@ class Addr(ctypes.Structure):
         ("u", AddrUDesc)
     ]
 
+class Ret(ctypes.Structure):
+    """Wrapper for NVM_RET"""
+
+    _fields_ = [
+        ("status", ctypes.c_uint64),
+        ("result", ctypes.c_uint32),
+    ]
+
+class VblkRet(ctypes.Structure):
+    """Wrapper for NVM_VBLK_RET"""
+
+    _fields_ = [
+        ("nbytes", ctypes.c_size_t),
+        ("nfailed", ctypes.c_int),
+        ("failed", ctypes.POINTER(Addr)),
+    ]
+
+class BbtDesc(ctypes.Structure):
+    """Wrapper for NVM_BBT"""
+
+    _fields_ = [
+        ("dev", ctypes.c_void_p),
+        ("addr", Addr),
+        ("blks", ctypes.POINTER(ctypes.c_uint8)),
+        ("nblks", ctypes.c_uint64),
+    ]
+
 class Geometry(ctypes.Structure):
     """Geometry of a Non-Volatile Memory device or subset thereof"""
 
@@ -64,8 +110,173 @@ class Geometry(ctypes.Structure):
         ("vpg_nbytes", ctypes.c_size_t),
     ]
 
-LLN = ctypes.cdll.LoadLibrary("liblightnvm.so")
-LLN.nvm_dev_get_geo.restype = ctypes.POINTER(Geometry)
+LLN = ctypes.CDLL("liblightnvm.so", use_errno=True)
+LIBC = ctypes.CDLL(ctypes.util.find_library("c"))
+
+def _proto(name, restype, *argtypes):
+    """Declare the prototype of a liblightnvm function"""
+
+    func = getattr(LLN, name)
+    func.restype = restype
+    func.argtypes = list(argtypes)
+
+_VP = ctypes.c_void_p
+_RETP = ctypes.POINTER(Ret)
+_ADDRP = ctypes.POINTER(Addr)
+_SZ = ctypes.c_size_t
+_SSZ = ctypes.c_ssize_t
+_U16 = ctypes.c_uint16
+
+_proto("nvm_dev_open", _VP, ctypes.c_char_p)
+_proto("nvm_dev_close", None, _VP)
+_proto("nvm_dev_pr", None, _VP)
+_proto("nvm_dev_get_geo", ctypes.POINTER(Geometry), _VP)
+_proto("nvm_dev_get_pmode", ctypes.c_int, _VP)
+_proto("nvm_dev_get_numa_node", ctypes.c_int, _VP)
+_proto("nvm_dev_set_erase_naddrs_max", ctypes.c_int, _VP, ctypes.c_int)
+_proto("nvm_dev_set_read_naddrs_max", ctypes.c_int, _VP, ctypes.c_int)
+_proto("nvm_dev_set_write_naddrs_max", ctypes.c_int, _VP, ctypes.c_int)
+
+_proto("nvm_buf_alloc", _VP, ctypes.POINTER(Geometry), _SZ)
+_proto("nvm_dev_buf_alloc", _VP, _VP, _SZ)
+_proto("nvm_buf_fill", None, _VP, _SZ)
+
+_proto("nvm_addr_erase", _SSZ, _VP, _ADDRP, ctypes.c_int, _U16, _RETP)
+_proto("nvm_addr_write", _SSZ, _VP, _ADDRP, ctypes.c_int, _VP, _VP, _U16,
+       _RETP)
+_proto("nvm_addr_read", _SSZ, _VP, _ADDRP, ctypes.c_int, _VP, _VP, _U16,
+       _RETP)
+_proto("nvm_addr_check", ctypes.c_int, Addr, ctypes.POINTER(Geometry))
+_proto("nvm_addr_gen2dev", ctypes.c_uint64, _VP, Addr)
+_proto("nvm_addr_dev2gen", Addr, _VP, ctypes.c_uint64)
+
+_proto("nvm_vblk_alloc", _VP, _VP, _ADDRP, ctypes.c_int)
+_proto("nvm_vblk_alloc_line", _VP, _VP, ctypes.c_int, ctypes.c_int,
+       ctypes.c_int, ctypes.c_int, ctypes.c_int)
+_proto("nvm_vblk_free", None, _VP)
+_proto("nvm_vblk_erase", _SSZ, _VP)
+_proto("nvm_vblk_write", _SSZ, _VP, _VP, _SZ)
+_proto("nvm_vblk_pwrite", _SSZ, _VP, _VP, _SZ, _SZ)
+_proto("nvm_vblk_pad", _SSZ, _VP)
+_proto("nvm_vblk_read", _SSZ, _VP, _VP, _SZ)
+_proto("nvm_vblk_pread", _SSZ, _VP, _VP, _SZ, _SZ)
+_proto("nvm_vblk_get_ret", ctypes.POINTER(VblkRet), _VP)
+_proto("nvm_vblk_get_nbytes", _SZ, _VP)
+_proto("nvm_vblk_pr", None, _VP)
+
+_proto("nvm_bbt_get", ctypes.POINTER(BbtDesc), _VP, Addr, _RETP)
+_proto("nvm_bbt_set", ctypes.c_int, _VP, ctypes.POINTER(BbtDesc), _RETP)
+_proto("nvm_bbt_mark", ctypes.c_int, _VP, _ADDRP, ctypes.c_int, _U16, _RETP)
+_proto("nvm_bbt_flush", ctypes.c_int, _VP, Addr, _RETP)
+_proto("nvm_bbt_pr", None, ctypes.POINTER(BbtDesc))
+
+LIBC.free.restype = None
+LIBC.free.argtypes = [_VP]
+
+def addrs_alloc(naddrs):
+    """Allocate a zeroed array of `naddrs` addresses"""
+
+    return (Addr * naddrs)()
+
+def addrs_from_ppas(ppas):
+    """
+    Construct an address array from an iterable of 64bit generic addresses,
+    without copying when given a numpy array of uint64
+    """
+
+    if numpy is not None and isinstance(ppas, numpy.ndarray):
+        ppas = numpy.ascontiguousarray(ppas, dtype=numpy.uint64)
+        return (Addr * len(ppas)).from_buffer(ppas)
+
+    ppas = list(ppas)
+    addrs = addrs_alloc(len(ppas))
+    for i, ppa in enumerate(ppas):
+        addrs[i].u.ppa = ppa
+
+    return addrs
+
+def addrs_ppas(addrs):
+    """
+    Return the 64bit generic addresses of the given address array, as a numpy
+    array sharing memory with it when numpy is available, a list otherwise
+    """
+
+    if numpy is not None:
+        return numpy.frombuffer(addrs, dtype=numpy.uint64)
+
+    return [addr.u.ppa for addr in addrs]
+
+def _check(err, func):
+    """Raise OSError with errno when the liblightnvm call failed"""
+
+    if err < 0:
+        errno = ctypes.get_errno()
+        raise OSError(errno, "%s failed" % func)
+
+    return err
+
+class _Alloc(object):
+    """Memory allocated by liblightnvm, freed when no longer referenced"""
+
+    def __init__(self, ptr):
+        self.ptr = ptr
+
+    def __del__(self):
+        self.free()
+
+    def free(self):
+        if not self.ptr:
+            return
+
+        LIBC.free(self.ptr)
+        self.ptr = None
+
+class Buffer(object):
+    """
+    Buffer allocated by liblightnvm, exposed as a writable memoryview or numpy
+    array of uint8 sharing memory with the buffer
+
+    Views keep the allocation alive after the Buffer itself is released, an
+    explicit free() however releases it at once and invalidates any views.
+    """
+
+    def __init__(self, ptr, nbytes):
+        if not ptr:
+            raise MemoryError("failed allocating %d bytes" % nbytes)
+
+        self.ptr = ptr
+        self.nbytes = nbytes
+        self._alloc = _Alloc(ptr)
+        self._raw = (ctypes.c_char * nbytes).from_address(ptr)
+        self._raw._alloc = self._alloc  # Base of views, holds the allocation
+
+    def __len__(self):
+        return self.nbytes
+
+    def free(self):
+        if not self.ptr:
+            return
+
+        self._alloc.free()
+        self.ptr = None
+        self._raw = None
+
+    def view(self):
+        return memoryview(self._raw).cast("B")
+
+    def numpy(self):
+        if numpy is None:
+            raise ImportError("numpy is not available")
+
+        return numpy.frombuffer(self._raw, dtype=numpy.uint8)
+
+    def fill(self):
+        LLN.nvm_buf_fill(self.ptr, self.nbytes)
+
+    def at(self, offset):
+        """Pointer to `offset` bytes into the buffer"""
+
+        return self.ptr + offset
 
 class Device(object):
 
@@ -77,7 +288,11 @@ class Device(object):
         if self._dev:
             return True
 
-        self._dev = LLN.nvm_dev_open(self.dev_path)
+        path = self.dev_path
+        if not isinstance(path, bytes):
+            path = path.encode()
+
+        self._dev = LLN.nvm_dev_open(path)
 
         return self._dev
 
@@ -100,6 +315,213 @@ class Device(object):
 
         LLN.nvm_dev_pr(self._dev)
 
+    def pmode(self):
+        return LLN.nvm_dev_get_pmode(self._dev)
+
+    def numa_node(self):
+        return LLN.nvm_dev_get_numa_node(self._dev)
+
+    def set_naddrs_max(self, erase, read, write):
+        """Set the maximum number of addresses per ERASE, READ and WRITE"""
+
+        _check(LLN.nvm_dev_set_erase_naddrs_max(self._dev, erase),
+               "nvm_dev_set_erase_naddrs_max")
+        _check(LLN.nvm_dev_set_read_naddrs_max(self._dev, read),
+               "nvm_dev_set_read_naddrs_max")
+        _check(LLN.nvm_dev_set_write_naddrs_max(self._dev, write),
+               "nvm_dev_set_write_naddrs_max")
+
+    def buf_alloc(self, nbytes):
+        """Allocate a Buffer on the NUMA node of the device"""
+
+        return Buffer(LLN.nvm_dev_buf_alloc(self._dev, nbytes), nbytes)
+
+    def addrs_block(self, ch, lun, blk, pmode=None):
+        """Addresses of the planes of a block, as used for erase"""
+
+        geo = self.geo().contents
+        if pmode is None:
+            pmode = self.pmode()
+        nplanes = geo.nplanes if pmode else 1
+
+        addrs = addrs_alloc(nplanes)
+        for pl in range(nplanes):
+            addrs[pl].u.g.ch = ch
+            addrs[pl].u.g.lun = lun
+            addrs[pl].u.g.blk = blk
+            addrs[pl].u.g.pl = pl
+
+        return addrs
+
+    def addrs_vpage(self, ch, lun, blk, pg):
+        """Sector addresses of a virtual page, in plane-mode order"""
+
+        geo = self.geo().contents
+        naddrs = geo.nplanes * geo.nsectors
+
+        addrs = addrs_alloc(naddrs)
+        for i in range(naddrs):
+            addrs[i].u.g.ch = ch
+            addrs[i].u.g.lun = lun
+            addrs[i].u.g.blk = blk
+            addrs[i].u.g.pg = pg
+            addrs[i].u.g.pl = (i // geo.nsectors) % geo.nplanes
+            addrs[i].u.g.sec = i % geo.nsectors
+
+        return addrs
+
+    def addr_erase(self, addrs, flags=None):
+        """Erase the given address array, returns Ret"""
+
+        ret = Ret()
+        flags = self.pmode() if flags is None else flags
+        _check(LLN.nvm_addr_erase(self._dev, addrs, len(addrs), flags,
+                                  ctypes.byref(ret)), "nvm_addr_erase")
+
+        return ret
+
+    def addr_write(self, addrs, buf, meta=None, flags=None):
+        """Write Buffer `buf` to the given address array, returns Ret"""
+
+        ret = Ret()
+        flags = self.pmode() if flags is None else flags
+        _check(LLN.nvm_addr_write(self._dev, addrs, len(addrs), buf.ptr,
+                                  meta.ptr if meta else None, flags,
+                                  ctypes.byref(ret)), "nvm_addr_write")
+
+        return ret
+
+    def addr_read(self, addrs, buf, meta=None, flags=None):
+        """Read the given address array into Buffer `buf`, returns Ret"""
+
+        ret = Ret()
+        flags = self.pmode() if flags is None else flags
+        _check(LLN.nvm_addr_read(self._dev, addrs, len(addrs), buf.ptr,
+                                 meta.ptr if meta else None, flags,
+                                 ctypes.byref(ret)), "nvm_addr_read")
+
+        return ret
+
+    def addr_gen2dev(self, addr):
+        return LLN.nvm_addr_gen2dev(self._dev, addr)
+
+    def addr_dev2gen(self, ppa):
+        return LLN.nvm_addr_dev2gen(self._dev, ppa)
+
+class Vblk(object):
+    """Wrapper for NVM_VBLK"""
+
+    def __init__(self, dev, addrs=None, line=None):
+        """
+        Construct from an address array, or from a tuple `line` of
+        (ch_bgn, ch_end, lun_bgn, lun_end, blk)
+        """
+
+        self.dev = dev
+        if line is not None:
+            self._vblk = LLN.nvm_vblk_alloc_line(dev._dev, *line)
+        else:
+            self._vblk = LLN.nvm_vblk_alloc(dev._dev, addrs, len(addrs))
+        if not self._vblk:
+            raise OSError(ctypes.get_errno(), "nvm_vblk_alloc failed")
+
+    def __del__(self):
+        self.free()
+
+    def free(self):
+        if not self._vblk:
+            return
+
+        LLN.nvm_vblk_free(self._vblk)
+        self._vblk = None
+
+    def nbytes(self):
+        return LLN.nvm_vblk_get_nbytes(self._vblk)
+
+    def erase(self):
+        return _check(LLN.nvm_vblk_erase(self._vblk), "nvm_vblk_erase")
+
+    def write(self, buf, count=None):
+        count = len(buf) if count is None else count
+        return _check(LLN.nvm_vblk_write(self._vblk, buf.ptr, count),
+                      "nvm_vblk_write")
+
+    def pwrite(self, buf, count=None, offset=0):
+        count = len(buf) if count is None else count
+        return _check(LLN.nvm_vblk_pwrite(self._vblk, buf.ptr, count, offset),
+                      "nvm_vblk_pwrite")
+
+    def pad(self):
+        return _check(LLN.nvm_vblk_pad(self._vblk), "nvm_vblk_pad")
+
+    def read(self, buf, count=None):
+        count = len(buf) if count is None else count
+        return _check(LLN.nvm_vblk_read(self._vblk, buf.ptr, count),
+                      "nvm_vblk_read")
+
+    def pread(self, buf, count=None, offset=0):
+        count = len(buf) if count is None else count
+        return _check(LLN.nvm_vblk_pread(self._vblk, buf.ptr, count, offset),
+                      "nvm_vblk_pread")
+
+    def ret(self):
+        """Bytes transferred and failed addresses of the last pread/pwrite"""
+
+        vret = LLN.nvm_vblk_get_ret(self._vblk).contents
+
+        return vret.nbytes, [vret.failed[i] for i in range(vret.nfailed)]
+
+    def pr(self):
+        LLN.nvm_vblk_pr(self._vblk)
+
+class Bbt(object):
+    """
+    Bad-block-table of a LUN, states are exposed via `blks`
+
+    The table is owned by the device, `blks` and its numpy views keep the
+    Device alive but are invalidated by Device.close().
+    """
+
+    def __init__(self, dev, addr):
+        self.dev = dev
+        self.addr = addr
+        self.ret = Ret()
+
+        self._bbt = LLN.nvm_bbt_get(dev._dev, addr, ctypes.byref(self.ret))
+        if not self._bbt:
+            raise OSError(ctypes.get_errno(), "nvm_bbt_get failed")
+
+        bbt = self._bbt.contents
+        self.blks = (ctypes.c_uint8 * bbt.nblks).from_address(
+            ctypes.addressof(bbt.blks.contents))
+        self.blks._dev = dev            # Base of views, holds the device
+
+    def numpy(self):
+        """Block states as a numpy array sharing memory with the table"""
+
+        return numpy.frombuffer(self.blks, dtype=numpy.uint8)
+
+    def set(self):
+        return _check(LLN.nvm_bbt_set(self.dev._dev, self._bbt,
+                                      ctypes.byref(self.ret)), "nvm_bbt_set")
+
+    def flush(self):
+        return _check(LLN.nvm_bbt_flush(self.dev._dev, self.addr,
+                                        ctypes.byref(self.ret)),
+                      "nvm_bbt_flush")
+
+    def pr(self):
+        LLN.nvm_bbt_pr(self._bbt)
+
+def bbt_mark(dev, addrs, flags):
+    """Mark the blocks of the given address array with state `flags`"""
+
+    ret = Ret()
+    _check(LLN.nvm_bbt_mark(dev._dev, addrs, len(addrs), flags,
+                            ctypes.byref(ret)), "nvm_bbt_mark")
+
+    return ret
+
 class Version(object):
 
     def __init__(self):
@@ -132,8 +554,8 @@ def main():
 
     addrs = []
 
-    for ch in xrange(0, geo.contents.nchannels):
-        for lun in xrange(0, geo.contents.nluns):
+    for ch in range(0, geo.contents.nchannels):
+        for lun in range(0, geo.contents.nluns):
             addr = Addr()
             addr.u.g.ch = ch
             addr.u.g.lun = lun
@@ -1,17 +1,14 @@
 #!/usr/bin/env python
 from __future__ import print_function
-from subprocess import Popen, PIPE
 from collections import deque
 import argparse
 import logging
 import pprint
+import time
 import csv
-import re
 import os
 import lnvm
 
-CLI = "nvm_vblk"
-
 class Experiment(object):
 
     def __init__(self, args):
@@ -20,6 +17,7 @@ class Experiment(object):
         self.ops = [sub.replace("set_", "") for sub in self.subs]
         self.rotate = args.rotate
         self.naddrs_max = args.naddrs_max
+        self.ntrials = args.ntrials
         self.rpath = args.rpath
         self.dev_path = args.dev_path
         self.addrs = deque(args.addr)
@@ -42,56 +40,65 @@ class Experiment(object):
         return True
 
     def run(self):
-        """Run experiment"""
-
-        env = os.environ.copy()
-
-        env["NVM_CLI_ERASE_NADDRS_MAX"] = str(self.naddrs_max[0])
-        env["NVM_CLI_READ_NADDRS_MAX"] = str(self.naddrs_max[1])
-        env["NVM_CLI_WRITE_NADDRS_MAX"] = str(self.naddrs_max[2])
+        """
+        Run experiment in-process: one device handle, a buffer allocated and
+        filled once, and `trials` runs per span of which the median is kept
+        """
 
-        logging.info("Running experiment")
-        for span in self.spans:                         # Get addrs for the span
+        dev = lnvm.Device(self.dev_path)
+        if not dev.open():
+            logging.error("Failed opening dev_path(%s)", self.dev_path)
+            return False
 
-            addrs = " ".join(self.spans[span])
+        dev.set_naddrs_max(*self.naddrs_max)
 
-            for op, sub_cmd in zip(self.ops, self.subs):  # DO: erase/write/read
-                REGEX = "nvm_vblk_%s, elapsed wall-clock: (\d+\.\d+)" % op
+        geo = dev.geo().contents
+        vblk_nbytes = geo.nplanes * geo.npages * geo.nsectors * \
+                      geo.sector_nbytes
 
-                cmd = " ".join([CLI, sub_cmd, self.dev_path, addrs])
+        buf = dev.buf_alloc(max(self.spans) * vblk_nbytes)
+        buf.fill()
 
-                process = Popen(
-                    cmd.split(" "),
-                    stdout=PIPE,
-                    stderr=PIPE,
-                    env = env
-                )
-                out, err = process.communicate()
-
-                if process.returncode:
-                    logging.error(
-                        "cmd(%s), returncode(%d), out(%s), err(%s)",
-                        cmd,
-                        process.returncode,
-                        out,
-                        err
-                    )
-                    return False
-
-                matches = list(re.finditer(REGEX, out))
-                if len(matches) != 1:
-                    logging.error("Could not find elapsed time in output")
-                    return False
-
-                wall_clock = float(matches[0].group(1))
-                res = (span, wall_clock)
+        logging.info("Running experiment")
+        for span in sorted(self.spans):                 # Get addrs for the span
+            addrs = lnvm.addrs_from_ppas(
+                [int(addr, 16) for addr in self.spans[span]]
+            )
+            vblk = lnvm.Vblk(dev, addrs)
+            nbytes = vblk.nbytes()
+
+            walls = {op: [] for op in self.ops}
+            for _ in range(self.ntrials):
+                for op in self.ops:                     # DO: erase/write/read
+                    t_bgn = time.time()
+                    try:
+                        if op == "erase":
+                            vblk.erase()
+                        elif op == "write":
+                            vblk.pwrite(buf, nbytes, 0)
+                        else:
+                            vblk.pread(buf, nbytes, 0)
+                    except OSError as exc:
+                        logging.error("span(%d), op(%s), err(%s)", span, op,
+                                      exc)
+                        dev.close()
+                        return False
+                    walls[op].append(time.time() - t_bgn)
+
+            vblk.free()
+
+            for op in self.ops:
+                wall_clock = sorted(walls[op])[len(walls[op]) // 2]
+                res = (span, wall_clock, nbytes)
                 self.trials[op].append(res)
 
-                logging.info("cmd(%s)", cmd)
-                logging.info("res(%s)", res)
+                logging.info("op(%s), res(%s)", op, res)
 
             self.to_file(self.rpath)
 
+        buf.free()
+        dev.close()
+
         logging.info("DONE")
 
         return True
@@ -112,7 +119,7 @@ class Experiment(object):
                     self.naddrs_max[2]
                 )
             ])
-            with open(rpath, "wb") as csv_fd:
+            with open(rpath, "w") as csv_fd:
                 csv_writer = csv.writer(csv_fd)
                 csv_writer.writerows(self.trials[op])
 
@@ -167,6 +174,12 @@ if __name__ == "__main__":
         default=[64,64,64],
         help="Max number of addresses for ERASE READ WRITE"
     )
+    PRSR.add_argument(
+        "--ntrials",
+        type=int,
+        default=3,
+        help="Number of trials per span, the median wall-clock is kept"
+    )
     PRSR.add_argument(
         "--dry",
         action="store_const",
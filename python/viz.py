@@ -114,15 +114,21 @@ def main(args):
             csv_reader = csv.reader(csv_fd)
             raw = list(csv_reader)
 
-            topics[topic]["luns"] = [int(lun) for lun, sample in raw]
-            topics[topic]["samples"] = [float(sample) for lun, sample in raw]
+            topics[topic]["luns"] = [int(row[0]) for row in raw]
+            topics[topic]["samples"] = [float(row[1]) for row in raw]
 
             sz = float(16777216)
             mb = (1024 * 1024)
 
+            # Rows are "luns,secs" or "luns,secs,nbytes" as by nvm_bench scale
+            topics[topic]["nbytes"] = [
+                float(row[2]) if len(row) > 2 else sz * int(row[0])
+                for row in raw
+            ]
+
             topics[topic]["throughput"] = [
-                ((sz * lun) / wc)/mb for lun, wc in zip(
-                    topics[topic]["luns"], topics[topic]["samples"]
+                (nbytes / wc)/mb for nbytes, wc in zip(
+                    topics[topic]["nbytes"], topics[topic]["samples"]
                 )
             ]
             topics[topic]["wall-clock"] = [
@@ -27,6 +27,8 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#define _GNU_SOURCE
+#include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -36,6 +38,7 @@
 #include <liblightnvm.h>
 #include <nvm.h>
 #include <nvm_debug.h>
+#include <nvm_omp.h>
 
 void nvm_ret_pr(struct nvm_ret *ret)
 {
@@ -69,7 +72,11 @@ int nvm_addr_check(struct nvm_addr addr, const struct nvm_geo *geo)
 	return exceeded;
 }
 
-inline uint64_t nvm_addr_gen2dev(struct nvm_dev *dev, struct nvm_addr addr)
+/**
+ * Generic codec, any format via the offsets of dev->fmt and masks of dev->mask
+ */
+static uint64_t addr_fmt_gen2dev(const struct nvm_dev *dev,
+				 struct nvm_addr addr)
 {
 	uint64_t d_addr = 0;
 
@@ -83,17 +90,8 @@ inline uint64_t nvm_addr_gen2dev(struct nvm_dev *dev, struct nvm_addr addr)
 	return d_addr;
 }
 
-uint64_t nvm_addr_gen2off(struct nvm_dev *dev, struct nvm_addr addr)
-{
-	return nvm_addr_gen2dev(dev, addr) << dev->ssw;
-}
-
-uint64_t nvm_addr_gen2lba(struct nvm_dev *dev, struct nvm_addr addr)
-{
-	return nvm_addr_gen2off(dev, addr) >> NVM_UNIVERSAL_SECT_SH;
-}
-
-inline struct nvm_addr nvm_addr_dev2gen(struct nvm_dev *dev, uint64_t addr)
+static struct nvm_addr addr_fmt_dev2gen(const struct nvm_dev *dev,
+					uint64_t addr)
 {
 	struct nvm_addr gen;
 
@@ -108,6 +106,138 @@ inline struct nvm_addr nvm_addr_dev2gen(struct nvm_dev *dev, uint64_t addr)
 	return gen;
 }
 
+/**
+ * Identity codec, the format places every field at its offset in struct
+ * nvm_addr e.g. "0x380830082808001010102008". Converting is then a matter of
+ * masking, dev->codec_mask holds the bits of the fields in both.
+ */
+static uint64_t addr_ident_gen2dev(const struct nvm_dev *dev,
+				   struct nvm_addr addr)
+{
+	addr.g.rsvd = 0;
+
+	return addr.ppa;
+}
+
+static struct nvm_addr addr_ident_dev2gen(const struct nvm_dev *dev,
+					  uint64_t addr)
+{
+	struct nvm_addr gen;
+
+	gen.ppa = addr & dev->codec_mask;
+
+	return gen;
+}
+
+/**
+ * Codec of "0x10010e020201080603050002", the format packed by the emulator for
+ * its default geometry, with constant shifts and masks
+ */
+static uint64_t addr_emu_gen2dev(const struct nvm_dev *dev,
+				 struct nvm_addr addr)
+{
+	return ((uint64_t)addr.g.ch << 16) | ((uint64_t)addr.g.lun << 14) |
+	       ((uint64_t)addr.g.pl << 2) | ((uint64_t)addr.g.blk << 8) |
+	       ((uint64_t)addr.g.pg << 3) | (uint64_t)addr.g.sec;
+}
+
+static struct nvm_addr addr_emu_dev2gen(const struct nvm_dev *dev,
+					uint64_t addr)
+{
+	struct nvm_addr gen;
+
+	gen.ppa = 0;
+	gen.g.ch = (addr >> 16) & 0x1;
+	gen.g.lun = (addr >> 14) & 0x3;
+	gen.g.pl = (addr >> 2) & 0x1;
+	gen.g.blk = (addr >> 8) & 0x3f;
+	gen.g.pg = (addr >> 3) & 0x1f;
+	gen.g.sec = addr & 0x3;
+
+	return gen;
+}
+
+/**
+ * Formats with a hard-coded codec
+ */
+static const struct {
+	const char *fmt;
+	uint64_t (*gen2dev)(const struct nvm_dev *, struct nvm_addr);
+	struct nvm_addr (*dev2gen)(const struct nvm_dev *, uint64_t);
+} addr_codecs[] = {
+	{"0x10010e020201080603050002", addr_emu_gen2dev, addr_emu_dev2gen},
+};
+
+void nvm_addr_codec_setup(struct nvm_dev *dev)
+{
+	const uint8_t GEN_OFZ[6] = {	// ch, lun, pl, blk, pg, sec
+		NVM_BLK_BITS + NVM_PG_BITS + NVM_SEC_BITS + NVM_PL_BITS +
+		NVM_LUN_BITS,
+		NVM_BLK_BITS + NVM_PG_BITS + NVM_SEC_BITS + NVM_PL_BITS,
+		NVM_BLK_BITS + NVM_PG_BITS + NVM_SEC_BITS,
+		0,
+		NVM_BLK_BITS,
+		NVM_BLK_BITS + NVM_PG_BITS,
+	};
+	struct nvm_addr gen_mask;
+	int ident = 1;
+
+	dev->gen2dev = addr_fmt_gen2dev;
+	dev->dev2gen = addr_fmt_dev2gen;
+	dev->codec_mask = 0;
+	dev->ppa_mask = 0;
+
+	for (int i = 0; i < 6; ++i)
+		dev->ppa_mask |= dev->mask.a[i];
+
+	for (size_t i = 0; i < sizeof(addr_codecs) / sizeof(*addr_codecs); ++i) {
+		struct nvm_addr_fmt fmt;
+		struct nvm_addr_fmt_mask mask;
+
+		nvm_addr_fmt_parse(addr_codecs[i].fmt, &fmt, &mask);
+		if (memcmp(fmt.a, dev->fmt.a, sizeof(fmt.a)))
+			continue;
+
+		dev->gen2dev = addr_codecs[i].gen2dev;
+		dev->dev2gen = addr_codecs[i].dev2gen;
+		return;
+	}
+
+	for (int i = 0; i < 6; ++i) {
+		if (dev->fmt.a[i * 2 + 1] && dev->fmt.a[i * 2] != GEN_OFZ[i])
+			ident = 0;
+	}
+	if (!ident)
+		return;
+
+	gen_mask.ppa = ~0ULL;		// Bits of the fields in nvm_addr
+	gen_mask.g.rsvd = 0;
+	dev->codec_mask = dev->ppa_mask & gen_mask.ppa;
+
+	dev->gen2dev = addr_ident_gen2dev;
+	dev->dev2gen = addr_ident_dev2gen;
+}
+
+inline uint64_t nvm_addr_gen2dev(struct nvm_dev *dev, struct nvm_addr addr)
+{
+	return dev->gen2dev(dev, addr);
+}
+
+uint64_t nvm_addr_gen2off(struct nvm_dev *dev, struct nvm_addr addr)
+{
+	return nvm_addr_gen2dev(dev, addr) << dev->ssw;
+}
+
+uint64_t nvm_addr_gen2lba(struct nvm_dev *dev, struct nvm_addr addr)
+{
+	return nvm_addr_gen2off(dev, addr) >> NVM_UNIVERSAL_SECT_SH;
+}
+
+inline struct nvm_addr nvm_addr_dev2gen(struct nvm_dev *dev, uint64_t addr)
+{
+	return dev->dev2gen(dev, addr);
+}
+
 struct nvm_addr nvm_addr_off2gen(struct nvm_dev *dev, size_t off)
 {
 	return nvm_addr_dev2gen(dev, off >> dev->ssw);
@@ -118,28 +248,53 @@ struct nvm_addr nvm_addr_lba2gen(struct nvm_dev *dev, uint64_t off)
 	return nvm_addr_off2gen(dev, off << NVM_UNIVERSAL_SECT_SH);
 }
 
-static ssize_t nvm_addr_cmd(struct nvm_dev *dev, struct nvm_addr addrs[],
-			    int naddrs, void *data, void *meta, uint16_t flags,
-			    uint16_t opcode, struct nvm_ret *ret)
+/**
+ * Convert addresses to device format
+ */
+static inline void addr_gen2dev_list(struct nvm_dev *dev,
+				     const struct nvm_addr addrs[], int naddrs,
+				     uint64_t ppas[])
+{
+	for (int i = 0; i < naddrs; ++i)
+		ppas[i] = dev->gen2dev(dev, addrs[i]);
+}
+
+/**
+ * Issue a command on device-format addresses, `addrs` holds the same in
+ * generic format when the caller has them and is otherwise NULL, they are then
+ * decoded only when needed by the scheduler or the trace
+ */
+static ssize_t addr_cmd(struct nvm_dev *dev, const uint64_t ppas[],
+			struct nvm_addr addrs[], int naddrs, void *data,
+			void *meta, uint16_t flags, uint16_t opcode,
+			struct nvm_ret *ret)
 {
 	struct nvm_user_vio ctl;
-	uint64_t dev_addrs[naddrs];
-	int i, err;
+	struct nvm_addr gen_addrs[NVM_NADDR_MAX];
+	size_t luns[NVM_NADDR_MAX];
+	struct nvm_sched *sched = NULL;
+	int nluns = 0;
+	uint64_t ts = 0;
+	int err;
 
-	if (naddrs > NVM_NADDR_MAX) {
+	if (naddrs < 1 || naddrs > NVM_NADDR_MAX) {
 		errno = EINVAL;
 		return -1;
 	}
 
+	if (!addrs && (__atomic_load_n(&dev->sched, __ATOMIC_RELAXED) ||
+		       nvm_trace_enabled)) {
+		for (int i = 0; i < naddrs; ++i)
+			gen_addrs[i] = dev->dev2gen(dev, ppas[i]);
+		addrs = gen_addrs;
+	}
+
 	memset(&ctl, 0, sizeof(ctl));
 	ctl.opcode = opcode;
 	ctl.control = flags | NVM_FLAG_DEFAULT;
 
-	for (i = 0; i < naddrs; ++i) {	// Setup PPAs: Convert address format
-		dev_addrs[i] = nvm_addr_gen2dev(dev, addrs[i]);
-	}
 	ctl.nppas = naddrs - 1;		// Unnatural numbers: counting from zero
-	ctl.ppa_list = naddrs == 1 ? dev_addrs[0] : (uint64_t)dev_addrs;
+	ctl.ppa_list = naddrs == 1 ? ppas[0] : (uint64_t)ppas;
 
 	ctl.addr = (uint64_t)data;	// Setup data
 	ctl.data_len = data ? dev->geo.sector_nbytes * naddrs : 0;
@@ -147,12 +302,27 @@ static ssize_t nvm_addr_cmd(struct nvm_dev *dev, struct nvm_addr addrs[],
 	ctl.metadata = (uint64_t)meta;	// Setup metadata
 	ctl.metadata_len = meta ? dev->geo.meta_nbytes * naddrs : 0;
 
-	err = ioctl(dev->fd, NVME_NVM_IOCTL_SUBMIT_VIO, &ctl);
+	if (addrs)
+		sched = nvm_sched_acquire(dev, opcode, addrs, naddrs, luns,
+					  &nluns);
+
+	if (nvm_trace_enabled)
+		ts = nvm_trace_ts();
+
+	err = dev->be->vio(dev, &ctl);
+
+	if (sched)
+		nvm_sched_release(dev, sched, luns, nluns);
+
+	if (ts)
+		nvm_trace_push(opcode, addrs, naddrs, ts, err, ctl.result,
+			       ctl.status);
 #ifdef NVM_DEBUG_ENABLED
 	if (err || ctl.result || ctl.status) {
 		printf("opcode(0x%02x), err(%d), ctl.result(%u), ctl.status(%llu)\n",
 		       opcode, err, ctl.result, ctl.status);
-		nvm_addr_prn(addrs, naddrs);
+		if (addrs)
+			nvm_addr_prn(addrs, naddrs);
 	}
 #endif
 	if (ret) {
@@ -176,30 +346,779 @@ static ssize_t nvm_addr_cmd(struct nvm_dev *dev, struct nvm_addr addrs[],
 	}
 }
 
+/**
+ * Issue the command, then re-issue only the addresses flagged as failed in
+ * ret->status, with exponential backoff, for up to dev->retry_nretries times.
+ * Re-issues are single-plane, as they may cover only part of a plane-mode unit.
+ * Writes are not retried as a failed program cannot be repeated in place, nor
+ * are commands rejected as invalid. On return ret->status flags the addresses
+ * which still failed.
+ */
+static ssize_t nvm_addr_cmd(struct nvm_dev *dev, const uint64_t ppas[],
+			    struct nvm_addr addrs[], int naddrs, void *data,
+			    void *meta, uint16_t flags, uint16_t opcode,
+			    struct nvm_ret *ret)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	const uint64_t ALL = naddrs >= 64 ? ~0ULL : (1ULL << naddrs) - 1;
+	// A plane-mode command must cover whole units, re-issue single-plane
+	const uint16_t sub_flags = flags & ~(NVM_FLAG_PMODE_DUAL |
+					     NVM_FLAG_PMODE_QUAD);
+	struct nvm_ret lret = {};
+	uint64_t failed;
+	char *bdata = NULL, *bmeta = NULL;
+
+	if (!ret)
+		ret = &lret;
+
+	if (!addr_cmd(dev, ppas, addrs, naddrs, data, meta, flags, opcode,
+		      ret))
+		return 0;
+
+	if (!dev->retry_nretries || opcode == S12_OPC_WRITE ||
+	    ret->result == S12_RSP_ERR_INVALID)
+		return -1;			// Propagate errno
+
+	failed = ret->status ? ret->status & ALL : ALL;
+
+	if (data)
+		bdata = nvm_dev_buf_alloc(dev, naddrs * geo->sector_nbytes);
+	if (meta)
+		bmeta = nvm_dev_buf_alloc(dev, naddrs * geo->meta_nbytes);
+	if ((data && !bdata) || (meta && !bmeta)) {
+		free(bdata);
+		free(bmeta);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (int r = 0; failed && r < dev->retry_nretries; ++r) {
+		uint64_t sub_ppas[naddrs];
+		struct nvm_addr sub[naddrs];
+		int idx[naddrs];
+		struct nvm_ret sret = {};
+		int nsub = 0;
+		int err;
+
+		usleep((useconds_t)dev->retry_backoff_us << r);
+
+		for (int i = 0; i < naddrs; ++i) {
+			if (!(failed & (1ULL << i)))
+				continue;
+			sub_ppas[nsub] = ppas[i];
+			if (addrs)
+				sub[nsub] = addrs[i];
+			idx[nsub] = i;
+			++nsub;
+		}
+
+		err = addr_cmd(dev, sub_ppas, addrs ? sub : NULL, nsub, bdata,
+			       bmeta, sub_flags, opcode, &sret);
+
+		failed = 0;
+		for (int k = 0; k < nsub; ++k) {
+			const int i = idx[k];
+
+			if (err && (!sret.status || (sret.status & (1ULL << k)))) {
+				failed |= 1ULL << i;
+				continue;
+			}
+			if (data)
+				memcpy((char *)data + i * geo->sector_nbytes,
+				       bdata + k * geo->sector_nbytes,
+				       geo->sector_nbytes);
+			if (meta)
+				memcpy((char *)meta + i * geo->meta_nbytes,
+				       bmeta + k * geo->meta_nbytes,
+				       geo->meta_nbytes);
+		}
+		if (failed)
+			ret->result = sret.result;
+	}
+
+	free(bdata);
+	free(bmeta);
+
+	ret->status = failed;
+	if (failed) {
+		errno = EIO;
+		return -1;
+	}
+
+	ret->result = 0;
+
+	return 0;
+}
+
 ssize_t nvm_addr_erase(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 		       uint16_t flags, struct nvm_ret *ret)
 {
-	return nvm_addr_cmd(dev, addrs, naddrs, NULL, NULL, flags,
+	uint64_t ppas[NVM_NADDR_MAX];
+
+	if (naddrs < 1 || naddrs > NVM_NADDR_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+	addr_gen2dev_list(dev, addrs, naddrs, ppas);
+
+	return nvm_addr_cmd(dev, ppas, addrs, naddrs, NULL, NULL, flags,
 			    S12_OPC_ERASE, ret);
 }
 
-ssize_t nvm_addr_write(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
-		       const void *data, const void *meta, uint16_t flags,
-		       struct nvm_ret *ret)
+static inline int addr_meta_crc(struct nvm_dev *dev)
+{
+	return dev->meta_mode == NVM_META_MODE_CRC ||
+	       dev->meta_mode == NVM_META_MODE_CRC_SEQ;
+}
+
+/**
+ * Write with a struct nvm_meta_crc leading the OOB area of each sector, the
+ * remainder taken from the caller's meta
+ */
+static ssize_t addr_write_crc(struct nvm_dev *dev, const uint64_t ppas[],
+			      struct nvm_addr addrs[], int naddrs,
+			      const char *data, const char *meta,
+			      uint16_t flags, struct nvm_ret *ret)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	char cmeta[naddrs * geo->meta_nbytes];
+	struct nvm_meta_crc crc = {};
+
+	if (dev->meta_mode == NVM_META_MODE_CRC_SEQ)
+		crc.seq = __atomic_add_fetch(&dev->meta_seq, 1,
+					     __ATOMIC_RELAXED);
+
+	if (meta)
+		memcpy(cmeta, meta, sizeof(cmeta));
+	else
+		memset(cmeta, 0, sizeof(cmeta));
+
+	for (int i = 0; data && i < naddrs; ++i) {
+		crc.crc = nvm_meta_crc(data + i * geo->sector_nbytes,
+				       geo->sector_nbytes, crc.seq);
+		memcpy(cmeta + i * geo->meta_nbytes, &crc, sizeof(crc));
+	}
+
+	return nvm_addr_cmd(dev, ppas, addrs, naddrs, (char *)data, cmeta,
+			    flags, S12_OPC_WRITE, ret);
+}
+
+/**
+ * Read and verify the struct nvm_meta_crc leading the OOB area of each sector,
+ * failed sectors are flagged in ret->status as the device does for other
+ * errors
+ */
+static ssize_t addr_read_crc(struct nvm_dev *dev, const uint64_t ppas[],
+			     struct nvm_addr addrs[], int naddrs, char *data,
+			     char *meta, uint16_t flags, struct nvm_ret *ret)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	char cmeta[naddrs * geo->meta_nbytes];
+	uint64_t status = 0;
+
+	if (nvm_addr_cmd(dev, ppas, addrs, naddrs, data, cmeta, flags,
+			 S12_OPC_READ, ret))
+		return -1;			// Propagate errno
+
+	for (int i = 0; data && i < naddrs; ++i) {
+		struct nvm_meta_crc crc;
+
+		memcpy(&crc, cmeta + i * geo->meta_nbytes, sizeof(crc));
+		if (crc.crc != nvm_meta_crc(data + i * geo->sector_nbytes,
+					    geo->sector_nbytes, crc.seq))
+			status |= 1ULL << i;
+	}
+
+	if (meta)
+		memcpy(meta, cmeta, sizeof(cmeta));
+
+	if (status) {
+		if (ret) {
+			ret->result = S12_RSP_ERR_FAILCRC;
+			ret->status = status;
+		}
+		errno = EBADMSG;
+		return -1;
+	}
+
+	return 0;
+}
+
+static ssize_t addr_write(struct nvm_dev *dev, const uint64_t ppas[],
+			  struct nvm_addr addrs[], int naddrs, const void *data,
+			  const void *meta, uint16_t flags, struct nvm_ret *ret)
 {
 	char *cdata = (char *)data;
         char *cmeta = (char *)meta;
 
-	return nvm_addr_cmd(dev, addrs, naddrs, cdata, cmeta, flags,
+	if (addr_meta_crc(dev))
+		return addr_write_crc(dev, ppas, addrs, naddrs, cdata, cmeta,
+				      flags, ret);
+
+	return nvm_addr_cmd(dev, ppas, addrs, naddrs, cdata, cmeta, flags,
 			    S12_OPC_WRITE, ret);
 }
 
+static ssize_t addr_read(struct nvm_dev *dev, const uint64_t ppas[],
+			 struct nvm_addr addrs[], int naddrs, void *data,
+			 void *meta, uint16_t flags, struct nvm_ret *ret)
+{
+	if (addr_meta_crc(dev))
+		return addr_read_crc(dev, ppas, addrs, naddrs, data, meta,
+				     flags, ret);
+
+	return nvm_addr_cmd(dev, ppas, addrs, naddrs, data, meta, flags,
+			    S12_OPC_READ, ret);
+}
+
+ssize_t nvm_addr_write(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		       const void *data, const void *meta, uint16_t flags,
+		       struct nvm_ret *ret)
+{
+	uint64_t ppas[NVM_NADDR_MAX];
+
+	if (naddrs < 1 || naddrs > NVM_NADDR_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+	addr_gen2dev_list(dev, addrs, naddrs, ppas);
+
+	return addr_write(dev, ppas, addrs, naddrs, data, meta, flags, ret);
+}
+
 ssize_t nvm_addr_read(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
 		      void *data, void *meta, uint16_t flags,
 		      struct nvm_ret *ret)
 {
-	return nvm_addr_cmd(dev, addrs, naddrs, data, meta, flags,
-			    S12_OPC_READ, ret);
+	uint64_t ppas[NVM_NADDR_MAX];
+
+	if (naddrs < 1 || naddrs > NVM_NADDR_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+	addr_gen2dev_list(dev, addrs, naddrs, ppas);
+
+	return addr_read(dev, ppas, addrs, naddrs, data, meta, flags, ret);
+}
+
+/**
+ * @returns Non-zero when any of the device-format addresses has bits set
+ * outside of the fields of the address format
+ */
+static inline int addr_ppas_check(struct nvm_dev *dev, const uint64_t ppas[],
+				  int naddrs)
+{
+	uint64_t bits = 0;
+
+	for (int i = 0; i < naddrs; ++i)
+		bits |= ppas[i];
+
+	return (bits & ~dev->ppa_mask) != 0;
+}
+
+ssize_t nvm_addr_erase_dev(struct nvm_dev *dev, const uint64_t ppas[],
+			   int naddrs, uint16_t flags, struct nvm_ret *ret)
+{
+	if (naddrs < 1 || naddrs > NVM_NADDR_MAX ||
+	    addr_ppas_check(dev, ppas, naddrs)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return nvm_addr_cmd(dev, ppas, NULL, naddrs, NULL, NULL, flags,
+			    S12_OPC_ERASE, ret);
+}
+
+ssize_t nvm_addr_write_dev(struct nvm_dev *dev, const uint64_t ppas[],
+			   int naddrs, const void *data, const void *meta,
+			   uint16_t flags, struct nvm_ret *ret)
+{
+	if (naddrs < 1 || naddrs > NVM_NADDR_MAX ||
+	    addr_ppas_check(dev, ppas, naddrs)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return addr_write(dev, ppas, NULL, naddrs, data, meta, flags, ret);
+}
+
+ssize_t nvm_addr_read_dev(struct nvm_dev *dev, const uint64_t ppas[],
+			  int naddrs, void *data, void *meta, uint16_t flags,
+			  struct nvm_ret *ret)
+{
+	if (naddrs < 1 || naddrs > NVM_NADDR_MAX ||
+	    addr_ppas_check(dev, ppas, naddrs)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return addr_read(dev, ppas, NULL, naddrs, data, meta, flags, ret);
+}
+
+/**
+ * @returns Number of addresses in the smallest command of the plane-mode in
+ * flags, commands are split on multiples of it
+ */
+static inline int addr_unit_naddrs(const struct nvm_geo *geo, uint16_t flags,
+				   uint16_t opcode)
+{
+	int unit_naddrs = 1;
+
+	if (flags & NVM_FLAG_PMODE_QUAD)
+		unit_naddrs = 4;
+	else if (flags & NVM_FLAG_PMODE_DUAL)
+		unit_naddrs = 2;
+	if (opcode != S12_OPC_ERASE && unit_naddrs > 1)
+		unit_naddrs *= geo->nsectors;
+
+	return unit_naddrs;
+}
+
+/**
+ * Split the addresses into chunks of whole plane-mode units within the
+ * naddrs_max of the opcode. Chunks are grouped by the LUN of their first
+ * address, groups run concurrently and the chunks of a group in order. Writes
+ * run in a single group when a chunk spans LUNs, as chunks of different groups
+ * could then program the same block out of order.
+ */
+static ssize_t nvm_addr_cmd_many(struct nvm_dev *dev, struct nvm_addr addrs[],
+				 int naddrs, char *data, char *meta,
+				 uint16_t flags, uint16_t opcode,
+				 struct nvm_ret rets[], int nrets)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const size_t NLUNS = geo->nchannels * geo->nluns;
+	int unit_naddrs;
+	int naddrs_max, cmd_naddrs, nchunks;
+	size_t *grp_bgn = NULL;		// Offset of each group in chunks
+	int *chunks = NULL;		// Chunk indexes sorted by group
+	int *grps = NULL;		// Groups with chunks
+	int *chunk_grp = NULL;		// Group of each chunk
+	int ngrps = 0, serial = 0;
+	int fail_errno = 0;		// errno of the first failing command
+	size_t nerr = 0;
+
+	switch (opcode) {
+	case S12_OPC_ERASE:
+		naddrs_max = dev->erase_naddrs_max;
+		break;
+	case S12_OPC_WRITE:
+		naddrs_max = dev->write_naddrs_max;
+		break;
+	default:
+		naddrs_max = dev->read_naddrs_max;
+		break;
+	}
+
+	unit_naddrs = addr_unit_naddrs(geo, flags, opcode);
+
+	if (naddrs < 1 || unit_naddrs > naddrs_max || naddrs % unit_naddrs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	cmd_naddrs = (naddrs_max / unit_naddrs) * unit_naddrs;
+	nchunks = (naddrs + cmd_naddrs - 1) / cmd_naddrs;
+
+	grp_bgn = calloc(NLUNS + 1, sizeof(*grp_bgn));
+	chunks = malloc(nchunks * sizeof(*chunks));
+	grps = malloc(NLUNS * sizeof(*grps));
+	chunk_grp = malloc(nchunks * sizeof(*chunk_grp));
+	if (!grp_bgn || !chunks || !grps || !chunk_grp) {
+		errno = ENOMEM;
+		nerr = 1;
+		goto out;
+	}
+
+	for (int c = 0; c < nchunks; ++c) {
+		const int bgn = c * cmd_naddrs;
+		const int end = NVM_MIN(bgn + cmd_naddrs, naddrs);
+
+		if (addrs[bgn].g.ch >= geo->nchannels ||
+		    addrs[bgn].g.lun >= geo->nluns) {
+			errno = EINVAL;
+			nerr = 1;
+			goto out;
+		}
+		chunk_grp[c] = addrs[bgn].g.ch * geo->nluns + addrs[bgn].g.lun;
+
+		for (int i = bgn + 1; i < end; ++i) {
+			if (opcode == S12_OPC_WRITE &&
+			    (addrs[i].g.ch != addrs[bgn].g.ch ||
+			     addrs[i].g.lun != addrs[bgn].g.lun))
+				serial = 1;
+		}
+	}
+	for (int c = 0; serial && c < nchunks; ++c)
+		chunk_grp[c] = 0;
+
+	for (int c = 0; c < nchunks; ++c)	// Counting sort on group
+		++grp_bgn[chunk_grp[c] + 1];
+	for (size_t g = 0; g < NLUNS; ++g) {
+		if (grp_bgn[g + 1])
+			grps[ngrps++] = g;
+		grp_bgn[g + 1] += grp_bgn[g];
+	}
+	for (int c = 0; c < nchunks; ++c)
+		chunks[grp_bgn[chunk_grp[c]]++] = c;
+	for (size_t g = NLUNS; g > 0; --g)	// Restore offsets
+		grp_bgn[g] = grp_bgn[g - 1];
+	grp_bgn[0] = 0;
+
+	#pragma omp parallel num_threads(ngrps) reduction(+:nerr) if(ngrps>1)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(dev, &aff);
+
+		#pragma omp for schedule(static,1)
+		for (int g = 0; g < ngrps; ++g) {
+			const size_t end = grp_bgn[grps[g] + 1];
+
+			for (size_t i = grp_bgn[grps[g]]; i < end; ++i) {
+				const int c = chunks[i];
+				const int bgn = c * cmd_naddrs;
+				const int n = NVM_MIN(cmd_naddrs, naddrs - bgn);
+				char *cdata = data ?
+					data + bgn * geo->sector_nbytes : NULL;
+				char *cmeta = meta ?
+					meta + bgn * geo->meta_nbytes : NULL;
+				struct nvm_ret ret = {};
+
+				ssize_t err;
+
+				switch (opcode) {
+				case S12_OPC_WRITE:
+					err = nvm_addr_write(dev, addrs + bgn,
+							     n, cdata, cmeta,
+							     flags, &ret);
+					break;
+				case S12_OPC_READ:
+					err = nvm_addr_read(dev, addrs + bgn,
+							    n, cdata, cmeta,
+							    flags, &ret);
+					break;
+				default:
+					err = nvm_addr_erase(dev, addrs + bgn,
+							     n, flags, &ret);
+					break;
+				}
+				if (err) {
+					int none = 0;
+
+					__atomic_compare_exchange_n(&fail_errno,
+						&none, errno, 0,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED);
+					++nerr;
+				}
+
+				if (rets && c < nrets)
+					rets[c] = ret;
+			}
+		}
+
+		nvm_numa_unbind_worker(&aff);
+	}
+
+	if (nerr)
+		errno = fail_errno ? fail_errno : EIO;
+
+out:
+	free(grp_bgn);
+	free(chunks);
+	free(grps);
+	free(chunk_grp);
+
+	return nerr ? -1 : nchunks;
+}
+
+ssize_t nvm_addr_erase_many(struct nvm_dev *dev, struct nvm_addr addrs[],
+			    int naddrs, uint16_t flags, struct nvm_ret rets[],
+			    int nrets)
+{
+	return nvm_addr_cmd_many(dev, addrs, naddrs, NULL, NULL, flags,
+				 S12_OPC_ERASE, rets, nrets);
+}
+
+ssize_t nvm_addr_write_many(struct nvm_dev *dev, struct nvm_addr addrs[],
+			    int naddrs, const void *data, const void *meta,
+			    uint16_t flags, struct nvm_ret rets[], int nrets)
+{
+	return nvm_addr_cmd_many(dev, addrs, naddrs, (char *)data,
+				 (char *)meta, flags, S12_OPC_WRITE, rets,
+				 nrets);
+}
+
+ssize_t nvm_addr_read_many(struct nvm_dev *dev, struct nvm_addr addrs[],
+			   int naddrs, void *data, void *meta, uint16_t flags,
+			   struct nvm_ret rets[], int nrets)
+{
+	return nvm_addr_cmd_many(dev, addrs, naddrs, data, meta, flags,
+				 S12_OPC_READ, rets, nrets);
+}
+
+/**
+ * Copy via the device-side copy of the backend, one command per chunk
+ */
+static ssize_t addr_copy_dev(struct nvm_dev *dev, struct nvm_addr src[],
+			     struct nvm_addr dst[], int naddrs, int cmd_naddrs,
+			     uint16_t flags, struct nvm_ret *ret)
+{
+	const int nchunks = (naddrs + cmd_naddrs - 1) / cmd_naddrs;
+
+	for (int c = 0; c < nchunks; ++c) {
+		const int bgn = c * cmd_naddrs;
+		const int n = NVM_MIN(cmd_naddrs, naddrs - bgn);
+		uint64_t dev_src[n], dev_dst[n];
+		struct nvm_ret lret = {};
+
+		for (int i = 0; i < n; ++i) {
+			dev_src[i] = nvm_addr_gen2dev(dev, src[bgn + i]);
+			dev_dst[i] = nvm_addr_gen2dev(dev, dst[bgn + i]);
+		}
+
+		if (dev->be->copy(dev, dev_src, dev_dst, n, flags, &lret)) {
+			if (ret)
+				*ret = lret;
+			return -1;		// Propagate errno
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * State of a copy through host buffers, shared by the caller reading chunks
+ * into the ring and the thread programming them
+ */
+struct addr_copy {
+	struct nvm_dev *dev;
+	struct nvm_addr *dst;
+	int naddrs;
+	int cmd_naddrs;
+	int nchunks;
+	uint16_t flags;
+
+	char *data[2];			///< Ring of chunk buffers
+	char *meta[2];
+
+	int nread;			///< Chunks read into the ring
+	int nprogrammed;		///< Chunks programmed from the ring
+	int fail_chunk;			///< First failed chunk, nchunks if none
+	int fail_errno;			///< errno of the first failure
+	struct nvm_ret fail_ret;	///< Result of the first failure
+
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+};
+
+/**
+ * Record the failure of chunk `c`, keeping the first, called with the lock held
+ */
+static void addr_copy_fail(struct addr_copy *cp, int c, int err,
+			   const struct nvm_ret *ret)
+{
+	if (c < cp->fail_chunk) {
+		cp->fail_chunk = c;
+		cp->fail_errno = err;
+		cp->fail_ret = *ret;
+	}
+}
+
+/**
+ * Program the chunks in order as they are read, until all are programmed or
+ * a chunk fails
+ */
+static void *addr_copy_program(void *arg)
+{
+	struct addr_copy *cp = arg;
+
+	nvm_numa_bind(cp->dev);
+
+	for (int c = 0; c < cp->nchunks; ++c) {
+		const int bgn = c * cp->cmd_naddrs;
+		const int n = NVM_MIN(cp->cmd_naddrs, cp->naddrs - bgn);
+		struct nvm_ret ret = {};
+		ssize_t err;
+
+		pthread_mutex_lock(&cp->lock);
+		while (cp->nread <= c && cp->fail_chunk == cp->nchunks)
+			pthread_cond_wait(&cp->cv, &cp->lock);
+		if (cp->nread <= c) {		// Read of the chunk failed
+			pthread_mutex_unlock(&cp->lock);
+			break;
+		}
+		pthread_mutex_unlock(&cp->lock);
+
+		err = nvm_addr_write(cp->dev, cp->dst + bgn, n, cp->data[c % 2],
+				     cp->meta[c % 2], cp->flags, &ret);
+
+		pthread_mutex_lock(&cp->lock);
+		if (err)
+			addr_copy_fail(cp, c, errno, &ret);
+		else
+			cp->nprogrammed = c + 1;
+		pthread_cond_broadcast(&cp->cv);
+		pthread_mutex_unlock(&cp->lock);
+
+		if (err)
+			break;
+	}
+
+	return NULL;
+}
+
+/**
+ * Copy through a ring of two host buffers, the caller reads chunk c while a
+ * thread of its own programs chunk c - 1. Explicit threads are used as the
+ * copy commonly runs within a parallel region, e.g. from nvm_vblk_copy, where
+ * a nested OpenMP region would get a single thread.
+ */
+static ssize_t addr_copy_host(struct nvm_dev *dev, struct nvm_addr src[],
+			      struct nvm_addr dst[], int naddrs, int cmd_naddrs,
+			      uint16_t flags, struct nvm_ret *ret)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	const size_t data_nbytes = cmd_naddrs * geo->sector_nbytes;
+	const size_t meta_nbytes = cmd_naddrs * geo->meta_nbytes;
+	struct addr_copy cp = {
+		.dev = dev,
+		.dst = dst,
+		.naddrs = naddrs,
+		.cmd_naddrs = cmd_naddrs,
+		.nchunks = (naddrs + cmd_naddrs - 1) / cmd_naddrs,
+		.flags = flags,
+	};
+	pthread_t programmer;
+	ssize_t res = 0;
+	int err;
+
+	cp.fail_chunk = cp.nchunks;
+
+	for (int i = 0; i < 2; ++i) {
+		cp.data[i] = nvm_dev_buf_alloc(dev, data_nbytes);
+		if (meta_nbytes)
+			cp.meta[i] = nvm_dev_buf_alloc(dev, meta_nbytes);
+		if (!cp.data[i] || (meta_nbytes && !cp.meta[i])) {
+			errno = ENOMEM;
+			res = -1;
+			goto out;
+		}
+	}
+
+	pthread_mutex_init(&cp.lock, NULL);
+	pthread_cond_init(&cp.cv, NULL);
+
+	err = pthread_create(&programmer, NULL, addr_copy_program, &cp);
+	if (err) {
+		errno = err;
+		res = -1;
+		goto out_sync;
+	}
+
+	for (int c = 0; c < cp.nchunks; ++c) {
+		const int bgn = c * cmd_naddrs;
+		const int n = NVM_MIN(cmd_naddrs, naddrs - bgn);
+		struct nvm_ret lret = {};
+
+		pthread_mutex_lock(&cp.lock);	// Wait for a free buffer
+		while (c - cp.nprogrammed >= 2 && cp.fail_chunk == cp.nchunks)
+			pthread_cond_wait(&cp.cv, &cp.lock);
+		if (cp.fail_chunk < cp.nchunks) {
+			pthread_mutex_unlock(&cp.lock);
+			break;
+		}
+		pthread_mutex_unlock(&cp.lock);
+
+		err = nvm_addr_read(dev, src + bgn, n, cp.data[c % 2],
+				    cp.meta[c % 2], flags, &lret);
+
+		pthread_mutex_lock(&cp.lock);
+		if (err)
+			addr_copy_fail(&cp, c, errno, &lret);
+		else
+			cp.nread = c + 1;
+		pthread_cond_broadcast(&cp.cv);
+		pthread_mutex_unlock(&cp.lock);
+
+		if (err)
+			break;
+	}
+
+	pthread_join(programmer, NULL);
+
+	if (cp.fail_chunk < cp.nchunks) {
+		if (ret)
+			*ret = cp.fail_ret;
+		errno = cp.fail_errno;
+		res = -1;
+	}
+
+out_sync:
+	pthread_cond_destroy(&cp.cv);
+	pthread_mutex_destroy(&cp.lock);
+
+out:
+	for (int i = 0; i < 2; ++i) {
+		free(cp.data[i]);
+		free(cp.meta[i]);
+	}
+
+	return res;
+}
+
+ssize_t nvm_addr_copy(struct nvm_dev *dev, struct nvm_addr src[],
+		      struct nvm_addr dst[], int naddrs, uint16_t flags,
+		      struct nvm_ret *ret)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	const int naddrs_max = NVM_MIN(dev->read_naddrs_max,
+				       dev->write_naddrs_max);
+	const int unit_naddrs = addr_unit_naddrs(geo, flags, S12_OPC_WRITE);
+	int cmd_naddrs;
+
+	if (naddrs < 1 || unit_naddrs > naddrs_max || naddrs % unit_naddrs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	cmd_naddrs = (naddrs_max / unit_naddrs) * unit_naddrs;
+
+	if (dev->be->copy)
+		return addr_copy_dev(dev, src, dst, naddrs, cmd_naddrs, flags,
+				     ret);
+
+	return addr_copy_host(dev, src, dst, naddrs, cmd_naddrs, flags, ret);
+}
+
+int nvm_addr_fmt_parse(const char *str, struct nvm_addr_fmt *fmt,
+		       struct nvm_addr_fmt_mask *mask)
+{
+	size_t len = strlen(str);
+	char buf_fmt[3];
+
+	if (len == 27 && str[26] == '\n')	// Trailing newline from sysfs
+		--len;
+	if (len != 26 || str[0] != '0' || str[1] != 'x') {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (int i = 0; i < 12; ++i) {
+		buf_fmt[0] = str[2 + i*2];	// offset in bits
+		buf_fmt[1] = str[2 + i*2 + 1];	// number of bits
+		buf_fmt[2] = '\0';
+		fmt->a[i] = strtol(buf_fmt, NULL, 16);
+
+		if ((i % 2)) {
+			// i-1 = offset
+			// i = width
+			mask->a[i/2] = (((uint64_t)1<< fmt->a[i])-1) << fmt->a[i-1];
+		}
+	}
+
+	return 0;
 }
 
 void nvm_addr_fmt_pr(struct nvm_addr_fmt *fmt)
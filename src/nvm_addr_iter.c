@@ -0,0 +1,175 @@
+/*
+ * addr_iter - Enumeration of the addresses of a region
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+
+static const int iter_orders[][NVM_ADDR_NFIELDS] = {
+	[NVM_ADDR_ITER_ORDER_GEO] = {
+		NVM_ADDR_FIELD_CH, NVM_ADDR_FIELD_LUN, NVM_ADDR_FIELD_BLK,
+		NVM_ADDR_FIELD_PG, NVM_ADDR_FIELD_PL, NVM_ADDR_FIELD_SEC
+	},
+	[NVM_ADDR_ITER_ORDER_STRIPE] = {
+		NVM_ADDR_FIELD_BLK, NVM_ADDR_FIELD_PG, NVM_ADDR_FIELD_LUN,
+		NVM_ADDR_FIELD_CH, NVM_ADDR_FIELD_PL, NVM_ADDR_FIELD_SEC
+	},
+};
+
+static void iter_fields(struct nvm_addr addr, uint32_t fields[])
+{
+	fields[NVM_ADDR_FIELD_CH] = addr.g.ch;
+	fields[NVM_ADDR_FIELD_LUN] = addr.g.lun;
+	fields[NVM_ADDR_FIELD_BLK] = addr.g.blk;
+	fields[NVM_ADDR_FIELD_PG] = addr.g.pg;
+	fields[NVM_ADDR_FIELD_PL] = addr.g.pl;
+	fields[NVM_ADDR_FIELD_SEC] = addr.g.sec;
+}
+
+struct nvm_addr_iter *nvm_addr_iter_alloc(struct nvm_dev *dev,
+					  struct nvm_addr bgn,
+					  struct nvm_addr end, int unit,
+					  int order)
+{
+	struct nvm_addr_iter *iter;
+
+	if (!dev || nvm_addr_check(bgn, &dev->geo) ||
+	    nvm_addr_check(end, &dev->geo) || unit < NVM_ADDR_ITER_SECTOR ||
+	    unit > NVM_ADDR_ITER_BLOCK || order < NVM_ADDR_ITER_ORDER_GEO ||
+	    order > NVM_ADDR_ITER_ORDER_STRIPE) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	iter = calloc(1, sizeof(*iter));
+	if (!iter) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	iter->dev = dev;
+
+	for (int i = 0; i < NVM_ADDR_NFIELDS; ++i)
+		iter->fields[i] = iter_orders[order][i];
+
+	iter_fields(bgn, iter->bgn);
+	iter_fields(end, iter->end);
+
+	switch (unit) {			// Pin the fields below the unit
+	case NVM_ADDR_ITER_BLOCK:
+		iter->bgn[NVM_ADDR_FIELD_PG] = iter->end[NVM_ADDR_FIELD_PG] = 0;
+		/* fall through */
+	case NVM_ADDR_ITER_PAGE:
+		iter->bgn[NVM_ADDR_FIELD_SEC] = iter->end[NVM_ADDR_FIELD_SEC] = 0;
+		break;
+	}
+
+	iter->naddrs = 1;
+	for (int f = 0; f < NVM_ADDR_NFIELDS; ++f) {
+		if (iter->bgn[f] > iter->end[f]) {
+			free(iter);
+			errno = EINVAL;
+			return NULL;
+		}
+		iter->naddrs *= iter->end[f] - iter->bgn[f] + 1;
+	}
+
+	iter->unit_naddrs = (iter->end[NVM_ADDR_FIELD_PL] -
+			     iter->bgn[NVM_ADDR_FIELD_PL] + 1) *
+			    (iter->end[NVM_ADDR_FIELD_SEC] -
+			     iter->bgn[NVM_ADDR_FIELD_SEC] + 1);
+
+	nvm_addr_iter_reset(iter);
+
+	return iter;
+}
+
+void nvm_addr_iter_free(struct nvm_addr_iter *iter)
+{
+	free(iter);
+}
+
+void nvm_addr_iter_reset(struct nvm_addr_iter *iter)
+{
+	for (int f = 0; f < NVM_ADDR_NFIELDS; ++f)
+		iter->cur[f] = iter->bgn[f];
+	iter->done = 0;
+}
+
+size_t nvm_addr_iter_get_naddrs(struct nvm_addr_iter *iter)
+{
+	return iter->naddrs;
+}
+
+int nvm_addr_iter_next(struct nvm_addr_iter *iter, struct nvm_addr addrs[],
+		       uint64_t ppas[], int naddrs_max)
+{
+	struct nvm_dev *dev = iter->dev;
+	uint32_t *cur = iter->cur;
+	int naddrs = 0;
+
+	if (naddrs_max < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (naddrs_max >= iter->unit_naddrs)	// Whole plane-mode units
+		naddrs_max -= naddrs_max % iter->unit_naddrs;
+
+	for (; naddrs < naddrs_max && !iter->done; ++naddrs) {
+		struct nvm_addr addr;
+		int i;
+
+		addr.ppa = 0;
+		addr.g.ch = cur[NVM_ADDR_FIELD_CH];
+		addr.g.lun = cur[NVM_ADDR_FIELD_LUN];
+		addr.g.blk = cur[NVM_ADDR_FIELD_BLK];
+		addr.g.pg = cur[NVM_ADDR_FIELD_PG];
+		addr.g.pl = cur[NVM_ADDR_FIELD_PL];
+		addr.g.sec = cur[NVM_ADDR_FIELD_SEC];
+
+		if (addrs)
+			addrs[naddrs] = addr;
+		if (ppas)
+			ppas[naddrs] = dev->gen2dev(dev, addr);
+
+		for (i = NVM_ADDR_NFIELDS - 1; i >= 0; --i) {	// Advance
+			const int f = iter->fields[i];
+
+			if (cur[f] < iter->end[f]) {
+				++cur[f];
+				break;
+			}
+			cur[f] = iter->bgn[f];
+		}
+		if (i < 0)
+			iter->done = 1;
+	}
+
+	return naddrs;
+}
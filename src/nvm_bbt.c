@@ -45,25 +45,13 @@ static inline int _bbt_idx(const struct nvm_dev *dev,
 static inline int _blk_idx(const struct nvm_dev *dev,
 		           const struct nvm_addr addr)
 {
-	return addr.g.blk * dev->geo.nplanes + addr.g.pl;
-}
+	const struct nvm_div *nplanes = &dev->gdiv.nplanes;
 
-/**
- * Hack'n'slashed in here...
- */
-struct krnl_bbt {
-	uint8_t		tblid[4];
-	uint16_t	verid;
-	uint16_t	revid;
-	uint32_t	rvsd1;
-	uint32_t	tblks;
-	uint32_t	tfact;
-	uint32_t	tgrown;
-	uint32_t	tdresv;
-	uint32_t	thresv;
-	uint32_t	rsvd2[8];
-	uint8_t		blk[0];
-};
+	if (!nplanes->mult)			// Power of two
+		return (addr.g.blk << nplanes->shift) | addr.g.pl;
+
+	return addr.g.blk * nplanes->d + addr.g.pl;
+}
 
 void krnl_bbt_pr(struct krnl_bbt *bbt)
 {
@@ -108,7 +96,7 @@ static inline int krnl_bbt_get(struct nvm_bbt *bbt, struct nvm_ret *ret)
 	int err;
 
 	krnl_bbt_sz = sizeof(*k_bbt) + sizeof(*(k_bbt->blk)) * bbt->nblks;
-	k_bbt = nvm_buf_alloc(&bbt->dev->geo, krnl_bbt_sz);
+	k_bbt = nvm_dev_buf_alloc(bbt->dev, krnl_bbt_sz);
 	if (!k_bbt) {
 		errno = ENOMEM;
 		return -1;
@@ -121,7 +109,7 @@ static inline int krnl_bbt_get(struct nvm_bbt *bbt, struct nvm_ret *ret)
 	ctl.ppa_list = nvm_addr_gen2dev(bbt->dev, bbt->addr);
 	ctl.nppas = 0;
 
-	err = ioctl(bbt->dev->fd, NVME_NVM_IOCTL_ADMIN_VIO, &ctl);
+	err = bbt->dev->be->admin(bbt->dev, &ctl);
 	if (ret) {			// Fill return-codes when available
 		ret->result = ctl.result;
 		ret->status = ctl.status;
@@ -185,7 +173,7 @@ static inline int krnl_bbt_mark(struct nvm_dev *dev, struct nvm_addr addrs[],
 	ctl.nppas = naddrs - 1;		// Unnatural numbers: counting from zero
 	ctl.ppa_list = naddrs == 1 ? dev_addrs[0] : (uint64_t)dev_addrs;
 
-	err = ioctl(dev->fd, NVME_NVM_IOCTL_ADMIN_VIO, &ctl);
+	err = dev->be->admin(dev, &ctl);
 	if (ret) {			// Fill return-codes when available
 		ret->result = ctl.result;
 		ret->status = ctl.status;
@@ -222,10 +210,13 @@ int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
 		return -1;			// Propagate `errno`
 
 	err = krnl_bbt_get(krnl, ret);
-	if (err)
+	if (err) {
+		nvm_bbt_free(krnl);
 		return -1;			// Propagate `errno`
+	}
 
 	if (bbt->nblks != krnl->nblks) {
+		nvm_bbt_free(krnl);
 		errno = EINVAL;
 		return -1;
 	}
@@ -238,12 +229,15 @@ int nvm_bbt_flush(struct nvm_dev *dev, struct nvm_addr addr,
 
 		// Convert "i -> (blk, pl)" and submit changed state
 		blk_addr.ppa = bbt->addr.ppa;
-		blk_addr.g.blk = i / dev->geo.nplanes;
-		blk_addr.g.pl = i % dev->geo.nplanes;
+		blk_addr.g.blk = nvm_div(&dev->gdiv.nplanes, i);
+		blk_addr.g.pl = nvm_mod(&dev->gdiv.nplanes, i);
 
-		if (krnl_bbt_mark(dev, &blk_addr, 1, bbt->blks[i], ret))
+		if (krnl_bbt_mark(dev, &blk_addr, 1, bbt->blks[i], ret)) {
+			nvm_bbt_free(krnl);
 			return -1;		// Propagate `errno`
+		}
 	}
+	nvm_bbt_free(krnl);
 
 	/* Deallocate the bbt entry */
 	nvm_bbt_free(dev->bbts[bbt_idx]);
@@ -388,7 +382,7 @@ struct nvm_bbt *nvm_bbt_alloc_cp(const struct nvm_bbt *bbt)
 	}
 
 	new->blks = malloc(sizeof(*(new->blks)) * bbt->nblks);
-	if (!new->nblks) {
+	if (!new->blks) {
 		free(new);
 		errno = ENOMEM;
 		return NULL;
@@ -0,0 +1,357 @@
+/*
+ * be_ioctl - Backend submitting via the LightNVM kernel ioctls
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <libudev.h>
+#include <linux/lightnvm.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+#include <nvm_debug.h>
+
+/*
+ * Searches the udev 'subsystem' for device named 'dev_name' of type 'devtype'
+ *
+ * NOTE: Caller is responsible for calling `udev_device_unref` on the returned
+ * udev_device
+ *
+ * @returns First device in 'subsystem' of given 'devtype' with given 'dev_name'
+ */
+struct udev_device *udev_dev_find(struct udev *udev, const char *subsystem,
+				  const char *devtype, const char *dev_name)
+{
+	struct udev_device *dev = NULL;
+
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *devices, *dev_list_entry;
+
+	enumerate = udev_enumerate_new(udev);	/* Search 'subsystem' */
+	udev_enumerate_add_match_subsystem(enumerate, subsystem);
+	udev_enumerate_scan_devices(enumerate);
+	devices = udev_enumerate_get_list_entry(enumerate);
+	udev_list_entry_foreach(dev_list_entry, devices) {
+		const char *path;
+		int path_len;
+
+		path = udev_list_entry_get_name(dev_list_entry);
+		if (!path) {
+			NVM_DEBUG("FAILED: retrieving path from entry\n");
+			continue;
+		}
+		path_len = strlen(path);
+
+		if (dev_name) {			/* Compare name */
+			int dev_name_len = strlen(dev_name);
+			int match = strcmp(dev_name,
+					   path + path_len-dev_name_len);
+			if (match != 0) {
+				continue;
+			}
+		}
+						/* Get the udev object */
+		dev = udev_device_new_from_syspath(udev, path);
+		if (!dev) {
+			NVM_DEBUG("FAILED: retrieving device from path\n");
+			continue;
+		}
+
+		if (devtype) {			/* Compare device type */
+			const char *sys_devtype;
+			int sys_devtype_match;
+
+			sys_devtype = udev_device_get_devtype(dev);
+			if (!sys_devtype) {
+				NVM_DEBUG("FAILED: sys_devtype(%s)", sys_devtype);
+				udev_device_unref(dev);
+				dev = NULL;
+				continue;
+			}
+
+			sys_devtype_match = strcmp(devtype, sys_devtype);
+			if (sys_devtype_match != 0) {
+				NVM_DEBUG("FAILED: %s != %s\n", devtype, sys_devtype);
+				udev_device_unref(dev);
+				dev = NULL;
+				continue;
+			}
+		}
+
+		break;
+	}
+
+	return dev;
+}
+
+struct udev_device *udev_nvmdev_find(struct udev *udev, const char *dev_name)
+{
+	struct udev_device *dev;
+
+	dev  = udev_dev_find(udev, "block", NULL, dev_name);
+	if (dev)
+		return dev;
+
+	NVM_DEBUG("FAILED: NOTHING FOUND\n");
+	return NULL;
+}
+
+static int sysattr2int(struct udev_device *dev, const char *attr, int *val)
+{
+	const char *dev_path;
+	char path[4096];
+	char buf[4096];
+	char c;
+	FILE *fp;
+	int i;
+
+	memset(buf, 0, sizeof(char)*4096);
+
+	dev_path = udev_device_get_syspath(dev);
+	if (!dev_path)
+		return -ENODEV;
+
+	sprintf(path, "%s/%s", dev_path, attr);
+	fp = fopen(path, "rb");
+	if (!fp)
+		return -ENODEV;
+
+	i = 0;
+	while (((c = getc(fp)) != EOF) && i < 4096) {
+		buf[i] = c;
+		++i;
+	}
+	fclose(fp);
+
+	*val = atoi(buf);
+	return 0;
+}
+
+static int sysattr2fmt(struct udev_device *dev, const char *attr,
+		   struct nvm_addr_fmt  *fmt, struct nvm_addr_fmt_mask *mask)
+{
+	const char *dev_path;
+	char path[4096];
+	char buf[4096];
+	char c;
+	FILE *fp;
+	int i;
+
+	memset(buf, 0, sizeof(char)*4096);
+
+	dev_path = udev_device_get_syspath(dev);
+	if (!dev_path)
+		return -ENODEV;
+
+	sprintf(path, "%s/%s", dev_path, attr);
+	fp = fopen(path, "rb");
+	if (!fp)
+		return -ENODEV;
+
+	i = 0;
+	while (((c = getc(fp)) != EOF) && i < 4096) {
+		buf[i] = c;
+		++i;
+	}
+	fclose(fp);
+
+	return nvm_addr_fmt_parse(buf, fmt, mask);
+}
+
+static int dev_attr_fill(struct nvm_dev *dev)
+{
+	struct udev *udev;
+	struct udev_device *udev_dev;
+	struct nvm_geo *geo;
+	int val;
+
+	udev = udev_new();
+	if (!udev) {
+		NVM_DEBUG("FAILED: udev_new for name(%s)\n", dev->name);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* Get a handle on udev / sysfs */
+	udev_dev = udev_nvmdev_find(udev, dev->name);
+	if (!udev_dev) {
+		NVM_DEBUG("FAILED: udev_nvmdev_find for name(%s)\n", dev->name);
+		udev_unref(udev);
+		errno = ENODEV;
+		return -1;
+	}
+
+	/* Extract ppa_format from sysfs via libudev */
+	if (sysattr2fmt(udev_dev, "lightnvm/ppa_format", &dev->fmt, &dev->mask)) {
+		NVM_DEBUG("FAILED: ppa_format for name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+
+	/*
+	 * Extract geometry from sysfs via libudev
+	 */
+	geo = &(dev->geo);
+
+	if (sysattr2int(udev_dev, "lightnvm/num_channels", &val)) {
+		NVM_DEBUG("FAILED: num_channels for dev->name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+	geo->nchannels = val;
+
+	if (sysattr2int(udev_dev, "lightnvm/num_luns", &val)) {
+		NVM_DEBUG("FAILED: num_luns for dev->name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+	geo->nluns = val;
+
+	if (sysattr2int(udev_dev, "lightnvm/num_planes", &val)) {
+		NVM_DEBUG("FAILED: num_planes for dev->name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+	geo->nplanes = val;
+
+	if (sysattr2int(udev_dev, "lightnvm/num_blocks", &val)) {
+		NVM_DEBUG("FAILED: num_blocks for dev->name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+	geo->nblocks = val;
+
+	if (sysattr2int(udev_dev, "lightnvm/num_pages", &val)) {
+		NVM_DEBUG("FAILED: num_pages for dev->name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+	geo->npages = val;
+
+	if (sysattr2int(udev_dev, "lightnvm/page_size", &val)) {
+		NVM_DEBUG("FAILED: page_size for dev->name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+	geo->page_nbytes = val;
+
+	if (sysattr2int(udev_dev, "lightnvm/hw_sector_size", &val)) {
+		NVM_DEBUG("FAILED: hw_sector_size for dev->name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+	geo->sector_nbytes = val;
+
+	if (sysattr2int(udev_dev, "lightnvm/oob_sector_size", &val)) {
+		NVM_DEBUG("FAILED: oob_sector_size dev->name(%s)\n", dev->name);
+		errno = EIO;
+		return -1;
+	}
+	geo->meta_nbytes = val;
+
+	/* NUMA node of the controller, absent on kernels without NUMA */
+	if (!sysattr2int(udev_dev, "device/numa_node", &val) ||
+	    !sysattr2int(udev_dev, "device/device/numa_node", &val))
+		dev->numa_node = val;
+
+	udev_device_unref(udev_dev);
+	udev_unref(udev);
+
+	// WARN: HOTFIX for reports of unrealisticly large OOB area
+	if (geo->meta_nbytes > 100) {
+		geo->meta_nbytes = 16;	// Naively hope this is right
+	}
+
+	return 0;
+}
+
+static int be_ioctl_open(struct nvm_dev *dev)
+{
+	int err;
+
+	dev->fd = open(dev->path, O_RDWR | O_DIRECT);
+	if (dev->fd < 0) {
+		NVM_DEBUG("FAILED: open dev->path(%s) dev->fd(%d)\n",
+			  dev->path, dev->fd);
+		return -1;
+	}
+
+	err = dev_attr_fill(dev);
+	if (err) {
+		NVM_DEBUG("FAILED: dev_attr_fill, err(%d)\n", err);
+		close(dev->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void be_ioctl_close(struct nvm_dev *dev)
+{
+	close(dev->fd);
+}
+
+static int be_ioctl_vio(struct nvm_dev *dev, struct nvm_user_vio *ctl)
+{
+	return ioctl(dev->fd, NVME_NVM_IOCTL_SUBMIT_VIO, ctl);
+}
+
+static int be_ioctl_admin(struct nvm_dev *dev, struct nvm_passthru_vio *ctl)
+{
+	return ioctl(dev->fd, NVME_NVM_IOCTL_ADMIN_VIO, ctl);
+}
+
+static ssize_t be_ioctl_pwrite(struct nvm_dev *dev, const void *buf,
+			       size_t count, off_t offset)
+{
+	return pwrite(dev->fd, buf, count, offset);
+}
+
+static ssize_t be_ioctl_pread(struct nvm_dev *dev, void *buf, size_t count,
+			      off_t offset)
+{
+	return pread(dev->fd, buf, count, offset);
+}
+
+const struct nvm_be nvm_be_ioctl = {
+	.name = "ioctl",
+	.pfx = NULL,
+	.open = be_ioctl_open,
+	.close = be_ioctl_close,
+	.vio = be_ioctl_vio,
+	.admin = be_ioctl_admin,
+	.pwrite = be_ioctl_pwrite,
+	.pread = be_ioctl_pread,
+	.fd_io = 1,
+};
@@ -0,0 +1,290 @@
+/*
+ * cmd - building of multi-plane vectored commands
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <linux/lightnvm.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+
+struct nvm_cmd_builder *nvm_cmd_builder_alloc(struct nvm_dev *dev)
+{
+	struct nvm_cmd_builder *builder;
+
+	builder = calloc(1, sizeof(*builder));
+	if (!builder) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	builder->dev = dev;
+
+	return builder;
+}
+
+void nvm_cmd_builder_free(struct nvm_cmd_builder *builder)
+{
+	if (!builder)
+		return;
+
+	free(builder->ents);
+	free(builder);
+}
+
+void nvm_cmd_builder_reset(struct nvm_cmd_builder *builder)
+{
+	builder->nents = 0;
+}
+
+int nvm_cmd_builder_get_naddrs(struct nvm_cmd_builder *builder)
+{
+	return builder->nents;
+}
+
+int nvm_cmd_builder_add(struct nvm_cmd_builder *builder, struct nvm_addr addr,
+			void *buf)
+{
+	if (nvm_addr_check(addr, nvm_dev_get_geo(builder->dev))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (builder->nents == builder->nents_max) {
+		int nents_max = builder->nents_max ? builder->nents_max * 2 : 64;
+		struct nvm_cmd_ent *ents;
+
+		ents = realloc(builder->ents, nents_max * sizeof(*ents));
+		if (!ents) {
+			errno = ENOMEM;
+			return -1;
+		}
+		builder->ents = ents;
+		builder->nents_max = nents_max;
+	}
+
+	builder->ents[builder->nents].addr = addr;
+	builder->ents[builder->nents].buf = buf;
+	++builder->nents;
+
+	return 0;
+}
+
+static int ent_cmp(const void *a, const void *b)
+{
+	const struct nvm_cmd_ent *ea = a, *eb = b;
+
+	if (ea->key < eb->key)
+		return -1;
+
+	return ea->key > eb->key;
+}
+
+/**
+ * Position of the address in the order the firmware expects, blocks before
+ * planes for erase, pages before planes before sectors otherwise
+ */
+static uint64_t ent_key(const struct nvm_geo *geo, struct nvm_addr addr,
+			uint16_t opcode)
+{
+	uint64_t key;
+
+	key = ((uint64_t)addr.g.ch * geo->nluns + addr.g.lun) * geo->nblocks +
+	      addr.g.blk;
+
+	if (opcode == S12_OPC_ERASE)
+		return key * geo->nplanes + addr.g.pl;
+
+	key = (key * geo->npages + addr.g.pg) * geo->nplanes + addr.g.pl;
+
+	return key * geo->nsectors + addr.g.sec;
+}
+
+/**
+ * Sort the addresses, then emit commands of whole units, a unit being the
+ * addresses a single plane-mode operation covers, and for writes at least a
+ * page. Addresses missing from a unit are filled in for erase and read, the
+ * latter into a scratch buffer. Writes must cover whole units, as a page can
+ * not be programmed again until its block is erased.
+ */
+static ssize_t builder_run(struct nvm_cmd_builder *builder, uint16_t opcode,
+			   struct nvm_ret *ret)
+{
+	struct nvm_dev *dev = builder->dev;
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const int PMODE = nvm_dev_get_pmode(dev);
+	const int ERASE = opcode == S12_OPC_ERASE;
+	const int WRITE = opcode == S12_OPC_WRITE;
+	int unit_naddrs = 1;
+	int naddrs_max;
+	char *bounce = NULL;
+	ssize_t ncmds = 0;
+
+	switch (opcode) {
+	case S12_OPC_ERASE:
+		naddrs_max = nvm_dev_get_erase_naddrs_max(dev);
+		break;
+	case S12_OPC_WRITE:
+		naddrs_max = nvm_dev_get_write_naddrs_max(dev);
+		break;
+	default:
+		naddrs_max = nvm_dev_get_read_naddrs_max(dev);
+		break;
+	}
+
+	if (PMODE != NVM_FLAG_PMODE_SNGL)
+		unit_naddrs = ERASE ? geo->nplanes : geo->nplanes * geo->nsectors;
+	else if (WRITE)
+		unit_naddrs = geo->nsectors;	// No sub-page programs
+
+	if (unit_naddrs > naddrs_max) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (int i = 0; i < builder->nents; ++i) {
+		builder->ents[i].key = ent_key(geo, builder->ents[i].addr,
+					       opcode);
+		if (!ERASE && !builder->ents[i].buf) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	qsort(builder->ents, builder->nents, sizeof(*builder->ents), ent_cmp);
+	for (int i = 1; i < builder->nents; ++i) {
+		if (builder->ents[i].key == builder->ents[i - 1].key) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	for (int i = 0; WRITE && i < builder->nents; i += unit_naddrs) {
+		const uint64_t key = builder->ents[i].key;	// Whole units
+
+		if ((key % unit_naddrs) || (i + unit_naddrs > builder->nents) ||
+		    (builder->ents[i + unit_naddrs - 1].key !=
+		     key + unit_naddrs - 1)) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	if (!ERASE) {
+		bounce = nvm_dev_buf_alloc(builder->dev,
+					   naddrs_max * geo->sector_nbytes);
+		if (!bounce) {
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < builder->nents; ++ncmds) {
+		struct nvm_addr addrs[naddrs_max];
+		struct nvm_cmd_ent *ents[naddrs_max];
+		int naddrs = 0;
+		ssize_t err;
+
+		while (i < builder->nents && naddrs + unit_naddrs <= naddrs_max) {
+			const uint64_t unit = builder->ents[i].key / unit_naddrs;
+			const struct nvm_addr base = builder->ents[i].addr;
+
+			for (int k = 0; k < unit_naddrs; ++k, ++naddrs) {
+				struct nvm_cmd_ent *ent = &builder->ents[i];
+				const uint64_t key = unit * unit_naddrs + k;
+
+				if (i < builder->nents && ent->key == key) {
+					addrs[naddrs] = ent->addr;
+					ents[naddrs] = ent;
+					++i;
+					continue;
+				}
+
+				addrs[naddrs] = base;	// Sibling fill-in
+				if (ERASE) {
+					addrs[naddrs].g.pl = key % geo->nplanes;
+				} else {
+					addrs[naddrs].g.pl = (key / geo->nsectors) %
+							     geo->nplanes;
+					addrs[naddrs].g.sec = key % geo->nsectors;
+				}
+				ents[naddrs] = NULL;
+			}
+		}
+
+		for (int k = 0; WRITE && k < naddrs; ++k)
+			memcpy(bounce + k * geo->sector_nbytes, ents[k]->buf,
+			       geo->sector_nbytes);
+
+		switch (opcode) {
+		case S12_OPC_ERASE:
+			err = nvm_addr_erase(dev, addrs, naddrs, PMODE, ret);
+			break;
+		case S12_OPC_WRITE:
+			err = nvm_addr_write(dev, addrs, naddrs, bounce, NULL,
+					     PMODE, ret);
+			break;
+		default:
+			err = nvm_addr_read(dev, addrs, naddrs, bounce, NULL,
+					    PMODE, ret);
+			break;
+		}
+		if (err) {
+			free(bounce);
+			return -1;		// Propagate errno
+		}
+
+		for (int k = 0; opcode == S12_OPC_READ && k < naddrs; ++k) {
+			if (ents[k])
+				memcpy(ents[k]->buf,
+				       bounce + k * geo->sector_nbytes,
+				       geo->sector_nbytes);
+		}
+	}
+
+	free(bounce);
+
+	return ncmds;
+}
+
+ssize_t nvm_cmd_builder_erase(struct nvm_cmd_builder *builder,
+			      struct nvm_ret *ret)
+{
+	return builder_run(builder, S12_OPC_ERASE, ret);
+}
+
+ssize_t nvm_cmd_builder_write(struct nvm_cmd_builder *builder,
+			      struct nvm_ret *ret)
+{
+	return builder_run(builder, S12_OPC_WRITE, ret);
+}
+
+ssize_t nvm_cmd_builder_read(struct nvm_cmd_builder *builder,
+			     struct nvm_ret *ret)
+{
+	return builder_run(builder, S12_OPC_READ, ret);
+}
@@ -0,0 +1,140 @@
+/*
+ * crc - CRC32C checksums
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#define CRC32C_POLY 0x82F63B78	///< Castagnoli polynomial, reflected
+
+static uint32_t crc32c_tbl[256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_tbl_init(void)
+{
+	for (uint32_t i = 0; i < 256; ++i) {
+		uint32_t crc = i;
+
+		for (int k = 0; k < 8; ++k)
+			crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+
+		crc32c_tbl[i] = crc;
+	}
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	pthread_once(&crc32c_once, crc32c_tbl_init);
+
+	while (len--)
+		crc = (crc >> 8) ^ crc32c_tbl[(crc ^ *buf++) & 0xFF];
+
+	return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	uint64_t crc64 = crc;
+
+	for (; len >= 8; len -= 8, buf += 8) {
+		uint64_t val;
+
+		memcpy(&val, buf, sizeof(val));
+		crc64 = __builtin_ia32_crc32di(crc64, val);
+	}
+	crc = crc64;
+	while (len--)
+		crc = __builtin_ia32_crc32qi(crc, *buf++);
+
+	return crc;
+}
+
+static int crc32c_hw_supported(void)
+{
+	static int supported = -1;
+
+	if (supported < 0)
+		supported = __builtin_cpu_supports("sse4.2");
+
+	return supported;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	for (; len >= 8; len -= 8, buf += 8) {
+		uint64_t val;
+
+		memcpy(&val, buf, sizeof(val));
+		crc = __crc32cd(crc, val);
+	}
+	while (len--)
+		crc = __crc32cb(crc, *buf++);
+
+	return crc;
+}
+
+static int crc32c_hw_supported(void)
+{
+	return 1;
+}
+#else
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *buf, size_t len)
+{
+	return crc32c_sw(crc, buf, len);
+}
+
+static int crc32c_hw_supported(void)
+{
+	return 0;
+}
+#endif
+
+uint32_t nvm_crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	crc = ~crc;
+
+	if (crc32c_hw_supported())
+		crc = crc32c_hw(crc, buf, len);
+	else
+		crc = crc32c_sw(crc, buf, len);
+
+	return ~crc;
+}
+
+uint32_t nvm_meta_crc(const void *data, size_t nbytes, uint32_t seq)
+{
+	return nvm_crc32c(nvm_crc32c(0, data, nbytes), &seq, sizeof(seq));
+}
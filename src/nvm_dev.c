@@ -35,177 +35,12 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <errno.h>
-#include <libudev.h>
 #include <linux/lightnvm.h>
 #include <liblightnvm.h>
 #include <nvm.h>
+#include <nvm_omp.h>
 #include <nvm_debug.h>
 
-/*
- * Searches the udev 'subsystem' for device named 'dev_name' of type 'devtype'
- *
- * NOTE: Caller is responsible for calling `udev_device_unref` on the returned
- * udev_device
- *
- * @returns First device in 'subsystem' of given 'devtype' with given 'dev_name'
- */
-struct udev_device *udev_dev_find(struct udev *udev, const char *subsystem,
-				  const char *devtype, const char *dev_name)
-{
-	struct udev_device *dev = NULL;
-
-	struct udev_enumerate *enumerate;
-	struct udev_list_entry *devices, *dev_list_entry;
-
-	enumerate = udev_enumerate_new(udev);	/* Search 'subsystem' */
-	udev_enumerate_add_match_subsystem(enumerate, subsystem);
-	udev_enumerate_scan_devices(enumerate);
-	devices = udev_enumerate_get_list_entry(enumerate);
-	udev_list_entry_foreach(dev_list_entry, devices) {
-		const char *path;
-		int path_len;
-
-		path = udev_list_entry_get_name(dev_list_entry);
-		if (!path) {
-			NVM_DEBUG("FAILED: retrieving path from entry\n");
-			continue;
-		}
-		path_len = strlen(path);
-
-		if (dev_name) {			/* Compare name */
-			int dev_name_len = strlen(dev_name);
-			int match = strcmp(dev_name,
-					   path + path_len-dev_name_len);
-			if (match != 0) {
-				continue;
-			}
-		}
-						/* Get the udev object */
-		dev = udev_device_new_from_syspath(udev, path);
-		if (!dev) {
-			NVM_DEBUG("FAILED: retrieving device from path\n");
-			continue;
-		}
-
-		if (devtype) {			/* Compare device type */
-			const char *sys_devtype;
-			int sys_devtype_match;
-
-			sys_devtype = udev_device_get_devtype(dev);
-			if (!sys_devtype) {
-				NVM_DEBUG("FAILED: sys_devtype(%s)", sys_devtype);
-				udev_device_unref(dev);
-				dev = NULL;
-				continue;
-			}
-
-			sys_devtype_match = strcmp(devtype, sys_devtype);
-			if (sys_devtype_match != 0) {
-				NVM_DEBUG("FAILED: %s != %s\n", devtype, sys_devtype);
-				udev_device_unref(dev);
-				dev = NULL;
-				continue;
-			}
-		}
-
-		break;
-	}
-
-	return dev;
-}
-
-struct udev_device *udev_nvmdev_find(struct udev *udev, const char *dev_name)
-{
-	struct udev_device *dev;
-
-	dev  = udev_dev_find(udev, "block", NULL, dev_name);
-	if (dev)
-		return dev;
-
-	NVM_DEBUG("FAILED: NOTHING FOUND\n");
-	return NULL;
-}
-
-static int sysattr2int(struct udev_device *dev, const char *attr, int *val)
-{
-	const char *dev_path;
-	char path[4096];
-	char buf[4096];
-	char c;
-	FILE *fp;
-	int i;
-
-	memset(buf, 0, sizeof(char)*4096);
-
-	dev_path = udev_device_get_syspath(dev);
-	if (!dev_path)
-		return -ENODEV;
-
-	sprintf(path, "%s/%s", dev_path, attr);
-	fp = fopen(path, "rb");
-	if (!fp)
-		return -ENODEV;
-
-	i = 0;
-	while (((c = getc(fp)) != EOF) && i < 4096) {
-		buf[i] = c;
-		++i;
-	}
-	fclose(fp);
-
-	*val = atoi(buf);
-	return 0;
-}
-
-static int sysattr2fmt(struct udev_device *dev, const char *attr,
-		   struct nvm_addr_fmt  *fmt, struct nvm_addr_fmt_mask *mask)
-{
-	const char *dev_path;
-	char path[4096];
-	char buf[4096];
-	char buf_fmt[3];
-	char c;
-	FILE *fp;
-	int i;
-
-	memset(buf, 0, sizeof(char)*4096);
-
-	dev_path = udev_device_get_syspath(dev);
-	if (!dev_path)
-		return -ENODEV;
-
-	sprintf(path, "%s/%s", dev_path, attr);
-	fp = fopen(path, "rb");
-	if (!fp)
-		return -ENODEV;
-
-	i = 0;
-	while (((c = getc(fp)) != EOF) && i < 4096) {
-		buf[i] = c;
-		++i;
-	}
-	fclose(fp);
-
-	if (strlen(buf) != 27) { // len !matching "0x380830082808001010102008\n"
-		return -1;
-	}
-
-	for (i = 0; i < 12; ++i) {
-		buf_fmt[0] = buf[2 + i*2];	// offset in bits
-		buf_fmt[1] = buf[2 + i*2 + 1];	// number of bits
-		buf_fmt[2] = '\0';
-		fmt->a[i] = strtol(buf_fmt, NULL, 16);
-
-		if ((i % 2)) {
-			// i-1 = offset
-			// i = width
-			mask->a[i/2] = (((uint64_t)1<< fmt->a[i])-1) << fmt->a[i-1];
-		}
-	}
-
-	return 0;
-}
-
 uint64_t ilog2(uint64_t x)
 {
   uint64_t val = 0;
@@ -216,104 +51,45 @@ uint64_t ilog2(uint64_t x)
   return val;
 }
 
-static int dev_attr_fill(struct nvm_dev *dev)
-{
-	struct udev *udev;
-	struct udev_device *udev_dev;
-	struct nvm_geo *geo;
-	int val;
-
-	udev = udev_new();
-	if (!udev) {
-		NVM_DEBUG("FAILED: udev_new for name(%s)\n", dev->name);
-		errno = ENOMEM;
-		return -1;
-	}
-
-	/* Get a handle on udev / sysfs */
-	udev_dev = udev_nvmdev_find(udev, dev->name);
-	if (!udev_dev) {
-		NVM_DEBUG("FAILED: udev_nvmdev_find for name(%s)\n", dev->name);
-		udev_unref(udev);
-		errno = ENODEV;
-		return -1;
-	}
-
-	/* Extract ppa_format from sysfs via libudev */
-	if (sysattr2fmt(udev_dev, "lightnvm/ppa_format", &dev->fmt, &dev->mask)) {
-		NVM_DEBUG("FAILED: ppa_format for name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
-	}
-
-	/*
-	 * Extract geometry from sysfs via libudev
-	 */
-	geo = &(dev->geo);
-
-	if (sysattr2int(udev_dev, "lightnvm/num_channels", &val)) {
-		NVM_DEBUG("FAILED: num_channels for dev->name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
-	}
-	geo->nchannels = val;
-
-	if (sysattr2int(udev_dev, "lightnvm/num_luns", &val)) {
-		NVM_DEBUG("FAILED: num_luns for dev->name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
-	}
-	geo->nluns = val;
-
-	if (sysattr2int(udev_dev, "lightnvm/num_planes", &val)) {
-		NVM_DEBUG("FAILED: num_planes for dev->name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
-	}
-	geo->nplanes = val;
-
-	if (sysattr2int(udev_dev, "lightnvm/num_blocks", &val)) {
-		NVM_DEBUG("FAILED: num_blocks for dev->name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
-	}
-	geo->nblocks = val;
-
-	if (sysattr2int(udev_dev, "lightnvm/num_pages", &val)) {
-		NVM_DEBUG("FAILED: num_pages for dev->name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
-	}
-	geo->npages = val;
+/**
+ * Backends in order of selection, the first backend with a prefix matching the
+ * device path is used. A backend without a prefix matches any path.
+ */
+static const struct nvm_be *dev_bes[] = {
+	&nvm_be_emu,
+	&nvm_be_ioctl,
+};
 
-	if (sysattr2int(udev_dev, "lightnvm/page_size", &val)) {
-		NVM_DEBUG("FAILED: page_size for dev->name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
-	}
-	geo->page_nbytes = val;
+/**
+ * Select the backend named by NVM_DEV_BE or the one matching the given path
+ */
+static const struct nvm_be *dev_be_select(const char *dev_path)
+{
+	const char *name = getenv("NVM_DEV_BE");
+	const int nbes = sizeof(dev_bes) / sizeof(dev_bes[0]);
 
-	if (sysattr2int(udev_dev, "lightnvm/hw_sector_size", &val)) {
-		NVM_DEBUG("FAILED: hw_sector_size for dev->name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
-	}
-	geo->sector_nbytes = val;
+	for (int i = 0; i < nbes; ++i) {
+		const struct nvm_be *be = dev_bes[i];
 
-	if (sysattr2int(udev_dev, "lightnvm/oob_sector_size", &val)) {
-		NVM_DEBUG("FAILED: oob_sector_size dev->name(%s)\n", dev->name);
-		errno = EIO;
-		return -1;
+		if (name) {
+			if (!strcmp(name, be->name))
+				return be;
+			continue;
+		}
+		if (!be->pfx || !strncmp(dev_path, be->pfx, strlen(be->pfx)))
+			return be;
 	}
-	geo->meta_nbytes = val;
 
-	udev_device_unref(udev_dev);
-	udev_unref(udev);
+	return NULL;
+}
 
-	// WARN: HOTFIX for reports of unrealisticly large OOB area
-	if (geo->meta_nbytes > 100) {
-		geo->meta_nbytes = 16;	// Naively hope this is right
-	}
+/**
+ * Derive geometry and defaults from the attributes filled by the open function
+ * of the backend
+ */
+static int dev_attr_derive(struct nvm_dev *dev)
+{
+	struct nvm_geo *geo = &dev->geo;
 
 	// Derive number of sectors
 	geo->nsectors = geo->page_nbytes / geo->sector_nbytes;
@@ -327,6 +103,12 @@ static int dev_attr_fill(struct nvm_dev *dev)
 			   geo->sector_nbytes;
 	geo->vpg_nbytes = geo->nplanes * geo->nsectors * geo->sector_nbytes;
 
+	/* Derive divisors for address arithmetic */
+	nvm_div_init(&dev->gdiv.nplanes, geo->nplanes);
+	nvm_div_init(&dev->gdiv.npages, geo->npages);
+	nvm_div_init(&dev->gdiv.nsectors, geo->nsectors);
+	nvm_div_init(&dev->gdiv.spage_naddrs, geo->nplanes * geo->nsectors);
+
 	/* Derive the sector-shift-width for LBA mapping */
 	dev->ssw = ilog2(geo->sector_nbytes);
 
@@ -353,7 +135,7 @@ static int dev_attr_fill(struct nvm_dev *dev)
 
 	dev->meta_mode = NVM_META_MODE_NONE;
 
-	return 0;
+	return nvm_dev_set_lba_layout(dev, NVM_LBA_LAYOUT_CHANNEL);
 }
 
 struct nvm_dev *nvm_dev_new(void)
@@ -361,8 +143,10 @@ struct nvm_dev *nvm_dev_new(void)
 	struct nvm_dev *dev;
 
 	dev = malloc(sizeof(*dev));
-	if (dev)
+	if (dev) {
 		memset(dev, 0, sizeof(*dev));
+		dev->numa_node = -1;
+	}
 
 	return dev;
 }
@@ -374,13 +158,15 @@ void nvm_dev_pr(struct nvm_dev *dev)
 		return;
 	}
 
-	printf("dev {\n path(%s), name(%s), fd(%d), ssw(%lu), pmode(%d),\n",
-	       dev->path, dev->name, dev->fd, dev->ssw, dev->pmode);
+	printf("dev {\n path(%s), name(%s), be(%s), fd(%d), ssw(%lu), pmode(%d),\n",
+	       dev->path, dev->name, dev->be->name, dev->fd, dev->ssw,
+	       dev->pmode);
 	printf(" erase_naddrs_max(%d), read_naddrs_max(%d), write_naddrs_max(%d),\n",
 	       dev->erase_naddrs_max,
 	       dev->read_naddrs_max,
 	       dev->write_naddrs_max);
-	printf(" meta_mode(%d),\n", dev->meta_mode);
+	printf(" meta_mode(%d), numa_node(%d),\n", dev->meta_mode,
+	       dev->numa_node);
 	printf(" bbts_cached(%d)\n}\n", dev->bbts_cached);
 	printf("dev-"); nvm_geo_pr(&dev->geo);
 	printf("dev-"); nvm_addr_fmt_pr(&dev->fmt);
@@ -437,6 +223,11 @@ const struct nvm_geo * nvm_dev_get_geo(struct nvm_dev *dev)
 	return &dev->geo;
 }
 
+const char *nvm_dev_get_be_name(struct nvm_dev *dev)
+{
+	return dev->be->name;
+}
+
 int nvm_dev_get_pmode(struct nvm_dev *dev)
 {
         return dev->pmode;
@@ -454,6 +245,13 @@ int nvm_dev_set_meta_mode(struct nvm_dev *dev, int meta_mode)
 		case NVM_META_MODE_ALPHA:
 		case NVM_META_MODE_CONST:
 			break;
+		case NVM_META_MODE_CRC:
+		case NVM_META_MODE_CRC_SEQ:
+			if (dev->geo.meta_nbytes < sizeof(struct nvm_meta_crc)) {
+				errno = EINVAL;
+				return -1;
+			}
+			break;
 		default:
 			errno = EINVAL;
 			return -1;
@@ -464,6 +262,34 @@ int nvm_dev_set_meta_mode(struct nvm_dev *dev, int meta_mode)
 	return 0;
 }
 
+int nvm_dev_set_retry(struct nvm_dev *dev, int nretries, int backoff_us)
+{
+	if (nretries < 0 || backoff_us < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	dev->retry_nretries = nretries;
+	dev->retry_backoff_us = backoff_us;
+
+	return 0;
+}
+
+int nvm_dev_get_lba_layout(struct nvm_dev *dev)
+{
+	return dev->lba_layout;
+}
+
+int nvm_dev_set_lba_layout(struct nvm_dev *dev, int layout)
+{
+	if (nvm_lba_map_init(&dev->lba_map, &dev->geo, layout))
+		return -1;		// Propagate errno
+
+	dev->lba_layout = layout;
+
+	return 0;
+}
+
 int nvm_dev_get_erase_naddrs_max(struct nvm_dev *dev)
 {
 	return dev->erase_naddrs_max;
@@ -580,24 +406,38 @@ struct nvm_dev *nvm_dev_open(const char *dev_path)
 	strncpy(dev->path, dev_path, NVM_DEV_PATH_LEN);
 	strncpy(dev->name, dev_path+5, NVM_DEV_NAME_LEN);
 
-	dev->fd = open(dev->path, O_RDWR | O_DIRECT);
-	if (dev->fd < 0) {
-		NVM_DEBUG("FAILED: open dev->path(%s) dev->fd(%d)\n",
-			  dev->path, dev->fd);
-
+	dev->be = dev_be_select(dev->path);
+	if (!dev->be) {
+		NVM_DEBUG("FAILED: no backend for dev->path(%s)\n", dev->path);
 		free(dev);
+		errno = EINVAL;
+		return NULL;
+	}
 
+	err = dev->be->open(dev);
+	if (err) {
+		NVM_DEBUG("FAILED: be(%s)->open, err(%d)\n", dev->be->name, err);
+		free(dev);
 		return NULL;
 	}
 
-	err = dev_attr_fill(dev);
+	nvm_addr_codec_setup(dev);	// Format is fixed from here on
+
+	err = dev_attr_derive(dev);
 	if (err) {
-		NVM_DEBUG("FAILED: dev_attr_fill, err(%d)\n", err);
-		close(dev->fd);
+		NVM_DEBUG("FAILED: dev_attr_derive, err(%d)\n", err);
+		dev->be->close(dev);
 		free(dev);
 		return NULL;
 	}
 
+	// Load the CPUs of the node reported by the backend, if any
+	if (nvm_dev_set_numa_node(dev, dev->numa_node)) {
+		NVM_DEBUG("FAILED: nvm_dev_set_numa_node, node(%d)\n",
+			  dev->numa_node);
+		nvm_dev_set_numa_node(dev, -1);
+	}
+
 	dev->bbts_cached = 0;
 	dev->nbbts = dev->geo.nchannels * dev->geo.nluns;
 	dev->bbts = malloc(sizeof(*dev->bbts) * dev->nbbts);
@@ -612,10 +452,167 @@ void nvm_dev_close(struct nvm_dev *dev)
 	if (!dev)
 		return;
 
+	nvm_ring_disable(dev);
+
 	nvm_bbt_flush_all(dev, NULL);
 	free(dev->bbts);
 
-	close(dev->fd);
+	nvm_sched_disable(dev);
+
+	dev->be->close(dev);
 	free(dev);
 }
 
+
+/**
+ * Account a failed block of nvm_dev_erase_range
+ */
+static inline void erase_range_failed(struct nvm_erase_stat *stat,
+				      struct nvm_addr addr)
+{
+	uint64_t idx = __atomic_fetch_add(&stat->nfailed, 1, __ATOMIC_RELAXED);
+
+	if (stat->failed && idx < stat->failed_max)
+		stat->failed[idx] = addr;
+}
+
+/**
+ * Erase the blocks `bgn` to `end` of the LUN of `lun_addr`, as few commands
+ * as erase_naddrs_max allows of every plane of each good block
+ */
+static ssize_t erase_range_lun(struct nvm_dev *dev, struct nvm_addr lun_addr,
+			       size_t bgn, size_t end, uint16_t flags,
+			       struct nvm_erase_stat *stat)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	const size_t cmd_nblks = dev->erase_naddrs_max / geo->nplanes;
+	const struct nvm_bbt *bbt;
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	size_t nerr = 0;
+	size_t blk = bgn;
+
+	bbt = nvm_bbt_get(dev, lun_addr, NULL);
+	if (!bbt) {
+		for (size_t b = bgn; b <= end; ++b) {
+			lun_addr.g.blk = b;
+			erase_range_failed(stat, lun_addr);
+		}
+		return end - bgn + 1;
+	}
+
+	while (blk <= end) {
+		struct nvm_ret ret = {};
+		int nblks = 0;
+
+		for (; blk <= end && nblks < cmd_nblks; ++blk) {
+			int bad = 0;
+
+			for (size_t pl = 0; pl < geo->nplanes; ++pl)
+				bad |= bbt->blks[blk * geo->nplanes + pl];
+			if (bad) {
+				__atomic_add_fetch(&stat->nskipped, 1,
+						   __ATOMIC_RELAXED);
+				continue;
+			}
+
+			for (size_t pl = 0; pl < geo->nplanes; ++pl) {
+				struct nvm_addr *addr;
+
+				addr = &addrs[nblks * geo->nplanes + pl];
+				*addr = lun_addr;
+				addr->g.blk = blk;
+				addr->g.pl = pl;
+			}
+			++nblks;
+		}
+		if (!nblks)
+			break;
+
+		if (!nvm_addr_erase(dev, addrs, nblks * geo->nplanes, flags,
+				    &ret)) {
+			__atomic_add_fetch(&stat->nerased, nblks,
+					   __ATOMIC_RELAXED);
+			continue;
+		}
+
+		for (int b = 0; b < nblks; ++b) {	// Failed planes fail blocks
+			const uint64_t planes = ((1ULL << geo->nplanes) - 1) <<
+						(b * geo->nplanes);
+
+			if (ret.status && !(ret.status & planes)) {
+				__atomic_add_fetch(&stat->nerased, 1,
+						   __ATOMIC_RELAXED);
+				continue;
+			}
+			erase_range_failed(stat, addrs[b * geo->nplanes]);
+			++nerr;
+		}
+	}
+
+	return nerr;
+}
+
+ssize_t nvm_dev_erase_range(struct nvm_dev *dev, struct nvm_addr bgn,
+			    struct nvm_addr end, uint16_t flags,
+			    struct nvm_erase_stat *stat)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_erase_stat lstat = {};
+	struct nvm_addr bgn_blk = {}, end_blk = {};
+	size_t nchannels, nluns, nlun_blks;
+	size_t nerr = 0;
+
+	bgn_blk.g.ch = bgn.g.ch;			// Ignore fields below blk
+	bgn_blk.g.lun = bgn.g.lun;
+	bgn_blk.g.blk = bgn.g.blk;
+	end_blk.g.ch = end.g.ch;
+	end_blk.g.lun = end.g.lun;
+	end_blk.g.blk = end.g.blk;
+
+	if (nvm_addr_check(bgn_blk, geo) || nvm_addr_check(end_blk, geo) ||
+	    bgn.g.ch > end.g.ch || bgn.g.lun > end.g.lun ||
+	    bgn.g.blk > end.g.blk ||
+	    dev->erase_naddrs_max < geo->nplanes) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!stat)
+		stat = &lstat;
+
+	nchannels = end.g.ch - bgn.g.ch + 1;
+	nluns = nchannels * (end.g.lun - bgn.g.lun + 1);
+	nlun_blks = end.g.blk - bgn.g.blk + 1;
+
+	stat->nblks = nluns * nlun_blks;
+	stat->nerased = 0;
+	stat->nskipped = 0;
+	stat->nfailed = 0;
+
+	#pragma omp parallel num_threads(nluns) reduction(+:nerr) if(nluns>1)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(dev, &aff);
+
+		#pragma omp for schedule(static,1)
+		for (size_t i = 0; i < nluns; ++i) {
+			struct nvm_addr lun_addr = bgn_blk;
+
+			lun_addr.g.ch = bgn.g.ch + i % nchannels; // Ch fastest
+			lun_addr.g.lun = bgn.g.lun + i / nchannels;
+
+			nerr += erase_range_lun(dev, lun_addr, bgn.g.blk,
+						end.g.blk, flags, stat);
+		}
+
+		nvm_numa_unbind_worker(&aff);
+	}
+
+	if (nerr) {
+		errno = EIO;
+		return -1;
+	}
+
+	return stat->nerased;
+}
@@ -0,0 +1,789 @@
+/*
+ * emu - RAM/file-backed emulation of an Open-Channel SSD
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <linux/lightnvm.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+#include <nvm_debug.h>
+
+#define NVM_EMU_MAGIC "LNVM-EMU"
+#define NVM_EMU_VER 1
+#define NVM_EMU_ALIGN 4096
+#define NVM_EMU_INJ_MAX 64
+
+/**
+ * Default geometry: "nchannels,nluns,nplanes,nblocks,npages,nsectors,
+ * sector_nbytes,meta_nbytes"
+ */
+#define NVM_EMU_GEO_DEF "2,4,2,64,32,4,4096,16"
+
+/**
+ * Header of the backing store, used to validate a re-opened backing file
+ */
+struct nvm_emu_hdr {
+	char magic[8];
+	uint32_t ver;
+	uint32_t rsvd;
+	uint64_t geo[8];	///< Geometry in the order of NVM_EMU_GEO
+	struct nvm_addr_fmt fmt;
+};
+
+/**
+ * An injected error, see nvm_emu_inject
+ */
+struct nvm_emu_inj {
+	struct nvm_addr addr;
+	int ops;
+	int count;
+};
+
+/**
+ * State of an emulated device
+ *
+ * The backing store is laid out as: header, write-pointers, bad-block-tables,
+ * out-of-bound area, and data. Each part is aligned to NVM_EMU_ALIGN. Sectors
+ * are stored in the row-major order of NVM_LBA_MAP, the bad-block-tables and
+ * write-pointers are indexed like the blks of struct nvm_bbt.
+ */
+struct nvm_emu {
+	int fd;				///< Backing file, -1 when backed by memory
+	char *base;			///< Mapping of the backing store
+	size_t nbytes;			///< Size of the mapping
+
+	struct nvm_emu_hdr *hdr;
+	uint32_t *wps;			///< Next sector to program, per blk
+	uint8_t *bbts;			///< Bad-block-table state, per blk
+	char *meta;			///< Out-of-bound area, per sector
+	char *data;			///< Data, per sector
+
+	pthread_mutex_t *locks;		///< One per LUN
+	pthread_mutex_t inj_lock;	///< Protects inj and ninj
+	int ninj;
+	struct nvm_emu_inj inj[NVM_EMU_INJ_MAX];
+};
+
+static inline size_t emu_align(size_t nbytes)
+{
+	return (nbytes + NVM_EMU_ALIGN - 1) & ~((size_t)NVM_EMU_ALIGN - 1);
+}
+
+/**
+ * @returns Number of bits needed to represent values in [0, val)
+ */
+static inline uint8_t emu_nbits(size_t val)
+{
+	uint8_t nbits = 0;
+
+	while (((size_t)1 << nbits) < val)
+		++nbits;
+
+	return nbits;
+}
+
+static inline size_t emu_lun_idx(const struct nvm_geo *geo,
+				 struct nvm_addr addr)
+{
+	return addr.g.ch * geo->nluns + addr.g.lun;
+}
+
+static inline size_t emu_blk_idx(const struct nvm_geo *geo,
+				 struct nvm_addr addr)
+{
+	return emu_lun_idx(geo, addr) * geo->nblocks * geo->nplanes + \
+	       addr.g.blk * geo->nplanes + addr.g.pl;
+}
+
+static inline size_t emu_sec_idx(const struct nvm_geo *geo,
+				 struct nvm_addr addr)
+{
+	return ((((emu_lun_idx(geo, addr) * geo->nblocks + addr.g.blk) * \
+		  geo->npages + addr.g.pg) * geo->nplanes + addr.g.pl) * \
+		geo->nsectors) + addr.g.sec;
+}
+
+static int emu_geo_parse(struct nvm_geo *geo)
+{
+	const char *str = getenv("NVM_EMU_GEO");
+	size_t val[8];
+
+	if (!str)
+		str = NVM_EMU_GEO_DEF;
+
+	if (sscanf(str, "%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu", &val[0], &val[1],
+		   &val[2], &val[3], &val[4], &val[5], &val[6], &val[7]) != 8) {
+		NVM_DEBUG("FAILED: NVM_EMU_GEO(%s)\n", str);
+		errno = EINVAL;
+		return -1;
+	}
+	for (int i = 0; i < 7; ++i) {
+		if (!val[i]) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	geo->nchannels = val[0];
+	geo->nluns = val[1];
+	geo->nplanes = val[2];
+	geo->nblocks = val[3];
+	geo->npages = val[4];
+	geo->nsectors = val[5];
+	geo->sector_nbytes = val[6];
+	geo->meta_nbytes = val[7];
+	geo->page_nbytes = geo->nsectors * geo->sector_nbytes;
+
+	if ((geo->nchannels > (1 << NVM_CH_BITS)) ||
+	    (geo->nluns > (1 << NVM_LUN_BITS)) ||
+	    (geo->nplanes > (1 << NVM_PL_BITS)) ||
+	    (geo->nblocks > (1 << NVM_BLK_BITS)) ||
+	    (geo->npages > (1 << NVM_PG_BITS)) ||
+	    (geo->nsectors > (1 << NVM_SEC_BITS)) ||
+	    (geo->sector_nbytes & (geo->sector_nbytes - 1))) {
+		NVM_DEBUG("FAILED: NVM_EMU_GEO(%s) exceeds limits\n", str);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Setup address format from NVM_EMU_FMT or pack the fields of the geometry,
+ * sectors in the least significant bits followed by planes, pages, blocks,
+ * LUNs, and channels
+ */
+static int emu_fmt_setup(struct nvm_dev *dev)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	const char *str = getenv("NVM_EMU_FMT");
+	struct nvm_addr_fmt *fmt = &dev->fmt;
+	uint8_t ofz = 0;
+
+	if (str)
+		return nvm_addr_fmt_parse(str, fmt, &dev->mask);
+
+	fmt->n.sec_ofz = ofz;
+	fmt->n.sec_len = emu_nbits(geo->nsectors);
+	ofz += fmt->n.sec_len;
+	fmt->n.pl_ofz = ofz;
+	fmt->n.pl_len = emu_nbits(geo->nplanes);
+	ofz += fmt->n.pl_len;
+	fmt->n.pg_ofz = ofz;
+	fmt->n.pg_len = emu_nbits(geo->npages);
+	ofz += fmt->n.pg_len;
+	fmt->n.blk_ofz = ofz;
+	fmt->n.blk_len = emu_nbits(geo->nblocks);
+	ofz += fmt->n.blk_len;
+	fmt->n.lun_ofz = ofz;
+	fmt->n.lun_len = emu_nbits(geo->nluns);
+	ofz += fmt->n.lun_len;
+	fmt->n.ch_ofz = ofz;
+	fmt->n.ch_len = emu_nbits(geo->nchannels);
+
+	for (int i = 0; i < 6; ++i)
+		dev->mask.a[i] = (((uint64_t)1 << fmt->a[i * 2 + 1]) - 1) << \
+				 fmt->a[i * 2];
+
+	return 0;
+}
+
+/**
+ * Check that the fields of the address format can represent the geometry
+ */
+static int emu_fmt_check(struct nvm_dev *dev)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	const size_t dims[6] = {geo->nchannels, geo->nluns, geo->nplanes,
+				geo->nblocks, geo->npages, geo->nsectors};
+
+	for (int i = 0; i < 6; ++i) {
+		if (dev->fmt.a[i * 2] + dev->fmt.a[i * 2 + 1] > 64 ||
+		    emu_nbits(dims[i]) > dev->fmt.a[i * 2 + 1]) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void emu_hdr_fill(struct nvm_dev *dev, struct nvm_emu_hdr *hdr)
+{
+	const struct nvm_geo *geo = &dev->geo;
+
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, NVM_EMU_MAGIC, sizeof(hdr->magic));
+	hdr->ver = NVM_EMU_VER;
+	hdr->geo[0] = geo->nchannels;
+	hdr->geo[1] = geo->nluns;
+	hdr->geo[2] = geo->nplanes;
+	hdr->geo[3] = geo->nblocks;
+	hdr->geo[4] = geo->npages;
+	hdr->geo[5] = geo->nsectors;
+	hdr->geo[6] = geo->sector_nbytes;
+	hdr->geo[7] = geo->meta_nbytes;
+	hdr->fmt = dev->fmt;
+}
+
+/**
+ * Map the backing store, a sparse file in NVM_EMU_DIR named after the device
+ * or anonymous memory when NVM_EMU_DIR is not set
+ */
+static int emu_map(struct nvm_dev *dev, struct nvm_emu *emu)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	const char *dir = getenv("NVM_EMU_DIR");
+	struct nvm_emu_hdr hdr;
+	size_t nblks, nsecs, wps_ofz, bbts_ofz, meta_ofz, data_ofz;
+	int fresh = 1;
+
+	nblks = geo->nchannels * geo->nluns * geo->nplanes * geo->nblocks;
+	nsecs = nblks * geo->npages * geo->nsectors;
+
+	wps_ofz = emu_align(sizeof(struct nvm_emu_hdr));
+	bbts_ofz = wps_ofz + emu_align(nblks * sizeof(*emu->wps));
+	meta_ofz = bbts_ofz + emu_align(nblks * sizeof(*emu->bbts));
+	data_ofz = meta_ofz + emu_align(nsecs * geo->meta_nbytes);
+	emu->nbytes = data_ofz + nsecs * geo->sector_nbytes;
+
+	emu_hdr_fill(dev, &hdr);
+
+	if (dir) {
+		char path[NVM_DEV_PATH_LEN * 2];
+		struct stat st;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, dev->name);
+		emu->fd = open(path, O_RDWR | O_CREAT, 0644);
+		if (emu->fd < 0) {
+			NVM_DEBUG("FAILED: open path(%s)\n", path);
+			return -1;
+		}
+		if (fstat(emu->fd, &st)) {
+			close(emu->fd);
+			return -1;
+		}
+
+		fresh = st.st_size == 0;
+		if (fresh && ftruncate(emu->fd, emu->nbytes)) {
+			close(emu->fd);
+			return -1;
+		}
+		if (!fresh && (size_t)st.st_size != emu->nbytes) {
+			NVM_DEBUG("FAILED: path(%s) geometry mismatch\n", path);
+			close(emu->fd);
+			errno = EINVAL;
+			return -1;
+		}
+
+		emu->base = mmap(NULL, emu->nbytes, PROT_READ | PROT_WRITE,
+				 MAP_SHARED, emu->fd, 0);
+	} else {
+		emu->fd = -1;
+		emu->base = mmap(NULL, emu->nbytes, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+				 -1, 0);
+	}
+	if (emu->base == MAP_FAILED) {
+		NVM_DEBUG("FAILED: mmap nbytes(%zu)\n", emu->nbytes);
+		if (emu->fd >= 0)
+			close(emu->fd);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	emu->hdr = (struct nvm_emu_hdr *)emu->base;
+	emu->wps = (uint32_t *)(emu->base + wps_ofz);
+	emu->bbts = (uint8_t *)(emu->base + bbts_ofz);
+	emu->meta = emu->base + meta_ofz;
+	emu->data = emu->base + data_ofz;
+
+	if (fresh) {
+		*emu->hdr = hdr;
+	} else if (memcmp(emu->hdr, &hdr, sizeof(hdr))) {
+		NVM_DEBUG("FAILED: backing store header mismatch\n");
+		munmap(emu->base, emu->nbytes);
+		if (emu->fd >= 0)
+			close(emu->fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int emu_open(struct nvm_dev *dev)
+{
+	struct nvm_emu *emu;
+	size_t nluns;
+
+	if (emu_geo_parse(&dev->geo))
+		return -1;
+	if (emu_fmt_setup(dev) || emu_fmt_check(dev)) {
+		NVM_DEBUG("FAILED: address format does not fit geometry\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	emu = malloc(sizeof(*emu));
+	if (!emu) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(emu, 0, sizeof(*emu));
+
+	nluns = dev->geo.nchannels * dev->geo.nluns;
+	emu->locks = malloc(sizeof(*emu->locks) * nluns);
+	if (!emu->locks) {
+		free(emu);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (emu_map(dev, emu)) {
+		free(emu->locks);
+		free(emu);
+		return -1;
+	}
+
+	for (size_t i = 0; i < nluns; ++i)
+		pthread_mutex_init(&emu->locks[i], NULL);
+	pthread_mutex_init(&emu->inj_lock, NULL);
+
+	dev->emu = emu;
+	dev->fd = -1;
+
+	return 0;
+}
+
+static void emu_close(struct nvm_dev *dev)
+{
+	struct nvm_emu *emu = dev->emu;
+
+	if (!emu)
+		return;
+
+	for (size_t i = 0; i < dev->geo.nchannels * dev->geo.nluns; ++i)
+		pthread_mutex_destroy(&emu->locks[i]);
+	pthread_mutex_destroy(&emu->inj_lock);
+
+	munmap(emu->base, emu->nbytes);
+	if (emu->fd >= 0)
+		close(emu->fd);
+
+	free(emu->locks);
+	free(emu);
+	dev->emu = NULL;
+}
+
+int nvm_emu_inject(struct nvm_dev *dev, struct nvm_addr addr, int ops,
+		   int count)
+{
+	struct nvm_emu *emu = dev->emu;
+	int err = 0;
+
+	if (!emu) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (nvm_addr_check(addr, &dev->geo) || !count ||
+	    (ops & ~(NVM_EMU_ERR_ERASE | NVM_EMU_ERR_WRITE | NVM_EMU_ERR_READ))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&emu->inj_lock);
+	if (emu->ninj < NVM_EMU_INJ_MAX) {
+		emu->inj[emu->ninj].addr = addr;
+		emu->inj[emu->ninj].ops = ops;
+		emu->inj[emu->ninj].count = count;
+		++emu->ninj;
+	} else {
+		errno = ENOSPC;
+		err = -1;
+	}
+	pthread_mutex_unlock(&emu->inj_lock);
+
+	return err;
+}
+
+void nvm_emu_inject_clear(struct nvm_dev *dev)
+{
+	struct nvm_emu *emu = dev->emu;
+
+	if (!emu)
+		return;
+
+	pthread_mutex_lock(&emu->inj_lock);
+	emu->ninj = 0;
+	pthread_mutex_unlock(&emu->inj_lock);
+}
+
+/**
+ * @returns 1 when an injected error for the given operation hits the given
+ * address, 0 otherwise
+ */
+static int emu_inj_hit(struct nvm_emu *emu, struct nvm_addr addr, int op)
+{
+	int hit = 0;
+
+	if (!emu->ninj)
+		return 0;
+
+	if (op == NVM_EMU_ERR_ERASE) {		// Erase errors hit the blk
+		addr.g.pg = 0;
+		addr.g.sec = 0;
+	}
+
+	pthread_mutex_lock(&emu->inj_lock);
+	for (int i = 0; i < emu->ninj; ++i) {
+		struct nvm_emu_inj *inj = &emu->inj[i];
+		struct nvm_addr match = inj->addr;
+
+		if (!(inj->ops & op))
+			continue;
+
+		if (op == NVM_EMU_ERR_ERASE) {
+			match.g.pg = 0;
+			match.g.sec = 0;
+		}
+		if (match.ppa != addr.ppa)
+			continue;
+
+		hit = 1;
+		if (inj->count > 0 && !--inj->count)
+			emu->inj[i] = emu->inj[--emu->ninj];
+		break;
+	}
+	pthread_mutex_unlock(&emu->inj_lock);
+
+	return hit;
+}
+
+static uint32_t emu_erase(struct nvm_dev *dev, struct nvm_addr addr)
+{
+	struct nvm_emu *emu = dev->emu;
+	size_t blk = emu_blk_idx(&dev->geo, addr);
+
+	if (emu->bbts[blk] & NVM_BBT_BAD)
+		return S12_RSP_ERR_FAILWRITE;
+	if (emu_inj_hit(emu, addr, NVM_EMU_ERR_ERASE))
+		return S12_RSP_ERR_FAILWRITE;
+
+	emu->wps[blk] = 0;
+
+	return S12_RSP_SUCCESS;
+}
+
+static uint32_t emu_write(struct nvm_dev *dev, struct nvm_addr addr,
+			  const char *data, const char *meta)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	struct nvm_emu *emu = dev->emu;
+	size_t blk = emu_blk_idx(geo, addr);
+	size_t sec = emu_sec_idx(geo, addr);
+
+	if (!data)
+		return S12_RSP_ERR_INVALID;
+	if (emu->bbts[blk] & NVM_BBT_BAD)
+		return S12_RSP_ERR_FAILWRITE;
+	// Sectors of a blk must be programmed in order and only once per erase
+	if (emu->wps[blk] != addr.g.pg * geo->nsectors + addr.g.sec)
+		return S12_RSP_ERR_INVALID;
+	if (emu_inj_hit(emu, addr, NVM_EMU_ERR_WRITE))
+		return S12_RSP_ERR_FAILWRITE;
+
+	memcpy(emu->data + sec * geo->sector_nbytes, data, geo->sector_nbytes);
+	if (meta)
+		memcpy(emu->meta + sec * geo->meta_nbytes, meta,
+		       geo->meta_nbytes);
+	else
+		memset(emu->meta + sec * geo->meta_nbytes, 0, geo->meta_nbytes);
+
+	++emu->wps[blk];
+
+	return S12_RSP_SUCCESS;
+}
+
+static uint32_t emu_read(struct nvm_dev *dev, struct nvm_addr addr,
+			 char *data, char *meta)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	struct nvm_emu *emu = dev->emu;
+	size_t blk = emu_blk_idx(geo, addr);
+	size_t sec = emu_sec_idx(geo, addr);
+
+	if (emu->wps[blk] <= addr.g.pg * geo->nsectors + addr.g.sec)
+		return S12_RSP_ERR_EMPTYPAGE;
+	if (emu_inj_hit(emu, addr, NVM_EMU_ERR_READ))
+		return S12_RSP_ERR_FAILECC;
+
+	if (data)
+		memcpy(data, emu->data + sec * geo->sector_nbytes,
+		       geo->sector_nbytes);
+	if (meta)
+		memcpy(meta, emu->meta + sec * geo->meta_nbytes,
+		       geo->meta_nbytes);
+
+	return S12_RSP_SUCCESS;
+}
+
+static int emu_vio(struct nvm_dev *dev, struct nvm_user_vio *ctl)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	struct nvm_emu *emu = dev->emu;
+	const int naddrs = ctl->nppas + 1;
+	uint64_t *ppas = naddrs == 1 ? (uint64_t *)&ctl->ppa_list : \
+				       (uint64_t *)ctl->ppa_list;
+	char *data = (char *)ctl->addr;
+	char *meta = (char *)ctl->metadata;
+	int pmode = ctl->control & (NVM_FLAG_PMODE_DUAL | NVM_FLAG_PMODE_QUAD);
+
+	ctl->result = S12_RSP_SUCCESS;
+	ctl->status = 0;
+
+	if (naddrs > NVM_NADDR_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((pmode == NVM_FLAG_PMODE_DUAL && geo->nplanes < 2) ||
+	    (pmode == NVM_FLAG_PMODE_QUAD && geo->nplanes < 4)) {
+		ctl->result = S12_RSP_ERR_INVALID;
+		ctl->status = naddrs == 64 ? ~0ULL : (1ULL << naddrs) - 1;
+		return 0;
+	}
+	if (pmode) {			// Commands must cover whole units
+		int unit = pmode == NVM_FLAG_PMODE_QUAD ? 4 : 2;
+
+		if (ctl->opcode != S12_OPC_ERASE)
+			unit *= geo->nsectors;
+		if (naddrs % unit) {
+			ctl->result = S12_RSP_ERR_INVALID;
+			ctl->status = naddrs == 64 ? ~0ULL :
+						     (1ULL << naddrs) - 1;
+			return 0;
+		}
+	}
+
+	for (int i = 0; i < naddrs; ++i) {
+		struct nvm_addr addr = nvm_addr_dev2gen(dev, ppas[i]);
+		char *sdata = data ? data + i * geo->sector_nbytes : NULL;
+		char *smeta = meta ? meta + i * geo->meta_nbytes : NULL;
+		pthread_mutex_t *lock;
+		uint32_t result;
+
+		if (nvm_addr_check(addr, geo)) {
+			if (!ctl->result)
+				ctl->result = S12_RSP_ERR_INVALID;
+			ctl->status |= 1ULL << i;
+			continue;
+		}
+
+		lock = &emu->locks[emu_lun_idx(geo, addr)];
+		pthread_mutex_lock(lock);
+		switch (ctl->opcode) {
+		case S12_OPC_ERASE:
+			result = emu_erase(dev, addr);
+			break;
+		case S12_OPC_WRITE:
+			result = emu_write(dev, addr, sdata, smeta);
+			break;
+		case S12_OPC_READ:
+			result = emu_read(dev, addr, sdata, smeta);
+			break;
+		default:
+			result = S12_RSP_ERR_INVALID;
+			break;
+		}
+		pthread_mutex_unlock(lock);
+
+		if (result) {
+			if (!ctl->result)
+				ctl->result = result;
+			ctl->status |= 1ULL << i;
+		}
+	}
+
+	return 0;
+}
+
+static int emu_bbt_get(struct nvm_dev *dev, struct nvm_passthru_vio *ctl)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	struct nvm_emu *emu = dev->emu;
+	struct krnl_bbt *k_bbt = (struct krnl_bbt *)ctl->addr;
+	struct nvm_addr addr = nvm_addr_dev2gen(dev, ctl->ppa_list);
+	size_t nblks = geo->nplanes * geo->nblocks;
+	uint8_t *bbt;
+
+	addr.g.pl = addr.g.blk = addr.g.pg = addr.g.sec = 0;
+	if (nvm_addr_check(addr, geo) || !k_bbt ||
+	    ctl->data_len < sizeof(*k_bbt) + nblks) {
+		ctl->result = S12_RSP_ERR_INVALID;
+		ctl->status = 1;
+		return 0;
+	}
+
+	bbt = emu->bbts + emu_blk_idx(geo, addr);
+
+	memset(k_bbt, 0, sizeof(*k_bbt));
+	memcpy(k_bbt->tblid, "BBLT", 4);
+	k_bbt->verid = 1;
+	k_bbt->tblks = nblks;
+	for (size_t i = 0; i < nblks; ++i) {
+		k_bbt->blk[i] = bbt[i];
+		if (bbt[i] & NVM_BBT_BAD)
+			++k_bbt->tfact;
+		if (bbt[i] & NVM_BBT_GBAD)
+			++k_bbt->tgrown;
+	}
+
+	return 0;
+}
+
+static int emu_bbt_set(struct nvm_dev *dev, struct nvm_passthru_vio *ctl)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	struct nvm_emu *emu = dev->emu;
+	const int naddrs = ctl->nppas + 1;
+	uint64_t *ppas = naddrs == 1 ? (uint64_t *)&ctl->ppa_list : \
+				       (uint64_t *)ctl->ppa_list;
+
+	for (int i = 0; i < naddrs; ++i) {
+		struct nvm_addr addr = nvm_addr_dev2gen(dev, ppas[i]);
+
+		if (nvm_addr_check(addr, geo)) {
+			ctl->result = S12_RSP_ERR_INVALID;
+			ctl->status |= 1ULL << i;
+			continue;
+		}
+
+		emu->bbts[emu_blk_idx(geo, addr)] = ctl->control;
+	}
+
+	return 0;
+}
+
+static int emu_admin(struct nvm_dev *dev, struct nvm_passthru_vio *ctl)
+{
+	ctl->result = S12_RSP_SUCCESS;
+	ctl->status = 0;
+
+	if (ctl->nppas + 1 > NVM_NADDR_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	switch (ctl->opcode) {
+	case S12_OPC_GET_BBT:
+		return emu_bbt_get(dev, ctl);
+	case S12_OPC_SET_BBT:
+		return emu_bbt_set(dev, ctl);
+
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+/**
+ * Transfer sectors addressed by byte-offset like the block-device interface
+ * does, offsets are device-formatted addresses shifted by dev->ssw. Media rules
+ * are not enforced, the sectors are copied as is.
+ */
+static ssize_t emu_lba_xfer(struct nvm_dev *dev, char *buf, size_t count,
+			    off_t offset, int write)
+{
+	const struct nvm_geo *geo = &dev->geo;
+	struct nvm_emu *emu = dev->emu;
+	size_t nsecs = count / geo->sector_nbytes;
+	size_t i;
+
+	for (i = 0; i < nsecs; ++i) {
+		struct nvm_addr addr;
+		pthread_mutex_t *lock;
+		char *sec;
+
+		addr = nvm_addr_off2gen(dev, offset + i * geo->sector_nbytes);
+		if (nvm_addr_check(addr, geo))
+			break;
+
+		sec = emu->data + emu_sec_idx(geo, addr) * geo->sector_nbytes;
+		lock = &emu->locks[emu_lun_idx(geo, addr)];
+
+		pthread_mutex_lock(lock);
+		if (write)
+			memcpy(sec, buf + i * geo->sector_nbytes,
+			       geo->sector_nbytes);
+		else
+			memcpy(buf + i * geo->sector_nbytes, sec,
+			       geo->sector_nbytes);
+		pthread_mutex_unlock(lock);
+	}
+
+	if (!i && nsecs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return i * geo->sector_nbytes;
+}
+
+static ssize_t emu_pwrite(struct nvm_dev *dev, const void *buf, size_t count,
+			  off_t offset)
+{
+	return emu_lba_xfer(dev, (char *)buf, count, offset, 1);
+}
+
+static ssize_t emu_pread(struct nvm_dev *dev, void *buf, size_t count,
+			 off_t offset)
+{
+	return emu_lba_xfer(dev, buf, count, offset, 0);
+}
+
+const struct nvm_be nvm_be_emu = {
+	.name = "emu",
+	.pfx = "/emu/",
+	.open = emu_open,
+	.close = emu_close,
+	.vio = emu_vio,
+	.admin = emu_admin,
+	.pwrite = emu_pwrite,
+	.pread = emu_pread,
+};
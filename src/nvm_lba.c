@@ -27,6 +27,7 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
@@ -34,6 +35,247 @@
 #include <linux/lightnvm.h>
 #include <liblightnvm.h>
 #include <nvm.h>
+#include <nvm_omp.h>
+
+int nvm_lba_map_init(struct nvm_lba_map *map, const struct nvm_geo *geo,
+		     int layout)
+{
+	const size_t vpg_nbytes = geo->sector_nbytes * geo->nsectors *
+				  geo->nplanes;
+
+	map->sector_nbytes = geo->sector_nbytes;
+	map->plane_nbytes = geo->sector_nbytes * geo->nsectors;
+
+	switch (layout) {
+	case NVM_LBA_LAYOUT_CHANNEL:
+		map->channel_nbytes = vpg_nbytes;
+		map->lun_nbytes = map->channel_nbytes * geo->nchannels;
+		map->page_nbytes = map->lun_nbytes * geo->nluns;
+		map->block_nbytes = map->page_nbytes * geo->npages;
+		break;
+
+	case NVM_LBA_LAYOUT_LUN:
+		map->lun_nbytes = vpg_nbytes;
+		map->channel_nbytes = map->lun_nbytes * geo->nluns;
+		map->page_nbytes = map->channel_nbytes * geo->nchannels;
+		map->block_nbytes = map->page_nbytes * geo->npages;
+		break;
+
+	case NVM_LBA_LAYOUT_SEQ:
+		map->page_nbytes = vpg_nbytes;
+		map->block_nbytes = map->page_nbytes * geo->npages;
+		map->lun_nbytes = map->block_nbytes * geo->nblocks;
+		map->channel_nbytes = map->lun_nbytes * geo->nluns;
+		break;
+
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static inline struct nvm_addr lba_map_off2gen(const struct nvm_lba_map *map,
+					      const struct nvm_geo *geo,
+					      size_t off)
+{
+	struct nvm_addr addr;
+
+	addr.ppa = 0;
+	addr.g.ch = (off / map->channel_nbytes) % geo->nchannels;
+	addr.g.lun = (off / map->lun_nbytes) % geo->nluns;
+	addr.g.blk = (off / map->block_nbytes) % geo->nblocks;
+	addr.g.pg = (off / map->page_nbytes) % geo->npages;
+	addr.g.pl = (off / map->plane_nbytes) % geo->nplanes;
+	addr.g.sec = (off / map->sector_nbytes) % geo->nsectors;
+
+	return addr;
+}
+
+struct nvm_addr nvm_lba_striped_off2gen(struct nvm_dev *dev, size_t offset)
+{
+	return lba_map_off2gen(&dev->lba_map, &dev->geo, offset);
+}
+
+/**
+ * Split the request into virtual pages, group them per LUN preserving their
+ * logical order, and process the LUNs concurrently with commands of up to
+ * naddrs_max addresses. Virtual pages of a command which are not adjacent in
+ * the user buffer are gathered into / scattered from a bounce buffer.
+ */
+static ssize_t lba_striped_rw(struct nvm_dev *dev, char *buf, size_t count,
+			      off_t offset, int write)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	const struct nvm_lba_map *map = &dev->lba_map;
+	const size_t VPG_NBYTES = geo->vpg_nbytes;
+	const int VPG_NADDRS = geo->nplanes * geo->nsectors;
+	const int NADDRS_MAX = write ? dev->write_naddrs_max :
+				       dev->read_naddrs_max;
+	const int CMD_NVPGS = NVM_MAX(NADDRS_MAX / VPG_NADDRS, 1);
+	const int PMODE = nvm_dev_get_pmode(dev);
+	const size_t NLUNS = geo->nchannels * geo->nluns;
+	const size_t NVPGS = count / VPG_NBYTES;
+
+	size_t *lun_bgn = NULL;		// Offset of each LUN in vpgs
+	size_t *vpgs = NULL;		// Vpg indexes sorted by LUN
+	int *luns = NULL;		// LUNs with work
+	int nluns = 0;
+	size_t nerr = 0;
+
+	if ((count < 1) || (offset < 0) || (count % VPG_NBYTES) ||
+	    (offset % VPG_NBYTES) || (offset + count > geo->tbytes)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	lun_bgn = calloc(NLUNS + 1, sizeof(*lun_bgn));
+	vpgs = malloc(NVPGS * sizeof(*vpgs));
+	luns = malloc(NLUNS * sizeof(*luns));
+	if (!lun_bgn || !vpgs || !luns) {
+		free(lun_bgn);
+		free(vpgs);
+		free(luns);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (size_t i = 0; i < NVPGS; ++i) {	// Counting sort on LUN
+		struct nvm_addr addr = lba_map_off2gen(map, geo,
+						       offset + i * VPG_NBYTES);
+
+		++lun_bgn[addr.g.ch * geo->nluns + addr.g.lun + 1];
+	}
+	for (size_t lun = 0; lun < NLUNS; ++lun) {
+		if (lun_bgn[lun + 1])
+			luns[nluns++] = lun;
+		lun_bgn[lun + 1] += lun_bgn[lun];
+	}
+	for (size_t i = 0; i < NVPGS; ++i) {
+		struct nvm_addr addr = lba_map_off2gen(map, geo,
+						       offset + i * VPG_NBYTES);
+
+		vpgs[lun_bgn[addr.g.ch * geo->nluns + addr.g.lun]++] = i;
+	}
+	for (size_t lun = NLUNS; lun > 0; --lun)	// Restore offsets
+		lun_bgn[lun] = lun_bgn[lun - 1];
+	lun_bgn[0] = 0;
+
+	#pragma omp parallel num_threads(nluns) reduction(+:nerr) if(nluns>1)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(dev, &aff);
+
+		#pragma omp for schedule(static,1)
+		for (int l = 0; l < nluns; ++l) {
+			const size_t bgn = lun_bgn[luns[l]];
+			const size_t end = lun_bgn[luns[l] + 1];
+			struct nvm_addr addrs[CMD_NVPGS * VPG_NADDRS];
+			char *bounce = NULL;
+
+			for (size_t i = bgn; i < end && !nerr; i += CMD_NVPGS) {
+				const int nvpgs = NVM_MIN((size_t)CMD_NVPGS,
+							  end - i);
+				char *cmd_buf = buf + vpgs[i] * VPG_NBYTES;
+				int contig = 1;
+				ssize_t err;
+
+				for (int v = 0; v < nvpgs; ++v) {
+					size_t off = offset +
+						     vpgs[i + v] * VPG_NBYTES;
+					struct nvm_addr base;
+
+					base = lba_map_off2gen(map, geo, off);
+					for (int k = 0; k < VPG_NADDRS; ++k) {
+						int idx = v * VPG_NADDRS + k;
+						struct nvm_addr *addr;
+
+						addr = &addrs[idx];
+						addr->ppa = base.ppa;
+						addr->g.pl =
+							(k / geo->nsectors) %
+							geo->nplanes;
+						addr->g.sec = k % geo->nsectors;
+					}
+
+					if (v &&
+					    vpgs[i + v] != vpgs[i + v - 1] + 1)
+						contig = 0;
+				}
+
+				if (!contig && !bounce) {
+					bounce = nvm_dev_buf_alloc(dev,
+						CMD_NVPGS * VPG_NBYTES);
+					if (!bounce) {
+						++nerr;
+						break;
+					}
+				}
+				if (!contig)
+					cmd_buf = bounce;
+				if (!contig && write) {
+					for (int v = 0; v < nvpgs; ++v)
+						memcpy(bounce + v * VPG_NBYTES,
+						       buf + vpgs[i + v] *
+						       VPG_NBYTES, VPG_NBYTES);
+				}
+
+				if (write) {
+					err = nvm_addr_write(dev, addrs,
+							     nvpgs * VPG_NADDRS,
+							     cmd_buf, NULL,
+							     PMODE, NULL);
+				} else {
+					err = nvm_addr_read(dev, addrs,
+							    nvpgs * VPG_NADDRS,
+							    cmd_buf, NULL,
+							    PMODE, NULL);
+				}
+				if (err) {
+					++nerr;
+					break;
+				}
+
+				if (!contig && !write) {
+					for (int v = 0; v < nvpgs; ++v)
+						memcpy(buf + vpgs[i + v] *
+						       VPG_NBYTES,
+						       bounce + v * VPG_NBYTES,
+						       VPG_NBYTES);
+				}
+			}
+
+			free(bounce);
+		}
+
+		nvm_numa_unbind_worker(&aff);
+	}
+
+	free(lun_bgn);
+	free(vpgs);
+	free(luns);
+
+	if (nerr) {
+		errno = EIO;
+		return -1;
+	}
+
+	return count;
+}
+
+ssize_t nvm_lba_striped_pwrite(struct nvm_dev *dev, const void *buf,
+			       size_t count, off_t offset)
+{
+	return lba_striped_rw(dev, (char *)buf, count, offset, 1);
+}
+
+ssize_t nvm_lba_striped_pread(struct nvm_dev *dev, void *buf, size_t count,
+			      off_t offset)
+{
+	return lba_striped_rw(dev, buf, count, offset, 0);
+}
 
 void nvm_lba_map_pr(struct nvm_lba_map* map)
 {
@@ -67,7 +309,7 @@ ssize_t nvm_lba_pwrite(struct nvm_dev *dev, const void *buf, size_t count,
 		return -1;
 	}
 
-	return pwrite(dev->fd, buf, count, offset);
+	return dev->be->pwrite(dev, buf, count, offset);
 }
 
 ssize_t nvm_lba_pread(struct nvm_dev *dev, void *buf, size_t count,
@@ -90,6 +332,6 @@ ssize_t nvm_lba_pread(struct nvm_dev *dev, void *buf, size_t count,
 		return -1;
 	}
 
-	return pread(dev->fd, buf, count, offset);
+	return dev->be->pread(dev, buf, count, offset);
 }
 
@@ -0,0 +1,545 @@
+/*
+ * lba_ctx - Asynchronous LBA I/O via io_uring
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+#include <nvm_debug.h>
+#ifdef NVM_HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#define NVM_LBA_CTX_DEPTH_MAX 4096
+
+/**
+ * A command occupying a slot of the context from submission until reaped
+ */
+struct nvm_lba_cmd {
+	struct iovec iov;
+	off_t offset;
+	void *opaque;
+	int op;
+};
+
+struct nvm_lba_ctx {
+	struct nvm_dev *dev;
+	int depth;
+	int flags;
+
+	struct nvm_lba_cmd *cmds;	///< Command slots
+	int *free;			///< Stack of free slots
+	int nfree;
+	int *pend;			///< Slots awaiting synchronous completion
+	int npend;			///< Commands submitted but not yet entered
+
+	struct iovec *bufs;		///< Registered buffers
+	int nbufs;
+
+	int ring_fd;			///< -1 when completing synchronously
+#ifdef NVM_HAVE_IO_URING
+	void *sq_ptr;
+	size_t sq_nbytes;
+	void *cq_ptr;
+	size_t cq_nbytes;
+	struct io_uring_sqe *sqes;
+	size_t sqes_nbytes;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_flags;
+	unsigned *sq_array;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+#endif
+};
+
+static inline int lba_check(struct nvm_dev *dev, size_t count, off_t offset)
+{
+	if (count < 1 || offset < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((count % dev->geo.vpg_nbytes) || (offset % dev->geo.vpg_nbytes)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (offset + count > dev->geo.tbytes) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+#ifdef NVM_HAVE_IO_URING
+
+static inline int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int uring_enter(int fd, unsigned to_submit,
+			      unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		       NULL, 0);
+}
+
+static inline int uring_register(int fd, unsigned opcode, void *arg,
+				 unsigned nargs)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nargs);
+}
+
+static void ctx_uring_term(struct nvm_lba_ctx *ctx)
+{
+	if (ctx->sqes)
+		munmap(ctx->sqes, ctx->sqes_nbytes);
+	if (ctx->cq_ptr && ctx->cq_ptr != ctx->sq_ptr)
+		munmap(ctx->cq_ptr, ctx->cq_nbytes);
+	if (ctx->sq_ptr)
+		munmap(ctx->sq_ptr, ctx->sq_nbytes);
+
+	close(ctx->ring_fd);
+	ctx->ring_fd = -1;
+}
+
+/**
+ * Setup the rings and register the device fd, the fd is referenced as fixed
+ * file zero by all submissions
+ */
+static int ctx_uring_init(struct nvm_lba_ctx *ctx)
+{
+	struct io_uring_params p;
+	int err;
+
+	memset(&p, 0, sizeof(p));
+	if (ctx->flags & NVM_LBA_CTX_SQPOLL) {
+		p.flags |= IORING_SETUP_SQPOLL;
+		p.sq_thread_idle = 1000;	// msec
+	}
+
+	ctx->ring_fd = uring_setup(ctx->depth, &p);
+	if (ctx->ring_fd < 0) {
+		NVM_DEBUG("FAILED: io_uring_setup depth(%d)\n", ctx->depth);
+		return -1;
+	}
+
+	ctx->sq_nbytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ctx->cq_nbytes = p.cq_off.cqes + \
+			 p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ctx->sq_nbytes = NVM_MAX(ctx->sq_nbytes, ctx->cq_nbytes);
+		ctx->cq_nbytes = ctx->sq_nbytes;
+	}
+
+	ctx->sq_ptr = mmap(NULL, ctx->sq_nbytes, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, ctx->ring_fd,
+			   IORING_OFF_SQ_RING);
+	if (ctx->sq_ptr == MAP_FAILED) {
+		ctx->sq_ptr = NULL;
+		goto failed;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ctx->cq_ptr = ctx->sq_ptr;
+	} else {
+		ctx->cq_ptr = mmap(NULL, ctx->cq_nbytes, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, ctx->ring_fd,
+				   IORING_OFF_CQ_RING);
+		if (ctx->cq_ptr == MAP_FAILED) {
+			ctx->cq_ptr = NULL;
+			goto failed;
+		}
+	}
+
+	ctx->sqes_nbytes = p.sq_entries * sizeof(struct io_uring_sqe);
+	ctx->sqes = mmap(NULL, ctx->sqes_nbytes, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, ctx->ring_fd,
+			 IORING_OFF_SQES);
+	if (ctx->sqes == MAP_FAILED) {
+		ctx->sqes = NULL;
+		goto failed;
+	}
+
+	ctx->sq_head = (unsigned *)((char *)ctx->sq_ptr + p.sq_off.head);
+	ctx->sq_tail = (unsigned *)((char *)ctx->sq_ptr + p.sq_off.tail);
+	ctx->sq_mask = (unsigned *)((char *)ctx->sq_ptr + p.sq_off.ring_mask);
+	ctx->sq_flags = (unsigned *)((char *)ctx->sq_ptr + p.sq_off.flags);
+	ctx->sq_array = (unsigned *)((char *)ctx->sq_ptr + p.sq_off.array);
+
+	ctx->cq_head = (unsigned *)((char *)ctx->cq_ptr + p.cq_off.head);
+	ctx->cq_tail = (unsigned *)((char *)ctx->cq_ptr + p.cq_off.tail);
+	ctx->cq_mask = (unsigned *)((char *)ctx->cq_ptr + p.cq_off.ring_mask);
+	ctx->cqes = (struct io_uring_cqe *)((char *)ctx->cq_ptr + \
+					    p.cq_off.cqes);
+
+	err = uring_register(ctx->ring_fd, IORING_REGISTER_FILES,
+			     &ctx->dev->fd, 1);
+	if (err) {
+		NVM_DEBUG("FAILED: IORING_REGISTER_FILES\n");
+		goto failed;
+	}
+
+	return 0;
+
+failed:
+	err = errno;
+	ctx_uring_term(ctx);
+	errno = err;
+	return -1;
+}
+
+static void ctx_uring_prep(struct nvm_lba_ctx *ctx, int slot)
+{
+	struct nvm_lba_cmd *cmd = &ctx->cmds[slot];
+	unsigned tail = *ctx->sq_tail;
+	unsigned idx = tail & *ctx->sq_mask;
+	struct io_uring_sqe *sqe = &ctx->sqes[idx];
+	int buf_idx = -1;
+
+	for (int i = 0; i < ctx->nbufs; ++i) {	// Use registered buffers
+		char *bgn = ctx->bufs[i].iov_base;
+		char *end = bgn + ctx->bufs[i].iov_len;
+		char *base = cmd->iov.iov_base;
+
+		if (base >= bgn && base + cmd->iov.iov_len <= end) {
+			buf_idx = i;
+			break;
+		}
+	}
+
+	memset(sqe, 0, sizeof(*sqe));
+	if (buf_idx < 0) {
+		sqe->opcode = cmd->op == NVM_LBA_OP_WRITE ? IORING_OP_WRITEV : \
+							    IORING_OP_READV;
+		sqe->addr = (uint64_t)&cmd->iov;
+		sqe->len = 1;
+	} else {
+		sqe->opcode = cmd->op == NVM_LBA_OP_WRITE ? \
+			      IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+		sqe->addr = (uint64_t)cmd->iov.iov_base;
+		sqe->len = cmd->iov.iov_len;
+		sqe->buf_index = buf_idx;
+	}
+	sqe->fd = 0;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->off = cmd->offset;
+	sqe->user_data = slot;
+
+	ctx->sq_array[idx] = idx;
+	__atomic_store_n(ctx->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Move completions from the CQ ring to `cpls`
+ */
+static int ctx_uring_harvest(struct nvm_lba_ctx *ctx,
+			     struct nvm_lba_cpl *cpls, int ncpls)
+{
+	unsigned head = *ctx->cq_head;
+	unsigned tail = __atomic_load_n(ctx->cq_tail, __ATOMIC_ACQUIRE);
+	int n = 0;
+
+	while (head != tail && n < ncpls) {
+		struct io_uring_cqe *cqe = &ctx->cqes[head & *ctx->cq_mask];
+		int slot = cqe->user_data;
+
+		cpls[n].opaque = ctx->cmds[slot].opaque;
+		cpls[n].res = cqe->res;
+		ctx->free[ctx->nfree++] = slot;
+
+		++head;
+		++n;
+	}
+	__atomic_store_n(ctx->cq_head, head, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+static int ctx_uring_reap(struct nvm_lba_ctx *ctx, struct nvm_lba_cpl *cpls,
+			  int ncpls, int min)
+{
+	int n = ctx_uring_harvest(ctx, cpls, ncpls);
+
+	while (ctx->npend || n < min) {
+		unsigned to_submit = ctx->npend;
+		unsigned wait = n < min ? min - n : 0;
+		unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+		int ret;
+
+		if (ctx->flags & NVM_LBA_CTX_SQPOLL) {	// Kernel pulls the SQ
+			to_submit = 0;
+			ctx->npend = 0;
+			if (__atomic_load_n(ctx->sq_flags, __ATOMIC_ACQUIRE) & \
+			    IORING_SQ_NEED_WAKEUP)
+				flags |= IORING_ENTER_SQ_WAKEUP;
+			if (!flags)
+				break;
+		}
+
+		ret = uring_enter(ctx->ring_fd, to_submit, wait, flags);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return n ? n : -1;
+		}
+		if (!(ctx->flags & NVM_LBA_CTX_SQPOLL))
+			ctx->npend -= ret;
+
+		n += ctx_uring_harvest(ctx, cpls + n, ncpls - n);
+	}
+
+	return n;
+}
+
+#endif
+
+/**
+ * Execute pending commands via the backend of the device, used by backends
+ * which do not do LBA I/O on a file descriptor, e.g. the emulator
+ *
+ * The commands are checked by nvm_lba_submit, thus handed straight to the
+ * backend.
+ */
+static int ctx_sync_reap(struct nvm_lba_ctx *ctx, struct nvm_lba_cpl *cpls,
+			 int ncpls)
+{
+	int n = 0;
+
+	for (n = 0; n < ncpls && n < ctx->npend; ++n) {
+		int slot = ctx->pend[n];
+		struct nvm_lba_cmd *cmd = &ctx->cmds[slot];
+		ssize_t res;
+
+		if (cmd->op == NVM_LBA_OP_WRITE)
+			res = ctx->dev->be->pwrite(ctx->dev, cmd->iov.iov_base,
+						   cmd->iov.iov_len,
+						   cmd->offset);
+		else
+			res = ctx->dev->be->pread(ctx->dev, cmd->iov.iov_base,
+						  cmd->iov.iov_len,
+						  cmd->offset);
+
+		cpls[n].opaque = cmd->opaque;
+		cpls[n].res = res < 0 ? -errno : res;
+		ctx->free[ctx->nfree++] = slot;
+	}
+
+	ctx->npend -= n;
+	memmove(ctx->pend, ctx->pend + n, sizeof(*ctx->pend) * ctx->npend);
+
+	return n;
+}
+
+struct nvm_lba_ctx *nvm_lba_ctx_create(struct nvm_dev *dev, int depth,
+				       int flags)
+{
+	struct nvm_lba_ctx *ctx;
+
+	if (depth < 1 || depth > NVM_LBA_CTX_DEPTH_MAX ||
+	    (flags & ~NVM_LBA_CTX_SQPOLL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ctx = malloc(sizeof(*ctx));
+	if (!ctx) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(ctx, 0, sizeof(*ctx));
+
+	ctx->dev = dev;
+	ctx->depth = depth;
+	ctx->flags = flags;
+	ctx->ring_fd = -1;
+
+	ctx->cmds = malloc(sizeof(*ctx->cmds) * depth);
+	ctx->free = malloc(sizeof(*ctx->free) * depth);
+	ctx->pend = malloc(sizeof(*ctx->pend) * depth);
+	if (!ctx->cmds || !ctx->free || !ctx->pend) {
+		nvm_lba_ctx_destroy(ctx);
+		errno = ENOMEM;
+		return NULL;
+	}
+	for (int i = 0; i < depth; ++i)
+		ctx->free[i] = depth - 1 - i;
+	ctx->nfree = depth;
+
+	if (!dev->be->fd_io)		// Complete via the backend in reap
+		return ctx;
+
+#ifdef NVM_HAVE_IO_URING
+	if (ctx_uring_init(ctx)) {
+		int err = errno;
+
+		nvm_lba_ctx_destroy(ctx);
+		errno = err;
+		return NULL;
+	}
+
+	return ctx;
+#else
+	nvm_lba_ctx_destroy(ctx);
+	errno = ENOSYS;
+	return NULL;
+#endif
+}
+
+void nvm_lba_ctx_destroy(struct nvm_lba_ctx *ctx)
+{
+	if (!ctx)
+		return;
+
+#ifdef NVM_HAVE_IO_URING
+	if (ctx->ring_fd >= 0)
+		ctx_uring_term(ctx);
+#endif
+
+	free(ctx->bufs);
+	free(ctx->pend);
+	free(ctx->free);
+	free(ctx->cmds);
+	free(ctx);
+}
+
+int nvm_lba_ctx_reg_bufs(struct nvm_lba_ctx *ctx, void *bufs[],
+			 size_t nbytes[], int nbufs)
+{
+	if (ctx->nbufs) {
+		errno = EBUSY;
+		return -1;
+	}
+	if (nbufs < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ctx->bufs = malloc(sizeof(*ctx->bufs) * nbufs);
+	if (!ctx->bufs) {
+		errno = ENOMEM;
+		return -1;
+	}
+	for (int i = 0; i < nbufs; ++i) {
+		ctx->bufs[i].iov_base = bufs[i];
+		ctx->bufs[i].iov_len = nbytes[i];
+	}
+
+#ifdef NVM_HAVE_IO_URING
+	if (ctx->ring_fd >= 0 && uring_register(ctx->ring_fd,
+						IORING_REGISTER_BUFFERS,
+						ctx->bufs, nbufs)) {
+		int err = errno;
+
+		NVM_DEBUG("FAILED: IORING_REGISTER_BUFFERS\n");
+		free(ctx->bufs);
+		ctx->bufs = NULL;
+		errno = err;
+		return -1;
+	}
+#endif
+
+	ctx->nbufs = nbufs;
+
+	return 0;
+}
+
+int nvm_lba_submit(struct nvm_lba_ctx *ctx, int op, void *buf, size_t count,
+		   off_t offset, void *opaque)
+{
+	struct nvm_lba_cmd *cmd;
+	int slot;
+
+	if (op != NVM_LBA_OP_READ && op != NVM_LBA_OP_WRITE) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (lba_check(ctx->dev, count, offset))
+		return -1;
+	if (!ctx->nfree) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	slot = ctx->free[--ctx->nfree];
+	cmd = &ctx->cmds[slot];
+	cmd->iov.iov_base = buf;
+	cmd->iov.iov_len = count;
+	cmd->offset = offset;
+	cmd->opaque = opaque;
+	cmd->op = op;
+
+#ifdef NVM_HAVE_IO_URING
+	if (ctx->ring_fd >= 0) {
+		ctx_uring_prep(ctx, slot);
+		++ctx->npend;
+		return 0;
+	}
+#endif
+	ctx->pend[ctx->npend++] = slot;
+
+	return 0;
+}
+
+int nvm_lba_reap(struct nvm_lba_ctx *ctx, struct nvm_lba_cpl *cpls,
+		 int ncpls, int min)
+{
+	int ninflight = ctx->depth - ctx->nfree;
+
+	if (ncpls < 1 || min < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	min = NVM_MIN(NVM_MIN(min, ncpls), ninflight);
+
+#ifdef NVM_HAVE_IO_URING
+	if (ctx->ring_fd >= 0)
+		return ctx_uring_reap(ctx, cpls, ncpls, min);
+#endif
+
+	return ctx_sync_reap(ctx, cpls, ncpls);
+}
+
+int nvm_lba_ctx_get_ninflight(struct nvm_lba_ctx *ctx)
+{
+	return ctx->depth - ctx->nfree;
+}
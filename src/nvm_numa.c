@@ -0,0 +1,223 @@
+/*
+ * numa - NUMA placement of buffers and worker threads
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <linux/mempolicy.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+#include <nvm_omp.h>
+#include <nvm_debug.h>
+
+/**
+ * Node the calling thread was last bound to by nvm_numa_bind, -1 if never
+ */
+static __thread int numa_bound = -1;
+
+/**
+ * Parse a sysfs cpulist such as "0-7,16-23" into the given bitmap
+ *
+ * @returns 0 on success, -1 when the list is malformed or empty
+ */
+static int cpulist_parse(const char *list, uint64_t *cpus, int ncpus_max)
+{
+	const char *p = list;
+	int ncpus = 0;
+
+	memset(cpus, 0, ncpus_max / 8);
+
+	while (*p && *p != '\n') {
+		char *end;
+		long bgn, last;
+
+		bgn = strtol(p, &end, 10);
+		if (end == p)
+			return -1;
+
+		last = bgn;
+		if (*end == '-') {
+			p = end + 1;
+			last = strtol(p, &end, 10);
+			if (end == p)
+				return -1;
+		}
+
+		for (long cpu = bgn; cpu <= last && cpu < ncpus_max; ++cpu) {
+			cpus[cpu / 64] |= 1ULL << (cpu % 64);
+			++ncpus;
+		}
+
+		p = (*end == ',') ? end + 1 : end;
+	}
+
+	return ncpus ? 0 : -1;
+}
+
+int nvm_dev_set_numa_node(struct nvm_dev *dev, int node)
+{
+	uint64_t cpus[NVM_NUMA_NCPUS_MAX / 64];
+	char path[128];
+	char buf[4096];
+	size_t nread;
+	FILE *fp;
+
+	if (node < 0) {				// Disable placement
+		dev->numa_node = -1;
+		memset(dev->numa_cpus, 0, sizeof(dev->numa_cpus));
+		return 0;
+	}
+
+	sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+	fp = fopen(path, "rb");
+	if (!fp) {
+		NVM_DEBUG("FAILED: fopen path(%s)\n", path);
+		errno = EINVAL;
+		return -1;
+	}
+	nread = fread(buf, 1, sizeof(buf) - 1, fp);
+	fclose(fp);
+	buf[nread] = '\0';
+
+	if (cpulist_parse(buf, cpus, NVM_NUMA_NCPUS_MAX)) {
+		NVM_DEBUG("FAILED: cpulist_parse buf(%s)\n", buf);
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(dev->numa_cpus, cpus, sizeof(cpus));
+	dev->numa_node = node;
+
+	return 0;
+}
+
+int nvm_dev_get_numa_node(struct nvm_dev *dev)
+{
+	return dev->numa_node;
+}
+
+void *nvm_dev_buf_alloc(struct nvm_dev *dev, size_t nbytes)
+{
+	const size_t PAGE_NBYTES = sysconf(_SC_PAGESIZE);
+	const size_t align = NVM_MAX(PAGE_NBYTES, dev->geo.sector_nbytes);
+	unsigned long nodemask[(NVM_NUMA_NODES_MAX + 63) / 64] = { 0 };
+	size_t len;
+	void *buf;
+	int err;
+
+	if (!nbytes) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	len = ((nbytes + PAGE_NBYTES - 1) / PAGE_NBYTES) * PAGE_NBYTES;
+
+	err = posix_memalign(&buf, align, len);
+	if (err) {
+		errno = err;
+		return NULL;
+	}
+
+	if (dev->numa_node < 0 || dev->numa_node >= NVM_NUMA_NODES_MAX)
+		return buf;
+
+	// Placement is best-effort, the buffer is usable wherever it lives
+	nodemask[dev->numa_node / 64] = 1UL << (dev->numa_node % 64);
+	if (syscall(SYS_mbind, buf, len, MPOL_BIND, nodemask,
+		    NVM_NUMA_NODES_MAX + 1, MPOL_MF_MOVE)) {
+		NVM_DEBUG("FAILED: mbind node(%d), errno(%d)\n", dev->numa_node,
+			  errno);
+	}
+
+	return buf;
+}
+
+/**
+ * Set the affinity of the calling thread to the CPUs of the node of the device
+ */
+static int numa_setaffinity(struct nvm_dev *dev)
+{
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	for (int cpu = 0; cpu < NVM_NUMA_NCPUS_MAX && cpu < CPU_SETSIZE; ++cpu)
+		if (dev->numa_cpus[cpu / 64] & (1ULL << (cpu % 64)))
+			CPU_SET(cpu, &cpus);
+
+	if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+		NVM_DEBUG("FAILED: sched_setaffinity node(%d)\n",
+			  dev->numa_node);
+		return -1;
+	}
+
+	return 0;
+}
+
+void nvm_numa_bind(struct nvm_dev *dev)
+{
+	if (dev->numa_node < 0 || numa_bound == dev->numa_node)
+		return;
+
+	if (numa_setaffinity(dev))
+		return;
+
+	numa_bound = dev->numa_node;
+}
+
+void nvm_numa_bind_worker(struct nvm_dev *dev, struct nvm_numa_aff *aff)
+{
+	aff->bound = 0;
+
+	if (!omp_get_thread_num() || dev->numa_node < 0)
+		return;
+
+	if (sched_getaffinity(0, sizeof(aff->cpus), (cpu_set_t *)aff->cpus)) {
+		NVM_DEBUG("FAILED: sched_getaffinity\n");
+		return;
+	}
+	if (numa_setaffinity(dev))
+		return;
+
+	aff->bound = 1;
+}
+
+void nvm_numa_unbind_worker(struct nvm_numa_aff *aff)
+{
+	if (!aff->bound)
+		return;
+
+	if (sched_setaffinity(0, sizeof(aff->cpus), (cpu_set_t *)aff->cpus)) {
+		NVM_DEBUG("FAILED: sched_setaffinity restore\n");
+	}
+	aff->bound = 0;
+}
@@ -0,0 +1,342 @@
+/*
+ * ring - Lock-free submission ring drained by submitter threads
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+#include <nvm_debug.h>
+
+enum {
+	RING_CMD_PENDING = 0,
+	RING_CMD_DONE = 1,
+	RING_CMD_WAITED = 2	///< Pending with a thread in nvm_ring_wait
+};
+
+/**
+ * Slot of the ring, `seq` tells whose turn it is: the producer of position
+ * `pos` when it equals `pos`, the consumer when it equals `pos + 1`
+ */
+struct ring_cell {
+	uint64_t seq;
+	struct nvm_ring_cmd *cmd;
+};
+
+/**
+ * Bounded multi-producer multi-consumer queue, Dmitry Vyukov's design, with
+ * the submitters sleeping on a futex when it runs empty
+ */
+struct nvm_ring {
+	uint64_t enq __attribute__((aligned(64)));	///< Next position to fill
+	uint64_t deq __attribute__((aligned(64)));	///< Next position to drain
+	uint32_t kick __attribute__((aligned(64)));	///< Futex, bumped on push
+	uint32_t nsleeping;		///< Submitters waiting on `kick`
+	int stop;			///< Set to drain and exit submitters
+	struct nvm_dev *dev;
+	uint64_t mask;			///< Number of cells minus one
+	int nsubmitters;
+	pthread_t *submitters;
+	struct ring_cell *cells;
+};
+
+static long futex(uint32_t *uaddr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, uaddr, op, val, NULL, NULL, 0);
+}
+
+static int ring_push(struct nvm_ring *ring, struct nvm_ring_cmd *cmd)
+{
+	uint64_t pos = __atomic_load_n(&ring->enq, __ATOMIC_RELAXED);
+	struct ring_cell *cell;
+
+	for (;;) {
+		int64_t dif;
+
+		cell = &ring->cells[pos & ring->mask];
+		dif = (int64_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+		      (int64_t)pos;
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&ring->enq, &pos,
+							pos + 1, 1,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return -1;		// Full
+		} else {
+			pos = __atomic_load_n(&ring->enq, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->cmd = cmd;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static struct nvm_ring_cmd *ring_pop(struct nvm_ring *ring)
+{
+	uint64_t pos = __atomic_load_n(&ring->deq, __ATOMIC_RELAXED);
+	struct nvm_ring_cmd *cmd;
+	struct ring_cell *cell;
+
+	for (;;) {
+		int64_t dif;
+
+		cell = &ring->cells[pos & ring->mask];
+		dif = (int64_t)__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+		      (int64_t)(pos + 1);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&ring->deq, &pos,
+							pos + 1, 1,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return NULL;		// Empty
+		} else {
+			pos = __atomic_load_n(&ring->deq, __ATOMIC_RELAXED);
+		}
+	}
+
+	cmd = cell->cmd;
+	__atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+
+	return cmd;
+}
+
+static int ring_empty(struct nvm_ring *ring)
+{
+	return __atomic_load_n(&ring->deq, __ATOMIC_SEQ_CST) ==
+	       __atomic_load_n(&ring->enq, __ATOMIC_SEQ_CST);
+}
+
+static void ring_cmd_exec(struct nvm_ring *ring, struct nvm_ring_cmd *cmd)
+{
+	const uint64_t one = 1;
+	ssize_t err;
+
+	memset(&cmd->ret, 0, sizeof(cmd->ret));
+
+	switch (cmd->op) {
+	case NVM_RING_OP_ERASE:
+		err = nvm_addr_erase(ring->dev, cmd->addrs, cmd->naddrs,
+				     cmd->flags, &cmd->ret);
+		break;
+	case NVM_RING_OP_WRITE:
+		err = nvm_addr_write(ring->dev, cmd->addrs, cmd->naddrs,
+				     cmd->data, cmd->meta, cmd->flags,
+				     &cmd->ret);
+		break;
+	case NVM_RING_OP_READ:
+		err = nvm_addr_read(ring->dev, cmd->addrs, cmd->naddrs,
+				    cmd->data, cmd->meta, cmd->flags,
+				    &cmd->ret);
+		break;
+	default:
+		err = -1;
+		errno = EINVAL;
+		break;
+	}
+	cmd->res = err ? -errno : 0;
+
+	if (cmd->efd >= 0 && write(cmd->efd, &one, sizeof(one)) < 0) {
+		NVM_DEBUG("FAILED: write efd(%d)\n", cmd->efd);
+	}
+
+	// The waiter may free `cmd` as soon as it observes completion
+	if (__atomic_exchange_n(&cmd->done, RING_CMD_DONE, __ATOMIC_ACQ_REL) ==
+	    RING_CMD_WAITED)
+		futex(&cmd->done, FUTEX_WAKE_PRIVATE, INT_MAX);
+}
+
+static void *ring_submitter(void *arg)
+{
+	struct nvm_ring *ring = arg;
+
+	nvm_numa_bind(ring->dev);
+
+	for (;;) {
+		struct nvm_ring_cmd *cmd = ring_pop(ring);
+		uint32_t kick;
+
+		if (cmd) {
+			ring_cmd_exec(ring, cmd);
+			continue;
+		}
+
+		kick = __atomic_load_n(&ring->kick, __ATOMIC_SEQ_CST);
+		__atomic_fetch_add(&ring->nsleeping, 1, __ATOMIC_SEQ_CST);
+
+		if (!ring_empty(ring)) {		// Lost a race, retry
+			__atomic_fetch_sub(&ring->nsleeping, 1,
+					   __ATOMIC_SEQ_CST);
+			continue;
+		}
+		if (__atomic_load_n(&ring->stop, __ATOMIC_SEQ_CST)) {
+			__atomic_fetch_sub(&ring->nsleeping, 1,
+					   __ATOMIC_SEQ_CST);
+			break;
+		}
+
+		futex(&ring->kick, FUTEX_WAIT_PRIVATE, kick);
+		__atomic_fetch_sub(&ring->nsleeping, 1, __ATOMIC_SEQ_CST);
+	}
+
+	return NULL;
+}
+
+static void ring_kick(struct nvm_ring *ring, int nwake)
+{
+	__atomic_fetch_add(&ring->kick, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->nsleeping, __ATOMIC_SEQ_CST))
+		futex(&ring->kick, FUTEX_WAKE_PRIVATE, nwake);
+}
+
+int nvm_ring_submit(struct nvm_dev *dev, struct nvm_ring_cmd *cmd)
+{
+	struct nvm_ring *ring = dev->ring;
+
+	if (!ring) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	__atomic_store_n(&cmd->done, RING_CMD_PENDING, __ATOMIC_RELAXED);
+
+	if (ring_push(ring, cmd)) {
+		errno = EAGAIN;
+		return -1;
+	}
+	ring_kick(ring, 1);
+
+	return 0;
+}
+
+int nvm_ring_poll(struct nvm_ring_cmd *cmd)
+{
+	return __atomic_load_n(&cmd->done, __ATOMIC_ACQUIRE) == RING_CMD_DONE;
+}
+
+int nvm_ring_wait(struct nvm_ring_cmd *cmd)
+{
+	uint32_t done = RING_CMD_PENDING;
+
+	__atomic_compare_exchange_n(&cmd->done, &done, RING_CMD_WAITED, 0,
+				    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+	while (__atomic_load_n(&cmd->done, __ATOMIC_ACQUIRE) != RING_CMD_DONE)
+		futex(&cmd->done, FUTEX_WAIT_PRIVATE, RING_CMD_WAITED);
+
+	if (cmd->res) {
+		errno = -cmd->res;
+		return -1;
+	}
+
+	return 0;
+}
+
+int nvm_ring_enable(struct nvm_dev *dev, int nentries, int nsubmitters)
+{
+	struct nvm_ring *ring;
+	uint64_t ncells = 1;
+
+	if (nentries < 1 || nsubmitters < 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (dev->ring) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	while (ncells < (uint64_t)nentries)	// Round up to a power of two
+		ncells <<= 1;
+
+	if (posix_memalign((void **)&ring, 64, sizeof(*ring))) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->dev = dev;
+	ring->mask = ncells - 1;
+
+	ring->cells = calloc(ncells, sizeof(*ring->cells));
+	ring->submitters = calloc(nsubmitters, sizeof(*ring->submitters));
+	if (!ring->cells || !ring->submitters) {
+		free(ring->cells);
+		free(ring->submitters);
+		free(ring);
+		errno = ENOMEM;
+		return -1;
+	}
+	for (uint64_t i = 0; i < ncells; ++i)
+		ring->cells[i].seq = i;
+
+	for (; ring->nsubmitters < nsubmitters; ++ring->nsubmitters) {
+		if (pthread_create(&ring->submitters[ring->nsubmitters], NULL,
+				   ring_submitter, ring)) {
+			NVM_DEBUG("FAILED: pthread_create\n");
+			dev->ring = ring;
+			nvm_ring_disable(dev);
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+
+	dev->ring = ring;
+
+	return 0;
+}
+
+void nvm_ring_disable(struct nvm_dev *dev)
+{
+	struct nvm_ring *ring = dev->ring;
+
+	if (!ring)
+		return;
+
+	__atomic_store_n(&ring->stop, 1, __ATOMIC_SEQ_CST);
+	ring_kick(ring, INT_MAX);
+
+	for (int i = 0; i < ring->nsubmitters; ++i)
+		pthread_join(ring->submitters[i], NULL);
+
+	dev->ring = NULL;
+	free(ring->submitters);
+	free(ring->cells);
+	free(ring);
+}
@@ -0,0 +1,312 @@
+/*
+ * sched - per-LUN admission scheduling of commands
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/lightnvm.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+
+/**
+ * A thread waiting for a slot on a LUN, lives on the stack of the waiter
+ */
+struct sched_waiter {
+	struct sched_waiter *next;	///< Next waiter in arrival order
+	pthread_cond_t cv;		///< Signaled when granted
+	uint64_t ts;			///< Arrival time in nsec
+	int read;			///< Whether the command is a read
+	int granted;			///< Set by the releaser granting a slot
+};
+
+/**
+ * Admission state of a LUN, at most `depth` commands are in flight and the
+ * rest wait in arrival order
+ */
+struct sched_lun {
+	pthread_mutex_t lock;
+	struct sched_waiter *head;	///< Oldest waiter
+	struct sched_waiter *tail;	///< Youngest waiter
+	int ninflight;			///< Commands holding a slot
+};
+
+struct nvm_sched {
+	int depth;			///< Slots per LUN
+	uint64_t aging_ns;		///< Wait before a non-read is promoted
+	size_t nluns;			///< Number of LUNs in the device
+	struct nvm_sched_stat stat;	///< Updated atomically
+	struct sched_lun luns[];
+};
+
+/**
+ * Pick the waiter to grant a slot: reads before programs and erases, unless
+ * the oldest waiter is a program or erase which has waited for longer than
+ * aging_ns. Returns NULL when there are no waiters.
+ */
+static struct sched_waiter *sched_pick(struct nvm_sched *sched,
+				       struct sched_lun *lun)
+{
+	struct sched_waiter *prev = NULL, *pick = lun->head;
+
+	if (!pick)
+		return NULL;
+
+	if (!pick->read && (nvm_trace_ts() - pick->ts) < sched->aging_ns) {
+		struct sched_waiter *cur;
+
+		for (cur = lun->head; cur->next; cur = cur->next) {
+			if (cur->next->read) {
+				prev = cur;
+				pick = cur->next;
+				break;
+			}
+		}
+	} else if (!pick->read) {
+		for (struct sched_waiter *cur = pick->next; cur; cur = cur->next) {
+			if (cur->read) {
+				__atomic_fetch_add(&sched->stat.npromotions,
+						   1, __ATOMIC_RELAXED);
+				break;
+			}
+		}
+	}
+
+	if (prev)
+		prev->next = pick->next;
+	else
+		lun->head = pick->next;
+	if (lun->tail == pick)
+		lun->tail = prev;
+
+	return pick;
+}
+
+static void sched_lun_acquire(struct nvm_sched *sched, struct sched_lun *lun,
+			      int read)
+{
+	struct sched_waiter waiter;
+
+	pthread_mutex_lock(&lun->lock);
+
+	if (!lun->head && lun->ninflight < sched->depth) {
+		++lun->ninflight;
+	} else {
+		memset(&waiter, 0, sizeof(waiter));
+		pthread_cond_init(&waiter.cv, NULL);
+		waiter.ts = nvm_trace_ts();
+		waiter.read = read;
+
+		if (lun->tail)
+			lun->tail->next = &waiter;
+		else
+			lun->head = &waiter;
+		lun->tail = &waiter;
+
+		__atomic_fetch_add(&sched->stat.nwaits, 1, __ATOMIC_RELAXED);
+
+		while (!waiter.granted)
+			pthread_cond_wait(&waiter.cv, &lun->lock);
+
+		pthread_cond_destroy(&waiter.cv);
+	}
+
+	if (lun->ninflight > __atomic_load_n(&sched->stat.max_inflight,
+					     __ATOMIC_RELAXED))
+		__atomic_store_n(&sched->stat.max_inflight, lun->ninflight,
+				 __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&lun->lock);
+}
+
+static void sched_lun_release(struct nvm_sched *sched, struct sched_lun *lun)
+{
+	struct sched_waiter *waiter;
+
+	pthread_mutex_lock(&lun->lock);
+
+	--lun->ninflight;
+
+	waiter = sched_pick(sched, lun);
+	if (waiter) {			// Hand the slot over
+		++lun->ninflight;
+		waiter->granted = 1;
+		pthread_cond_signal(&waiter->cv);
+	}
+
+	pthread_mutex_unlock(&lun->lock);
+}
+
+/**
+ * Fill `luns` with the distinct LUNs addressed, in ascending order, such that
+ * commands spanning LUNs acquire their slots in the same order and cannot
+ * deadlock. Returns the number of LUNs.
+ */
+static int sched_luns(struct nvm_dev *dev, struct nvm_addr addrs[], int naddrs,
+		      size_t luns[])
+{
+	int nluns = 0;
+
+	for (int i = 0; i < naddrs; ++i) {
+		size_t lun = addrs[i].g.ch * dev->geo.nluns + addrs[i].g.lun;
+		int j;
+
+		if (lun >= dev->sched->nluns)	// Left for the device to reject
+			continue;
+
+		for (j = nluns; j > 0 && luns[j - 1] > lun; --j)
+			;
+		if (j > 0 && luns[j - 1] == lun)
+			continue;
+
+		memmove(&luns[j + 1], &luns[j], (nluns - j) * sizeof(*luns));
+		luns[j] = lun;
+		++nluns;
+	}
+
+	return nluns;
+}
+
+struct nvm_sched *nvm_sched_acquire(struct nvm_dev *dev, uint16_t opcode,
+				    struct nvm_addr addrs[], int naddrs,
+				    size_t luns[], int *nluns)
+{
+	const int read = opcode == S12_OPC_READ;
+	struct nvm_sched *sched;
+
+	*nluns = 0;
+
+	if (!__atomic_load_n(&dev->sched, __ATOMIC_RELAXED))
+		return NULL;
+
+	// Count the command as a user before looking at the scheduler again,
+	// such that nvm_sched_disable either sees the user or the command
+	// sees the scheduler gone
+	__atomic_fetch_add(&dev->sched_nusers, 1, __ATOMIC_SEQ_CST);
+	sched = __atomic_load_n(&dev->sched, __ATOMIC_SEQ_CST);
+	if (!sched) {
+		__atomic_fetch_sub(&dev->sched_nusers, 1, __ATOMIC_RELEASE);
+		return NULL;
+	}
+
+	*nluns = sched_luns(dev, addrs, naddrs, luns);
+	for (int i = 0; i < *nluns; ++i)
+		sched_lun_acquire(sched, &sched->luns[luns[i]], read);
+
+	__atomic_fetch_add(&sched->stat.ncmds, 1, __ATOMIC_RELAXED);
+
+	return sched;
+}
+
+void nvm_sched_release(struct nvm_dev *dev, struct nvm_sched *sched,
+		       size_t luns[], int nluns)
+{
+	for (int i = nluns - 1; i >= 0; --i)
+		sched_lun_release(sched, &sched->luns[luns[i]]);
+
+	__atomic_fetch_sub(&dev->sched_nusers, 1, __ATOMIC_RELEASE);
+}
+
+int nvm_sched_enable(struct nvm_dev *dev, int depth, int aging_us)
+{
+	struct nvm_sched *sched;
+	const size_t nluns = dev->geo.nchannels * dev->geo.nluns;
+
+	if (depth < 1 || aging_us < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (__atomic_load_n(&dev->sched, __ATOMIC_RELAXED)) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	sched = calloc(1, sizeof(*sched) + nluns * sizeof(sched->luns[0]));
+	if (!sched) {
+		errno = ENOMEM;
+		return -1;
+	}
+	sched->depth = depth;
+	sched->aging_ns = aging_us * 1000ULL;
+	sched->nluns = nluns;
+	for (size_t i = 0; i < nluns; ++i)
+		pthread_mutex_init(&sched->luns[i].lock, NULL);
+
+	__atomic_store_n(&dev->sched, sched, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+void nvm_sched_disable(struct nvm_dev *dev)
+{
+	struct nvm_sched *sched;
+
+	sched = __atomic_exchange_n(&dev->sched, NULL, __ATOMIC_SEQ_CST);
+	if (!sched)
+		return;
+
+	// Drain the commands holding or waiting for a slot, they are granted
+	// as the holders release theirs
+	while (__atomic_load_n(&dev->sched_nusers, __ATOMIC_ACQUIRE))
+		usleep(100);
+
+	for (size_t i = 0; i < sched->nluns; ++i)
+		pthread_mutex_destroy(&sched->luns[i].lock);
+	free(sched);
+}
+
+int nvm_sched_get_stat(struct nvm_dev *dev, struct nvm_sched_stat *stat)
+{
+	if (!dev->sched) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	stat->ncmds = __atomic_load_n(&dev->sched->stat.ncmds,
+				      __ATOMIC_RELAXED);
+	stat->nwaits = __atomic_load_n(&dev->sched->stat.nwaits,
+				       __ATOMIC_RELAXED);
+	stat->npromotions = __atomic_load_n(&dev->sched->stat.npromotions,
+					    __ATOMIC_RELAXED);
+	stat->max_inflight = __atomic_load_n(&dev->sched->stat.max_inflight,
+					     __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+void nvm_sched_stat_pr(const struct nvm_sched_stat *stat)
+{
+	printf("sched_stat {\n");
+	printf(" ncmds(%lu), nwaits(%lu), npromotions(%lu), max_inflight(%d)\n",
+	       stat->ncmds, stat->nwaits, stat->npromotions,
+	       stat->max_inflight);
+	printf("}\n");
+}
@@ -0,0 +1,271 @@
+/*
+ * stream - append-only writer over lines with erase-ahead
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <linux/lightnvm.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+
+enum stream_line_state {
+	STREAM_LINE_NONE = 0x0,		///< Not yet erased
+	STREAM_LINE_ERASED = 0x1,	///< Erased, ready for writing
+	STREAM_LINE_FAILED = 0x2	///< Erase failed, line is skipped
+};
+
+struct nvm_stream {
+	struct nvm_dev *dev;
+	int nlines;			///< Number of lines in the stream
+	int nahead;			///< Lines to erase ahead of the current
+	struct nvm_vblk **lines;	///< Lines in the order they are written
+	int *states;			///< enum stream_line_state of each line
+	int cur;			///< Line currently being written
+	int erase_next;			///< Next line for the eraser
+	int stop;			///< Tells the eraser to terminate
+
+	pthread_t eraser;
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+};
+
+/**
+ * Erase lines in order, staying at most `nahead` lines ahead of the line
+ * being written
+ */
+static void *stream_erase_ahead(void *arg)
+{
+	struct nvm_stream *stream = arg;
+
+	nvm_numa_bind(stream->dev);
+
+	pthread_mutex_lock(&stream->lock);
+	for (;;) {
+		const int idx = stream->erase_next;
+		ssize_t err;
+
+		if (stream->stop || idx >= stream->nlines)
+			break;
+		if (idx > stream->cur + stream->nahead) {
+			pthread_cond_wait(&stream->cv, &stream->lock);
+			continue;
+		}
+		++stream->erase_next;
+		pthread_mutex_unlock(&stream->lock);
+
+		err = nvm_vblk_erase(stream->lines[idx]);
+
+		pthread_mutex_lock(&stream->lock);
+		stream->states[idx] = err < 0 ? STREAM_LINE_FAILED :
+						STREAM_LINE_ERASED;
+		pthread_cond_broadcast(&stream->cv);
+	}
+	pthread_mutex_unlock(&stream->lock);
+
+	return NULL;
+}
+
+static void stream_free(struct nvm_stream *stream)
+{
+	for (int i = 0; stream->lines && i < stream->nlines; ++i)
+		nvm_vblk_free(stream->lines[i]);
+	free(stream->lines);
+	free(stream->states);
+	free(stream);
+}
+
+struct nvm_stream *nvm_stream_open(struct nvm_dev *dev, int ch_bgn,
+				   int ch_end, int lun_bgn, int lun_end,
+				   int blk_bgn, int blk_end, int nahead)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+	struct nvm_stream *stream;
+
+	if (ch_bgn < 0 || ch_bgn > ch_end || ch_end >= (int)geo->nchannels ||
+	    lun_bgn < 0 || lun_bgn > lun_end || lun_end >= (int)geo->nluns ||
+	    blk_bgn < 0 || blk_bgn > blk_end || blk_end >= (int)geo->nblocks ||
+	    nahead < 1) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	stream = calloc(1, sizeof(*stream));
+	if (!stream) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	stream->dev = dev;
+	stream->nlines = blk_end - blk_bgn + 1;
+	stream->nahead = nahead;
+
+	stream->lines = calloc(stream->nlines, sizeof(*stream->lines));
+	stream->states = calloc(stream->nlines, sizeof(*stream->states));
+	if (!stream->lines || !stream->states) {
+		stream_free(stream);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (int i = 0; i < stream->nlines; ++i) {
+		stream->lines[i] = nvm_vblk_alloc_line(dev, ch_bgn, ch_end,
+						       lun_bgn, lun_end,
+						       blk_bgn + i);
+		if (!stream->lines[i]) {
+			stream_free(stream);
+			return NULL;	// Propagate errno
+		}
+	}
+
+	pthread_mutex_init(&stream->lock, NULL);
+	pthread_cond_init(&stream->cv, NULL);
+
+	if (pthread_create(&stream->eraser, NULL, stream_erase_ahead, stream)) {
+		pthread_cond_destroy(&stream->cv);
+		pthread_mutex_destroy(&stream->lock);
+		stream_free(stream);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	return stream;
+}
+
+/**
+ * Wait for the current line to be erased, skipping lines which failed to
+ * erase. Returns the line or NULL with errno set to ENOSPC when exhausted.
+ */
+static struct nvm_vblk *stream_line(struct nvm_stream *stream)
+{
+	struct nvm_vblk *line = NULL;
+
+	pthread_mutex_lock(&stream->lock);
+	while (stream->cur < stream->nlines) {
+		struct nvm_vblk *cur = stream->lines[stream->cur];
+
+		if (stream->states[stream->cur] == STREAM_LINE_NONE) {
+			pthread_cond_wait(&stream->cv, &stream->lock);
+			continue;
+		}
+		if (stream->states[stream->cur] == STREAM_LINE_ERASED &&
+		    nvm_vblk_get_pos_write(cur) < nvm_vblk_get_nbytes(cur)) {
+			line = cur;
+			break;
+		}
+
+		++stream->cur;			// Failed or full, roll over
+		pthread_cond_broadcast(&stream->cv);
+	}
+	pthread_mutex_unlock(&stream->lock);
+
+	if (!line)
+		errno = ENOSPC;
+
+	return line;
+}
+
+/**
+ * Address of the virtual page at the given offset in the line, following the
+ * striping of nvm_vblk_pwrite
+ */
+static struct nvm_addr stream_off2gen(struct nvm_vblk *line, size_t offset)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(line->dev);
+	const size_t spg = offset / geo->vpg_nbytes;
+	struct nvm_addr addr;
+
+	addr.ppa = line->blks[spg % line->nblks].ppa;
+	addr.g.pg = (spg / line->nblks) % geo->npages;
+
+	return addr;
+}
+
+ssize_t nvm_stream_append(struct nvm_stream *stream, const void *buf,
+			  size_t count, struct nvm_addr *addr)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(stream->dev);
+	const char *cbuf = buf;
+	size_t nbytes = 0;
+
+	if (!buf || !count || count % geo->vpg_nbytes) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (nbytes < count) {
+		struct nvm_vblk *line = stream_line(stream);
+		size_t pos, n;
+
+		if (!line)
+			return -1;		// Propagate errno
+
+		pos = nvm_vblk_get_pos_write(line);
+		n = NVM_MIN(count - nbytes, nvm_vblk_get_nbytes(line) - pos);
+
+		if (addr && !nbytes)
+			*addr = stream_off2gen(line, pos);
+
+		if (nvm_vblk_write(line, cbuf + nbytes, n) < 0)
+			return -1;		// Propagate errno
+
+		nbytes += n;
+	}
+
+	return nbytes;
+}
+
+int nvm_stream_close(struct nvm_stream *stream)
+{
+	int err = 0;
+
+	if (!stream)
+		return 0;
+
+	pthread_mutex_lock(&stream->lock);
+	stream->stop = 1;
+	pthread_cond_broadcast(&stream->cv);
+	pthread_mutex_unlock(&stream->lock);
+
+	pthread_join(stream->eraser, NULL);
+
+	if (stream->cur < stream->nlines) {	// Pad a partially written line
+		struct nvm_vblk *line = stream->lines[stream->cur];
+		size_t pos = nvm_vblk_get_pos_write(line);
+
+		if (pos && pos < nvm_vblk_get_nbytes(line) &&
+		    nvm_vblk_pad(line) < 0)
+			err = -1;
+	}
+
+	pthread_cond_destroy(&stream->cv);
+	pthread_mutex_destroy(&stream->lock);
+	stream_free(stream);
+
+	return err;
+}
@@ -0,0 +1,349 @@
+/*
+ * trace - Per-thread lock-free command tracing
+ *
+ * Copyright (C) 2015 Javier González <javier@cnexlabs.com>
+ * Copyright (C) 2015 Matias Bjørling <matias@cnexlabs.com>
+ * Copyright (C) 2016 Simon A. F. Lund <slund@cnexlabs.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  - Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  - Redistributions in binary form must reproduce the above copyright notice,
+ *  this list of conditions and the following disclaimer in the documentation
+ *  and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+#include <nvm_debug.h>
+
+#define NVM_TRACE_MAGIC "NVMT"
+#define NVM_TRACE_VER 1
+
+/**
+ * Single-producer ring of trace records, one per submitting thread
+ *
+ * The owning thread is the only writer, it fills the slot at `head` and then
+ * publishes it by incrementing `head`. Readers never block the writer; when the
+ * ring is full the oldest records are overwritten.
+ *
+ * When the owning thread exits, the ring is retired, its records are kept for
+ * nvm_trace_dump and the ring is handed to the next thread needing one.
+ */
+struct nvm_trace_ring {
+	struct nvm_trace_ring *next;	///< Next ring in the global list
+	uint32_t tid;			///< Id of the owning thread
+	int retired;			///< Non-zero when no thread owns the ring
+	uint64_t head;			///< Total number of records pushed
+	uint64_t nrecs;			///< Capacity, power of two
+	struct nvm_trace_rec recs[];
+};
+
+/**
+ * Header of the binary trace file, followed by `nrecs` records
+ */
+struct nvm_trace_hdr {
+	char magic[4];
+	uint32_t ver;
+	uint32_t rec_nbytes;
+	uint32_t rsvd;
+	uint64_t nrecs;
+};
+
+int nvm_trace_enabled = 0;
+
+static uint64_t trace_nrecs = 0;
+static uint32_t trace_ntids = 0;
+static struct nvm_trace_ring *trace_rings = NULL;
+static __thread struct nvm_trace_ring *trace_ring = NULL;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+
+uint64_t nvm_trace_ts(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void trace_ring_retire(void *arg)
+{
+	struct nvm_trace_ring *ring = arg;
+
+	__atomic_store_n(&ring->retired, 1, __ATOMIC_RELEASE);
+}
+
+static void trace_key_create(void)
+{
+	if (pthread_key_create(&trace_key, trace_ring_retire)) {
+		NVM_DEBUG("FAILED: pthread_key_create");
+	}
+}
+
+/**
+ * Claim a ring retired by an exited thread, avoids growing the list with
+ * every short-lived thread
+ */
+static struct nvm_trace_ring *trace_ring_claim(uint64_t nrecs)
+{
+	struct nvm_trace_ring *ring;
+
+	for (ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next) {
+		int retired = 1;
+
+		if (ring->nrecs != nrecs)
+			continue;
+
+		if (__atomic_compare_exchange_n(&ring->retired, &retired, 0, 0,
+						__ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			return ring;
+	}
+
+	return NULL;
+}
+
+static struct nvm_trace_ring *trace_ring_get(void)
+{
+	struct nvm_trace_ring *ring = trace_ring;
+	const uint64_t nrecs = trace_nrecs;
+
+	if (ring)			// Capacity is fixed on first use
+		return ring;
+
+	pthread_once(&trace_once, trace_key_create);
+
+	ring = trace_ring_claim(nrecs);
+	if (ring) {
+		ring->tid = __atomic_fetch_add(&trace_ntids, 1,
+					       __ATOMIC_RELAXED);
+		goto out;
+	}
+
+	ring = malloc(sizeof(*ring) + nrecs * sizeof(ring->recs[0]));
+	if (!ring)
+		return NULL;
+
+	ring->tid = __atomic_fetch_add(&trace_ntids, 1, __ATOMIC_RELAXED);
+	ring->retired = 0;
+	ring->head = 0;
+	ring->nrecs = nrecs;
+
+	do {				// Lock-free push onto the global list
+		ring->next = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+	} while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring,
+					      0, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+out:
+	if (pthread_setspecific(trace_key, ring)) {
+		NVM_DEBUG("FAILED: pthread_setspecific");
+	}
+
+	trace_ring = ring;
+
+	return ring;
+}
+
+void nvm_trace_push(uint16_t opcode, struct nvm_addr addrs[], int naddrs,
+		    uint64_t ts, int err, uint32_t result, uint64_t status)
+{
+	struct nvm_trace_ring *ring = trace_ring_get();
+	struct nvm_trace_rec *rec;
+	uint64_t head;
+
+	if (!ring)
+		return;
+
+	head = ring->head;
+	rec = &ring->recs[head & (ring->nrecs - 1)];
+
+	rec->ts = ts;
+	rec->dur = nvm_trace_ts() - ts;
+	rec->ppa = naddrs ? addrs[0].ppa : 0;
+	rec->status = status;
+	rec->result = result;
+	rec->tid = ring->tid;
+	rec->opcode = opcode;
+	rec->naddrs = naddrs;
+	rec->err = err;
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int nvm_trace_enable(size_t nrecs)
+{
+	uint64_t pow2 = 1;
+
+	if (!nrecs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (pow2 < nrecs)		// Round up for cheap index masking
+		pow2 <<= 1;
+
+	trace_nrecs = pow2;
+	__atomic_store_n(&nvm_trace_enabled, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void nvm_trace_disable(void)
+{
+	__atomic_store_n(&nvm_trace_enabled, 0, __ATOMIC_RELEASE);
+}
+
+static int trace_rec_cmp(const void *a, const void *b)
+{
+	const struct nvm_trace_rec *ra = a, *rb = b;
+
+	return (ra->ts > rb->ts) - (ra->ts < rb->ts);
+}
+
+int nvm_trace_dump(const char *path)
+{
+	struct nvm_trace_hdr hdr;
+	struct nvm_trace_rec *recs;
+	struct nvm_trace_ring *ring;
+	size_t nrecs = 0, cap = 0;
+	FILE *fp;
+	int err = 0;
+
+	for (ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next)
+		cap += ring->nrecs;
+
+	recs = malloc(sizeof(*recs) * (cap ? cap : 1));
+	if (!recs) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE); ring;
+	     ring = ring->next) {
+		const uint64_t n = ring->nrecs;
+		uint64_t bgn, end, head;
+
+		if (!n)
+			continue;
+
+		end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		bgn = end > n ? end - n : 0;
+
+		for (uint64_t i = bgn; i < end; ++i)
+			recs[nrecs + (i - bgn)] = ring->recs[i & (n - 1)];
+
+		// Drop records the writer may have overwritten while copying, the
+		// writer fills the slot of index `head`, holding index `head - n`,
+		// before publishing `head + 1`. The fence keeps the copies above
+		// from being reordered after the reload.
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		if (head + 1 > n && head + 1 - n > bgn) {
+			const uint64_t torn = NVM_MIN(head + 1 - n - bgn,
+						      end - bgn);
+
+			memmove(&recs[nrecs], &recs[nrecs + torn],
+				sizeof(*recs) * (end - bgn - torn));
+			bgn += torn;
+		}
+
+		nrecs += end - bgn;
+	}
+
+	qsort(recs, nrecs, sizeof(*recs), trace_rec_cmp);
+
+	fp = fopen(path, "wb");
+	if (!fp) {
+		free(recs);
+		return -1;			// Propagate `errno`
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, NVM_TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.ver = NVM_TRACE_VER;
+	hdr.rec_nbytes = sizeof(*recs);
+	hdr.nrecs = nrecs;
+
+	if ((fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ||
+	    (fwrite(recs, sizeof(*recs), nrecs, fp) != nrecs)) {
+		errno = EIO;
+		err = -1;
+	}
+
+	fclose(fp);
+	free(recs);
+
+	return err;
+}
+
+struct nvm_trace_rec *nvm_trace_load(const char *path, size_t *nrecs)
+{
+	struct nvm_trace_hdr hdr;
+	struct nvm_trace_rec *recs;
+	FILE *fp;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return NULL;			// Propagate `errno`
+
+	if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+	    memcmp(hdr.magic, NVM_TRACE_MAGIC, sizeof(hdr.magic)) ||
+	    (hdr.ver != NVM_TRACE_VER) ||
+	    (hdr.rec_nbytes != sizeof(*recs))) {
+		fclose(fp);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	recs = malloc(sizeof(*recs) * (hdr.nrecs ? hdr.nrecs : 1));
+	if (!recs) {
+		fclose(fp);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (fread(recs, sizeof(*recs), hdr.nrecs, fp) != hdr.nrecs) {
+		fclose(fp);
+		free(recs);
+		errno = EIO;
+		return NULL;
+	}
+	fclose(fp);
+
+	*nrecs = hdr.nrecs;
+
+	return recs;
+}
+
+void nvm_trace_rec_pr(const struct nvm_trace_rec *rec)
+{
+	printf("trace_rec { ts(%lu), dur(%lu), tid(%u), opcode(0x%02x), ",
+	       rec->ts, rec->dur, rec->tid, rec->opcode);
+	printf("naddrs(%u), ppa(0x%016lx), err(%d), result(0x%x), status(%lu) }\n",
+	       rec->naddrs, rec->ppa, rec->err, rec->result, rec->status);
+}
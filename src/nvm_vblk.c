@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <string.h>
 #include <errno.h>
 #include <stdio.h>
 #include <linux/lightnvm.h>
@@ -71,6 +72,12 @@ struct nvm_vblk* nvm_vblk_alloc(struct nvm_dev *dev, struct nvm_addr addrs[],
 	}
 
 	vblk->nblks = naddrs;
+	nvm_div_init(&vblk->nblks_div, vblk->nblks);
+	vblk->nparity = 0;
+	vblk->ret.nbytes = 0;
+	vblk->ret.nfailed = 0;
+	vblk->ret.failed = NULL;
+	vblk->nfailed_max = 0;
 	vblk->dev = dev;
 	vblk->pos_write = 0;
 	vblk->pos_read = 0;
@@ -100,6 +107,7 @@ struct nvm_vblk *nvm_vblk_alloc_line(struct nvm_dev *dev, int ch_bgn,
 			++(vblk->nblks);
 		}
 	}
+	nvm_div_init(&vblk->nblks_div, vblk->nblks);
 
 	vblk->nbytes = vblk->nblks * geo->nplanes * geo->npages *
 		       geo->nsectors * geo->sector_nbytes;
@@ -109,9 +117,51 @@ struct nvm_vblk *nvm_vblk_alloc_line(struct nvm_dev *dev, int ch_bgn,
 
 void nvm_vblk_free(struct nvm_vblk *vblk)
 {
+	if (vblk)
+		free(vblk->ret.failed);
 	free(vblk);
 }
 
+/**
+ * Append the addresses flagged in `status` to the failure list of the vblk,
+ * all of them when the command failed without flagging any
+ *
+ * @returns the number of addresses flagged
+ */
+static int vblk_ret_failed(struct nvm_vblk *vblk, struct nvm_addr addrs[],
+			   int naddrs, uint64_t status)
+{
+	int nflagged = 0;
+
+	#pragma omp critical(vblk_ret)
+	{
+		for (int i = 0; i < naddrs; ++i) {
+			if (status && !(status & (1ULL << i)))
+				continue;
+
+			++nflagged;
+
+			if (vblk->ret.nfailed == vblk->nfailed_max) {
+				const int nmax = vblk->nfailed_max ?
+						 vblk->nfailed_max * 2 : 64;
+				struct nvm_addr *failed;
+
+				failed = realloc(vblk->ret.failed,
+						 nmax * sizeof(*failed));
+				if (!failed)
+					continue;	// The list is best-effort
+
+				vblk->ret.failed = failed;
+				vblk->nfailed_max = nmax;
+			}
+
+			vblk->ret.failed[vblk->ret.nfailed++] = addrs[i];
+		}
+	}
+
+	return nflagged;
+}
+
 static inline int _cmd_nblks(int nblks, int cmd_nblks_max)
 {
 	int cmd_nblks = cmd_nblks_max;
@@ -132,29 +182,39 @@ ssize_t nvm_vblk_erase(struct nvm_vblk *vblk)
 				vblk->dev->erase_naddrs_max / BLK_NADDRS);
 	const int NTHREADS = vblk->nblks < CMD_NBLKS ? 1 : vblk->nblks / CMD_NBLKS;
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if (NTHREADS>1)
-	for (int off = 0; off < vblk->nblks; off += CMD_NBLKS) {
-		ssize_t err;
-		struct nvm_ret ret = {};
+	#pragma omp parallel num_threads(NTHREADS) reduction(+:nerr) if(NTHREADS>1)
+	{
+		struct nvm_numa_aff aff;
 
-		const int nblks = NVM_MIN(CMD_NBLKS, vblk->nblks - off);
-		const int naddrs = nblks * BLK_NADDRS;
+		nvm_numa_bind_worker(vblk->dev, &aff);
 
-		struct nvm_addr addrs[naddrs];
+		#pragma omp for schedule(static,1) ordered
+		for (int off = 0; off < vblk->nblks; off += CMD_NBLKS) {
+			ssize_t err;
+			struct nvm_ret ret = {};
 
-		for (int i = 0; i < naddrs; ++i) {
-			const int idx = off + (i / BLK_NADDRS);
+			const int nblks = NVM_MIN(CMD_NBLKS, vblk->nblks - off);
+			const int naddrs = nblks * BLK_NADDRS;
 
-			addrs[i].ppa = vblk->blks[idx].ppa;
-			addrs[i].g.pl = i % geo->nplanes;
-		}
+			struct nvm_addr addrs[naddrs];
 
-		err = nvm_addr_erase(vblk->dev, addrs, naddrs, PMODE, &ret);
-		if (err)
-			++nerr;
+			for (int i = 0; i < naddrs; ++i) {
+				const int idx = off + (i / BLK_NADDRS);
+
+				addrs[i].ppa = vblk->blks[idx].ppa;
+				addrs[i].g.pl = i % geo->nplanes;
+			}
 
-		#pragma omp ordered
-		{}
+			err = nvm_addr_erase(vblk->dev, addrs, naddrs, PMODE,
+					     &ret);
+			if (err)
+				++nerr;
+
+			#pragma omp ordered
+			{}
+		}
+
+		nvm_numa_unbind_worker(&aff);
 	}
 
 	if (nerr) {
@@ -177,12 +237,22 @@ static inline int _cmd_nspages(int nblks, int cmd_nspages_max)
 	return cmd_nspages;
 }
 
+static ssize_t vblk_parity_pwrite(struct nvm_vblk *vblk, const char *buf,
+				  size_t count, size_t offset);
+
+static ssize_t vblk_parity_pread(struct nvm_vblk *vblk, char *buf,
+				 size_t count, size_t offset, int around);
+
+static void vblk_vpg_addrs(struct nvm_vblk *vblk, int idx, int pg, int npages,
+			   struct nvm_addr addrs[]);
+
 ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
 			size_t offset)
 {
 	size_t nerr = 0;
 	const int PMODE = nvm_dev_get_pmode(vblk->dev);
 	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const struct nvm_geo_div *gdiv = &vblk->dev->gdiv;
 
 	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
 	const int CMD_NSPAGES = _cmd_nspages(vblk->nblks,
@@ -199,6 +269,12 @@ ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
 	const size_t meta_tbytes = CMD_NSPAGES * SPAGE_NADDRS * geo->meta_nbytes;
 	char *meta = NULL;
 
+	vblk->ret.nbytes = 0;
+	vblk->ret.nfailed = 0;
+
+	if (vblk->nparity)
+		return vblk_parity_pwrite(vblk, buf, count, offset);
+
 	if (offset + count > vblk->nbytes) {		// Check bounds
 		errno = EINVAL;
 		return -1;
@@ -212,7 +288,7 @@ ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
 	if (!buf) {	// Allocate and use a padding buffer
 		const size_t nbytes = CMD_NSPAGES * SPAGE_NADDRS * geo->sector_nbytes;
 
-		padding_buf = nvm_buf_alloc(geo, nbytes);
+		padding_buf = nvm_dev_buf_alloc(vblk->dev, nbytes);
 		if (!padding_buf) {
 			errno = ENOMEM;
 			return -1;
@@ -220,8 +296,9 @@ ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
 		nvm_buf_fill(padding_buf, nbytes);
 	}
 
-	if (vblk->dev->meta_mode != NVM_META_MODE_NONE) {	// Meta
-		meta = nvm_buf_alloc(geo, meta_tbytes);		// Alloc buf
+	if (vblk->dev->meta_mode == NVM_META_MODE_ALPHA ||	// Meta
+	    vblk->dev->meta_mode == NVM_META_MODE_CONST) {
+		meta = nvm_dev_buf_alloc(vblk->dev, meta_tbytes);	// Alloc buf
 		if (!meta) {
 			errno = ENOMEM;
 			return -1;
@@ -235,47 +312,69 @@ ssize_t nvm_vblk_pwrite(struct nvm_vblk *vblk, const void *buf, size_t count,
 				for (size_t i = 0; i < meta_tbytes; ++i)
 					meta[i] = 65 + (meta_tbytes % 20);
 				break;
-			case NVM_META_MODE_NONE:
+			default:
 				break;
 		}
 	}
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
-		struct nvm_ret ret = {};
-
-		const int nspages = NVM_MIN(CMD_NSPAGES, (int)(end - off));
-		const int naddrs = nspages * SPAGE_NADDRS;
-
-		struct nvm_addr addrs[naddrs];
-		const char *buf_off;
-
-		if (padding_buf)
-			buf_off = padding_buf;
-		else
-			buf_off = buf + (off - bgn) * geo->sector_nbytes * SPAGE_NADDRS;
-
-		for (int i = 0; i < naddrs; ++i) {
-			const int spg = off + (i / SPAGE_NADDRS);
-			const int idx = spg % vblk->nblks;
-			const int pg = (spg / vblk->nblks) % geo->npages;
-
-			addrs[i].ppa = vblk->blks[idx].ppa;
-			addrs[i].g.pg = pg;
-			addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
-			addrs[i].g.sec = i % geo->nsectors;
+	#pragma omp parallel num_threads(NTHREADS) reduction(+:nerr) if(NTHREADS>1)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(vblk->dev, &aff);
+
+		#pragma omp for schedule(static,1) ordered
+		for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
+			struct nvm_ret ret = {};
+
+			const int nspages = NVM_MIN(CMD_NSPAGES,
+						    (int)(end - off));
+			const int naddrs = nspages * SPAGE_NADDRS;
+
+			struct nvm_addr addrs[naddrs];
+			const char *buf_off;
+
+			if (padding_buf)
+				buf_off = padding_buf;
+			else
+				buf_off = buf + (off - bgn) *
+					  geo->sector_nbytes * SPAGE_NADDRS;
+
+			for (int i = 0; i < naddrs; ++i) {
+				const int spg = off +
+						nvm_div(&gdiv->spage_naddrs, i);
+				const int idx = nvm_mod(&vblk->nblks_div, spg);
+				const int pg = nvm_mod(&gdiv->npages,
+						       nvm_div(&vblk->nblks_div,
+							       spg));
+
+				addrs[i].ppa = vblk->blks[idx].ppa;
+				addrs[i].g.pg = pg;
+				addrs[i].g.pl = nvm_mod(&gdiv->nplanes,
+							nvm_div(&gdiv->nsectors,
+								i));
+				addrs[i].g.sec = nvm_mod(&gdiv->nsectors, i);
+			}
+
+			const ssize_t err = nvm_addr_write(vblk->dev, addrs,
+							   naddrs, buf_off,
+							   meta, PMODE, &ret);
+			if (err) {
+				vblk_ret_failed(vblk, addrs, naddrs, ret.status);
+				++nerr;
+			}
+
+			#pragma omp ordered
+			{}
 		}
 
-		const ssize_t err = nvm_addr_write(vblk->dev, addrs, naddrs,
-						   buf_off, meta, PMODE, &ret);
-		if (err)
-			++nerr;
-
-		#pragma omp ordered
-		{}
+		nvm_numa_unbind_worker(&aff);
 	}
 
 	free(padding_buf);
+	free(meta);
+
+	vblk->ret.nbytes = count - vblk->ret.nfailed * geo->sector_nbytes;
 
 	if (nerr) {
 		errno = EIO;
@@ -302,12 +401,114 @@ ssize_t nvm_vblk_pad(struct nvm_vblk *vblk)
 	return nvm_vblk_write(vblk, NULL, vblk->nbytes - vblk->pos_write);
 }
 
+/**
+ * Number of virtual pages of block `idx` written up to the write position
+ */
+static int vblk_npages_written(struct nvm_vblk *vblk, int idx)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const int NDATA = vblk->nblks - vblk->nparity;
+	const size_t nspages = vblk->pos_write / geo->vpg_nbytes;
+
+	if (vblk->nparity)		// Whole stripes, parity included
+		return nspages / NDATA;
+
+	return nspages / vblk->nblks + (idx < (int)(nspages % vblk->nblks));
+}
+
+ssize_t nvm_vblk_copy(struct nvm_vblk *src, struct nvm_vblk *dst)
+{
+	size_t nerr = 0;
+	struct nvm_dev *dev = src->dev;
+	const int PMODE = nvm_dev_get_pmode(dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(dev);
+
+	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
+	const int CMD_NSPAGES = NVM_MAX(NVM_MIN(dev->read_naddrs_max,
+						dev->write_naddrs_max) /
+					SPAGE_NADDRS, 1);
+	const int NWORKERS = NVM_MAX(src->nblks / (2 * CMD_NSPAGES), 1);
+
+	dst->ret.nbytes = 0;
+	dst->ret.nfailed = 0;
+
+	if (dst->dev != dev || dst->nblks != src->nblks ||
+	    dst->nparity != src->nparity) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Each worker copies the blocks `idx % NWORKERS == w` in page order,
+	// such that a command spans the LUNs of up to CMD_NSPAGES blocks and the
+	// read of a command overlaps the program of the one before it, on other
+	// LUNs when the worker has more than CMD_NSPAGES blocks
+	#pragma omp parallel num_threads(NWORKERS) reduction(+:nerr) if(NWORKERS>1)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(dev, &aff);
+
+		#pragma omp for schedule(static,1)
+		for (int w = 0; w < NWORKERS; ++w) {
+			const int npages = vblk_npages_written(src, w);
+			const int nblks = (src->nblks - w + NWORKERS - 1) /
+					  NWORKERS;
+			const int naddrs_max = npages * nblks * SPAGE_NADDRS;
+			struct nvm_addr *addrs;
+			int naddrs = 0;
+
+			if (!npages)
+				continue;
+
+			addrs = malloc(2 * naddrs_max * sizeof(*addrs));
+			if (!addrs) {
+				++nerr;
+				continue;
+			}
+
+			for (int pg = 0; pg < npages; ++pg) {
+				for (int idx = w; idx < src->nblks;
+				     idx += NWORKERS) {
+					if (pg >= vblk_npages_written(src, idx))
+						break;
+
+					vblk_vpg_addrs(src, idx, pg, 1,
+						       addrs + naddrs);
+					vblk_vpg_addrs(dst, idx, pg, 1,
+						       addrs + naddrs_max +
+						       naddrs);
+					naddrs += SPAGE_NADDRS;
+				}
+			}
+
+			if (nvm_addr_copy(dev, addrs, addrs + naddrs_max,
+					  naddrs, PMODE, NULL) < 0)
+				++nerr;
+
+			free(addrs);
+		}
+
+		nvm_numa_unbind_worker(&aff);
+	}
+
+	if (nerr) {
+		errno = EIO;
+		return -1;
+	}
+
+	dst->pos_write = src->pos_write;
+	dst->ret.nbytes = src->pos_write;
+
+	return src->pos_write;
+}
+
 ssize_t nvm_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count,
 		       size_t offset)
 {
-	size_t nerr = 0;
+	size_t nerr = 0, nbad = 0;
 	const int PMODE = nvm_dev_get_pmode(vblk->dev);
 	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const struct nvm_geo_div *gdiv = &vblk->dev->gdiv;
 
 	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
 	const int CMD_NSPAGES = _cmd_nspages(vblk->nblks,
@@ -319,6 +520,12 @@ ssize_t nvm_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count,
 	const size_t bgn = offset / ALIGN;
 	const size_t end = bgn + (count / ALIGN);
 
+	vblk->ret.nbytes = 0;
+	vblk->ret.nfailed = 0;
+
+	if (vblk->nparity)
+		return vblk_parity_pread(vblk, buf, count, offset, -1);
+
 	if (offset + count > vblk->nbytes) {		// Check bounds
 		errno = EINVAL;
 		return -1;
@@ -329,38 +536,424 @@ ssize_t nvm_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count,
 		return -1;
 	}
 
-	#pragma omp parallel for num_threads(NTHREADS) schedule(static,1) reduction(+:nerr) ordered if(NTHREADS>1)
-	for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
-		struct nvm_ret ret = {};
+	#pragma omp parallel num_threads(NTHREADS) reduction(+:nerr,nbad) if(NTHREADS>1)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(vblk->dev, &aff);
+
+		#pragma omp for schedule(static,1) ordered
+		for (size_t off = bgn; off < end; off += CMD_NSPAGES) {
+			struct nvm_ret ret = {};
+
+			const int nspages = NVM_MIN(CMD_NSPAGES,
+						    (int)(end - off));
+			const int naddrs = nspages * SPAGE_NADDRS;
+
+			struct nvm_addr addrs[naddrs];
+			char *buf_off;
+
+			buf_off = buf + (off - bgn) * geo->sector_nbytes *
+				  SPAGE_NADDRS;
+
+			for (int i = 0; i < naddrs; ++i) {
+				const int spg = off +
+						nvm_div(&gdiv->spage_naddrs, i);
+				const int idx = nvm_mod(&vblk->nblks_div, spg);
+				const int pg = nvm_mod(&gdiv->npages,
+						       nvm_div(&vblk->nblks_div,
+							       spg));
+
+				addrs[i].ppa = vblk->blks[idx].ppa;
+				addrs[i].g.pg = pg;
+				addrs[i].g.pl = nvm_mod(&gdiv->nplanes,
+							nvm_div(&gdiv->nsectors,
+								i));
+				addrs[i].g.sec = nvm_mod(&gdiv->nsectors, i);
+			}
+
+			const ssize_t err = nvm_addr_read(vblk->dev, addrs,
+							  naddrs, buf_off,
+							  NULL, PMODE, &ret);
+			if (err) {
+				vblk_ret_failed(vblk, addrs, naddrs, ret.status);
+				++nerr;
+			}
+			if (err && ret.result == S12_RSP_ERR_FAILCRC)
+				++nbad;
+
+			#pragma omp ordered
+			{}
+		}
+
+		nvm_numa_unbind_worker(&aff);
+	}
+
+	vblk->ret.nbytes = count - vblk->ret.nfailed * geo->sector_nbytes;
+
+	if (nerr) {
+		errno = nbad ? EBADMSG : EIO;
+		return -1;
+	}
+
+	return count;
+}
+
+/**
+ * XOR src into dst, written such that the compiler vectorizes it, bytewise as
+ * the buffers of the caller need not be aligned
+ */
+static void vblk_xor(char *restrict dst, const char *restrict src,
+		     size_t nbytes)
+{
+	for (size_t i = 0; i < nbytes; ++i)
+		dst[i] ^= src[i];
+}
+
+/**
+ * Addresses of `npages` virtual pages of block `idx`, starting at page `pg`
+ */
+static void vblk_vpg_addrs(struct nvm_vblk *vblk, int idx, int pg, int npages,
+			   struct nvm_addr addrs[])
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+	const struct nvm_geo_div *gdiv = &vblk->dev->gdiv;
+	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
 
-		const int nspages = NVM_MIN(CMD_NSPAGES, (int)(end - off));
-		const int naddrs = nspages * SPAGE_NADDRS;
+	for (int i = 0; i < npages * SPAGE_NADDRS; ++i) {
+		addrs[i].ppa = vblk->blks[idx].ppa;
+		addrs[i].g.pg = pg + nvm_div(&gdiv->spage_naddrs, i);
+		addrs[i].g.pl = nvm_mod(&gdiv->nplanes,
+					nvm_div(&gdiv->nsectors, i));
+		addrs[i].g.sec = nvm_mod(&gdiv->nsectors, i);
+	}
+}
 
-		struct nvm_addr addrs[naddrs];
-		char *buf_off;
+int nvm_vblk_set_parity(struct nvm_vblk *vblk, int nparity)
+{
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
 
-		buf_off = buf + (off - bgn) * geo->sector_nbytes * SPAGE_NADDRS;
+	if (nparity < 0 || nparity > 1 || vblk->nblks < 2) {
+		errno = EINVAL;
+		return -1;
+	}
 
-		for (int i = 0; i < naddrs; ++i) {
-			const int spg = off + (i / SPAGE_NADDRS);
-			const int idx = spg % vblk->nblks;
-			const int pg = (spg / vblk->nblks) % geo->npages;
-
-			addrs[i].ppa = vblk->blks[idx].ppa;
-			addrs[i].g.pg = pg;
-			addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
-			addrs[i].g.sec = i % geo->nsectors;
+	vblk->nparity = nparity;
+	vblk->nbytes = (vblk->nblks - nparity) * geo->npages * geo->vpg_nbytes;
+	vblk->pos_write = 0;
+	vblk->pos_read = 0;
+
+	return 0;
+}
+
+int nvm_vblk_get_parity(struct nvm_vblk *vblk)
+{
+	return vblk->nparity;
+}
+
+/**
+ * Stripe `s` consists of virtual page `s` of each block, the data blocks hold
+ * consecutive virtual pages of the buffer and the last block their XOR. Each
+ * block is written by its own thread, in page order, the parity thread
+ * computing the parity from the buffer.
+ */
+static ssize_t vblk_parity_pwrite(struct nvm_vblk *vblk, const char *buf,
+				  size_t count, size_t offset)
+{
+	size_t nerr = 0, nfailed = 0;
+	const int PMODE = nvm_dev_get_pmode(vblk->dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+
+	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
+	const int CMD_NSPAGES = NVM_MAX(vblk->dev->write_naddrs_max /
+					SPAGE_NADDRS, 1);
+	const int NDATA = vblk->nblks - vblk->nparity;
+	const size_t STRIPE_NBYTES = NDATA * geo->vpg_nbytes;
+
+	const size_t bgn = offset / STRIPE_NBYTES;
+	const size_t end = bgn + count / STRIPE_NBYTES;
+
+	char *padding_buf = NULL;
+
+	if (offset + count > vblk->nbytes) {		// Check bounds
+		errno = EINVAL;
+		return -1;
+	}
+	if ((count % STRIPE_NBYTES) || (offset % STRIPE_NBYTES)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!buf) {	// Pad with a stripe of the padding pattern
+		padding_buf = nvm_dev_buf_alloc(vblk->dev, STRIPE_NBYTES);
+		if (!padding_buf) {
+			errno = ENOMEM;
+			return -1;
+		}
+		nvm_buf_fill(padding_buf, STRIPE_NBYTES);
+	}
+
+	#pragma omp parallel num_threads(vblk->nblks) reduction(+:nerr,nfailed)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(vblk->dev, &aff);
+
+		#pragma omp for schedule(static,1)
+		for (int idx = 0; idx < vblk->nblks; ++idx) {
+			char *stage;	// Pages of the block, gathered or parity
+
+			stage = nvm_dev_buf_alloc(vblk->dev,
+						  CMD_NSPAGES * geo->vpg_nbytes);
+			if (!stage) {
+				struct nvm_addr addrs[SPAGE_NADDRS];
+
+				for (size_t s = bgn; s < end; ++s) {
+					vblk_vpg_addrs(vblk, idx, s, 1, addrs);
+					vblk_ret_failed(vblk, addrs,
+							SPAGE_NADDRS, 0);
+				}
+				if (idx < NDATA)
+					nfailed += (end - bgn) * SPAGE_NADDRS;
+				++nerr;
+				continue;
+			}
+
+			for (size_t s = bgn; s < end; s += CMD_NSPAGES) {
+				const int nspages = NVM_MIN(CMD_NSPAGES,
+							    (int)(end - s));
+				const int naddrs = nspages * SPAGE_NADDRS;
+				struct nvm_addr addrs[naddrs];
+				struct nvm_ret ret = {};
+				int nflagged;
+
+				for (int p = 0; p < nspages; ++p) {
+					const char *stripe = padding_buf ?
+						padding_buf :
+						buf + (s - bgn + p) *
+						STRIPE_NBYTES;
+					char *vpg = stage + p * geo->vpg_nbytes;
+
+					if (idx < NDATA) {
+						memcpy(vpg, stripe + idx *
+						       geo->vpg_nbytes,
+						       geo->vpg_nbytes);
+						continue;
+					}
+
+					memset(vpg, 0, geo->vpg_nbytes);
+					for (int d = 0; d < NDATA; ++d)
+						vblk_xor(vpg, stripe + d *
+							 geo->vpg_nbytes,
+							 geo->vpg_nbytes);
+				}
+
+				vblk_vpg_addrs(vblk, idx, s, nspages, addrs);
+				if (!nvm_addr_write(vblk->dev, addrs, naddrs,
+						    stage, NULL, PMODE, &ret))
+					continue;
+
+				++nerr;
+				nflagged = vblk_ret_failed(vblk, addrs, naddrs,
+							   ret.status);
+				if (idx < NDATA)	// Parity is not data
+					nfailed += nflagged;
+			}
+
+			free(stage);
 		}
 
-		const ssize_t err = nvm_addr_read(vblk->dev, addrs, naddrs,
-						  buf_off, NULL, PMODE, &ret);
-		if (err)
+		nvm_numa_unbind_worker(&aff);
+	}
+
+	free(padding_buf);
+
+	vblk->ret.nbytes = count - nfailed * geo->sector_nbytes;
+
+	if (nerr) {
+		errno = EIO;
+		return -1;
+	}
+
+	return count;
+}
+
+/**
+ * Rebuild data page `lost` of `stripe`, at virtual page `s`, from the parity
+ * and the other data pages of the stripe
+ */
+static int vblk_parity_rebuild(struct nvm_vblk *vblk, char *stripe, size_t s,
+			       int lost)
+{
+	const int PMODE = nvm_dev_get_pmode(vblk->dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+
+	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
+	const int NDATA = vblk->nblks - vblk->nparity;
+
+	struct nvm_addr addrs[SPAGE_NADDRS];
+	char *vpg = stripe + lost * geo->vpg_nbytes;
+
+	vblk_vpg_addrs(vblk, NDATA, s, 1, addrs);
+	if (nvm_addr_read(vblk->dev, addrs, SPAGE_NADDRS, vpg, NULL, PMODE,
+			  NULL))
+		return -1;
+
+	for (int d = 0; d < NDATA; ++d) {
+		if (d != lost)
+			vblk_xor(vpg, stripe + d * geo->vpg_nbytes,
+				 geo->vpg_nbytes);
+	}
+
+	return 0;
+}
+
+/**
+ * Read the data blocks, one thread per block, except block `around` which is
+ * not touched. Each thread reads up to read_naddrs_max addresses per command
+ * and only re-reads page by page to find the pages of a failed command. The
+ * virtual pages which failed to read, or were not read, are rebuilt from the
+ * parity and the other data pages of their stripe.
+ */
+static ssize_t vblk_parity_pread(struct nvm_vblk *vblk, char *buf,
+				 size_t count, size_t offset, int around)
+{
+	size_t nerr = 0, nfailed = 0;
+	const int PMODE = nvm_dev_get_pmode(vblk->dev);
+	const struct nvm_geo *geo = nvm_dev_get_geo(vblk->dev);
+
+	const int SPAGE_NADDRS = geo->nplanes * geo->nsectors;
+	const int CMD_NSPAGES = NVM_MAX(vblk->dev->read_naddrs_max /
+					SPAGE_NADDRS, 1);
+	const int NDATA = vblk->nblks - vblk->nparity;
+	const size_t STRIPE_NBYTES = NDATA * geo->vpg_nbytes;
+
+	const size_t bgn = offset / STRIPE_NBYTES;
+	const size_t end = bgn + count / STRIPE_NBYTES;
+	const size_t NSTRIPES = end - bgn;
+
+	char *failed;			// Failed data pages of each stripe
+
+	if (offset + count > vblk->nbytes) {		// Check bounds
+		errno = EINVAL;
+		return -1;
+	}
+	if ((count % STRIPE_NBYTES) || (offset % STRIPE_NBYTES)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	failed = calloc(NSTRIPES * NDATA, 1);
+	if (!failed) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	#pragma omp parallel num_threads(NDATA)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(vblk->dev, &aff);
+
+		#pragma omp for schedule(static,1)
+		for (int idx = 0; idx < NDATA; ++idx) {
+			char *stage = NULL;	// Pages of the block, scattered
+
+			if (idx != around)
+				stage = nvm_dev_buf_alloc(vblk->dev,
+							  CMD_NSPAGES *
+							  geo->vpg_nbytes);
+
+			for (size_t s = bgn; s < end; s += CMD_NSPAGES) {
+				const int nspages = NVM_MIN(CMD_NSPAGES,
+							    (int)(end - s));
+				struct nvm_addr addrs[nspages * SPAGE_NADDRS];
+				char *vpg = buf + ((s - bgn) * NDATA + idx) *
+					    geo->vpg_nbytes;
+				int err;
+
+				if (!stage) {	// Around, or out of memory
+					for (int p = 0; p < nspages; ++p)
+						failed[(s - bgn + p) * NDATA +
+						       idx] = 1;
+					continue;
+				}
+
+				vblk_vpg_addrs(vblk, idx, s, nspages, addrs);
+				err = nvm_addr_read(vblk->dev, addrs,
+						    nspages * SPAGE_NADDRS,
+						    stage, NULL, PMODE, NULL);
+
+				for (int p = 0; p < nspages; ++p) {
+					char *dst = vpg + p * STRIPE_NBYTES;
+
+					if (!err) {
+						memcpy(dst, stage + p *
+						       geo->vpg_nbytes,
+						       geo->vpg_nbytes);
+						continue;
+					}
+
+					// Find the pages which failed
+					if (nspages == 1 ||
+					    nvm_addr_read(vblk->dev, addrs +
+							  p * SPAGE_NADDRS,
+							  SPAGE_NADDRS, dst,
+							  NULL, PMODE, NULL))
+						failed[(s - bgn + p) * NDATA +
+						       idx] = 1;
+				}
+			}
+
+			free(stage);
+		}
+
+		nvm_numa_unbind_worker(&aff);
+	}
+
+	#pragma omp parallel reduction(+:nerr,nfailed)
+	{
+		struct nvm_numa_aff aff;
+
+		nvm_numa_bind_worker(vblk->dev, &aff);
+
+		#pragma omp for schedule(static)
+		for (size_t s = 0; s < NSTRIPES; ++s) {
+			struct nvm_addr addrs[SPAGE_NADDRS];
+			char *stripe = buf + s * STRIPE_NBYTES;
+			int nlost = 0, lost = 0;
+
+			for (int d = 0; d < NDATA; ++d) {
+				if (failed[s * NDATA + d]) {
+					++nlost;
+					lost = d;
+				}
+			}
+			if (!nlost)
+				continue;
+
+			if (nlost <= vblk->nparity &&
+			    !vblk_parity_rebuild(vblk, stripe, bgn + s, lost))
+				continue;
+
+			for (int d = 0; d < NDATA; ++d) {	// Not rebuilt
+				if (!failed[s * NDATA + d])
+					continue;
+
+				vblk_vpg_addrs(vblk, d, bgn + s, 1, addrs);
+				nfailed += vblk_ret_failed(vblk, addrs,
+							   SPAGE_NADDRS, 0);
+			}
 			++nerr;
+		}
 
-		#pragma omp ordered
-		{}
+		nvm_numa_unbind_worker(&aff);
 	}
 
+	free(failed);
+
+	vblk->ret.nbytes = count - nfailed * geo->sector_nbytes;
+
 	if (nerr) {
 		errno = EIO;
 		return -1;
@@ -369,6 +962,20 @@ ssize_t nvm_vblk_pread(struct nvm_vblk *vblk, void *buf, size_t count,
 	return count;
 }
 
+ssize_t nvm_vblk_pread_around(struct nvm_vblk *vblk, void *buf, size_t count,
+			      size_t offset, int idx)
+{
+	vblk->ret.nbytes = 0;
+	vblk->ret.nfailed = 0;
+
+	if (!vblk->nparity || idx < 0 || idx >= vblk->nblks - vblk->nparity) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return vblk_parity_pread(vblk, buf, count, offset, idx);
+}
+
 ssize_t nvm_vblk_read(struct nvm_vblk *vblk, void *buf, size_t count)
 {
 	ssize_t nbytes = nvm_vblk_pread(vblk, buf, count, vblk->pos_read);
@@ -381,6 +988,11 @@ ssize_t nvm_vblk_read(struct nvm_vblk *vblk, void *buf, size_t count)
 	return nbytes;			// Return number of bytes read
 }
 
+const struct nvm_vblk_ret *nvm_vblk_get_ret(struct nvm_vblk *vblk)
+{
+	return &vblk->ret;
+}
+
 struct nvm_addr *nvm_vblk_get_addrs(struct nvm_vblk *vblk)
 {
 	return vblk->blks;
@@ -1,9 +1,11 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
 #include <liblightnvm.h>
+#include <nvm.h>
 
 #include <CUnit/Basic.h>
 
@@ -98,6 +100,45 @@ void _test_FMT_CONV(int func)
 /**
  * Tests: gen <-> dev
  */
+/**
+ * Compare nvm_div and nvm_mod with / and % over divisors of either kind, on
+ * the edges around multiples of the divisor and a sweep of the 32-bit range
+ */
+void test_DIV(void)
+{
+	const uint32_t divisors[] = {
+		1, 2, 3, 4, 6, 7, 12, 64, 1000, 4096, 65535, 1U << 31,
+		UINT32_MAX
+	};
+	size_t nmismatch = 0;
+
+	for (size_t i = 0; i < sizeof(divisors) / sizeof(divisors[0]); ++i) {
+		const uint32_t d = divisors[i];
+		const uint32_t edges[] = {
+			0, 1, d - 1, d, d + 1, 2 * d - 1, 2 * d,
+			UINT32_MAX - d, UINT32_MAX - 1, UINT32_MAX
+		};
+		struct nvm_div div;
+
+		nvm_div_init(&div, d);
+
+		for (size_t e = 0; e < sizeof(edges) / sizeof(edges[0]); ++e) {
+			const uint32_t n = edges[e];
+
+			if (nvm_div(&div, n) != n / d ||
+			    nvm_mod(&div, n) != n % d)
+				++nmismatch;
+		}
+		for (uint64_t n = 0; n <= UINT32_MAX; n += 65521) {
+			if (nvm_div(&div, n) != n / d ||
+			    nvm_mod(&div, n) != n % d)
+				++nmismatch;
+		}
+	}
+
+	CU_ASSERT_EQUAL(nmismatch, 0);
+}
+
 void test_FMT_GEN_DEV(void)
 {
 	_test_FMT_CONV(0);
@@ -119,6 +160,67 @@ void test_FMT_GEN_LBA(void)
 	_test_FMT_CONV(2);
 }
 
+/**
+ * Tests: gen <-> dev against shifts of the format, for formats with a
+ * hard-coded, a masking and the generic codec
+ */
+void test_FMT_CODECS(void)
+{
+	const char *fmts[] = {
+		"0x10010e020201080603050002",
+		"0x380830082808001010102008",
+		"0x1a01180214010e0609050002",
+	};
+
+	if (strcmp(nvm_dev_get_be_name(dev), "emu")) {
+		CU_PASS("Formats are set via ENV on an emulated device");
+		return;
+	}
+
+	for (size_t f = 0; f < sizeof(fmts) / sizeof(*fmts); ++f) {
+		struct nvm_dev *fdev;
+		int ofz[6];
+
+		for (int i = 0; i < 6; ++i) {
+			char buf[3] = { fmts[f][2 + i * 4], fmts[f][3 + i * 4] };
+
+			ofz[i] = strtol(buf, NULL, 16);
+		}
+
+		setenv("NVM_EMU_FMT", fmts[f], 1);
+		fdev = nvm_dev_open(nvm_dev_path);
+		unsetenv("NVM_EMU_FMT");
+		CU_ASSERT_PTR_NOT_NULL(fdev);
+		if (!fdev)
+			continue;
+
+		for (int i = 0; i < 4096; ++i) {
+			struct nvm_addr addr = { .ppa = 0 };
+			uint64_t expected;
+
+			addr.g.ch = rand() % geo->nchannels;
+			addr.g.lun = rand() % geo->nluns;
+			addr.g.pl = rand() % geo->nplanes;
+			addr.g.blk = rand() % geo->nblocks;
+			addr.g.pg = rand() % geo->npages;
+			addr.g.sec = rand() % geo->nsectors;
+
+			expected = ((uint64_t)addr.g.ch << ofz[0]) |
+				   ((uint64_t)addr.g.lun << ofz[1]) |
+				   ((uint64_t)addr.g.pl << ofz[2]) |
+				   ((uint64_t)addr.g.blk << ofz[3]) |
+				   ((uint64_t)addr.g.pg << ofz[4]) |
+				   ((uint64_t)addr.g.sec << ofz[5]);
+
+			CU_ASSERT_EQUAL(nvm_addr_gen2dev(fdev, addr), expected);
+			CU_ASSERT_EQUAL(nvm_addr_dev2gen(fdev, expected).ppa,
+					addr.ppa);
+		}
+
+		nvm_dev_close(fdev);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	switch(argc) {
@@ -147,6 +249,8 @@ int main(int argc, char **argv)
 	(NULL == CU_add_test(pSuite, "fmt gen <-> dev", test_FMT_GEN_DEV)) ||
 	(NULL == CU_add_test(pSuite, "fmt gen <-> lba", test_FMT_GEN_LBA)) ||
 	(NULL == CU_add_test(pSuite, "fmt gen <-> off", test_FMT_GEN_OFF)) ||
+	(NULL == CU_add_test(pSuite, "fmt codecs", test_FMT_CODECS)) ||
+	(NULL == CU_add_test(pSuite, "div", test_DIV)) ||
 	0)
 	{
 		CU_cleanup_registry();
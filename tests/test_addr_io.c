@@ -404,6 +404,282 @@ void test_NADDR_META1_QUAD(void)
 	}
 }
 
+/**
+ * Erase, write and read a block on every LUN with a single call each, the
+ * address vectors exceeding NVM_NADDR_MAX
+ */
+void test_MANY(void)
+{
+	const int pmode = nvm_dev_get_pmode(dev);
+	const int nluns = geo->nchannels * geo->nluns;
+	const int vpg_naddrs = geo->nplanes * geo->nsectors;
+	const int naddrs = nluns * geo->npages * vpg_naddrs;
+	const size_t buf_nbytes = naddrs * geo->sector_nbytes;
+	struct nvm_addr *addrs = NULL;
+	struct nvm_ret *rets = NULL;
+	char *buf_w = NULL, *buf_r = NULL;
+	ssize_t ncmds;
+
+	++blk_addr.g.blk;
+
+	addrs = malloc(naddrs * sizeof(*addrs));
+	rets = malloc(naddrs * sizeof(*rets));
+	buf_w = nvm_buf_alloc(geo, buf_nbytes);
+	buf_r = nvm_buf_alloc(geo, buf_nbytes);
+	if (!addrs || !rets || !buf_w || !buf_r) {
+		CU_FAIL("Allocation failure");
+		goto out;
+	}
+	nvm_buf_fill(buf_w, buf_nbytes);
+	memset(buf_r, 0, buf_nbytes);
+
+	for (int i = 0; i < nluns * geo->nplanes; ++i) {	// Erase
+		addrs[i].ppa = blk_addr.ppa;
+		addrs[i].g.ch = (i / geo->nplanes) / geo->nluns;
+		addrs[i].g.lun = (i / geo->nplanes) % geo->nluns;
+		addrs[i].g.pl = i % geo->nplanes;
+	}
+	ncmds = nvm_addr_erase_many(dev, addrs, nluns * geo->nplanes, pmode,
+				    rets, naddrs);
+	CU_ASSERT(ncmds > 0);
+
+	for (int i = 0; i < naddrs; ++i) {		// LUN, page, plane, sector
+		const int lun = i / (geo->npages * vpg_naddrs);
+
+		addrs[i].ppa = blk_addr.ppa;
+		addrs[i].g.ch = lun / geo->nluns;
+		addrs[i].g.lun = lun % geo->nluns;
+		addrs[i].g.pg = (i / vpg_naddrs) % geo->npages;
+		addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+		addrs[i].g.sec = i % geo->nsectors;
+	}
+
+	ncmds = nvm_addr_write_many(dev, addrs, naddrs, buf_w, NULL, pmode,
+				    rets, naddrs);
+	CU_ASSERT(ncmds >= naddrs / NVM_NADDR_MAX);
+	for (int i = 0; i < ncmds; ++i)
+		CU_ASSERT_EQUAL(rets[i].result, 0);
+
+	ncmds = nvm_addr_read_many(dev, addrs, naddrs, buf_r, NULL, pmode,
+				   rets, naddrs);
+	CU_ASSERT(ncmds >= naddrs / NVM_NADDR_MAX);
+
+	CU_ASSERT(!compare_buffers(buf_w, buf_r, buf_nbytes));
+
+	CU_ASSERT(nvm_addr_read_many(dev, addrs, 0, buf_r, NULL, pmode, NULL,
+				     0) < 0);
+
+	addrs[0].g.ch = geo->nchannels;			// Invalid address
+	errno = 0;
+	CU_ASSERT(nvm_addr_read_many(dev, addrs, naddrs, buf_r, NULL, pmode,
+				     NULL, 0) < 0);
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+out:
+	free(addrs);
+	free(rets);
+	free(buf_w);
+	free(buf_r);
+}
+
+/**
+ * Copy a block on to another along with its metadata, the copy spanning
+ * several commands
+ */
+void test_COPY(void)
+{
+	const int pmode = nvm_dev_get_pmode(dev);
+	const int naddrs = geo->npages * geo->nplanes * geo->nsectors;
+	const size_t buf_nbytes = naddrs * geo->sector_nbytes;
+	const size_t meta_nbytes = naddrs * geo->meta_nbytes;
+	struct nvm_addr *src = NULL, *dst = NULL;
+	char *buf_w = NULL, *buf_r = NULL;
+	char *meta_w = NULL, *meta_r = NULL;
+	struct nvm_ret ret = {};
+
+	src = malloc(naddrs * sizeof(*src));
+	dst = malloc(naddrs * sizeof(*dst));
+	buf_w = nvm_buf_alloc(geo, buf_nbytes);
+	buf_r = nvm_buf_alloc(geo, buf_nbytes);
+	meta_w = nvm_buf_alloc(geo, meta_nbytes);
+	meta_r = nvm_buf_alloc(geo, meta_nbytes);
+	if (!src || !dst || !buf_w || !buf_r || !meta_w || !meta_r) {
+		CU_FAIL("Allocation failure");
+		goto out;
+	}
+	nvm_buf_fill(buf_w, buf_nbytes);
+	nvm_buf_fill(meta_w, meta_nbytes);
+	memset(buf_r, 0, buf_nbytes);
+	memset(meta_r, 0, meta_nbytes);
+
+	++blk_addr.g.blk;
+	for (int i = 0; i < geo->nplanes; ++i) {		// Erase both
+		src[i].ppa = blk_addr.ppa;
+		src[i].g.pl = i;
+		dst[i].ppa = blk_addr.ppa;
+		dst[i].g.blk = blk_addr.g.blk + 1;
+		dst[i].g.pl = i;
+	}
+	CU_ASSERT(!nvm_addr_erase(dev, src, geo->nplanes, pmode, NULL));
+	CU_ASSERT(!nvm_addr_erase(dev, dst, geo->nplanes, pmode, NULL));
+
+	for (int i = 0; i < naddrs; ++i) {		// Page, plane, sector
+		src[i].ppa = blk_addr.ppa;
+		src[i].g.pg = i / (geo->nplanes * geo->nsectors);
+		src[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+		src[i].g.sec = i % geo->nsectors;
+		dst[i] = src[i];
+		dst[i].g.blk = blk_addr.g.blk + 1;
+	}
+	++blk_addr.g.blk;
+
+	CU_ASSERT(nvm_addr_write_many(dev, src, naddrs, buf_w, meta_w, pmode,
+				      NULL, 0) > 0);
+
+	CU_ASSERT(!nvm_addr_copy(dev, src, dst, naddrs, pmode, &ret));
+	CU_ASSERT_EQUAL(ret.result, 0);
+
+	CU_ASSERT(nvm_addr_read_many(dev, dst, naddrs, buf_r, meta_r, pmode,
+				     NULL, 0) > 0);
+	CU_ASSERT(!compare_buffers(buf_w, buf_r, buf_nbytes));
+	CU_ASSERT(!compare_buffers(meta_w, meta_r, meta_nbytes));
+
+	CU_ASSERT(nvm_addr_copy(dev, src, dst, 0, pmode, NULL) < 0);
+
+	if (!strcmp(nvm_dev_get_be_name(dev), "emu")) {	// Failing read
+		CU_ASSERT(!nvm_emu_inject(dev, src[0], NVM_EMU_ERR_READ, 1));
+		errno = 0;
+		CU_ASSERT(nvm_addr_copy(dev, src, dst, naddrs, pmode, &ret) < 0);
+		CU_ASSERT_EQUAL(errno, EIO);
+		CU_ASSERT(ret.result != 0);
+		nvm_emu_inject_clear(dev);
+	}
+
+out:
+	free(src);
+	free(dst);
+	free(buf_w);
+	free(buf_r);
+	free(meta_w);
+	free(meta_r);
+}
+
+void test_DEV(void)
+{
+	const int pmode = nvm_dev_get_pmode(dev);
+	const int naddrs = geo->nplanes * geo->nsectors;
+	const size_t buf_nbytes = naddrs * geo->sector_nbytes;
+	struct nvm_addr addrs[naddrs];
+	uint64_t ppas[naddrs];
+	char *buf_w = NULL, *buf_r = NULL;
+	struct nvm_ret ret = {};
+
+	buf_w = nvm_buf_alloc(geo, buf_nbytes);
+	buf_r = nvm_buf_alloc(geo, buf_nbytes);
+	if (!buf_w || !buf_r) {
+		CU_FAIL("Allocation failure");
+		goto out;
+	}
+	nvm_buf_fill(buf_w, buf_nbytes);
+
+	++blk_addr.g.blk;
+	for (int i = 0; i < geo->nplanes; ++i) {
+		addrs[i].ppa = blk_addr.ppa;
+		addrs[i].g.pl = i;
+		ppas[i] = nvm_addr_gen2dev(dev, addrs[i]);
+	}
+	CU_ASSERT(!nvm_addr_erase_dev(dev, ppas, geo->nplanes, pmode, &ret));
+
+	for (int i = 0; i < naddrs; ++i) {
+		addrs[i].ppa = blk_addr.ppa;
+		addrs[i].g.pl = i / geo->nsectors;
+		addrs[i].g.sec = i % geo->nsectors;
+		ppas[i] = nvm_addr_gen2dev(dev, addrs[i]);
+	}
+	CU_ASSERT(!nvm_addr_write_dev(dev, ppas, naddrs, buf_w, NULL, pmode,
+				      &ret));
+
+	memset(buf_r, 0, buf_nbytes);			// Same as generic
+	CU_ASSERT(!nvm_addr_read(dev, addrs, naddrs, buf_r, NULL, pmode,
+				 &ret));
+	CU_ASSERT(!compare_buffers(buf_w, buf_r, buf_nbytes));
+
+	memset(buf_r, 0, buf_nbytes);
+	CU_ASSERT(!nvm_addr_read_dev(dev, ppas, naddrs, buf_r, NULL, pmode,
+				     &ret));
+	CU_ASSERT(!compare_buffers(buf_w, buf_r, buf_nbytes));
+
+	ppas[naddrs - 1] |= 1ULL << 63;			// Outside of the format
+	errno = 0;
+	CU_ASSERT(nvm_addr_read_dev(dev, ppas, naddrs, buf_r, NULL, pmode,
+				    &ret) < 0);
+	CU_ASSERT_EQUAL(errno, EINVAL);
+	CU_ASSERT(nvm_addr_read_dev(dev, ppas, 0, buf_r, NULL, pmode,
+				    &ret) < 0);
+
+out:
+	free(buf_w);
+	free(buf_r);
+}
+
+/**
+ * Fail the read of a single sector and the erase of a single plane of a
+ * dual-plane unit, the re-issue of the failed address alone must succeed
+ */
+void test_RETRY_DUAL(void)
+{
+	const int naddrs = 2 * geo->nsectors;
+	const size_t buf_nbytes = naddrs * geo->sector_nbytes;
+	struct nvm_addr addrs[naddrs];
+	char *buf_w = NULL, *buf_r = NULL;
+	struct nvm_ret ret = {};
+
+	if (strcmp(nvm_dev_get_be_name(dev), "emu") || geo->nplanes < 2) {
+		CU_PASS("Injecting errors requires a dual-plane emulated device");
+		return;
+	}
+
+	buf_w = nvm_buf_alloc(geo, buf_nbytes);
+	buf_r = nvm_buf_alloc(geo, buf_nbytes);
+	if (!buf_w || !buf_r) {
+		CU_FAIL("Allocation failure");
+		goto out;
+	}
+	nvm_buf_fill(buf_w, buf_nbytes);
+	memset(buf_r, 0, buf_nbytes);
+
+	CU_ASSERT(!nvm_dev_set_retry(dev, 2, 10));
+
+	++blk_addr.g.blk;
+	for (int i = 0; i < 2; ++i) {
+		addrs[i].ppa = blk_addr.ppa;
+		addrs[i].g.pl = i;
+	}
+	CU_ASSERT(!nvm_emu_inject(dev, addrs[1], NVM_EMU_ERR_ERASE, 1));
+	CU_ASSERT(!nvm_addr_erase(dev, addrs, 2, NVM_FLAG_PMODE_DUAL, &ret));
+	CU_ASSERT_EQUAL(ret.status, 0);
+
+	for (int i = 0; i < naddrs; ++i) {
+		addrs[i].ppa = blk_addr.ppa;
+		addrs[i].g.pl = i / geo->nsectors;
+		addrs[i].g.sec = i % geo->nsectors;
+	}
+	CU_ASSERT(!nvm_addr_write(dev, addrs, naddrs, buf_w, NULL,
+				  NVM_FLAG_PMODE_DUAL, &ret));
+
+	CU_ASSERT(!nvm_emu_inject(dev, addrs[1], NVM_EMU_ERR_READ, 1));
+	CU_ASSERT(!nvm_addr_read(dev, addrs, naddrs, buf_r, NULL,
+				 NVM_FLAG_PMODE_DUAL, &ret));
+	CU_ASSERT_EQUAL(ret.status, 0);
+	CU_ASSERT(!compare_buffers(buf_w, buf_r, buf_nbytes));
+
+out:
+	nvm_emu_inject_clear(dev);
+	CU_ASSERT(!nvm_dev_set_retry(dev, 0, 0));
+	free(buf_w);
+	free(buf_r);
+}
+
 int main(int argc, char **argv)
 {
 	switch(argc) {
@@ -443,6 +719,10 @@ int main(int argc, char **argv)
 	(NULL == CU_add_test(pSuite, "NADDR META0 DUAL", test_NADDR_META0_DUAL)) ||
 	(NULL == CU_add_test(pSuite, "NADDR META0 SNGL", test_NADDR_META0_SNGL)) ||
 	(NULL == CU_add_test(pSuite, "1ADDR META0 SNGL", test_1ADDR_META0_SNGL)) ||
+	(NULL == CU_add_test(pSuite, "MANY", test_MANY)) ||
+	(NULL == CU_add_test(pSuite, "COPY", test_COPY)) ||
+	(NULL == CU_add_test(pSuite, "DEV", test_DEV)) ||
+	(NULL == CU_add_test(pSuite, "RETRY DUAL", test_RETRY_DUAL)) ||
 	0)
 	{
 		CU_cleanup_registry();
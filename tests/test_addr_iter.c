@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <liblightnvm.h>
+
+#include <CUnit/Basic.h>
+
+static char nvm_dev_path[NVM_DEV_PATH_LEN] = "/dev/nvme0n1";
+
+static int blk = 12;
+
+static struct nvm_dev *dev;
+static const struct nvm_geo *geo;
+
+int setup(void)
+{
+	dev = nvm_dev_open(nvm_dev_path);
+	if (!dev) {
+		perror("nvm_dev_open");
+		CU_ASSERT_PTR_NOT_NULL(dev);
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	return 0;
+}
+
+int teardown(void)
+{
+	nvm_dev_close(dev);
+
+	return 0;
+}
+
+/**
+ * Enumerate the sectors of a LUN in geometric order and compare with nested
+ * loops, chunk by chunk in both formats
+ */
+void test_ITER_GEO(void)
+{
+	struct nvm_addr bgn = { .ppa = 0 }, end = { .ppa = 0 };
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	uint64_t ppas[NVM_NADDR_MAX];
+	struct nvm_addr_iter *iter;
+	size_t nseen = 0;
+	int naddrs;
+
+	end.g.blk = geo->nblocks - 1;
+	end.g.pg = geo->npages - 1;
+	end.g.pl = geo->nplanes - 1;
+	end.g.sec = geo->nsectors - 1;
+
+	iter = nvm_addr_iter_alloc(dev, bgn, end, NVM_ADDR_ITER_SECTOR,
+				   NVM_ADDR_ITER_ORDER_GEO);
+	CU_ASSERT_PTR_NOT_NULL(iter);
+	if (!iter)
+		return;
+
+	CU_ASSERT_EQUAL(nvm_addr_iter_get_naddrs(iter), geo->nblocks *
+			geo->npages * geo->nplanes * geo->nsectors);
+
+	while ((naddrs = nvm_addr_iter_next(iter, addrs, ppas,
+					    NVM_NADDR_MAX)) > 0) {
+		CU_ASSERT(!(naddrs % (geo->nplanes * geo->nsectors)));
+
+		for (int i = 0; i < naddrs; ++i, ++nseen) {
+			struct nvm_addr expected = { .ppa = 0 };
+
+			expected.g.sec = nseen % geo->nsectors;
+			expected.g.pl = (nseen / geo->nsectors) % geo->nplanes;
+			expected.g.pg = (nseen / (geo->nsectors *
+				geo->nplanes)) % geo->npages;
+			expected.g.blk = nseen / (geo->nsectors *
+				geo->nplanes * geo->npages);
+
+			CU_ASSERT_EQUAL(addrs[i].ppa, expected.ppa);
+			CU_ASSERT_EQUAL(ppas[i],
+					nvm_addr_gen2dev(dev, expected));
+		}
+	}
+	CU_ASSERT_EQUAL(naddrs, 0);
+	CU_ASSERT_EQUAL(nseen, nvm_addr_iter_get_naddrs(iter));
+
+	nvm_addr_iter_reset(iter);
+	CU_ASSERT_EQUAL(nvm_addr_iter_next(iter, addrs, NULL, 1), 1);
+	CU_ASSERT_EQUAL(addrs[0].ppa, bgn.ppa);
+	CU_ASSERT(nvm_addr_iter_next(iter, addrs, NULL, 0) < 0);
+
+	nvm_addr_iter_free(iter);
+}
+
+/**
+ * Enumerate the pages of a line striped, the pages of each chunk are on
+ * distinct LUNs and every address is seen once
+ */
+void test_ITER_STRIPE(void)
+{
+	const size_t nluns = geo->nchannels * geo->nluns;
+	struct nvm_addr bgn = { .ppa = 0 }, end = { .ppa = 0 };
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_addr_iter *iter;
+	char *seen;
+	size_t nseen = 0;
+	int naddrs;
+
+	bgn.g.blk = end.g.blk = blk;
+	end.g.ch = geo->nchannels - 1;
+	end.g.lun = geo->nluns - 1;
+	end.g.pg = geo->npages - 1;
+	end.g.pl = geo->nplanes - 1;
+	end.g.sec = geo->nsectors - 1;
+
+	iter = nvm_addr_iter_alloc(dev, bgn, end, NVM_ADDR_ITER_PAGE,
+				   NVM_ADDR_ITER_ORDER_STRIPE);
+	seen = calloc(nluns * geo->npages * geo->nplanes, 1);
+	CU_ASSERT_PTR_NOT_NULL(iter);
+	CU_ASSERT_PTR_NOT_NULL(seen);
+	if (!iter || !seen)
+		goto out;
+
+	CU_ASSERT_EQUAL(nvm_addr_iter_get_naddrs(iter),
+			nluns * geo->npages * geo->nplanes);
+
+	while ((naddrs = nvm_addr_iter_next(iter, addrs, NULL,
+					    NVM_NADDR_MAX)) > 0) {
+		for (int i = 0; i < naddrs; ++i, ++nseen) {
+			const size_t lun = addrs[i].g.lun * geo->nchannels +
+					   addrs[i].g.ch;
+			const size_t idx = (lun * geo->npages + addrs[i].g.pg) *
+					   geo->nplanes + addrs[i].g.pl;
+
+			CU_ASSERT_EQUAL(addrs[i].g.blk, blk);
+			CU_ASSERT_EQUAL(addrs[i].g.sec, 0);
+			CU_ASSERT_EQUAL(lun, (nseen / geo->nplanes) % nluns);
+			CU_ASSERT(!seen[idx]);
+			seen[idx] = 1;
+		}
+	}
+	CU_ASSERT_EQUAL(nseen, nvm_addr_iter_get_naddrs(iter));
+
+out:
+	nvm_addr_iter_free(iter);
+	free(seen);
+}
+
+/**
+ * Erase a line with the block addresses of an iterator
+ */
+void test_ITER_ERASE(void)
+{
+	struct nvm_addr bgn = { .ppa = 0 }, end = { .ppa = 0 };
+	struct nvm_addr addrs[NVM_NADDR_MAX];
+	struct nvm_addr_iter *iter;
+	int naddrs, ncmds = 0;
+
+	bgn.g.blk = end.g.blk = blk;
+	end.g.ch = geo->nchannels - 1;
+	end.g.lun = geo->nluns - 1;
+	end.g.pl = geo->nplanes - 1;
+
+	iter = nvm_addr_iter_alloc(dev, bgn, end, NVM_ADDR_ITER_BLOCK,
+				   NVM_ADDR_ITER_ORDER_GEO);
+	CU_ASSERT_PTR_NOT_NULL(iter);
+	if (!iter)
+		return;
+
+	CU_ASSERT_EQUAL(nvm_addr_iter_get_naddrs(iter),
+			geo->nchannels * geo->nluns * geo->nplanes);
+
+	while ((naddrs = nvm_addr_iter_next(iter, addrs, NULL,
+					    geo->nplanes)) > 0) {
+		CU_ASSERT(!nvm_addr_erase(dev, addrs, naddrs,
+					  nvm_dev_get_pmode(dev), NULL));
+		++ncmds;
+	}
+	CU_ASSERT_EQUAL(ncmds, geo->nchannels * geo->nluns);
+
+	nvm_addr_iter_free(iter);
+
+	end.g.blk = blk - 1;		// Empty and out of bounds regions
+	CU_ASSERT_PTR_NULL(nvm_addr_iter_alloc(dev, bgn, end,
+					       NVM_ADDR_ITER_BLOCK,
+					       NVM_ADDR_ITER_ORDER_GEO));
+	end.g.blk = geo->nblocks;
+	CU_ASSERT_PTR_NULL(nvm_addr_iter_alloc(dev, bgn, end,
+					       NVM_ADDR_ITER_BLOCK,
+					       NVM_ADDR_ITER_ORDER_GEO));
+}
+
+int main(int argc, char **argv)
+{
+	switch(argc) {
+	case 3:
+		blk = atoi(argv[2]);
+	case 2:
+		if (strlen(argv[1]) > NVM_DEV_PATH_LEN) {
+			printf("ERR: len(dev_path) > %d characters\n",
+			       NVM_DEV_PATH_LEN);
+			return 1;
+                }
+		strncpy(nvm_dev_path, argv[1], NVM_DEV_PATH_LEN);
+		break;
+	}
+
+	CU_pSuite pSuite = NULL;
+
+	if (CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	pSuite = CU_add_suite("nvm_addr_iter_*", setup, teardown);
+	if (NULL == pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+	(NULL == CU_add_test(pSuite, "Geometric order", test_ITER_GEO)) ||
+	(NULL == CU_add_test(pSuite, "Striped order", test_ITER_STRIPE)) ||
+	(NULL == CU_add_test(pSuite, "Erase", test_ITER_ERASE)) ||
+	0)
+	{
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* Run all tests using the CUnit Basic interface */
+	CU_basic_set_mode(CU_BRM_NORMAL);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
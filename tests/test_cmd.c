@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <liblightnvm.h>
+
+#include <CUnit/Basic.h>
+
+static char nvm_dev_path[NVM_DEV_PATH_LEN] = "/emu/nvme0n1";
+
+static struct nvm_dev *dev;
+static const struct nvm_geo *geo;
+static struct nvm_cmd_builder *builder;
+static int blk = 3;
+static char *buf_w, *buf_r;
+static size_t nsecs;
+
+int setup(void)
+{
+	dev = nvm_dev_open(nvm_dev_path);
+	if (!dev) {
+		perror("nvm_dev_open");
+		CU_ASSERT_PTR_NOT_NULL(dev);
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	builder = nvm_cmd_builder_alloc(dev);
+	if (!builder)
+		return -1;
+
+	nsecs = 2 * geo->nplanes * geo->nsectors;	// Two virtual pages
+	buf_w = nvm_buf_alloc(geo, nsecs * geo->sector_nbytes);
+	buf_r = nvm_buf_alloc(geo, nsecs * geo->sector_nbytes);
+	if (!buf_w || !buf_r)
+		return -1;
+
+	nvm_buf_fill(buf_w, nsecs * geo->sector_nbytes);
+
+	return 0;
+}
+
+int teardown(void)
+{
+	free(buf_w);
+	free(buf_r);
+
+	nvm_cmd_builder_free(builder);
+	nvm_dev_close(dev);
+
+	return 0;
+}
+
+/**
+ * Address of the i'th sector of the two virtual pages on LUN 0
+ */
+static struct nvm_addr sec_addr(size_t i)
+{
+	struct nvm_addr addr;
+
+	addr.ppa = 0;
+	addr.g.blk = blk;
+	addr.g.pg = i / (geo->nplanes * geo->nsectors);
+	addr.g.pl = (i / geo->nsectors) % geo->nplanes;
+	addr.g.sec = i % geo->nsectors;
+
+	return addr;
+}
+
+/**
+ * Invalid addresses and duplicates are rejected
+ */
+void test_INVALID(void)
+{
+	struct nvm_addr addr = sec_addr(0);
+
+	nvm_cmd_builder_reset(builder);
+
+	addr.g.blk = geo->nblocks;
+	CU_ASSERT(nvm_cmd_builder_add(builder, addr, buf_r) && errno == EINVAL);
+	CU_ASSERT_EQUAL(nvm_cmd_builder_get_naddrs(builder), 0);
+
+	CU_ASSERT(!nvm_cmd_builder_add(builder, sec_addr(0), buf_r));
+	CU_ASSERT(!nvm_cmd_builder_add(builder, sec_addr(0), buf_r));
+	CU_ASSERT(nvm_cmd_builder_read(builder, NULL) < 0 && errno == EINVAL);
+
+	nvm_cmd_builder_reset(builder);
+	CU_ASSERT_EQUAL(nvm_cmd_builder_read(builder, NULL), 0);
+}
+
+/**
+ * Erase via a single plane, then write and read the sectors of two virtual
+ * pages added in reverse order, each in one command
+ */
+void test_PE_W_R(void)
+{
+	struct nvm_addr addr = sec_addr(0);
+
+	nvm_cmd_builder_reset(builder);
+	CU_ASSERT(!nvm_cmd_builder_add(builder, addr, NULL));
+	CU_ASSERT_EQUAL(nvm_cmd_builder_erase(builder, NULL), 1);
+
+	nvm_cmd_builder_reset(builder);
+	for (size_t i = nsecs; i > 0; --i) {
+		CU_ASSERT(!nvm_cmd_builder_add(builder, sec_addr(i - 1),
+				buf_w + (i - 1) * geo->sector_nbytes));
+	}
+	CU_ASSERT_EQUAL(nvm_cmd_builder_get_naddrs(builder), nsecs);
+	CU_ASSERT_EQUAL(nvm_cmd_builder_write(builder, NULL),
+			nsecs <= nvm_dev_get_write_naddrs_max(dev) ? 1 : 2);
+
+	memset(buf_r, 0, nsecs * geo->sector_nbytes);
+	nvm_cmd_builder_reset(builder);
+	for (size_t i = 0; i < nsecs; i += 2) {	// Every other sector
+		CU_ASSERT(!nvm_cmd_builder_add(builder, sec_addr(i),
+				buf_r + i * geo->sector_nbytes));
+	}
+	CU_ASSERT(nvm_cmd_builder_read(builder, NULL) > 0);
+
+	for (size_t i = 0; i < nsecs; ++i) {
+		const size_t ofz = i * geo->sector_nbytes;
+
+		if (i % 2) {			// Not added, left untouched
+			CU_ASSERT_EQUAL(buf_r[ofz], 0);
+		} else {
+			CU_ASSERT(!memcmp(buf_r + ofz, buf_w + ofz,
+					  geo->sector_nbytes));
+		}
+	}
+}
+
+/**
+ * Writes of partial pages are rejected without programming anything, the page
+ * is then written as a whole
+ */
+void test_PARTIAL(void)
+{
+	const int unit = nvm_dev_get_pmode(dev) == NVM_FLAG_PMODE_SNGL ?
+			 geo->nsectors : geo->nplanes * geo->nsectors;
+	struct nvm_addr addr = sec_addr(0);
+
+	nvm_cmd_builder_reset(builder);
+	CU_ASSERT(!nvm_cmd_builder_add(builder, addr, NULL));
+	CU_ASSERT_EQUAL(nvm_cmd_builder_erase(builder, NULL), 1);
+
+	nvm_cmd_builder_reset(builder);
+	CU_ASSERT(!nvm_cmd_builder_add(builder, sec_addr(0), buf_w));
+	CU_ASSERT(nvm_cmd_builder_write(builder, NULL) < 0 && errno == EINVAL);
+
+	for (int i = 1; i < unit - 1; ++i) {	// All but the last sector
+		CU_ASSERT(!nvm_cmd_builder_add(builder, sec_addr(i),
+				buf_w + i * geo->sector_nbytes));
+	}
+	CU_ASSERT(nvm_cmd_builder_write(builder, NULL) < 0 && errno == EINVAL);
+
+	CU_ASSERT(!nvm_cmd_builder_add(builder, sec_addr(unit - 1),
+			buf_w + (unit - 1) * geo->sector_nbytes));
+	CU_ASSERT_EQUAL(nvm_cmd_builder_write(builder, NULL), 1);
+
+	memset(buf_r, 0, unit * geo->sector_nbytes);
+	nvm_cmd_builder_reset(builder);
+	for (int i = 0; i < unit; ++i) {
+		CU_ASSERT(!nvm_cmd_builder_add(builder, sec_addr(i),
+				buf_r + i * geo->sector_nbytes));
+	}
+	CU_ASSERT(nvm_cmd_builder_read(builder, NULL) > 0);
+	CU_ASSERT(!memcmp(buf_r, buf_w, unit * geo->sector_nbytes));
+}
+
+int main(int argc, char **argv)
+{
+	switch(argc) {
+	case 3:
+		blk = atoi(argv[2]);
+	case 2:
+		if (strlen(argv[1]) > NVM_DEV_PATH_LEN) {
+			printf("ERR: len(dev_path) > %d characters\n",
+			       NVM_DEV_PATH_LEN);
+			return 1;
+                }
+		strncpy(nvm_dev_path, argv[1], NVM_DEV_PATH_LEN);
+		break;
+	}
+
+	CU_pSuite pSuite = NULL;
+
+	if (CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	pSuite = CU_add_suite("nvm_cmd_builder_*", setup, teardown);
+	if (NULL == pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+	(NULL == CU_add_test(pSuite, "Invalid", test_INVALID)) ||
+	(NULL == CU_add_test(pSuite, "PE_W_R", test_PE_W_R)) ||
+	(NULL == CU_add_test(pSuite, "Partial", test_PARTIAL)) ||
+	0)
+	{
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* Run all tests using the CUnit Basic interface */
+	CU_basic_set_mode(CU_BRM_NORMAL);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
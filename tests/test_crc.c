@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <liblightnvm.h>
+
+#include <CUnit/Basic.h>
+
+static char nvm_dev_path[NVM_DEV_PATH_LEN] = "/emu/nvme0n1";
+
+static struct nvm_dev *dev;
+static const struct nvm_geo *geo;
+static int blk = 7;
+
+int setup(void)
+{
+	dev = nvm_dev_open(nvm_dev_path);
+	if (!dev) {
+		perror("nvm_dev_open");
+		CU_ASSERT_PTR_NOT_NULL(dev);
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	return 0;
+}
+
+int teardown(void)
+{
+	nvm_dev_close(dev);
+
+	return 0;
+}
+
+/**
+ * Known answers, and chaining over split buffers
+ */
+void test_CRC32C(void)
+{
+	const char *check = "123456789";
+	char zeros[32] = {};
+
+	CU_ASSERT_EQUAL(nvm_crc32c(0, check, 9), 0xE3069283);
+	CU_ASSERT_EQUAL(nvm_crc32c(nvm_crc32c(0, check, 4), check + 4, 5),
+			0xE3069283);
+	CU_ASSERT_EQUAL(nvm_crc32c(0, zeros, sizeof(zeros)), 0x8A9136AA);
+	CU_ASSERT_EQUAL(nvm_crc32c(0, NULL, 0), 0);
+}
+
+static void _test_VBLK(int meta_mode)
+{
+	struct nvm_vblk *vblk;
+	char *buf_w, *buf_r;
+	size_t nbytes;
+
+	CU_ASSERT(!nvm_dev_set_meta_mode(dev, meta_mode));
+
+	vblk = nvm_vblk_alloc_line(dev, 0, 0, 0, 0, blk);
+	nbytes = nvm_vblk_get_nbytes(vblk);
+	buf_w = nvm_buf_alloc(geo, nbytes);
+	buf_r = nvm_buf_alloc(geo, nbytes);
+	if (!vblk || !buf_w || !buf_r) {
+		CU_FAIL("Allocation failure");
+		goto out;
+	}
+	nvm_buf_fill(buf_w, nbytes);
+	memset(buf_r, 0, nbytes);
+
+	CU_ASSERT(nvm_vblk_erase(vblk) >= 0);
+	CU_ASSERT_EQUAL(nvm_vblk_write(vblk, buf_w, nbytes), nbytes);
+	CU_ASSERT_EQUAL(nvm_vblk_read(vblk, buf_r, nbytes), nbytes);
+	CU_ASSERT(!memcmp(buf_w, buf_r, nbytes));
+
+out:
+	nvm_dev_set_meta_mode(dev, NVM_META_MODE_NONE);
+	nvm_vblk_free(vblk);
+	free(buf_w);
+	free(buf_r);
+}
+
+/**
+ * Data written and read in CRC mode via a virtual block round-trips
+ */
+void test_VBLK_CRC(void)
+{
+	_test_VBLK(NVM_META_MODE_CRC);
+}
+
+void test_VBLK_CRC_SEQ(void)
+{
+	_test_VBLK(NVM_META_MODE_CRC_SEQ);
+}
+
+/**
+ * Erase block `b` of LUN 0 and fill `addrs` with its first virtual page
+ */
+static int erase_vpg(int b, struct nvm_addr addrs[], int naddrs)
+{
+	for (int i = 0; i < naddrs; ++i) {
+		addrs[i].ppa = 0;
+		addrs[i].g.blk = b;
+		addrs[i].g.pl = i % geo->nplanes;
+	}
+	if (nvm_addr_erase(dev, addrs, geo->nplanes, nvm_dev_get_pmode(dev),
+			   NULL))
+		return -1;
+
+	for (int i = 0; i < naddrs; ++i) {
+		addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+		addrs[i].g.sec = i % geo->nsectors;
+	}
+
+	return 0;
+}
+
+/**
+ * The OOB holds the checksum and sequence number, sectors whose OOB does not
+ * match their data fail with EBADMSG and are flagged in ret.status
+ */
+void test_CORRUPT(void)
+{
+	const int pmode = nvm_dev_get_pmode(dev);
+	const int naddrs = geo->nplanes * geo->nsectors;
+	const size_t nbytes = naddrs * geo->sector_nbytes;
+	struct nvm_addr addrs[naddrs];
+	struct nvm_meta_crc crc;
+	struct nvm_ret ret = {};
+	char *buf, *meta;
+
+	buf = nvm_buf_alloc(geo, nbytes);
+	meta = nvm_buf_alloc(geo, naddrs * geo->meta_nbytes);
+	if (!buf || !meta) {
+		CU_FAIL("Allocation failure");
+		goto out;
+	}
+	nvm_buf_fill(buf, nbytes);
+
+	CU_ASSERT(!nvm_dev_set_meta_mode(dev, NVM_META_MODE_CRC_SEQ));
+	CU_ASSERT(!erase_vpg(blk + 1, addrs, naddrs));
+	CU_ASSERT(!nvm_addr_write(dev, addrs, naddrs, buf, NULL, pmode, NULL));
+	CU_ASSERT(!nvm_addr_read(dev, addrs, naddrs, buf, meta, pmode, NULL));
+	memcpy(&crc, meta, sizeof(crc));
+	CU_ASSERT(crc.seq > 0);
+	CU_ASSERT_EQUAL(crc.crc, nvm_crc32c(nvm_crc32c(0, buf,
+				geo->sector_nbytes), &crc.seq, sizeof(crc.seq)));
+
+	CU_ASSERT(!nvm_dev_set_meta_mode(dev, NVM_META_MODE_NONE));
+	memset(meta, 0, naddrs * geo->meta_nbytes);
+	CU_ASSERT(!erase_vpg(blk + 2, addrs, naddrs));
+	CU_ASSERT(!nvm_addr_write(dev, addrs, naddrs, buf, meta, pmode, NULL));
+
+	CU_ASSERT(!nvm_dev_set_meta_mode(dev, NVM_META_MODE_CRC));
+	CU_ASSERT(nvm_addr_read(dev, addrs, naddrs, buf, NULL, pmode, &ret));
+	CU_ASSERT_EQUAL(errno, EBADMSG);
+	CU_ASSERT_EQUAL(ret.status, naddrs == 64 ? ~0ULL : (1ULL << naddrs) - 1);
+
+out:
+	nvm_dev_set_meta_mode(dev, NVM_META_MODE_NONE);
+	free(buf);
+	free(meta);
+}
+
+int main(int argc, char **argv)
+{
+	switch(argc) {
+	case 3:
+		blk = atoi(argv[2]);
+	case 2:
+		if (strlen(argv[1]) > NVM_DEV_PATH_LEN) {
+			printf("ERR: len(dev_path) > %d characters\n",
+			       NVM_DEV_PATH_LEN);
+			return 1;
+                }
+		strncpy(nvm_dev_path, argv[1], NVM_DEV_PATH_LEN);
+		break;
+	}
+
+	CU_pSuite pSuite = NULL;
+
+	if (CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	pSuite = CU_add_suite("nvm_crc_*", setup, teardown);
+	if (NULL == pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+	(NULL == CU_add_test(pSuite, "CRC32C", test_CRC32C)) ||
+	(NULL == CU_add_test(pSuite, "VBLK CRC", test_VBLK_CRC)) ||
+	(NULL == CU_add_test(pSuite, "VBLK CRC_SEQ", test_VBLK_CRC_SEQ)) ||
+	(NULL == CU_add_test(pSuite, "Corrupt", test_CORRUPT)) ||
+	0)
+	{
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* Run all tests using the CUnit Basic interface */
+	CU_basic_set_mode(CU_BRM_NORMAL);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
@@ -1,7 +1,13 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <stdio.h>
+#include <sched.h>
 #include <liblightnvm.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <CUnit/Basic.h>
 
@@ -38,6 +44,156 @@ void test_DEV_OPEN_CLOSE_N(void)
 	}
 }
 
+void test_DEV_NUMA(void)
+{
+	struct nvm_dev *dev;
+	char *buf;
+
+	dev = nvm_dev_open(nvm_dev_path);
+	CU_ASSERT_PTR_NOT_NULL(dev);
+	if (!dev)
+		return;
+
+	CU_ASSERT(nvm_dev_get_numa_node(dev) >= -1);
+
+	CU_ASSERT(!nvm_dev_set_numa_node(dev, -1));
+	CU_ASSERT_EQUAL(nvm_dev_get_numa_node(dev), -1);
+	CU_ASSERT(nvm_dev_set_numa_node(dev, 4096) < 0);
+
+	if (!nvm_dev_set_numa_node(dev, 0))		// Node 0 may not exist
+		CU_ASSERT_EQUAL(nvm_dev_get_numa_node(dev), 0);
+
+	buf = nvm_dev_buf_alloc(dev, nvm_dev_get_geo(dev)->vpg_nbytes);
+	CU_ASSERT_PTR_NOT_NULL(buf);
+	CU_ASSERT(!((uintptr_t)buf % nvm_dev_get_geo(dev)->sector_nbytes));
+	free(buf);
+
+	CU_ASSERT_PTR_NULL(nvm_dev_buf_alloc(dev, 0));
+
+	nvm_dev_close(dev);
+}
+
+/**
+ * Pin the threads of a parallel region of the application each to a single
+ * CPU, then check that a parallel library call with placement enabled leaves
+ * the pins as they were
+ */
+void test_DEV_NUMA_AFFINITY(void)
+{
+#ifdef _OPENMP
+	const int nthreads = 4;
+	cpu_set_t pinned[nthreads], orig;
+	struct nvm_addr bgn = {}, end = {};
+	const struct nvm_geo *geo;
+	struct nvm_dev *dev;
+	int nchanged = 0;
+
+	dev = nvm_dev_open(nvm_dev_path);
+	CU_ASSERT_PTR_NOT_NULL(dev);
+	if (!dev)
+		return;
+	geo = nvm_dev_get_geo(dev);
+
+	if (nvm_dev_set_numa_node(dev, 0)) {		// Node 0 may not exist
+		CU_PASS("NUMA node 0 is not available");
+		nvm_dev_close(dev);
+		return;
+	}
+	CU_ASSERT(!sched_getaffinity(0, sizeof(orig), &orig));
+
+	#pragma omp parallel num_threads(nthreads)
+	{
+		cpu_set_t *cpus = &pinned[omp_get_thread_num()];
+
+		CPU_ZERO(cpus);
+		CPU_SET(sched_getcpu(), cpus);
+		sched_setaffinity(0, sizeof(*cpus), cpus);
+	}
+
+	end.g.ch = geo->nchannels - 1;
+	end.g.lun = geo->nluns - 1;
+	bgn.g.blk = end.g.blk = 30;
+	CU_ASSERT(nvm_dev_erase_range(dev, bgn, end, nvm_dev_get_pmode(dev),
+				      NULL) >= 0);
+
+	#pragma omp parallel num_threads(nthreads) reduction(+:nchanged)
+	{
+		cpu_set_t cpus;
+
+		sched_getaffinity(0, sizeof(cpus), &cpus);
+		if (!CPU_EQUAL(&cpus, &pinned[omp_get_thread_num()]))
+			++nchanged;
+		sched_setaffinity(0, sizeof(orig), &orig);
+	}
+	CU_ASSERT_EQUAL(nchanged, 0);
+
+	nvm_dev_close(dev);
+#else
+	CU_PASS("Worker affinity requires OpenMP");
+#endif
+}
+
+void test_DEV_ERASE_RANGE(void)
+{
+	struct nvm_erase_stat stat = {};
+	struct nvm_addr failed[4];
+	struct nvm_addr bgn = {}, end = {}, bad = {}, err = {};
+	const struct nvm_geo *geo;
+	struct nvm_dev *dev;
+	int emu;
+	ssize_t res;
+
+	dev = nvm_dev_open(nvm_dev_path);
+	CU_ASSERT_PTR_NOT_NULL(dev);
+	if (!dev)
+		return;
+	geo = nvm_dev_get_geo(dev);
+	emu = !strcmp(nvm_dev_get_be_name(dev), "emu");
+
+	bgn.g.blk = 20;
+	end.g.ch = geo->nchannels - 1;
+	end.g.lun = geo->nluns - 1;
+	end.g.blk = 23;
+
+	CU_ASSERT(!nvm_dev_set_bbts_cached(dev, 1));	// Mark in memory only
+	bad.g.blk = 21;
+	bad.g.pl = geo->nplanes - 1;
+	CU_ASSERT(!nvm_bbt_mark(dev, &bad, 1, NVM_BBT_HMRK, NULL));
+
+	err.g.ch = geo->nchannels - 1;
+	err.g.blk = 22;
+	if (emu)
+		CU_ASSERT(!nvm_emu_inject(dev, err, NVM_EMU_ERR_ERASE, 1));
+
+	stat.failed = failed;
+	stat.failed_max = 4;
+	res = nvm_dev_erase_range(dev, bgn, end, nvm_dev_get_pmode(dev),
+				  &stat);
+
+	CU_ASSERT_EQUAL(stat.nblks, geo->nchannels * geo->nluns * 4);
+	CU_ASSERT_EQUAL(stat.nskipped, 1);
+	if (emu) {
+		CU_ASSERT(res < 0);
+		CU_ASSERT_EQUAL(errno, EIO);
+		CU_ASSERT_EQUAL(stat.nfailed, 1);
+		CU_ASSERT_EQUAL(stat.nerased, stat.nblks - 2);
+		CU_ASSERT_EQUAL(failed[0].g.ch, err.g.ch);
+		CU_ASSERT_EQUAL(failed[0].g.lun, err.g.lun);
+		CU_ASSERT_EQUAL(failed[0].g.blk, err.g.blk);
+	} else {
+		CU_ASSERT_EQUAL(res, stat.nblks - 1);
+		CU_ASSERT_EQUAL(stat.nfailed, 0);
+	}
+
+	end.g.blk = bgn.g.blk - 1;			// Empty range
+	CU_ASSERT(nvm_dev_erase_range(dev, bgn, end, 0x0, NULL) < 0);
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+	CU_ASSERT(!nvm_bbt_mark(dev, &bad, 1, NVM_BBT_FREE, NULL));
+
+	nvm_dev_close(dev);
+}
+
 int main(int argc, char **argv)
 {
 	if (argc > 1) {
@@ -65,6 +221,9 @@ int main(int argc, char **argv)
 	if (
 	(NULL == CU_add_test(pSuite, "nvm_dev_[open|close]", test_DEV_OPEN_CLOSE)) ||
 	(NULL == CU_add_test(pSuite, "nvm_dev_[open|close] n", test_DEV_OPEN_CLOSE_N)) ||
+	(NULL == CU_add_test(pSuite, "nvm_dev_numa", test_DEV_NUMA)) ||
+	(NULL == CU_add_test(pSuite, "nvm_dev_numa_affinity", test_DEV_NUMA_AFFINITY)) ||
+	(NULL == CU_add_test(pSuite, "nvm_dev_erase_range", test_DEV_ERASE_RANGE)) ||
 	0
 	)
 	{
@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <liblightnvm.h>
+
+#include <CUnit/Basic.h>
+
+static char nvm_dev_path[NVM_DEV_PATH_LEN] = "/emu/nvme0n1";
+
+static struct nvm_dev *dev;
+static const struct nvm_geo *geo;
+static struct nvm_addr blk_addr;
+static char *buf_w, *buf_r, *meta_w, *meta_r;
+
+int setup(void)
+{
+	dev = nvm_dev_open(nvm_dev_path);
+	if (!dev) {
+		perror("nvm_dev_open");
+		CU_ASSERT_PTR_NOT_NULL(dev);
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	buf_w = nvm_buf_alloc(geo, geo->sector_nbytes);
+	buf_r = nvm_buf_alloc(geo, geo->sector_nbytes);
+	meta_w = nvm_buf_alloc(geo, geo->meta_nbytes);
+	meta_r = nvm_buf_alloc(geo, geo->meta_nbytes);
+	if (!buf_w || !buf_r || !meta_w || !meta_r)
+		return -1;
+
+	nvm_buf_fill(buf_w, geo->sector_nbytes);
+	for (int i = 0; i < geo->meta_nbytes; ++i)
+		meta_w[i] = 'A' + (i % 26);
+
+	blk_addr.ppa = 0;
+	blk_addr.g.blk = 1;
+
+	return 0;
+}
+
+int teardown(void)
+{
+	free(buf_w);
+	free(buf_r);
+	free(meta_w);
+	free(meta_r);
+
+	nvm_dev_close(dev);
+
+	return 0;
+}
+
+static ssize_t erase(struct nvm_addr addr)
+{
+	return nvm_addr_erase(dev, &addr, 1, NVM_FLAG_PMODE_SNGL, NULL);
+}
+
+static ssize_t write_sec(struct nvm_addr addr, struct nvm_ret *ret)
+{
+	return nvm_addr_write(dev, &addr, 1, buf_w, meta_w,
+			      NVM_FLAG_PMODE_SNGL, ret);
+}
+
+static ssize_t read_sec(struct nvm_addr addr, struct nvm_ret *ret)
+{
+	return nvm_addr_read(dev, &addr, 1, buf_r, meta_r,
+			     NVM_FLAG_PMODE_SNGL, ret);
+}
+
+/**
+ * Sectors can only be written once between erases
+ */
+void test_ERASE_BEFORE_WRITE(void)
+{
+	struct nvm_addr addr = blk_addr;
+	struct nvm_ret ret = {};
+
+	++blk_addr.g.blk;
+
+	CU_ASSERT(!erase(addr));
+	CU_ASSERT(!write_sec(addr, &ret));
+	CU_ASSERT(write_sec(addr, &ret) < 0);
+	CU_ASSERT(ret.status & 0x1);
+
+	CU_ASSERT(!erase(addr));
+	CU_ASSERT(!write_sec(addr, &ret));
+}
+
+/**
+ * Sectors of a block must be written in order
+ */
+void test_WRITE_ORDER(void)
+{
+	struct nvm_addr addr = blk_addr;
+	struct nvm_ret ret = {};
+
+	++blk_addr.g.blk;
+
+	CU_ASSERT(!erase(addr));
+
+	addr.g.pg = 1;
+	CU_ASSERT(write_sec(addr, &ret) < 0);
+	CU_ASSERT(ret.status & 0x1);
+
+	for (size_t pg = 0; pg < 2; ++pg) {
+		for (size_t sec = 0; sec < geo->nsectors; ++sec) {
+			addr.g.pg = pg;
+			addr.g.sec = sec;
+			CU_ASSERT(!write_sec(addr, &ret));
+		}
+	}
+}
+
+/**
+ * Reads of unwritten sectors fail, reads of written sectors return data and
+ * out-of-bound area as written
+ */
+void test_READ(void)
+{
+	struct nvm_addr addr = blk_addr;
+	struct nvm_ret ret = {};
+
+	++blk_addr.g.blk;
+
+	CU_ASSERT(!erase(addr));
+	CU_ASSERT(read_sec(addr, &ret) < 0);
+	CU_ASSERT(ret.status & 0x1);
+
+	CU_ASSERT(!write_sec(addr, &ret));
+	memset(buf_r, 0, geo->sector_nbytes);
+	memset(meta_r, 0, geo->meta_nbytes);
+	CU_ASSERT(!read_sec(addr, &ret));
+	CU_ASSERT(!memcmp(buf_r, buf_w, geo->sector_nbytes));
+	CU_ASSERT(!memcmp(meta_r, meta_w, geo->meta_nbytes));
+}
+
+/**
+ * Injected errors hit the given number of commands and then clear
+ */
+void test_INJECT(void)
+{
+	struct nvm_addr addr = blk_addr;
+	struct nvm_ret ret = {};
+
+	++blk_addr.g.blk;
+
+	CU_ASSERT(!nvm_emu_inject(dev, addr, NVM_EMU_ERR_ERASE, -1));
+	CU_ASSERT(erase(addr) < 0);
+	CU_ASSERT(erase(addr) < 0);
+	nvm_emu_inject_clear(dev);
+	CU_ASSERT(!erase(addr));
+
+	CU_ASSERT(!nvm_emu_inject(dev, addr, NVM_EMU_ERR_WRITE, 1));
+	CU_ASSERT(write_sec(addr, &ret) < 0);
+	CU_ASSERT(!write_sec(addr, &ret));	// Failed write did not program
+
+	CU_ASSERT(!nvm_emu_inject(dev, addr, NVM_EMU_ERR_READ, 2));
+	CU_ASSERT(read_sec(addr, &ret) < 0);
+	CU_ASSERT(read_sec(addr, &ret) < 0);
+	CU_ASSERT(!read_sec(addr, &ret));
+}
+
+/**
+ * Blocks marked bad in the bad-block-table cannot be erased or written
+ */
+void test_BBT_BAD(void)
+{
+	struct nvm_addr addr = blk_addr;
+	struct nvm_ret ret = {};
+
+	++blk_addr.g.blk;
+
+	CU_ASSERT(!nvm_bbt_mark(dev, &addr, 1, NVM_BBT_BAD, &ret));
+	CU_ASSERT(erase(addr) < 0);
+	CU_ASSERT(write_sec(addr, &ret) < 0);
+
+	CU_ASSERT(!nvm_bbt_mark(dev, &addr, 1, NVM_BBT_FREE, &ret));
+	CU_ASSERT(!erase(addr));
+	CU_ASSERT(!write_sec(addr, &ret));
+}
+
+int main(int argc, char **argv)
+{
+	switch(argc) {
+	case 2:
+		if (strlen(argv[1]) > NVM_DEV_PATH_LEN) {
+			printf("ERR: len(dev_path) > %d characters\n",
+			       NVM_DEV_PATH_LEN);
+			return 1;
+                }
+		strncpy(nvm_dev_path, argv[1], NVM_DEV_PATH_LEN);
+		break;
+	}
+
+	CU_pSuite pSuite = NULL;
+
+	if (CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	pSuite = CU_add_suite("nvm_emu_*", setup, teardown);
+	if (NULL == pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+	(NULL == CU_add_test(pSuite, "Erase before write", test_ERASE_BEFORE_WRITE)) ||
+	(NULL == CU_add_test(pSuite, "Write order", test_WRITE_ORDER)) ||
+	(NULL == CU_add_test(pSuite, "Read", test_READ)) ||
+	(NULL == CU_add_test(pSuite, "Inject", test_INJECT)) ||
+	(NULL == CU_add_test(pSuite, "BBT bad", test_BBT_BAD)) ||
+	0)
+	{
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* Run all tests using the CUnit Basic interface */
+	CU_basic_set_mode(CU_BRM_NORMAL);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
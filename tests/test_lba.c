@@ -102,6 +102,168 @@ void test_VBLK_PE_LW_LR(void)
 	}
 }
 
+/**
+ * Test that nvm_lba_submit / nvm_lba_reap works as expected.
+ */
+void test_VBLK_PE_LAW_LAR(void)
+{
+	const int depth = 16;
+	const size_t nvpgs = nbytes / geo->vpg_nbytes;
+	struct nvm_lba_cpl cpls[depth];
+	struct nvm_lba_ctx *ctx;
+
+	ctx = nvm_lba_ctx_create(dev, depth, 0);
+	if (!ctx) {
+		CU_FAIL("nvm_lba_ctx_create");
+		return;
+	}
+
+	errno = 0;					// Beyond the device
+	CU_ASSERT(nvm_lba_submit(ctx, NVM_LBA_OP_READ, buf_r, geo->vpg_nbytes,
+				 geo->tbytes, NULL) < 0);
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+	for (int ch = bgn.g.ch; ch <= end.g.ch; ++ch) {
+		for (int lun = bgn.g.lun; lun <= end.g.lun; ++lun) {
+			struct nvm_vblk *vblk;
+			struct nvm_addr addr = {};
+			off_t offset;
+
+			addr.g.ch = ch;
+			addr.g.lun = lun;
+			addr.g.blk = bgn.g.blk;
+			offset = nvm_addr_gen2off(dev, addr);
+
+			vblk = nvm_vblk_alloc(dev, &addr, 1);
+			nvm_vblk_erase(vblk);
+			free(vblk);
+
+			memset(buf_r, 0, nbytes);
+			for (int op = NVM_LBA_OP_WRITE; op >= NVM_LBA_OP_READ; --op) {
+				char *buf = op == NVM_LBA_OP_WRITE ? buf_w : buf_r;
+				size_t nsubmitted = 0, nreaped = 0;
+
+				while (nreaped < nvpgs) {
+					size_t vpg_ofz = nsubmitted * geo->vpg_nbytes;
+					int n;
+
+					if (nsubmitted < nvpgs &&
+					    !nvm_lba_submit(ctx, op, buf + vpg_ofz,
+							    geo->vpg_nbytes,
+							    offset + vpg_ofz, NULL)) {
+						++nsubmitted;
+						continue;
+					}
+
+					n = nvm_lba_reap(ctx, cpls, depth, 1);
+					CU_ASSERT(n > 0);
+					if (n < 1)
+						goto out;
+
+					for (int i = 0; i < n; ++i)
+						CU_ASSERT_EQUAL(cpls[i].res,
+								geo->vpg_nbytes);
+					nreaped += n;
+				}
+			}
+
+			CU_ASSERT(!memcmp(buf_w, buf_r, nbytes));
+		}
+	}
+
+out:
+	nvm_lba_ctx_destroy(ctx);
+}
+
+/**
+ * Test that nvm_lba_striped_pwrite / nvm_lba_striped_pread works as expected
+ * for each layout, writing block `blk` of every LUN in the device
+ */
+void test_STRIPED_PE_SW_SR(void)
+{
+	const int layouts[] = {
+		NVM_LBA_LAYOUT_CHANNEL,
+		NVM_LBA_LAYOUT_LUN,
+		NVM_LBA_LAYOUT_SEQ
+	};
+	const size_t nluns = geo->nchannels * geo->nluns;
+	const size_t line_nbytes = nbytes * nluns;
+	char *line_w, *line_r;
+
+	line_w = nvm_buf_alloc(geo, line_nbytes);
+	line_r = nvm_buf_alloc(geo, line_nbytes);
+	if (!line_w || !line_r) {
+		CU_FAIL("nvm_buf_alloc");
+		goto out;
+	}
+	nvm_buf_fill(line_w, line_nbytes);
+
+	for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); ++l) {
+		struct nvm_vblk *line;
+		struct nvm_addr addr;
+
+		CU_ASSERT(!nvm_dev_set_lba_layout(dev, layouts[l]));
+		CU_ASSERT_EQUAL(nvm_dev_get_lba_layout(dev), layouts[l]);
+
+		line = nvm_vblk_alloc_line(dev, 0, geo->nchannels - 1, 0,
+					   geo->nluns - 1, blk);
+		if (!line) {
+			CU_FAIL("nvm_vblk_alloc_line");
+			goto out;
+		}
+		CU_ASSERT(nvm_vblk_erase(line) >= 0);
+		nvm_vblk_free(line);
+
+		memset(line_r, 0, line_nbytes);
+
+		if (layouts[l] == NVM_LBA_LAYOUT_SEQ) {
+			for (size_t lun = 0; lun < nluns; ++lun) {
+				off_t offset = (lun * geo->nblocks + blk) *
+					       nbytes;
+
+				addr = nvm_lba_striped_off2gen(dev, offset);
+				CU_ASSERT_EQUAL(addr.g.ch, lun / geo->nluns);
+				CU_ASSERT_EQUAL(addr.g.lun, lun % geo->nluns);
+				CU_ASSERT_EQUAL(addr.g.blk, blk);
+
+				CU_ASSERT_EQUAL(nvm_lba_striped_pwrite(dev,
+					line_w + lun * nbytes, nbytes, offset),
+					nbytes);
+				CU_ASSERT_EQUAL(nvm_lba_striped_pread(dev,
+					line_r + lun * nbytes, nbytes, offset),
+					nbytes);
+			}
+		} else {
+			off_t offset = blk * line_nbytes;
+
+			addr = nvm_lba_striped_off2gen(dev, offset +
+						       geo->vpg_nbytes);
+			CU_ASSERT_EQUAL(addr.g.blk, blk);
+			CU_ASSERT_EQUAL(addr.g.pg, 0);
+			if (layouts[l] == NVM_LBA_LAYOUT_CHANNEL)
+				CU_ASSERT_EQUAL(addr.g.ch, 1 % geo->nchannels);
+			if (layouts[l] == NVM_LBA_LAYOUT_LUN)
+				CU_ASSERT_EQUAL(addr.g.lun, 1 % geo->nluns);
+
+			CU_ASSERT_EQUAL(nvm_lba_striped_pwrite(dev, line_w,
+							       line_nbytes,
+							       offset),
+					line_nbytes);
+			CU_ASSERT_EQUAL(nvm_lba_striped_pread(dev, line_r,
+							      line_nbytes,
+							      offset),
+					line_nbytes);
+		}
+
+		CU_ASSERT(!memcmp(line_w, line_r, line_nbytes));
+	}
+
+out:
+	nvm_dev_set_lba_layout(dev, NVM_LBA_LAYOUT_CHANNEL);
+	free(line_w);
+	free(line_r);
+}
+
 int main(int argc, char **argv)
 {
 	switch(argc) {
@@ -137,6 +299,8 @@ int main(int argc, char **argv)
 
 	if (
 	(NULL == CU_add_test(pSuite, "nvm_lba_PE_LW_LR", test_VBLK_PE_LW_LR)) ||
+	(NULL == CU_add_test(pSuite, "nvm_lba_PE_LAW_LAR", test_VBLK_PE_LAW_LAR)) ||
+	(NULL == CU_add_test(pSuite, "nvm_lba_STRIPED_PE_SW_SR", test_STRIPED_PE_SW_SR)) ||
 	0)
 	{
 		CU_cleanup_registry();
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <liblightnvm.h>
+
+#include <CUnit/Basic.h>
+
+#define NTHREADS 8
+
+static char nvm_dev_path[NVM_DEV_PATH_LEN] = "/emu/nvme0n1";
+
+static struct nvm_dev *dev;
+static const struct nvm_geo *geo;
+static int blk = 3;
+
+struct worker {
+	pthread_t thread;
+	int idx;		///< Sector of each page written by the worker
+	int nerr;
+};
+
+int setup(void)
+{
+	dev = nvm_dev_open(nvm_dev_path);
+	if (!dev) {
+		perror("nvm_dev_open");
+		CU_ASSERT_PTR_NOT_NULL(dev);
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	return 0;
+}
+
+int teardown(void)
+{
+	nvm_dev_close(dev);
+
+	return 0;
+}
+
+static int submit(struct nvm_ring_cmd *cmd)
+{
+	while (nvm_ring_submit(dev, cmd)) {
+		if (errno != EAGAIN)
+			return -1;
+		sched_yield();
+	}
+
+	return 0;
+}
+
+/**
+ * Read back sector `idx` of every page of the block, via the ring, with all
+ * reads of the worker in flight at once
+ */
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	struct nvm_ring_cmd cmds[geo->npages];
+	struct nvm_addr addrs[geo->npages];
+	char *bufs;
+
+	bufs = nvm_buf_alloc(geo, geo->npages * geo->sector_nbytes);
+	if (!bufs) {
+		++w->nerr;
+		return NULL;
+	}
+
+	memset(cmds, 0, sizeof(cmds));
+	for (size_t pg = 0; pg < geo->npages; ++pg) {
+		addrs[pg].ppa = 0;
+		addrs[pg].g.blk = blk;
+		addrs[pg].g.pg = pg;
+		addrs[pg].g.sec = w->idx % geo->nsectors;
+		addrs[pg].g.pl = (w->idx / geo->nsectors) % geo->nplanes;
+
+		cmds[pg].op = NVM_RING_OP_READ;
+		cmds[pg].addrs = &addrs[pg];
+		cmds[pg].naddrs = 1;
+		cmds[pg].data = bufs + pg * geo->sector_nbytes;
+		cmds[pg].flags = NVM_FLAG_PMODE_SNGL;
+		cmds[pg].efd = -1;
+
+		if (submit(&cmds[pg]))
+			++w->nerr;
+	}
+
+	for (size_t pg = 0; pg < geo->npages; ++pg) {
+		const char *sector = bufs + pg * geo->sector_nbytes;
+
+		if (nvm_ring_wait(&cmds[pg]) || cmds[pg].ret.result)
+			++w->nerr;
+		if (sector[0] != (char)(pg + w->idx) ||
+		    sector[geo->sector_nbytes - 1] != (char)(pg + w->idx))
+			++w->nerr;
+	}
+
+	free(bufs);
+
+	return NULL;
+}
+
+void test_ENABLE(void)
+{
+	struct nvm_ring_cmd cmd = { .efd = -1 };
+
+	CU_ASSERT(nvm_ring_submit(dev, &cmd) && errno == EINVAL);
+	CU_ASSERT(nvm_ring_enable(dev, 0, 1) && errno == EINVAL);
+	CU_ASSERT(nvm_ring_enable(dev, 8, 0) && errno == EINVAL);
+
+	CU_ASSERT(!nvm_ring_enable(dev, 8, 2));
+	CU_ASSERT(nvm_ring_enable(dev, 8, 2) && errno == EBUSY);
+
+	cmd.op = 0x42;
+	CU_ASSERT(!nvm_ring_submit(dev, &cmd));
+	CU_ASSERT(nvm_ring_wait(&cmd) && errno == EINVAL);
+	CU_ASSERT(nvm_ring_poll(&cmd));
+
+	nvm_ring_disable(dev);
+	CU_ASSERT(nvm_ring_submit(dev, &cmd) && errno == EINVAL);
+}
+
+/**
+ * Erase and write a block through the ring, completing via an eventfd, then
+ * read it back from many threads sharing the ring
+ */
+void test_SHARED(void)
+{
+	const int vpg_naddrs = geo->nplanes * geo->nsectors;
+	const int pmode = nvm_dev_get_pmode(dev);
+	struct nvm_ring_cmd cmd;
+	struct nvm_addr addrs[vpg_naddrs];
+	struct worker workers[NTHREADS];
+	char *buf;
+	uint64_t ncpl;
+	int efd;
+
+	buf = nvm_buf_alloc(geo, vpg_naddrs * geo->sector_nbytes);
+	efd = eventfd(0, 0);
+	if (!buf || efd < 0) {
+		CU_FAIL("nvm_buf_alloc / eventfd");
+		free(buf);
+		return;
+	}
+
+	CU_ASSERT(!nvm_ring_enable(dev, 4, 2));
+
+	for (size_t pl = 0; pl < geo->nplanes; ++pl) {
+		addrs[pl].ppa = 0;
+		addrs[pl].g.blk = blk;
+		addrs[pl].g.pl = pl;
+	}
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.op = NVM_RING_OP_ERASE;
+	cmd.addrs = addrs;
+	cmd.naddrs = geo->nplanes;
+	cmd.flags = pmode;
+	cmd.efd = efd;
+	CU_ASSERT(!submit(&cmd));
+	CU_ASSERT_EQUAL(read(efd, &ncpl, sizeof(ncpl)), sizeof(ncpl));
+	CU_ASSERT(nvm_ring_poll(&cmd));
+	CU_ASSERT_EQUAL(cmd.res, 0);
+
+	for (size_t pg = 0; pg < geo->npages; ++pg) {
+		for (int i = 0; i < vpg_naddrs; ++i) {
+			addrs[i].ppa = 0;
+			addrs[i].g.blk = blk;
+			addrs[i].g.pg = pg;
+			addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+			addrs[i].g.sec = i % geo->nsectors;
+			memset(buf + i * geo->sector_nbytes, (char)(pg + i),
+			       geo->sector_nbytes);
+		}
+
+		cmd.op = NVM_RING_OP_WRITE;
+		cmd.naddrs = vpg_naddrs;
+		cmd.data = buf;
+		cmd.efd = -1;
+		CU_ASSERT(!submit(&cmd));
+		CU_ASSERT(!nvm_ring_wait(&cmd));
+	}
+
+	memset(workers, 0, sizeof(workers));
+	for (int i = 0; i < NTHREADS; ++i) {
+		workers[i].idx = i % vpg_naddrs;
+		CU_ASSERT(!pthread_create(&workers[i].thread, NULL, work,
+					  &workers[i]));
+	}
+	for (int i = 0; i < NTHREADS; ++i) {
+		CU_ASSERT(!pthread_join(workers[i].thread, NULL));
+		CU_ASSERT_EQUAL(workers[i].nerr, 0);
+	}
+
+	nvm_ring_disable(dev);
+	close(efd);
+	free(buf);
+}
+
+int main(int argc, char **argv)
+{
+	switch(argc) {
+	case 3:
+		blk = atoi(argv[2]);
+	case 2:
+		if (strlen(argv[1]) > NVM_DEV_PATH_LEN) {
+			printf("ERR: len(dev_path) > %d characters\n",
+			       NVM_DEV_PATH_LEN);
+			return 1;
+                }
+		strncpy(nvm_dev_path, argv[1], NVM_DEV_PATH_LEN);
+		break;
+	}
+
+	CU_pSuite pSuite = NULL;
+
+	if (CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	pSuite = CU_add_suite("nvm_ring_*", setup, teardown);
+	if (NULL == pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+	(NULL == CU_add_test(pSuite, "Enable", test_ENABLE)) ||
+	(NULL == CU_add_test(pSuite, "Shared", test_SHARED)) ||
+	0)
+	{
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* Run all tests using the CUnit Basic interface */
+	CU_basic_set_mode(CU_BRM_NORMAL);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+
+#include <CUnit/Basic.h>
+
+#define NTHREADS 4
+
+static char nvm_dev_path[NVM_DEV_PATH_LEN] = "/emu/nvme0n1";
+
+static struct nvm_dev *dev;
+static const struct nvm_geo *geo;
+static int blk = 2;
+
+struct worker {
+	pthread_t thread;
+	struct nvm_addr luns[2];	///< LUNs written by the worker, in order
+	int nluns;
+	size_t ncmds;
+	int nerr;
+};
+
+int setup(void)
+{
+	dev = nvm_dev_open(nvm_dev_path);
+	if (!dev) {
+		perror("nvm_dev_open");
+		CU_ASSERT_PTR_NOT_NULL(dev);
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	return 0;
+}
+
+int teardown(void)
+{
+	nvm_dev_close(dev);
+
+	return 0;
+}
+
+/**
+ * Erase block `blk + idx` on each of the worker's LUNs, then write and read
+ * them one virtual page at a time, a page addressing all of its LUNs
+ */
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	const int vpg_naddrs = geo->nplanes * geo->nsectors;
+	const int naddrs = vpg_naddrs * w->nluns;
+	const int pmode = nvm_dev_get_pmode(dev);
+	struct nvm_addr addrs[naddrs];
+	char *buf_w, *buf_r;
+
+	buf_w = nvm_buf_alloc(geo, naddrs * geo->sector_nbytes);
+	buf_r = nvm_buf_alloc(geo, naddrs * geo->sector_nbytes);
+	if (!buf_w || !buf_r) {
+		++w->nerr;
+		goto out;
+	}
+
+	for (int l = 0; l < w->nluns; ++l) {
+		struct nvm_addr addrs[geo->nplanes];
+
+		for (size_t pl = 0; pl < geo->nplanes; ++pl) {
+			addrs[pl].ppa = w->luns[l].ppa;
+			addrs[pl].g.pl = pl;
+		}
+
+		if (nvm_addr_erase(dev, addrs, geo->nplanes, pmode, NULL))
+			++w->nerr;
+		++w->ncmds;
+	}
+
+	for (size_t pg = 0; pg < geo->npages; ++pg) {
+		for (int i = 0; i < naddrs; ++i) {
+			addrs[i].ppa = w->luns[i / vpg_naddrs].ppa;
+			addrs[i].g.pg = pg;
+			addrs[i].g.pl = (i / geo->nsectors) % geo->nplanes;
+			addrs[i].g.sec = i % geo->nsectors;
+		}
+
+		nvm_buf_fill(buf_w, naddrs * geo->sector_nbytes);
+		memset(buf_r, 0, naddrs * geo->sector_nbytes);
+
+		if (nvm_addr_write(dev, addrs, naddrs, buf_w, NULL, pmode, NULL))
+			++w->nerr;
+		if (nvm_addr_read(dev, addrs, naddrs, buf_r, NULL, pmode, NULL))
+			++w->nerr;
+		if (memcmp(buf_w, buf_r, naddrs * geo->sector_nbytes))
+			++w->nerr;
+		w->ncmds += 2;
+	}
+
+out:
+	free(buf_w);
+	free(buf_r);
+
+	return NULL;
+}
+
+static void run(struct worker workers[], int nworkers)
+{
+	struct nvm_sched_stat stat;
+	size_t ncmds = 0;
+
+	for (int i = 0; i < nworkers; ++i)
+		CU_ASSERT(!pthread_create(&workers[i].thread, NULL, work,
+					  &workers[i]));
+	for (int i = 0; i < nworkers; ++i) {
+		CU_ASSERT(!pthread_join(workers[i].thread, NULL));
+		CU_ASSERT_EQUAL(workers[i].nerr, 0);
+		ncmds += workers[i].ncmds;
+	}
+
+	CU_ASSERT(!nvm_sched_get_stat(dev, &stat));
+	CU_ASSERT_EQUAL(stat.ncmds, ncmds);
+	CU_ASSERT_EQUAL(stat.max_inflight, 1);
+}
+
+void test_ENABLE(void)
+{
+	struct nvm_sched_stat stat;
+
+	CU_ASSERT(nvm_sched_get_stat(dev, &stat));
+	CU_ASSERT(nvm_sched_enable(dev, 0, 0) && errno == EINVAL);
+	CU_ASSERT(nvm_sched_enable(dev, 1, -1) && errno == EINVAL);
+
+	CU_ASSERT(!nvm_sched_enable(dev, 1, 1000));
+	CU_ASSERT(nvm_sched_enable(dev, 1, 1000) && errno == EBUSY);
+	CU_ASSERT(!nvm_sched_get_stat(dev, &stat));
+	CU_ASSERT_EQUAL(stat.ncmds, 0);
+
+	nvm_sched_disable(dev);
+	CU_ASSERT(nvm_sched_get_stat(dev, &stat));
+}
+
+/**
+ * Workers sharing a LUN are admitted one at a time
+ */
+void test_SHARED_LUN(void)
+{
+	struct worker workers[NTHREADS];
+
+	memset(workers, 0, sizeof(workers));
+	for (int i = 0; i < NTHREADS; ++i) {
+		workers[i].luns[0].g.blk = blk + i;
+		workers[i].nluns = 1;
+	}
+
+	CU_ASSERT(!nvm_sched_enable(dev, 1, 1000));
+	run(workers, NTHREADS);
+	nvm_sched_disable(dev);
+}
+
+/**
+ * Workers spanning the same LUNs in opposite orders do not deadlock
+ */
+void test_SPANNING(void)
+{
+	struct worker workers[NTHREADS];
+
+	if (geo->nchannels * geo->nluns < 2) {
+		CU_PASS("Device has a single LUN");
+		return;
+	}
+
+	memset(workers, 0, sizeof(workers));
+	for (int i = 0; i < NTHREADS; ++i) {
+		int first = i % 2;
+
+		workers[i].luns[first].g.lun = 0;
+		workers[i].luns[!first].g.lun = 1 % geo->nluns;
+		workers[i].luns[!first].g.ch = geo->nluns > 1 ? 0 : 1;
+		workers[i].luns[0].g.blk = blk + i;
+		workers[i].luns[1].g.blk = blk + i;
+		workers[i].nluns = 2;
+	}
+
+	CU_ASSERT(!nvm_sched_enable(dev, 1, 0));
+	run(workers, NTHREADS);
+	nvm_sched_disable(dev);
+}
+
+struct waiter {
+	pthread_t thread;
+	uint16_t opcode;
+	int order;			///< Position in which the slot was granted
+	int done;
+};
+
+static int order_next;
+
+/**
+ * Take and release a slot on the first LUN, recording the grant order while
+ * holding it
+ */
+static void *wait_slot(void *arg)
+{
+	struct waiter *w = arg;
+	struct nvm_addr addr = { .ppa = 0 };
+	struct nvm_sched *sched;
+	size_t luns[1];
+	int nluns;
+
+	sched = nvm_sched_acquire(dev, w->opcode, &addr, 1, luns, &nluns);
+	w->order = __atomic_fetch_add(&order_next, 1, __ATOMIC_RELAXED);
+	if (sched)
+		nvm_sched_release(dev, sched, luns, nluns);
+	__atomic_store_n(&w->done, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+/**
+ * Start a waiter and return once it is queued behind the slot holder
+ */
+static void queue(struct waiter *w, uint16_t opcode, size_t nwaits)
+{
+	struct nvm_sched_stat stat;
+
+	memset(w, 0, sizeof(*w));
+	w->opcode = opcode;
+	w->order = -1;
+	CU_ASSERT(!pthread_create(&w->thread, NULL, wait_slot, w));
+
+	do {
+		usleep(100);
+		CU_ASSERT(!nvm_sched_get_stat(dev, &stat));
+	} while (stat.nwaits < nwaits);
+}
+
+/**
+ * A program queued behind a slot holder is passed by a read queued after it,
+ * unless it has waited for longer than aging_us, then it is promoted
+ */
+void test_PROMOTION(void)
+{
+	for (int aged = 0; aged < 2; ++aged) {
+		struct nvm_addr addr = { .ppa = 0 };
+		struct waiter prog, read;
+		struct nvm_sched_stat stat;
+		struct nvm_sched *sched;
+		size_t luns[1];
+		int nluns;
+
+		CU_ASSERT(!nvm_sched_enable(dev, 1, aged ? 1000 : 10000000));
+		order_next = 0;
+
+		sched = nvm_sched_acquire(dev, S12_OPC_READ, &addr, 1, luns,
+					  &nluns);
+		CU_ASSERT_PTR_NOT_NULL(sched);
+		queue(&prog, S12_OPC_WRITE, 1);
+		queue(&read, S12_OPC_READ, 2);
+		if (aged)
+			usleep(2000);
+		nvm_sched_release(dev, sched, luns, nluns);
+
+		CU_ASSERT(!pthread_join(prog.thread, NULL));
+		CU_ASSERT(!pthread_join(read.thread, NULL));
+		CU_ASSERT_EQUAL(prog.order, aged ? 0 : 1);
+		CU_ASSERT_EQUAL(read.order, aged ? 1 : 0);
+
+		CU_ASSERT(!nvm_sched_get_stat(dev, &stat));
+		CU_ASSERT_EQUAL(stat.nwaits, 2);
+		CU_ASSERT_EQUAL(stat.npromotions, aged);
+
+		nvm_sched_disable(dev);
+	}
+}
+
+static int disabled;
+
+static void *disable(void *arg)
+{
+	nvm_sched_disable(dev);
+	__atomic_store_n(&disabled, 1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+/**
+ * Disabling waits for the slot holder and the waiters to complete
+ */
+void test_DISABLE(void)
+{
+	struct nvm_addr addr = { .ppa = 0 };
+	struct nvm_sched *sched;
+	struct waiter waiter;
+	pthread_t thread;
+	size_t luns[1], unsched_luns[1];
+	int nluns, unsched_nluns;
+
+	CU_ASSERT(!nvm_sched_enable(dev, 1, 1000));
+	order_next = 0;
+	disabled = 0;
+
+	sched = nvm_sched_acquire(dev, S12_OPC_READ, &addr, 1, luns, &nluns);
+	CU_ASSERT_PTR_NOT_NULL(sched);
+	queue(&waiter, S12_OPC_WRITE, 1);
+
+	CU_ASSERT(!pthread_create(&thread, NULL, disable, NULL));
+	usleep(10000);
+	CU_ASSERT(!__atomic_load_n(&disabled, __ATOMIC_ACQUIRE));
+	CU_ASSERT(!__atomic_load_n(&waiter.done, __ATOMIC_ACQUIRE));
+	CU_ASSERT_PTR_NULL(nvm_sched_acquire(dev, S12_OPC_READ, &addr, 1,
+					     unsched_luns, &unsched_nluns));
+
+	nvm_sched_release(dev, sched, luns, nluns);
+	CU_ASSERT(!pthread_join(waiter.thread, NULL));
+	CU_ASSERT(!pthread_join(thread, NULL));
+	CU_ASSERT_EQUAL(waiter.order, 0);
+	CU_ASSERT(disabled);
+}
+
+int main(int argc, char **argv)
+{
+	switch(argc) {
+	case 3:
+		blk = atoi(argv[2]);
+	case 2:
+		if (strlen(argv[1]) > NVM_DEV_PATH_LEN) {
+			printf("ERR: len(dev_path) > %d characters\n",
+			       NVM_DEV_PATH_LEN);
+			return 1;
+                }
+		strncpy(nvm_dev_path, argv[1], NVM_DEV_PATH_LEN);
+		break;
+	}
+
+	CU_pSuite pSuite = NULL;
+
+	if (CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	pSuite = CU_add_suite("nvm_sched_*", setup, teardown);
+	if (NULL == pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+	(NULL == CU_add_test(pSuite, "Enable", test_ENABLE)) ||
+	(NULL == CU_add_test(pSuite, "Shared LUN", test_SHARED_LUN)) ||
+	(NULL == CU_add_test(pSuite, "Spanning", test_SPANNING)) ||
+	(NULL == CU_add_test(pSuite, "Promotion", test_PROMOTION)) ||
+	(NULL == CU_add_test(pSuite, "Disable", test_DISABLE)) ||
+	0)
+	{
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* Run all tests using the CUnit Basic interface */
+	CU_basic_set_mode(CU_BRM_NORMAL);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <liblightnvm.h>
+
+#include <CUnit/Basic.h>
+
+static char nvm_dev_path[NVM_DEV_PATH_LEN] = "/emu/nvme0n1";
+
+static struct nvm_dev *dev;
+static const struct nvm_geo *geo;
+static int blk = 4;
+static size_t line_nbytes;
+static char *buf_w, *buf_r;
+
+int setup(void)
+{
+	dev = nvm_dev_open(nvm_dev_path);
+	if (!dev) {
+		perror("nvm_dev_open");
+		CU_ASSERT_PTR_NOT_NULL(dev);
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	line_nbytes = geo->nchannels * geo->nluns * geo->npages *
+		      geo->vpg_nbytes;
+
+	buf_w = nvm_buf_alloc(geo, 2 * line_nbytes);
+	buf_r = nvm_buf_alloc(geo, 2 * line_nbytes);
+	if (!buf_w || !buf_r)
+		return -1;
+
+	nvm_buf_fill(buf_w, 2 * line_nbytes);
+
+	return 0;
+}
+
+int teardown(void)
+{
+	free(buf_w);
+	free(buf_r);
+
+	nvm_dev_close(dev);
+
+	return 0;
+}
+
+static struct nvm_stream *stream_open(int blk_bgn, int blk_end)
+{
+	return nvm_stream_open(dev, 0, geo->nchannels - 1, 0, geo->nluns - 1,
+			       blk_bgn, blk_end, 1);
+}
+
+/**
+ * Appends fill a line and roll over to the next, the stream is padded on close
+ * and runs out of space after the last line
+ */
+void test_APPEND(void)
+{
+	const size_t nbytes = line_nbytes / 2 + geo->vpg_nbytes;
+	struct nvm_stream *stream;
+	struct nvm_vblk *line;
+	struct nvm_addr addr;
+
+	CU_ASSERT_PTR_NULL(nvm_stream_open(dev, 0, 0, 0, 0, blk, blk, 0));
+
+	stream = stream_open(blk, blk + 1);
+	if (!stream) {
+		CU_FAIL("nvm_stream_open");
+		return;
+	}
+
+	CU_ASSERT(nvm_stream_append(stream, buf_w, 1, NULL) < 0);
+
+	for (int i = 0; i < 3; ++i) {
+		const size_t ofz = i * nbytes;
+
+		CU_ASSERT_EQUAL(nvm_stream_append(stream, buf_w + ofz, nbytes,
+						  &addr), nbytes);
+		CU_ASSERT_EQUAL(addr.g.blk, blk + ofz / line_nbytes);
+	}
+	CU_ASSERT_EQUAL(nvm_stream_append(stream, buf_w, line_nbytes, NULL), -1);
+	CU_ASSERT_EQUAL(errno, ENOSPC);
+
+	CU_ASSERT(!nvm_stream_close(stream));
+
+	for (int i = 0; i < 2; ++i) {
+		line = nvm_vblk_alloc_line(dev, 0, geo->nchannels - 1, 0,
+					   geo->nluns - 1, blk + i);
+		CU_ASSERT(nvm_vblk_pread(line, buf_r + i * line_nbytes,
+					 line_nbytes, 0) >= 0);
+		nvm_vblk_free(line);
+	}
+	CU_ASSERT(!memcmp(buf_w, buf_r, 3 * nbytes));
+}
+
+/**
+ * A line which fails to erase is skipped
+ */
+void test_SKIP_BAD(void)
+{
+	struct nvm_stream *stream;
+	struct nvm_addr addr = {};
+
+	if (strcmp(nvm_dev_get_be_name(dev), "emu")) {
+		CU_PASS("Injection requires an emulated device");
+		return;
+	}
+
+	addr.g.blk = blk + 2;
+	CU_ASSERT(!nvm_emu_inject(dev, addr, NVM_EMU_ERR_ERASE, 1));
+
+	stream = stream_open(blk + 2, blk + 3);
+	if (!stream) {
+		CU_FAIL("nvm_stream_open");
+		return;
+	}
+
+	CU_ASSERT_EQUAL(nvm_stream_append(stream, buf_w, geo->vpg_nbytes,
+					  &addr), geo->vpg_nbytes);
+	CU_ASSERT_EQUAL(addr.g.blk, blk + 3);
+	CU_ASSERT_EQUAL(addr.g.pg, 0);
+
+	CU_ASSERT(!nvm_stream_close(stream));
+	nvm_emu_inject_clear(dev);
+}
+
+int main(int argc, char **argv)
+{
+	switch(argc) {
+	case 3:
+		blk = atoi(argv[2]);
+	case 2:
+		if (strlen(argv[1]) > NVM_DEV_PATH_LEN) {
+			printf("ERR: len(dev_path) > %d characters\n",
+			       NVM_DEV_PATH_LEN);
+			return 1;
+                }
+		strncpy(nvm_dev_path, argv[1], NVM_DEV_PATH_LEN);
+		break;
+	}
+
+	CU_pSuite pSuite = NULL;
+
+	if (CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	pSuite = CU_add_suite("nvm_stream_*", setup, teardown);
+	if (NULL == pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+	(NULL == CU_add_test(pSuite, "Append", test_APPEND)) ||
+	(NULL == CU_add_test(pSuite, "Skip bad", test_SKIP_BAD)) ||
+	0)
+	{
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* Run all tests using the CUnit Basic interface */
+	CU_basic_set_mode(CU_BRM_NORMAL);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <liblightnvm.h>
+#include <nvm.h>
+
+#include <CUnit/Basic.h>
+
+static char nvm_dev_path[NVM_DEV_PATH_LEN] = "/emu/nvme0n1";
+
+static struct nvm_dev *dev;
+static const struct nvm_geo *geo;
+static int blk = 9;
+
+static char trace_path[] = "/tmp/nvm_test_trace.XXXXXX";
+static struct nvm_addr addrs[NVM_NADDR_MAX];
+static char *buf;
+
+int setup(void)
+{
+	int fd;
+
+	dev = nvm_dev_open(nvm_dev_path);
+	if (!dev) {
+		perror("nvm_dev_open");
+		CU_ASSERT_PTR_NOT_NULL(dev);
+		return -1;
+	}
+	geo = nvm_dev_get_geo(dev);
+
+	buf = nvm_buf_alloc(geo, geo->vpg_nbytes);
+	if (!buf) {
+		CU_FAIL("Allocation failure");
+		return -1;
+	}
+	nvm_buf_fill(buf, geo->vpg_nbytes);
+
+	fd = mkstemp(trace_path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return -1;
+	}
+	close(fd);
+
+	for (size_t i = 0; i < geo->nsectors; ++i) {
+		addrs[i].ppa = 0;
+		addrs[i].g.blk = blk;
+		addrs[i].g.sec = i;
+	}
+
+	return 0;
+}
+
+int teardown(void)
+{
+	nvm_trace_disable();
+	unlink(trace_path);
+	free(buf);
+	nvm_dev_close(dev);
+
+	return 0;
+}
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Dump and load the trace, keep the records submitted at or after `t0`
+ */
+static struct nvm_trace_rec *trace_get(uint64_t t0, size_t *nrecs)
+{
+	struct nvm_trace_rec *recs;
+	size_t n = 0, nall;
+
+	if (nvm_trace_dump(trace_path))
+		return NULL;
+
+	recs = nvm_trace_load(trace_path, &nall);
+	if (!recs)
+		return NULL;
+
+	for (size_t i = 0; i < nall; ++i) {
+		if (recs[i].ts >= t0)
+			recs[n++] = recs[i];
+	}
+	*nrecs = n;
+
+	return recs;
+}
+
+/**
+ * Read the first `naddrs` sectors of the page, the sector of the first address
+ * is `naddrs - 1`, such that a record can be checked for consistency
+ */
+static int read_n(int naddrs)
+{
+	struct nvm_addr rd[NVM_NADDR_MAX];
+
+	for (int i = 0; i < naddrs; ++i)
+		rd[i] = addrs[i];
+	rd[0].g.sec = naddrs - 1;
+
+	return nvm_addr_read(dev, rd, naddrs, buf, NULL, NVM_FLAG_PMODE_SNGL,
+			     NULL);
+}
+
+static void *read_one(void *arg)
+{
+	*(int *)arg = read_n(1);
+
+	return NULL;
+}
+
+void test_TRACE(void)
+{
+	const uint64_t t0 = now();
+	struct nvm_trace_rec *recs;
+	pthread_t thread;
+	size_t nrecs = 0;
+	int err = -1;
+
+	CU_ASSERT(!nvm_trace_enable(64));
+
+	CU_ASSERT(!nvm_addr_erase(dev, addrs, 1, NVM_FLAG_PMODE_SNGL, NULL));
+	CU_ASSERT(!nvm_addr_write(dev, addrs, geo->nsectors, buf, NULL,
+				  NVM_FLAG_PMODE_SNGL, NULL));
+	CU_ASSERT(!read_n(geo->nsectors));
+	CU_ASSERT(!pthread_create(&thread, NULL, read_one, &err));
+	CU_ASSERT(!pthread_join(thread, NULL));
+	CU_ASSERT(!err);
+
+	nvm_trace_disable();
+	CU_ASSERT(!read_n(1));			// Not traced
+
+	recs = trace_get(t0, &nrecs);
+	CU_ASSERT_PTR_NOT_NULL(recs);
+	CU_ASSERT_EQUAL(nrecs, 4);
+	if (nrecs != 4)
+		goto out;
+
+	for (size_t i = 1; i < nrecs; ++i)
+		CU_ASSERT(recs[i - 1].ts <= recs[i].ts);
+
+	CU_ASSERT_EQUAL(recs[0].opcode, S12_OPC_ERASE);
+	CU_ASSERT_EQUAL(recs[0].naddrs, 1);
+	CU_ASSERT_EQUAL(recs[0].ppa, addrs[0].ppa);
+	CU_ASSERT_EQUAL(recs[1].opcode, S12_OPC_WRITE);
+	CU_ASSERT_EQUAL(recs[1].naddrs, geo->nsectors);
+	CU_ASSERT_EQUAL(recs[2].opcode, S12_OPC_READ);
+	CU_ASSERT_EQUAL(recs[2].naddrs, geo->nsectors);
+	CU_ASSERT_EQUAL(recs[3].opcode, S12_OPC_READ);
+	CU_ASSERT_EQUAL(recs[3].naddrs, 1);
+
+	for (size_t i = 0; i < nrecs; ++i) {
+		CU_ASSERT(!recs[i].err);
+		CU_ASSERT(!recs[i].result);
+	}
+	CU_ASSERT_EQUAL(recs[0].tid, recs[2].tid);
+	CU_ASSERT(recs[0].tid != recs[3].tid);
+
+out:
+	free(recs);
+}
+
+/**
+ * When a ring wraps, only the newest records are dumped
+ */
+void test_TRACE_WRAP(void)
+{
+	const uint64_t t0 = now();
+	const int nsubmit = 100;
+	struct nvm_trace_rec *recs;
+	size_t nrecs = 0;
+
+	CU_ASSERT(!nvm_trace_enable(64));	// Same capacity as test_TRACE
+	for (int i = 0; i < nsubmit; ++i)
+		CU_ASSERT(!read_n(1 + i % geo->nsectors));
+	nvm_trace_disable();
+
+	// The oldest record of the full ring is left out, its slot is next
+	recs = trace_get(t0, &nrecs);
+	CU_ASSERT_PTR_NOT_NULL(recs);
+	CU_ASSERT_EQUAL(nrecs, 63);
+	if (nrecs != 63)
+		goto out;
+
+	for (size_t i = 0; i < nrecs; ++i) {
+		const int nth = nsubmit - nrecs + i;
+
+		CU_ASSERT_EQUAL(recs[i].naddrs, 1 + nth % geo->nsectors);
+	}
+
+out:
+	free(recs);
+}
+
+static int reader_stop;
+static uint32_t reader_tid;
+
+static void *reader(void *arg)
+{
+	for (int i = 0; !__atomic_load_n(&reader_stop, __ATOMIC_ACQUIRE); ++i)
+		read_n(1 + i % geo->nsectors);
+
+	return NULL;
+}
+
+/**
+ * Records of the reader are read_n(1 + i % nsectors) for consecutive `i`, thus
+ * consecutive records have consecutive naddrs, modulo nsectors
+ */
+static int reader_recs_valid(struct nvm_trace_rec *recs, size_t nrecs)
+{
+	for (size_t i = 0; i < nrecs; ++i) {
+		struct nvm_addr addr = { .ppa = recs[i].ppa };
+
+		if ((recs[i].naddrs != 1 + addr.g.sec) ||
+		    (recs[i].opcode != S12_OPC_READ))
+			return 0;
+		if (i && (recs[i].naddrs != recs[i - 1].naddrs % geo->nsectors + 1))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Dump while another thread keeps wrapping its ring, records overwritten
+ * during the dump must be dropped instead of ending up torn in the trace
+ */
+void test_TRACE_TORN(void)
+{
+	const uint64_t t0 = now();
+	struct nvm_trace_rec *recs;
+	pthread_t thread;
+	size_t nrecs = 0;
+
+	CU_ASSERT(!nvm_trace_enable(4));
+	reader_stop = 0;
+	CU_ASSERT(!pthread_create(&thread, NULL, reader, NULL));
+
+	for (int i = 0; i < 1000; ++i) {
+		recs = trace_get(t0, &nrecs);
+		CU_ASSERT_PTR_NOT_NULL(recs);
+		if (!recs)
+			break;
+
+		CU_ASSERT(nrecs < 4);
+		if (!reader_recs_valid(recs, nrecs)) {
+			CU_FAIL("Torn record");
+			for (size_t j = 0; j < nrecs; ++j)
+				nvm_trace_rec_pr(&recs[j]);
+		}
+		free(recs);
+	}
+
+	__atomic_store_n(&reader_stop, 1, __ATOMIC_RELEASE);
+	CU_ASSERT(!pthread_join(thread, NULL));
+	nvm_trace_disable();
+
+	// Records of the exited thread are kept, but for the boundary record,
+	// the oldest of the full ring
+	recs = trace_get(t0, &nrecs);
+	CU_ASSERT_PTR_NOT_NULL(recs);
+	CU_ASSERT_EQUAL(nrecs, 3);
+	CU_ASSERT(recs && reader_recs_valid(recs, nrecs));
+	if (recs && nrecs)
+		reader_tid = recs[0].tid;
+	free(recs);
+}
+
+/**
+ * A thread started after another has exited takes over the retired ring
+ * instead of allocating one of its own
+ */
+void test_TRACE_REUSE(void)
+{
+	const uint64_t t0 = now();
+	struct nvm_trace_rec *recs;
+	pthread_t thread;
+	size_t nrecs = 0, nreader = 0, nreuse = 0;
+	int err = -1;
+
+	CU_ASSERT(!nvm_trace_enable(4));	// Same capacity as test_TRACE_TORN
+	CU_ASSERT(!pthread_create(&thread, NULL, read_one, &err));
+	CU_ASSERT(!pthread_join(thread, NULL));
+	CU_ASSERT(!err);
+	nvm_trace_disable();
+
+	recs = trace_get(0, &nrecs);
+	CU_ASSERT_PTR_NOT_NULL(recs);
+	if (!recs)
+		return;
+
+	// The new thread overwrites one record of the torn-test thread, and the
+	// one after it is now the boundary record
+	for (size_t i = 0; i < nrecs; ++i) {
+		if (recs[i].tid == reader_tid)
+			++nreader;
+		if (recs[i].ts >= t0) {
+			CU_ASSERT(recs[i].tid != reader_tid);
+			++nreuse;
+		}
+	}
+	CU_ASSERT_EQUAL(nreader, 2);
+	CU_ASSERT_EQUAL(nreuse, 1);
+
+	free(recs);
+}
+
+int main(int argc, char **argv)
+{
+	switch(argc) {
+	case 3:
+		blk = atoi(argv[2]);
+	case 2:
+		if (strlen(argv[1]) > NVM_DEV_PATH_LEN) {
+			printf("ERR: len(dev_path) > %d characters\n",
+			       NVM_DEV_PATH_LEN);
+			return 1;
+                }
+		strncpy(nvm_dev_path, argv[1], NVM_DEV_PATH_LEN);
+		break;
+	}
+
+	CU_pSuite pSuite = NULL;
+
+	if (CUE_SUCCESS != CU_initialize_registry())
+		return CU_get_error();
+
+	pSuite = CU_add_suite("nvm_trace_*", setup, teardown);
+	if (NULL == pSuite) {
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	if (
+	(NULL == CU_add_test(pSuite, "Trace", test_TRACE)) ||
+	(NULL == CU_add_test(pSuite, "Trace wrap", test_TRACE_WRAP)) ||
+	(NULL == CU_add_test(pSuite, "Trace torn", test_TRACE_TORN)) ||
+	(NULL == CU_add_test(pSuite, "Trace reuse", test_TRACE_REUSE)) ||
+	0)
+	{
+		CU_cleanup_registry();
+		return CU_get_error();
+	}
+
+	/* Run all tests using the CUnit Basic interface */
+	CU_basic_set_mode(CU_BRM_NORMAL);
+	CU_basic_run_tests();
+	CU_cleanup_registry();
+
+	return CU_get_error();
+}
@@ -216,6 +216,209 @@ void test_VBLK_RAND(void)
 	}
 }
 
+/**
+ * Write a line with parity and read it back, around each block and with a
+ * block failing to read, a stripe with two failed blocks cannot be rebuilt
+ */
+void test_VBLK_PARITY(void)
+{
+	struct nvm_vblk *line;
+	size_t line_nbytes;
+	char *line_w = NULL, *line_r = NULL;
+
+	line = nvm_vblk_alloc_line(dev, 0, geo->nchannels - 1, 0,
+				   geo->nluns - 1, blk + 1);
+	if (!line) {
+		CU_FAIL("nvm_vblk_alloc_line");
+		return;
+	}
+	if (nvm_vblk_get_naddrs(line) < 2) {
+		CU_PASS("Parity requires a line of at least two LUNs");
+		goto out;
+	}
+
+	CU_ASSERT(nvm_vblk_set_parity(line, 2) < 0);
+	CU_ASSERT(!nvm_vblk_set_parity(line, 1));
+	CU_ASSERT_EQUAL(nvm_vblk_get_parity(line), 1);
+
+	line_nbytes = nvm_vblk_get_nbytes(line);
+	CU_ASSERT_EQUAL(line_nbytes, (nvm_vblk_get_naddrs(line) - 1) *
+			geo->npages * geo->vpg_nbytes);
+
+	line_w = nvm_buf_alloc(geo, line_nbytes);
+	line_r = nvm_buf_alloc(geo, line_nbytes);
+	if (!line_w || !line_r) {
+		CU_FAIL("nvm_buf_alloc");
+		goto out;
+	}
+	nvm_buf_fill(line_w, line_nbytes);
+
+	CU_ASSERT(nvm_vblk_erase(line) >= 0);
+	CU_ASSERT_EQUAL(nvm_vblk_write(line, line_w, line_nbytes / 2),
+			line_nbytes / 2);
+	CU_ASSERT(nvm_vblk_write(line, line_w, geo->vpg_nbytes) < 0);
+	CU_ASSERT_EQUAL(nvm_vblk_pad(line), line_nbytes - line_nbytes / 2);
+
+	memset(line_r, 0, line_nbytes);
+	CU_ASSERT_EQUAL(nvm_vblk_pread(line, line_r, line_nbytes / 2, 0),
+			line_nbytes / 2);
+	CU_ASSERT(!compare_buffers(line_w, line_r, line_nbytes / 2));
+
+	for (int idx = 0; idx < nvm_vblk_get_naddrs(line) - 1; ++idx) {
+		memset(line_r, 0, line_nbytes);
+		CU_ASSERT_EQUAL(nvm_vblk_pread_around(line, line_r,
+						      line_nbytes / 2, 0, idx),
+				line_nbytes / 2);
+		CU_ASSERT(!compare_buffers(line_w, line_r, line_nbytes / 2));
+	}
+	CU_ASSERT(nvm_vblk_pread_around(line, line_r, line_nbytes / 2, 0,
+					nvm_vblk_get_naddrs(line) - 1) < 0);
+	CU_ASSERT_EQUAL(errno, EINVAL);
+
+	if (!strcmp(nvm_dev_get_be_name(dev), "emu")) {
+		const struct nvm_vblk_ret *ret = nvm_vblk_get_ret(line);
+		struct nvm_addr addrs[2];
+
+		addrs[0] = nvm_vblk_get_addrs(line)[0];
+		addrs[1] = nvm_vblk_get_addrs(line)[1];
+
+		CU_ASSERT(!nvm_emu_inject(dev, addrs[1], NVM_EMU_ERR_READ, -1));
+		memset(line_r, 0, line_nbytes);
+		CU_ASSERT_EQUAL(nvm_vblk_pread(line, line_r, line_nbytes / 2, 0),
+				line_nbytes / 2);
+		CU_ASSERT(!compare_buffers(line_w, line_r, line_nbytes / 2));
+
+		CU_ASSERT_EQUAL(ret->nfailed, 0);
+		CU_ASSERT_EQUAL(ret->nbytes, line_nbytes / 2);
+
+		// Both pages of the first stripe are lost, and listed as failed
+		CU_ASSERT(!nvm_emu_inject(dev, addrs[0], NVM_EMU_ERR_READ, -1));
+		CU_ASSERT(nvm_vblk_pread(line, line_r, line_nbytes / 2, 0) < 0);
+		CU_ASSERT_EQUAL(ret->nfailed, 2 * geo->nplanes * geo->nsectors);
+		CU_ASSERT_EQUAL(ret->nbytes, line_nbytes / 2 -
+				2 * geo->vpg_nbytes);
+		for (int i = 0; i < ret->nfailed; ++i) {
+			CU_ASSERT_EQUAL(ret->failed[i].g.pg, 0);
+			CU_ASSERT(ret->failed[i].g.lun == addrs[0].g.lun ||
+				  ret->failed[i].g.lun == addrs[1].g.lun);
+			CU_ASSERT(ret->failed[i].g.ch == addrs[0].g.ch ||
+				  ret->failed[i].g.ch == addrs[1].g.ch);
+		}
+		nvm_emu_inject_clear(dev);
+
+		// A failed program of a data page is listed
+		CU_ASSERT(nvm_vblk_erase(line) >= 0);
+		CU_ASSERT(!nvm_emu_inject(dev, addrs[1], NVM_EMU_ERR_WRITE, 1));
+		CU_ASSERT(nvm_vblk_pwrite(line, line_w, line_nbytes, 0) < 0);
+		CU_ASSERT(ret->nfailed > 0);
+		CU_ASSERT_EQUAL(ret->nbytes, line_nbytes - ret->nfailed *
+				geo->sector_nbytes);
+		for (int i = 0; i < ret->nfailed; ++i) {
+			CU_ASSERT_EQUAL(ret->failed[i].g.ch, addrs[1].g.ch);
+			CU_ASSERT_EQUAL(ret->failed[i].g.lun, addrs[1].g.lun);
+		}
+
+		nvm_emu_inject_clear(dev);
+	}
+
+out:
+	nvm_vblk_free(line);
+	free(line_w);
+	free(line_r);
+}
+
+/**
+ * Fail the read of a sector once and then for good, the first is recovered by
+ * retrying and the second reported via the failure list of the vblk
+ */
+void test_VBLK_RETRY(void)
+{
+	const struct nvm_vblk_ret *ret;
+	struct nvm_addr addr;
+
+	if (strcmp(nvm_dev_get_be_name(dev), "emu")) {
+		CU_PASS("Injecting errors requires an emulated device");
+		return;
+	}
+
+	CU_ASSERT(nvm_vblk_erase(vblk) >= 0);
+	CU_ASSERT_EQUAL(nvm_vblk_pwrite(vblk, buf_w, geo->vpg_nbytes, 0),
+			geo->vpg_nbytes);
+
+	addr = nvm_vblk_get_addrs(vblk)[0];
+	addr.g.pg = 0;
+	addr.g.pl = 0;
+	addr.g.sec = 1;
+
+	CU_ASSERT(!nvm_emu_inject(dev, addr, NVM_EMU_ERR_READ, 1));
+	CU_ASSERT(nvm_vblk_pread(vblk, buf_r, geo->vpg_nbytes, 0) < 0);
+	ret = nvm_vblk_get_ret(vblk);
+	CU_ASSERT_EQUAL(ret->nfailed, 1);
+	CU_ASSERT_EQUAL(ret->nbytes, geo->vpg_nbytes - geo->sector_nbytes);
+	if (ret->nfailed == 1)
+		CU_ASSERT_EQUAL(ret->failed[0].ppa, addr.ppa);
+
+	CU_ASSERT(nvm_dev_set_retry(dev, -1, 0) < 0);
+	CU_ASSERT(!nvm_dev_set_retry(dev, 2, 10));
+
+	CU_ASSERT(!nvm_emu_inject(dev, addr, NVM_EMU_ERR_READ, 1));
+	memset(buf_r, 0, geo->vpg_nbytes);
+	CU_ASSERT_EQUAL(nvm_vblk_pread(vblk, buf_r, geo->vpg_nbytes, 0),
+			geo->vpg_nbytes);
+	CU_ASSERT(!compare_buffers(buf_w, buf_r, geo->vpg_nbytes));
+	CU_ASSERT_EQUAL(nvm_vblk_get_ret(vblk)->nfailed, 0);
+
+	CU_ASSERT(!nvm_emu_inject(dev, addr, NVM_EMU_ERR_READ, -1));
+	CU_ASSERT(nvm_vblk_pread(vblk, buf_r, geo->vpg_nbytes, 0) < 0);
+	CU_ASSERT_EQUAL(nvm_vblk_get_ret(vblk)->nfailed, 1);
+
+	nvm_emu_inject_clear(dev);
+	CU_ASSERT(!nvm_dev_set_retry(dev, 0, 0));
+}
+
+/**
+ * Copy the line on to the line of the next block and read the copy back
+ */
+void test_VBLK_COPY(void)
+{
+	struct nvm_vblk *copy;
+
+	copy = nvm_vblk_alloc_line(dev, ch_bgn, ch_end, lun_bgn, lun_end,
+				   blk + 1);
+	if (!copy) {
+		CU_FAIL("nvm_vblk_alloc_line");
+		return;
+	}
+
+	CU_ASSERT(nvm_vblk_erase(vblk) >= 0);
+	CU_ASSERT(nvm_vblk_erase(copy) >= 0);
+	CU_ASSERT_EQUAL(nvm_vblk_write(vblk, buf_w, nbytes), nbytes);
+
+	CU_ASSERT_EQUAL(nvm_vblk_copy(vblk, copy), nbytes);
+	CU_ASSERT_EQUAL(nvm_vblk_get_pos_write(copy), nbytes);
+
+	memset(buf_r, 0, nbytes);
+	CU_ASSERT_EQUAL(nvm_vblk_pread(copy, buf_r, nbytes, 0), nbytes);
+	CU_ASSERT(!compare_buffers(buf_w, buf_r, nbytes));
+
+	// A partly written line, ending within a row of pages, is copied up to
+	// its write position
+	CU_ASSERT(nvm_vblk_erase(vblk) >= 0);
+	CU_ASSERT(nvm_vblk_erase(copy) >= 0);
+	CU_ASSERT_EQUAL(nvm_vblk_write(vblk, buf_w, 3 * geo->vpg_nbytes),
+			3 * geo->vpg_nbytes);
+
+	CU_ASSERT_EQUAL(nvm_vblk_copy(vblk, copy), 3 * geo->vpg_nbytes);
+	CU_ASSERT_EQUAL(nvm_vblk_get_pos_write(copy), 3 * geo->vpg_nbytes);
+
+	memset(buf_r, 0, nbytes);
+	CU_ASSERT_EQUAL(nvm_vblk_pread(copy, buf_r, 3 * geo->vpg_nbytes, 0),
+			3 * geo->vpg_nbytes);
+	CU_ASSERT(!compare_buffers(buf_w, buf_r, 3 * geo->vpg_nbytes));
+
+	nvm_vblk_free(copy);
+}
+
 int main(int argc, char **argv)
 {
 	switch(argc) {
@@ -255,6 +458,9 @@ int main(int argc, char **argv)
 	(NULL == CU_add_test(pSuite, "nvm_vblk_RAND", test_VBLK_RAND)) ||
 	(NULL == CU_add_test(pSuite, "nvm_vblk_PE_PW_PR", test_VBLK_PE_PW_PR)) ||
 	(NULL == CU_add_test(pSuite, "nvm_vblk_PE_PR_PW_PR", test_VBLK_PE_PR_PW_PR)) ||
+	(NULL == CU_add_test(pSuite, "nvm_vblk_PARITY", test_VBLK_PARITY)) ||
+	(NULL == CU_add_test(pSuite, "nvm_vblk_RETRY", test_VBLK_RETRY)) ||
+	(NULL == CU_add_test(pSuite, "nvm_vblk_COPY", test_VBLK_COPY)) ||
 	0)
 	{
 		CU_cleanup_registry();